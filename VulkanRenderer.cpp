@@ -1,4 +1,5 @@
 #include "VulkanRenderer.h"
+#include "include/scene/SceneSerializer.h"
 
 std::vector<const char*> deviceExtensions = {
    VK_KHR_SWAPCHAIN_EXTENSION_NAME
@@ -9,6 +10,17 @@ std::vector<const char*> deviceExtensions = {
 const uint32_t WIDTH = 1800;
 const uint32_t HEIGHT = 900;
 
+const char* STARTUP_SCENE_FILE = "scenes/startup.miscene";
+
+// Compiled pipelines from earlier runs; only reused on the same device and driver
+const char* PIPELINE_CACHE_FILE = "pipeline_cache.bin";
+
+// Upload space shared by all texture decodes; larger images get their own staging buffer
+const VkDeviceSize TEXTURE_STAGING_RING_SIZE = 64 * 1024 * 1024;
+
+// Per-frame space for draw uniforms and other data that lives for one frame
+const VkDeviceSize FRAME_TRANSIENT_BUFFER_SIZE = 4 * 1024 * 1024;
+
 VulkanRenderer::VulkanRenderer() {
    
 
@@ -45,7 +57,12 @@ bool VulkanRenderer::isDeviceSuitable(VkPhysicalDevice device) {
         swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
     }
 
-    return indices.isComplete() && extensionsSupported && swapChainAdequate;
+    // Frame and upload synchronization use timeline semaphores, core in Vulkan 1.2
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(device, &deviceProperties);
+    bool timelineSupported = deviceProperties.apiVersion >= VK_API_VERSION_1_2;
+
+    return indices.isComplete() && extensionsSupported && swapChainAdequate && timelineSupported;
 }
 
 bool VulkanRenderer::checkDeviceExtensionSupport(VkPhysicalDevice device) {
@@ -99,29 +116,69 @@ VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& avai
 //above is all help functions
 
 void VulkanRenderer::initVulkan() {
+    auto initStartTime = std::chrono::high_resolution_clock::now();
+
     createInstance();
     createSurface();
     pickPhysicalDevice();
     createLogicalDevice();
+    gpuTimeline = std::make_unique<GpuTimeline>(device, graphicsQueue);
+    pipelineCache = std::make_unique<PipelineCache>(device, physicalDevice, PIPELINE_CACHE_FILE);
+    samplerCache = std::make_unique<SamplerCache>(device, physicalDevice);
+    threadPool = std::make_unique<ThreadPool>();
+    pipelineLibrary = std::make_unique<PipelineLibrary>(this, threadPool.get());
     createSwapChain();
     createImageViews();
+    sceneColorFormat = findSceneColorFormat();
     createRenderPass();
     createDescriptorSetLayout();
+    if (bindlessTexturesSupported) {
+        bindlessTextures = std::make_unique<BindlessTextureTable>(this);
+    }
     createGraphicsPipeline();
     createDepthResources();
-    createFramebuffers();
     createCommandPool();
+    renderGraph = std::make_unique<RenderGraph>(this);
+
+    mipGenerator = std::make_unique<MipGenerator>(this);
+    hiZCuller = std::make_unique<HiZCuller>(this, framesInFlight);
+    shadowRenderer = std::make_unique<ShadowRenderer>(this);
+    lightCuller = std::make_unique<LightCuller>(this, framesInFlight);
+    postProcessor = std::make_unique<PostProcessor>(this, swapChainImageFormat, swapChainStorage);
+    dynamicResolution = std::make_unique<DynamicResolution>(this, framesInFlight,
+        findQueueFamilies(physicalDevice).graphicsFamily.value());
+    setDynamicResolution(dynamicResolutionEnabled, targetFrameTime);
+    renderExtent = swapChainExtent;
+
+    // Weak or software GPUs benefit from rejecting draws on the CPU
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+    softwareOcclusionEnabled = deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU ||
+                               deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU;
+    softwareOcclusion = std::make_unique<SoftwareOcclusionCuller>();
+    occlusionWorker = std::make_unique<ThreadPool>(1);
+    hiZCuller->resize(swapChainExtent, depthImageView);
     
     // Create default texture before creating descriptor sets
     createDefaultTexture();
+    if (bindlessTextures) {
+        bindlessTextures->setDefaultTexture(getDefaultTextureImageInfo());
+    }
     
-    createUniformBuffers();
+    createFrameContexts();
     createDescriptorPool();
     createDescriptorSets();
-    createCommandBuffers();
-    createSyncObjects();
+
+    // Most of this is pipeline compilation, which a warm cache skips
+    float initMs = std::chrono::duration<float, std::chrono::milliseconds::period>(
+        std::chrono::high_resolution_clock::now() - initStartTime).count();
+    std::cout << "Renderer initialized in " << initMs << " ms ("
+              << (pipelineCache->isWarm() ? "warm" : "cold") << " pipeline cache)" << std::endl;
 
     // Initialize scene
+    stagingRing = std::make_unique<StagingRing>(this, TEXTURE_STAGING_RING_SIZE);
+    textureStreamer = std::make_unique<TextureStreamer>(this,
+        textureBudget != 0 ? textureBudget : getDefaultTextureBudget());
     scene = std::make_unique<Scene>(this);
 
     // Load initial models
@@ -132,8 +189,26 @@ void VulkanRenderer::initVulkan() {
 
 
    
+    // A saved startup scene replaces the models loaded below
+    SceneSerializer serializer(scene.get());
+    bool startupSceneLoaded = std::ifstream(STARTUP_SCENE_FILE).good() && serializer.loadBinary(STARTUP_SCENE_FILE);
+
     //scene->loadModel("models/models/blackrat.fbx", modelTransform);
-    scene->loadTexturedModel("models/blackrat.fbx", "texture/blackrat_color.png", modelTransform);
+    if (!startupSceneLoaded) {
+        scene->loadTexturedModel("models/blackrat.fbx", "texture/blackrat_color.png", modelTransform);
+    }
+
+    // A saved scene brings its own lights; the default model gets a sun
+    if (!startupSceneLoaded) {
+        Light sun;
+        sun.direction = glm::normalize(glm::vec3(-0.4f, -1.0f, -0.3f));
+        scene->addLight(sun);
+    }
+    const DedupStats& meshDedup = scene->getMeshDedupStats();
+    if (meshDedup.duplicates > 0) {
+        std::cout << "Shared " << meshDedup.duplicates << " duplicate meshes, saving "
+                  << meshDedup.bytesSaved / 1024 << " KB of geometry" << std::endl;
+    }
     //scene->loadTexturedModel("models/test_model.fbx", "texture/blackrat_color.png", modelTransform);
     //scene->loadTexturedModel("models/animal.fbx", "", modelTransform);
     //scene->loadTexturedModel("models/eyeball.fbx", "", modelTransform2);
@@ -155,7 +230,8 @@ void VulkanRenderer::createInstance() {
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "No Engine";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    // 1.2 for descriptor indexing; older devices fall back to per-draw texture binding
+    appInfo.apiVersion = VK_API_VERSION_1_2;
 
     VkInstanceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -209,9 +285,41 @@ void VulkanRenderer::createLogicalDevice() {
         queueCreateInfos.push_back(queueInfo);
     }
 
+    // Enable the optional features textures rely on when the device has them
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
     VkPhysicalDeviceFeatures deviceFeatures{};
+    deviceFeatures.samplerAnisotropy = supportedFeatures.samplerAnisotropy;
+    deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+    // Post-processing stores to BGRA swapchain images, which have no GLSL format
+    deviceFeatures.shaderStorageImageWriteWithoutFormat = supportedFeatures.shaderStorageImageWriteWithoutFormat;
+    storageImageWriteWithoutFormat = supportedFeatures.shaderStorageImageWriteWithoutFormat == VK_TRUE;
+
+    // Bindless textures need Vulkan 1.2 descriptor indexing (isDeviceSuitable checked for 1.2)
+    VkPhysicalDeviceVulkan12Features supported12{};
+    supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &supported12;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+    bindlessTexturesSupported = supportedFeatures.shaderSampledImageArrayDynamicIndexing &&
+                                BindlessTextureTable::isSupported(supported12);
+
+    VkPhysicalDeviceVulkan12Features enabled12{};
+    enabled12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    enabled12.timelineSemaphore = VK_TRUE;  // Mandatory in 1.2
+    if (bindlessTexturesSupported) {
+        deviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+        enabled12.runtimeDescriptorArray = VK_TRUE;
+        enabled12.descriptorBindingPartiallyBound = VK_TRUE;
+        enabled12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        enabled12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    }
+
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    createInfo.pNext = &enabled12;
     createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
     createInfo.ppEnabledExtensionNames = deviceExtensions.data();
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
@@ -231,6 +339,26 @@ void VulkanRenderer::createSwapChain() {
     SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice, surface);
 
     VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
+
+    // Post-processing writes the image from compute when it can: that takes a UNORM
+    // format (sRGB ones can't be storage images), so the shader applies gamma
+    swapChainStorage = false;
+    if (storageImageWriteWithoutFormat &&
+        (swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_STORAGE_BIT)) {
+        for (const auto& format : swapChainSupport.formats) {
+            if ((format.format != VK_FORMAT_B8G8R8A8_UNORM && format.format != VK_FORMAT_R8G8B8A8_UNORM) ||
+                format.colorSpace != VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+                continue;
+            }
+            VkFormatProperties properties;
+            vkGetPhysicalDeviceFormatProperties(physicalDevice, format.format, &properties);
+            if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) {
+                surfaceFormat = format;
+                swapChainStorage = true;
+                break;
+            }
+        }
+    }
     VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
     VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
@@ -250,6 +378,9 @@ void VulkanRenderer::createSwapChain() {
     createInfo.imageExtent = extent;
     createInfo.imageArrayLayers = 1;
     createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    if (swapChainStorage) {
+        createInfo.imageUsage |= VK_IMAGE_USAGE_STORAGE_BIT;
+    }
 
     QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
     uint32_t queueFamilyIndices[] = { indices.graphicsFamily.value(), indices.presentFamily.value() };
@@ -303,15 +434,17 @@ void VulkanRenderer::createImageViews() {
 }
 
 void VulkanRenderer::createRenderPass() {
+    // The lit passes render to the HDR scene color, not the swapchain, so the
+    // pipelines built against this pass don't depend on the swapchain format
     VkAttachmentDescription colorAttachment{};
-    colorAttachment.format = swapChainImageFormat;
+    colorAttachment.format = sceneColorFormat;
     colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
     colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
     VkAttachmentDescription depthAttachment{};
     depthAttachment.format = findDepthFormat();
@@ -350,154 +483,60 @@ void VulkanRenderer::createRenderPass() {
     }
 }
 
-
 void VulkanRenderer::createGraphicsPipeline() {
-    // Load SPIR-V shader binaries (ensure they are compiled and available)
-    auto vertCode = readFile("shaders/VertexShader.vert.spv");
-    auto fragCode = readFile("shaders/ComputerShader.frag.spv");
-
-    VkShaderModule vertModule = createShaderModule(vertCode);
-    VkShaderModule fragModule = createShaderModule(fragCode);
-
-    VkPipelineShaderStageCreateInfo vertStage{};
-    vertStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertStage.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vertStage.module = vertModule;
-    vertStage.pName = "main";
-
-    VkPipelineShaderStageCreateInfo fragStage{};
-    fragStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragStage.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragStage.module = fragModule;
-    fragStage.pName = "main";
-
-    VkPipelineShaderStageCreateInfo shaderStages[] = { vertStage, fragStage };
-
-    // Vertex input: specify binding and attribute descriptions for our Vertex structure
-    auto bindingDesc = Vertex::getBindingDescription();
-    auto attrDescs = Vertex::getAttributeDescriptions();
-
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.pVertexBindingDescriptions = &bindingDesc;
-    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attrDescs.size());
-    vertexInputInfo.pVertexAttributeDescriptions = attrDescs.data();
-
-    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-    VkViewport viewport{};
-    viewport.x = 0.f;
-    viewport.y = 0.f;
-    viewport.width = (float)swapChainExtent.width;
-    viewport.height = (float)swapChainExtent.height;
-    viewport.minDepth = 0.f;
-    viewport.maxDepth = 1.f;
-
-    VkRect2D scissor{};
-    scissor.offset = { 0, 0 };
-    scissor.extent = swapChainExtent;
-
-    VkPipelineViewportStateCreateInfo viewportState{};
-    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewportState.viewportCount = 1;
-    viewportState.pViewports = &viewport;
-    viewportState.scissorCount = 1;
-    viewportState.pScissors = &scissor;
-
-    VkPipelineRasterizationStateCreateInfo rasterizer{};
-    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizer.depthClampEnable = VK_FALSE;
-    rasterizer.rasterizerDiscardEnable = VK_FALSE;
-    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;;//VK_POLYGON_MODE_FILL
-    rasterizer.lineWidth = 1.f;
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT; //TODO: change to VK_CULL_MODE_BACK_BIT
-    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;//VK_FRONT_FACE_CLOCKWISE
-    rasterizer.depthBiasEnable = VK_FALSE;
-
-    VkPipelineMultisampleStateCreateInfo multisampling{};
-    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampling.sampleShadingEnable = VK_FALSE;
-    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-    colorBlendAttachment.colorWriteMask =
-        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
-        VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    colorBlendAttachment.blendEnable = VK_FALSE;
-
-    VkPipelineColorBlendStateCreateInfo colorBlending{};
-    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlending.logicOpEnable = VK_FALSE;
-    colorBlending.attachmentCount = 1;
-    colorBlending.pAttachments = &colorBlendAttachment;
+    // Set 1 holds the lights. Bindless: set 2 holds every texture and a push
+    // constant picks one per draw
+    std::vector<VkDescriptorSetLayout> setLayouts = { descriptorSetLayout, lightingSetLayout };
+    VkPushConstantRange textureIndexRange{};
+    textureIndexRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    textureIndexRange.offset = 0;
+    textureIndexRange.size = sizeof(uint32_t);
+    if (bindlessTextures) {
+        setLayouts.push_back(bindlessTextures->getDescriptorSetLayout());
+    }
 
     VkPipelineLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    layoutInfo.setLayoutCount = 1;                        
-    layoutInfo.pSetLayouts = &descriptorSetLayout;        
-    layoutInfo.pushConstantRangeCount = 0;
-    layoutInfo.pPushConstantRanges = nullptr;
+    layoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+    layoutInfo.pSetLayouts = setLayouts.data();
+    layoutInfo.pushConstantRangeCount = bindlessTextures ? 1 : 0;
+    layoutInfo.pPushConstantRanges = bindlessTextures ? &textureIndexRange : nullptr;
     if (vkCreatePipelineLayout(device, &layoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
         throw std::runtime_error("failed to create pipeline layout!");
 
-  
-    VkPipelineDepthStencilStateCreateInfo depthStencil{};
-    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-    depthStencil.depthTestEnable = VK_TRUE;
-    depthStencil.depthWriteEnable = VK_TRUE;
-    depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-    depthStencil.depthBoundsTestEnable = VK_FALSE;
-    depthStencil.stencilTestEnable = VK_FALSE;
-
-    VkGraphicsPipelineCreateInfo pipelineInfo{};
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount = 2;
-    pipelineInfo.pStages = shaderStages;
-    pipelineInfo.pVertexInputState = &vertexInputInfo;
-    pipelineInfo.pInputAssemblyState = &inputAssembly;
-    pipelineInfo.pViewportState = &viewportState;
-    pipelineInfo.pRasterizationState = &rasterizer;
-    pipelineInfo.pMultisampleState = &multisampling;
-    pipelineInfo.pColorBlendState = &colorBlending;
-    pipelineInfo.layout = pipelineLayout;
-    pipelineInfo.pDepthStencilState = &depthStencil;
-    pipelineInfo.renderPass = renderPass;
-    pipelineInfo.subpass = 0;
-
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS)
-        throw std::runtime_error("failed to create graphics pipeline!");
-
-    vkDestroyShaderModule(device, fragModule, nullptr);
-    vkDestroyShaderModule(device, vertModule, nullptr);
+    // Opaque, back-face culled; material variants start from this
+    auto bindingDesc = Vertex::getBindingDescription();
+    auto attrDescs = Vertex::getAttributeDescriptions();
+
+    basePipelineDesc = GraphicsPipelineDesc();
+    basePipelineDesc.vertexShader = "shaders/VertexShader.vert.spv";
+    basePipelineDesc.fragmentShader = bindlessTextures ? "shaders/bindless_frag.spv" : "shaders/ComputerShader.frag.spv";
+    basePipelineDesc.vertexBindings = { bindingDesc };
+    basePipelineDesc.vertexAttributes.assign(attrDescs.begin(), attrDescs.end());
+    basePipelineDesc.renderPass = renderPass;
+    basePipelineDesc.layout = pipelineLayout;
+
+    // Every draw can fall back to it, so it is compiled up front
+    graphicsPipeline = pipelineLibrary->getNow(basePipelineDesc);
 }
 
-void VulkanRenderer::createFramebuffers() {
-    swapChainFramebuffers.resize(swapChainImageViews.size());
-
-    for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-        std::array<VkImageView, 2> attachments = {
-            swapChainImageViews[i],
-            depthImageView
-        };
-
-        VkFramebufferCreateInfo framebufferInfo{};
-        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebufferInfo.renderPass = renderPass;
-        framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-        framebufferInfo.pAttachments = attachments.data();
-        framebufferInfo.width = swapChainExtent.width;
-        framebufferInfo.height = swapChainExtent.height;
-        framebufferInfo.layers = 1;
-
-        if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create framebuffer!");
-        }
+VkPipeline VulkanRenderer::getMaterialPipeline(const Material& material) {
+    bool blended = material.alpha < 1.0f;
+    if (!material.doubleSided && !blended) {
+        return graphicsPipeline;
+    }
+
+    GraphicsPipelineDesc desc = basePipelineDesc;
+    if (material.doubleSided) {
+        desc.cullMode = VK_CULL_MODE_NONE;
     }
+    if (blended) {
+        desc.alphaBlend = true;
+        desc.depthWrite = false;
+    }
+    return pipelineLibrary->get(desc, basePipelineDesc);
 }
+
 void VulkanRenderer::createCommandPool() {
     auto indices = findQueueFamilies(physicalDevice);
     VkCommandPoolCreateInfo poolInfo{};
@@ -509,85 +548,15 @@ void VulkanRenderer::createCommandPool() {
 
 
 
-void VulkanRenderer::createCommandBuffers() {
-    commandBuffers.resize(swapChainFramebuffers.size());
-    
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.commandPool = commandPool;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = (uint32_t)commandBuffers.size();
-    
-    if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate command buffers!");
-    }
-
-    for (size_t i = 0; i < commandBuffers.size(); i++) {
-        VkCommandBufferBeginInfo beginInfo{};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-        
-        if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) != VK_SUCCESS) {
-            throw std::runtime_error("failed to begin recording command buffer!");
-        }
-
-        VkRenderPassBeginInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = renderPass;
-        renderPassInfo.framebuffer = swapChainFramebuffers[i];
-        renderPassInfo.renderArea.offset = {0, 0};
-        renderPassInfo.renderArea.extent = swapChainExtent;
-
-        // Clear color and depth values
-        std::array<VkClearValue, 2> clearValues{};
-        clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}}; // Black background
-        clearValues[1].depthStencil = {1.0f, 0}; // Far depth
-
-        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-        renderPassInfo.pClearValues = clearValues.data();
-
-        vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-        // Bind the graphics pipeline
-        vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+void VulkanRenderer::createFrameContexts() {
+    // Per-draw uniforms are bound at offsets into the frame's transient buffer
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    uniformAlignment = properties.limits.minUniformBufferOffsetAlignment;
 
-        // Bind descriptor set for current frame
-        vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-            pipelineLayout, 0, 1, &descriptorSets[i % MAX_FRAMES_IN_FLIGHT], 0, nullptr);
-
-        // Calculate view and projection matrices
-        glm::mat4 view = glm::lookAt(cameraPos, cameraTarget, cameraUp);
-        glm::mat4 proj = glm::perspective(glm::radians(fov),
-            swapChainExtent.width / (float)swapChainExtent.height,
-            nearPlane, farPlane);
-
-        // Draw all meshes in the scene
-        if (scene) {
-            scene->draw(commandBuffers[i], view, proj);
-        }
-
-        vkCmdEndRenderPass(commandBuffers[i]);
-
-        if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
-            throw std::runtime_error("failed to record command buffer!");
-        }
-    }
-}
-
-void VulkanRenderer::createSyncObjects() {
-    imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-    VkSemaphoreCreateInfo semInfo{};
-    semInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-    VkFenceCreateInfo fenceInfo{};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        if (vkCreateSemaphore(device, &semInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-            vkCreateSemaphore(device, &semInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-            vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS)
-            throw std::runtime_error("failed to create synchronization objects!");
+    frames.clear();
+    for (uint32_t i = 0; i < framesInFlight; i++) {
+        frames.push_back(std::make_unique<FrameContext>(this, FRAME_TRANSIENT_BUFFER_SIZE));
     }
 }
 void VulkanRenderer::run() {
@@ -604,113 +573,253 @@ void VulkanRenderer::initWindow() {
 }
 
 void VulkanRenderer::mainLoop() {
+    if (threadedSimulationEnabled && scene) {
+        simulationRunning = true;
+        simulationThread = std::thread(&VulkanRenderer::simulationLoop, this);
+    }
+
     while (!glfwWindowShouldClose(window)) {
         glfwPollEvents();
         drawFrame();
     }
+    stopSimulationThread();
     vkDeviceWaitIdle(device);
 }
+
+void VulkanRenderer::simulateFrame(float deltaTime) {
+    if (scene) {
+        scene->update(deltaTime);
+    }
+
+    FrameSnapshot& snapshot = frameSnapshots.back();
+    if (scene) {
+        scene->buildSnapshot(snapshot);
+    }
+    snapshot.frameNumber = simulationFrame++;
+    snapshot.deltaTime = deltaTime;
+    snapshot.view = glm::lookAt(cameraPos, cameraTarget, cameraUp);
+    snapshot.fov = fov;
+    snapshot.nearPlane = nearPlane;
+    snapshot.farPlane = farPlane;
+
+    frameSnapshots.publish();
+}
+
+void VulkanRenderer::simulationLoop() {
+    auto lastFrameTime = std::chrono::high_resolution_clock::now();
+    while (simulationRunning) {
+        auto currentTime = std::chrono::high_resolution_clock::now();
+        float deltaTime = std::chrono::duration<float, std::chrono::seconds::period>
+            (currentTime - lastFrameTime).count();
+        lastFrameTime = currentTime;
+
+        simulateFrame(deltaTime);
+
+        // Stay at most one snapshot ahead of the renderer
+        std::unique_lock<std::mutex> lock(simulationMutex);
+        simulationCondition.wait(lock, [this]() {
+            return !simulationRunning || !frameSnapshots.hasPending();
+        });
+    }
+}
+
+void VulkanRenderer::stopSimulationThread() {
+    if (!simulationThread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(simulationMutex);
+        simulationRunning = false;
+    }
+    simulationCondition.notify_all();
+    simulationThread.join();
+}
+
 void VulkanRenderer::drawFrame() {
-    // Wait for the previous frame to complete
-    vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    if (!threadedSimulationEnabled) {
+        // Calculate delta time for scene update
+        static auto lastFrameTime = std::chrono::high_resolution_clock::now();
+        auto currentTime = std::chrono::high_resolution_clock::now();
+        float deltaTime = std::chrono::duration<float, std::chrono::seconds::period>
+            (currentTime - lastFrameTime).count();
+        lastFrameTime = currentTime;
+
+        simulateFrame(deltaTime);
+    }
+
+    // Textures decoded in the background since last frame become visible now
+    if (scene) {
+        scene->processTextureUploads();
+    }
+
+    // Pick up the newest snapshot and let the simulation start on the next one
+    if (frameSnapshots.acquire() && threadedSimulationEnabled) {
+        std::lock_guard<std::mutex> lock(simulationMutex);
+        simulationCondition.notify_one();
+    }
+    const FrameSnapshot& snapshot = frameSnapshots.front();
+
+    // Stream texture mips for what this frame shows, before any descriptor is written
+    if (textureStreamer) {
+        // Last frame's render size: the mips the scene will be sampled at
+        textureStreamer->addFeedback(snapshot, static_cast<float>(renderExtent.height));
+        textureStreamer->update();
+    }
+    if (bindlessTextures) {
+        bindlessTextures->update();
+    }
+
+    glm::mat4 view = snapshot.view;
+    glm::mat4 proj = glm::perspective(glm::radians(snapshot.fov),
+        swapChainExtent.width / (float)swapChainExtent.height,
+        snapshot.nearPlane, snapshot.farPlane);
+
+    // Maps follow their lights and the camera; cached static layers are reused
+    shadowRenderer->update(snapshot, swapChainExtent.width / (float)swapChainExtent.height);
+
+    // CPU occlusion culling runs on its own worker, overlapping with the GPU still
+    // working on the previous frame
+    std::future<void> occlusionJob;
+    if (scene && softwareOcclusionEnabled && !scene->getOccluders().empty()) {
+        glm::mat4 cullProj = proj;
+        cullProj[1][1] *= -1; // Same Y flip as bindDrawUniforms
+        glm::mat4 viewProj = cullProj * view;
+        occlusionJob = occlusionWorker->submit([this, &snapshot, viewProj]() {
+            softwareOcclusion->cull(scene->getOccluders(), snapshot.bounds, viewProj, softwareVisibility);
+        });
+    }
+
+    // Wait until the GPU is done with this frame's last use; its command buffer,
+    // transient descriptor sets and transient memory are recycled
+    FrameContext& frame = *frames[currentFrame];
+    frame.wait();
+
+    // That frame's GPU time is in now; it picks this frame's resolution
+    dynamicResolution->update(static_cast<uint32_t>(currentFrame));
+    renderExtent = dynamicResolution->getRenderExtent(swapChainExtent);
 
     // Acquire the next image from the swap chain
     uint32_t imageIndex;
     VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX,
-        imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+        frame.getImageAvailableSemaphore(), VK_NULL_HANDLE, &imageIndex);
 
     if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+        // Pool futures do not block on destruction; the job still reads the snapshot
+        if (occlusionJob.valid()) {
+            occlusionJob.wait();
+        }
         recreateSwapChain();
         return;
     } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
         throw std::runtime_error("failed to acquire swap chain image!");
     }
 
-    // Calculate delta time for scene update
-    static auto lastFrameTime = std::chrono::high_resolution_clock::now();
-    auto currentTime = std::chrono::high_resolution_clock::now();
-    float deltaTime = std::chrono::duration<float, std::chrono::seconds::period>
-        (currentTime - lastFrameTime).count();
-    lastFrameTime = currentTime;
-
-    // Update scene
-    if (scene) {
-        scene->update(deltaTime);
+    // Instances rejected by the CPU rasterizer are never recorded
+    const std::vector<uint8_t>* visibility = nullptr;
+    if (occlusionJob.valid()) {
+        occlusionJob.get();
+        visibility = &softwareVisibility;
     }
 
-    // Reset the fence only if we are submitting work
-    vkResetFences(device, 1, &inFlightFences[currentFrame]);
-
-    // Reset and begin command buffer (if using dynamic command buffer recording)
-    vkResetCommandBuffer(commandBuffers[imageIndex], 0);
-    
-    // Record the command buffer (if using dynamic command buffer recording)
+    // Record the frame's command buffer (its pool was reset by wait())
+    VkCommandBuffer commandBuffer = frame.getCommandBuffer();
     VkCommandBufferBeginInfo beginInfo{};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = 0;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
     
-    if (vkBeginCommandBuffer(commandBuffers[imageIndex], &beginInfo) != VK_SUCCESS) {
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
         throw std::runtime_error("failed to begin recording command buffer!");
     }
-
-    // Begin render pass
-    VkRenderPassBeginInfo renderPassInfo{};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = renderPass;
-    renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
-    renderPassInfo.renderArea.offset = {0, 0};
-    renderPassInfo.renderArea.extent = swapChainExtent;
-
-    std::array<VkClearValue, 2> clearValues{};
-    clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
-    clearValues[1].depthStencil = {1.0f, 0};
-
-    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-    renderPassInfo.pClearValues = clearValues.data();
-
-    // Record commands
-    vkCmdBeginRenderPass(commandBuffers[imageIndex], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-    
-    // Bind pipeline and descriptor sets
-    vkCmdBindPipeline(commandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-    vkCmdBindDescriptorSets(commandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS,
-        pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, nullptr);
-
-    // Draw scene
-    if (scene) {
-        glm::mat4 view = glm::lookAt(cameraPos, cameraTarget, cameraUp);
-        glm::mat4 proj = glm::perspective(glm::radians(fov),
-            swapChainExtent.width / (float)swapChainExtent.height,
-            nearPlane, farPlane);
-        scene->draw(commandBuffers[imageIndex], view, proj);
+    dynamicResolution->recordBegin(commandBuffer, static_cast<uint32_t>(currentFrame));
+
+    // Declare the frame; the graph places the barriers between its passes
+    renderGraph->reset();
+    RenderGraph::ImageHandle backbuffer = renderGraph->importImage("backbuffer",
+        swapChainImages[imageIndex], swapChainImageViews[imageIndex], swapChainImageFormat, swapChainExtent,
+        { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0 },  // Acquire waits here
+        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    // Full size whatever the render extent, so resolution changes don't reallocate it
+    RenderGraph::ImageHandle sceneColor = renderGraph->createImage("scene-color",
+        { swapChainExtent, sceneColorFormat });
+    RenderGraph::ImageHandle depth = renderGraph->importImage("depth",
+        depthImage, depthImageView, depthFormat, swapChainExtent,
+        { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT });
+
+    // Shadow passes come first; every lit pass samples what they leave
+    shadowMaps = shadowRenderer->addPasses(*renderGraph, snapshot);
+    writeLightingData(frame, snapshot);
+
+    // Then the local lights are binned into clusters. Last frame's lit passes read
+    // the grid and indices; the counter was last written by last frame's cull
+    lightClusters = renderGraph->importBuffer("light-clusters", lightCuller->getGridBuffer(),
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    lightIndices = renderGraph->importBuffer("light-indices", lightCuller->getIndexBuffer(),
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    RenderGraph::BufferHandle lightCounter = renderGraph->importBuffer("light-counter",
+        lightCuller->getCounterBuffer(), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+    renderGraph->addPass("light-reset", RenderGraph::PassType::Transfer,
+        [this](VkCommandBuffer commandBuffer) {
+            lightCuller->recordCounterReset(commandBuffer);
+        })
+        .writeBuffer(lightCounter, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+    uint32_t lightFrameIndex = static_cast<uint32_t>(currentFrame);
+    float aspectRatio = swapChainExtent.width / (float)swapChainExtent.height;
+    renderGraph->addPass("light-cull", RenderGraph::PassType::Compute,
+        [this, lightFrameIndex, &snapshot, aspectRatio](VkCommandBuffer commandBuffer) {
+            lightCuller->recordCull(commandBuffer, lightFrameIndex, snapshot.view, glm::radians(snapshot.fov),
+                aspectRatio, snapshot.nearPlane, snapshot.farPlane);
+        })
+        .writeBuffer(lightCounter, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                     VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)
+        .writeBuffer(lightClusters, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT)
+        .writeBuffer(lightIndices, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+    bool occlusionCulled = scene && occlusionCullingEnabled;
+    if (occlusionCulled) {
+        hiZCuller->updateInstances(static_cast<uint32_t>(currentFrame), snapshot.cullInstances);
+        // No draw buffers until the scene has instances
+        occlusionCulled = hiZCuller->getEarlyDrawBuffer() != VK_NULL_HANDLE;
     }
 
-    vkCmdEndRenderPass(commandBuffers[imageIndex]);
-
-    if (vkEndCommandBuffer(commandBuffers[imageIndex]) != VK_SUCCESS) {
-        throw std::runtime_error("failed to record command buffer!");
+    if (occlusionCulled) {
+        addOcclusionCulledPasses(sceneColor, depth, snapshot, view, proj, visibility);
+    } else {
+        RenderGraph::PassBuilder forward = renderGraph->addPass("forward", RenderGraph::PassType::Graphics,
+            [this, &snapshot, view, proj, visibility](VkCommandBuffer commandBuffer) {
+                bindLitPass(commandBuffer);
+
+                // Draw scene
+                if (scene) {
+                    scene->draw(commandBuffer, snapshot, view, proj, VK_NULL_HANDLE, visibility);
+                }
+            })
+            .colorAttachment(sceneColor, VK_ATTACHMENT_LOAD_OP_CLEAR, {{ 0.0f, 0.0f, 0.0f, 1.0f }})
+            .depthAttachment(depth, VK_ATTACHMENT_LOAD_OP_CLEAR)
+            .renderArea(renderExtent);
+        readLighting(forward);
     }
 
-    // Submit command buffer
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    // Tonemap (and upscale) into the swapchain image
+    postProcessor->addPass(*renderGraph, frame, sceneColor, renderExtent, backbuffer);
 
-    VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = waitSemaphores;
-    submitInfo.pWaitDstStageMask = waitStages;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
+    renderGraph->compile();
+    renderGraph->execute(commandBuffer);
+    dynamicResolution->recordEnd(commandBuffer, static_cast<uint32_t>(currentFrame));
 
-    VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = signalSemaphores;
-
-    if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
-        throw std::runtime_error("failed to submit draw command buffer!");
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record command buffer!");
     }
 
+    // Submit command buffer; the frame is complete when its timeline value is reached
+    GpuTimeline::Wait imageAvailable;
+    imageAvailable.semaphore = frame.getImageAvailableSemaphore();
+    imageAvailable.stageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    VkSemaphore signalSemaphores[] = {frame.getRenderFinishedSemaphore()};
+    frame.setSubmitValue(gpuTimeline->submit(&commandBuffer, 1, { imageAvailable }, { signalSemaphores[0] }));
+
     // Present the frame
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -730,22 +839,165 @@ void VulkanRenderer::drawFrame() {
         throw std::runtime_error("failed to present swap chain image!");
     }
 
-    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    currentFrame = (currentFrame + 1) % framesInFlight;
 }
+void VulkanRenderer::addOcclusionCulledPasses(RenderGraph::ImageHandle color, RenderGraph::ImageHandle depth,
+                                              const FrameSnapshot& snapshot,
+                                              const glm::mat4& view, const glm::mat4& proj,
+                                              const std::vector<uint8_t>* visibility) {
+    // Both draw buffers were last written by the previous frame's cull
+    RenderGraph::BufferHandle earlyDraws = renderGraph->importBuffer("early-draws",
+        hiZCuller->getEarlyDrawBuffer(), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+    RenderGraph::BufferHandle lateDraws = renderGraph->importBuffer("late-draws",
+        hiZCuller->getLateDrawBuffer(), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+    // Rebuilt from scratch every frame, so last frame's contents never matter
+    RenderGraph::ImageHandle pyramid = renderGraph->importImage("hiz-pyramid",
+        hiZCuller->getPyramidImage(), hiZCuller->getPyramidView(), HiZCuller::PYRAMID_FORMAT,
+        hiZCuller->getPyramidExtent(), { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0 },
+        VK_IMAGE_LAYOUT_UNDEFINED, hiZCuller->getPyramidLevels());
+
+    if (hiZCuller->needsDrawBufferClear()) {
+        renderGraph->addPass("hiz-clear", RenderGraph::PassType::Transfer,
+            [this](VkCommandBuffer commandBuffer) {
+                hiZCuller->recordDrawBufferClear(commandBuffer);
+            })
+            .writeBuffer(earlyDraws, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT)
+            .writeBuffer(lateDraws, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+    }
+
+    // Keep last frame's visibility but draw each slot with the mesh it holds now
+    uint32_t frameIndex = static_cast<uint32_t>(currentFrame);
+    renderGraph->addPass("hiz-refresh", RenderGraph::PassType::Compute,
+        [this, frameIndex](VkCommandBuffer commandBuffer) {
+            hiZCuller->recordEarlyRefresh(commandBuffer, frameIndex);
+        })
+        .writeBuffer(earlyDraws, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+    auto drawScene = [this, &snapshot, view, proj, visibility](VkCommandBuffer commandBuffer, VkBuffer drawBuffer) {
+        bindLitPass(commandBuffer);
+        scene->draw(commandBuffer, snapshot, view, proj, drawBuffer, visibility);
+    };
+
+    // Early pass: everything that was visible last frame
+    RenderGraph::PassBuilder early = renderGraph->addPass("early", RenderGraph::PassType::Graphics,
+        [this, drawScene](VkCommandBuffer commandBuffer) {
+            drawScene(commandBuffer, hiZCuller->getEarlyDrawBuffer());
+        })
+        .colorAttachment(color, VK_ATTACHMENT_LOAD_OP_CLEAR, {{ 0.0f, 0.0f, 0.0f, 1.0f }})
+        .depthAttachment(depth, VK_ATTACHMENT_LOAD_OP_CLEAR)
+        .readBuffer(earlyDraws, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT)
+        .renderArea(renderExtent);
+    readLighting(early);
+
+    // Build the pyramid from the early depth and cull every instance against it
+    renderGraph->addPass("hiz-pyramid", RenderGraph::PassType::Compute,
+        [this](VkCommandBuffer commandBuffer) {
+            hiZCuller->recordPyramidBuild(commandBuffer);
+        })
+        .readImage(depth, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+        .writeImage(pyramid, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    glm::mat4 cullProj = proj;
+    cullProj[1][1] *= -1; // Same Y flip as bindDrawUniforms
+    glm::mat4 viewProj = cullProj * view;
+    VkExtent2D cullExtent = renderExtent;
+    renderGraph->addPass("hiz-cull", RenderGraph::PassType::Compute,
+        [this, frameIndex, viewProj, cullExtent](VkCommandBuffer commandBuffer) {
+            hiZCuller->recordCull(commandBuffer, frameIndex, viewProj, cullExtent);
+        })
+        .readImage(pyramid, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_IMAGE_LAYOUT_GENERAL)
+        .writeBuffer(earlyDraws, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                     VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)
+        .writeBuffer(lateDraws, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                     VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    // Late pass: instances that just became visible
+    RenderGraph::PassBuilder late = renderGraph->addPass("late", RenderGraph::PassType::Graphics,
+        [this, drawScene](VkCommandBuffer commandBuffer) {
+            drawScene(commandBuffer, hiZCuller->getLateDrawBuffer());
+        })
+        .colorAttachment(color, VK_ATTACHMENT_LOAD_OP_LOAD)
+        .depthAttachment(depth, VK_ATTACHMENT_LOAD_OP_LOAD)
+        .readBuffer(lateDraws, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT)
+        .renderArea(renderExtent);
+    readLighting(late);
+}
+
+void VulkanRenderer::bindLitPass(VkCommandBuffer commandBuffer) {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+        LIGHTING_SET, 1, &lightingSets[currentFrame], 1, &lightingOffset);
+    if (bindlessTextures) {
+        bindlessTextures->bind(commandBuffer, pipelineLayout);
+    }
+}
+
+void VulkanRenderer::readLighting(RenderGraph::PassBuilder& pass) {
+    for (RenderGraph::ImageHandle shadowMap : shadowMaps) {
+        pass.readImage(shadowMap, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    }
+    pass.readBuffer(lightClusters, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    pass.readBuffer(lightIndices, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+}
+
+void VulkanRenderer::writeLightingData(FrameContext& frame, const FrameSnapshot& snapshot) {
+    // The frame's first transient allocation, so it only fails if the buffer is tiny
+    LinearAllocator::Allocation allocation =
+        frame.getTransientAllocator().allocate(sizeof(LightingData), uniformAlignment);
+    if (!allocation.isValid()) {
+        throw std::runtime_error("failed to allocate frame lighting data!");
+    }
+
+    // Directional lights first: they light everything and aren't culled
+    frameLights.clear();
+    uint32_t directionalCount = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t i = 0; i < snapshot.lights.size(); i++) {
+            const LightInstance& light = snapshot.lights[i];
+            if ((light.type == LightType::Directional) != (pass == 0)) {
+                continue;
+            }
+            GpuLight gpuLight;
+            gpuLight.position = glm::vec4(light.position, static_cast<float>(light.type));
+            gpuLight.color = glm::vec4(light.color, light.intensity);
+            gpuLight.direction = glm::vec4(light.direction, light.range);
+            gpuLight.params = glm::vec4(std::cos(light.innerAngle), std::cos(light.outerAngle),
+                                        static_cast<float>(shadowRenderer->getShadowMap(i)), 0.0f);
+            frameLights.push_back(gpuLight);
+        }
+        if (pass == 0) {
+            directionalCount = static_cast<uint32_t>(frameLights.size());
+        }
+    }
+
+    LightingData data{};
+    data.counts.x = lightCuller->updateLights(static_cast<uint32_t>(currentFrame), frameLights, directionalCount);
+    data.counts.z = std::min(directionalCount, data.counts.x);
+    // Clusters tile the part of the screen the scene renders to
+    data.clusterParams = LightCuller::getClusterParams(renderExtent, snapshot.nearPlane, snapshot.farPlane);
+    shadowRenderer->fillLightingData(data);
+
+    memcpy(allocation.data, &data, sizeof(data));
+    lightingOffset = static_cast<uint32_t>(allocation.offset);
+}
+
 void VulkanRenderer::createDescriptorSetLayout() {
-    // Existing uniform buffer binding
+    // Per-draw matrices, bound at a dynamic offset into the frame's transient buffer
     VkDescriptorSetLayoutBinding uboLayoutBinding{};
     uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     uboLayoutBinding.descriptorCount = 1;
     uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
-    // Add texture sampler binding
+    // Add texture sampler binding; every texture uses the default cached sampler,
+    // so it is baked into the layout
+    VkSampler textureSampler = samplerCache->get();
     VkDescriptorSetLayoutBinding samplerLayoutBinding{};
     samplerLayoutBinding.binding = 1; // Different binding point
     samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     samplerLayoutBinding.descriptorCount = 1;
     samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    samplerLayoutBinding.pImmutableSamplers = &textureSampler;
 
     std::array<VkDescriptorSetLayoutBinding, 2> bindings = {
         uboLayoutBinding, samplerLayoutBinding
@@ -759,46 +1011,58 @@ void VulkanRenderer::createDescriptorSetLayout() {
     if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
         throw std::runtime_error("failed to create descriptor set layout!");
     }
-}
-
-
 
-void VulkanRenderer::createUniformBuffers() {
-    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
-
-    uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-    uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-    uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
-
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        createBuffer(
-            bufferSize,
-            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            uniformBuffers[i],
-            uniformBuffersMemory[i]
-        );
+    // LightingData at a dynamic offset, the static and composite shadow map arrays,
+    // then the lights and the light clusters
+    VkSampler shadowSampler = samplerCache->get(ShadowRenderer::getSamplerDesc());
+    std::array<VkDescriptorSetLayoutBinding, 6> lightingBindings{};
+    lightingBindings[0].binding = 0;
+    lightingBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    lightingBindings[0].descriptorCount = 1;
+    lightingBindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    for (uint32_t i = 1; i < 3; i++) {
+        lightingBindings[i].binding = i;
+        lightingBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        lightingBindings[i].descriptorCount = 1;
+        lightingBindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        lightingBindings[i].pImmutableSamplers = &shadowSampler;
+    }
+    for (uint32_t i = 3; i < 6; i++) {
+        lightingBindings[i].binding = i;
+        lightingBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        lightingBindings[i].descriptorCount = 1;
+        lightingBindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    }
 
-        vkMapMemory(device, uniformBuffersMemory[i], 0, bufferSize, 0, &uniformBuffersMapped[i]);
+    layoutInfo.bindingCount = static_cast<uint32_t>(lightingBindings.size());
+    layoutInfo.pBindings = lightingBindings.data();
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &lightingSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create lighting descriptor set layout!");
     }
 }
 
+
+
 void VulkanRenderer::createDescriptorPool() {
-    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    std::array<VkDescriptorPoolSize, 3> poolSizes{};
     
-    // Uniform buffer pool size
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    // Uniform buffer pool size (draw matrices and lights)
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    poolSizes[0].descriptorCount = 2 * framesInFlight;
     
-    // Texture sampler pool size
+    // Texture sampler pool size (default texture and both shadow map arrays)
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    poolSizes[1].descriptorCount = 3 * framesInFlight;
+
+    // Lights, light clusters and light indices
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[2].descriptorCount = 3 * framesInFlight;
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
     poolInfo.pPoolSizes = poolSizes.data();
-    poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    poolInfo.maxSets = 2 * framesInFlight;
 
     if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
         throw std::runtime_error("failed to create descriptor pool!");
@@ -811,77 +1075,144 @@ void VulkanRenderer::createDescriptorSets() {
         createDefaultTexture();
     }
 
-    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, descriptorSetLayout);
+    std::vector<VkDescriptorSetLayout> layouts(framesInFlight, descriptorSetLayout);
     VkDescriptorSetAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    allocInfo.descriptorSetCount = framesInFlight;
     allocInfo.pSetLayouts = layouts.data();
 
-    descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+    descriptorSets.resize(framesInFlight);
     if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
         throw std::runtime_error("failed to allocate descriptor sets!");
     }
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        // Uniform buffer descriptor
+    // Draws without their own texture show the default one
+    for (uint32_t i = 0; i < framesInFlight; i++) {
+        writeDescriptorSet(descriptorSets[i], frames[i]->getTransientAllocator().getBuffer(),
+                           getDefaultTextureImageInfo());
+    }
+
+    // The shadow map arrays and light buffers never change; only the lighting offset does
+    std::vector<VkDescriptorSetLayout> lightingLayouts(framesInFlight, lightingSetLayout);
+    allocInfo.pSetLayouts = lightingLayouts.data();
+    lightingSets.resize(framesInFlight);
+    if (vkAllocateDescriptorSets(device, &allocInfo, lightingSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate lighting descriptor sets!");
+    }
+
+    VkDescriptorImageInfo shadowMapInfos[2]{};
+    shadowMapInfos[0].imageView = shadowRenderer->getStaticArrayView();
+    shadowMapInfos[0].imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    shadowMapInfos[1].imageView = shadowRenderer->getCompositeArrayView();
+    shadowMapInfos[1].imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+    for (uint32_t i = 0; i < framesInFlight; i++) {
         VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = uniformBuffers[i];
+        bufferInfo.buffer = frames[i]->getTransientAllocator().getBuffer();
         bufferInfo.offset = 0;
-        bufferInfo.range = sizeof(UniformBufferObject);
-
-        // Default texture descriptor
-        VkDescriptorImageInfo imageInfo{};
-        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imageInfo.imageView = defaultTexture->getImageView();
-        imageInfo.sampler = defaultTexture->getSampler();
-
-        std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
-        
-        // Uniform buffer write
-        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[0].dstSet = descriptorSets[i];
-        descriptorWrites[0].dstBinding = 0;
-        descriptorWrites[0].dstArrayElement = 0;
-        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrites[0].descriptorCount = 1;
+        bufferInfo.range = sizeof(LightingData);
+
+        std::array<VkDescriptorBufferInfo, 3> lightBufferInfos{};
+        lightBufferInfos[0] = { lightCuller->getLightBuffer(i), 0, VK_WHOLE_SIZE };
+        lightBufferInfos[1] = { lightCuller->getGridBuffer(), 0, VK_WHOLE_SIZE };
+        lightBufferInfos[2] = { lightCuller->getIndexBuffer(), 0, VK_WHOLE_SIZE };
+
+        std::array<VkWriteDescriptorSet, 6> descriptorWrites{};
+        for (uint32_t binding = 0; binding < 6; binding++) {
+            descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[binding].dstSet = lightingSets[i];
+            descriptorWrites[binding].dstBinding = binding;
+            descriptorWrites[binding].descriptorCount = 1;
+        }
+        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
         descriptorWrites[0].pBufferInfo = &bufferInfo;
-
-        // Texture sampler write
-        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[1].dstSet = descriptorSets[i];
-        descriptorWrites[1].dstBinding = 1;
-        descriptorWrites[1].dstArrayElement = 0;
         descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        descriptorWrites[1].descriptorCount = 1;
-        descriptorWrites[1].pImageInfo = &imageInfo;
+        descriptorWrites[1].pImageInfo = &shadowMapInfos[0];
+        descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[2].pImageInfo = &shadowMapInfos[1];
+        for (uint32_t b = 0; b < 3; b++) {
+            descriptorWrites[b + 3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[b + 3].pBufferInfo = &lightBufferInfos[b];
+        }
 
-        vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), 
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()),
                              descriptorWrites.data(), 0, nullptr);
     }
 }
 
-void VulkanRenderer::updateMVPMatrices(const glm::mat4& model, const glm::mat4& view, const glm::mat4& proj) {
+void VulkanRenderer::writeDescriptorSet(VkDescriptorSet descriptorSet, VkBuffer uniformBuffer,
+                                        const VkDescriptorImageInfo& imageInfo) {
+    // Uniform buffer descriptor; the offset comes from vkCmdBindDescriptorSets
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = uniformBuffer;
+    bufferInfo.offset = 0;
+    bufferInfo.range = sizeof(UniformBufferObject);
+
+    std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+
+    // Uniform buffer write
+    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[0].dstSet = descriptorSet;
+    descriptorWrites[0].dstBinding = 0;
+    descriptorWrites[0].dstArrayElement = 0;
+    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    descriptorWrites[0].descriptorCount = 1;
+    descriptorWrites[0].pBufferInfo = &bufferInfo;
+
+    // Texture sampler write
+    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[1].dstSet = descriptorSet;
+    descriptorWrites[1].dstBinding = 1;
+    descriptorWrites[1].dstArrayElement = 0;
+    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrites[1].descriptorCount = 1;
+    descriptorWrites[1].pImageInfo = &imageInfo;
+
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()),
+                         descriptorWrites.data(), 0, nullptr);
+}
+
+bool VulkanRenderer::bindDrawUniforms(VkCommandBuffer commandBuffer, const glm::mat4& model,
+                                      const glm::mat4& view, const glm::mat4& proj,
+                                      const VkDescriptorImageInfo* texture) {
+    FrameContext& frame = *frames[currentFrame];
+    LinearAllocator& allocator = frame.getTransientAllocator();
+    LinearAllocator::Allocation allocation = allocator.allocate(sizeof(UniformBufferObject), uniformAlignment);
+    if (!allocation.isValid()) {
+        return false;
+    }
+
     UniformBufferObject ubo{};
     ubo.model = model;
     ubo.view = view;
     ubo.proj = proj;
     ubo.proj[1][1] *= -1; // Flip Y coordinate for Vulkan
-    
-    // Update uniform buffer for current frame
-    memcpy(uniformBuffersMapped[currentFrame], &ubo, sizeof(ubo));
-}
+    memcpy(allocation.data, &ubo, sizeof(ubo));
 
-void VulkanRenderer::cleanupSwapChain() {
-    for (auto framebuffer : swapChainFramebuffers) {
-        vkDestroyFramebuffer(device, framebuffer, nullptr);
+    VkDescriptorSet descriptorSet = descriptorSets[currentFrame];
+    if (texture) {
+        descriptorSet = frame.allocateDescriptorSet(descriptorSetLayout);
+        if (descriptorSet == VK_NULL_HANDLE) {
+            return false;
+        }
+        writeDescriptorSet(descriptorSet, allocator.getBuffer(), *texture);
     }
 
-    vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+    uint32_t dynamicOffset = static_cast<uint32_t>(allocation.offset);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+        pipelineLayout, 0, 1, &descriptorSet, 1, &dynamicOffset);
+    return true;
+}
 
-    vkDestroyPipeline(device, graphicsPipeline, nullptr);
-    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-    vkDestroyRenderPass(device, renderPass, nullptr);
+void VulkanRenderer::cleanupSwapChain() {
+    // The graph's framebuffers name the swapchain and depth views
+    renderGraph->releaseFramebuffers();
+
+    // Render passes and pipelines don't depend on the size and survive a resize
+    vkDestroyImageView(device, depthImageView, nullptr);
+    vkDestroyImage(device, depthImage, nullptr);
+    vkFreeMemory(device, depthImageMemory, nullptr);
 
     for (auto imageView : swapChainImageViews) {
         vkDestroyImageView(device, imageView, nullptr);
@@ -890,6 +1221,12 @@ void VulkanRenderer::cleanupSwapChain() {
     vkDestroySwapchainKHR(device, swapChain, nullptr);
 }
 
+void VulkanRenderer::destroyRenderPasses() {
+    // Pipelines were built for these passes
+    pipelineLibrary->clear();
+    vkDestroyRenderPass(device, renderPass, nullptr);
+}
+
 void VulkanRenderer::recreateSwapChain() {
     // Handle minimization
     int width = 0, height = 0;
@@ -905,14 +1242,15 @@ void VulkanRenderer::recreateSwapChain() {
     // Cleanup old swap chain and dependent resources
     cleanupSwapChain();
 
-    // Recreate swap chain and dependent resources
+    // Recreate swap chain and dependent resources. Only post-processing names the
+    // swapchain format (rarely changes, e.g. moving to an HDR monitor)
     createSwapChain();
     createImageViews();
-    createRenderPass();
-    createGraphicsPipeline();
-    // createDepthResources(); // If you have depth buffer
-    createFramebuffers();
-    createCommandBuffers();
+    postProcessor->setOutput(swapChainImageFormat, swapChainStorage);
+    renderExtent = dynamicResolution->getRenderExtent(swapChainExtent);
+    createDepthResources();
+
+    hiZCuller->resize(swapChainExtent, depthImageView);
 }
 
 VkImageView VulkanRenderer::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags) {
@@ -990,11 +1328,21 @@ void VulkanRenderer::createImage(uint32_t width, uint32_t height, VkFormat forma
     vkBindImageMemory(device, image, imageMemory, 0);
 }
 
+VkFormat VulkanRenderer::findSceneColorFormat() {
+    // B10G11R11 is half the bandwidth of RGBA16F and enough range for lit color
+    return findSupportedFormat(
+        {VK_FORMAT_B10G11R11_UFLOAT_PACK32, VK_FORMAT_R16G16B16A16_SFLOAT},
+        VK_IMAGE_TILING_OPTIMAL,
+        VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BLEND_BIT |
+        VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT
+    );
+}
+
 VkFormat VulkanRenderer::findDepthFormat() {
     return findSupportedFormat(
         {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
         VK_IMAGE_TILING_OPTIMAL,
-        VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
+        VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT // sampled by the Hi-Z pass
     );
 }
 
@@ -1003,37 +1351,50 @@ bool VulkanRenderer::hasStencilComponent(VkFormat format) {
 }
 
 void VulkanRenderer::createDepthResources() {
-    VkFormat depthFormat = findDepthFormat();
+    depthFormat = findDepthFormat();
 
     createImage(swapChainExtent.width, swapChainExtent.height,
                depthFormat,
                VK_IMAGE_TILING_OPTIMAL,
-               VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+               VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
                depthImage,
                depthImageMemory);
 
     depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
 }
+void VulkanRenderer::setDynamicResolution(bool enabled, float targetFrameTimeMs) {
+    dynamicResolutionEnabled = enabled;
+    targetFrameTime = targetFrameTimeMs;
+    // Before run() the controller doesn't exist yet; initVulkan applies this
+    if (dynamicResolution) {
+        dynamicResolution->setEnabled(enabled);
+        dynamicResolution->setTargetFrameTime(targetFrameTimeMs);
+    }
+}
+
+VkDeviceSize VulkanRenderer::getDefaultTextureBudget() const {
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+    // Leave the other half for render targets, buffers and other applications
+    VkDeviceSize largestHeap = 0;
+    for (uint32_t i = 0; i < memProperties.memoryHeapCount; i++) {
+        if (memProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+            largestHeap = std::max(largestHeap, memProperties.memoryHeaps[i].size);
+        }
+    }
+    return largestHeap / 2;
+}
+
 void VulkanRenderer::createDefaultTexture() {
     // Create a 1x1 white texture as default
     unsigned char whitePixel[4] = {255, 255, 255, 255};
     
-    defaultTexture = std::make_shared<Texture>(device, physicalDevice);
+    defaultTexture = std::make_shared<Texture>(device, physicalDevice, samplerCache.get(), mipGenerator.get(),
+                                                   gpuTimeline.get());
     defaultTexture->createFromPixels(whitePixel, 1, 1, 4, commandPool, graphicsQueue);
 }
-void VulkanRenderer::updateTextureDescriptor(const VkDescriptorImageInfo& imageInfo) {
-    VkWriteDescriptorSet descriptorWrite{};
-    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrite.dstSet = descriptorSets[currentFrame];
-    descriptorWrite.dstBinding = 1; // Texture binding point
-    descriptorWrite.dstArrayElement = 0;
-    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorWrite.descriptorCount = 1;
-    descriptorWrite.pImageInfo = &imageInfo;
-    
-    vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
-}
 // In VulkanRenderer.cpp, modify the cleanup method:
 
 void VulkanRenderer::cleanup() {
@@ -1043,37 +1404,47 @@ void VulkanRenderer::cleanup() {
     // Clean up default texture (add this line)
     defaultTexture.reset();
 
-    // First cleanup the swap chain
+    // First cleanup the swap chain (and depth buffer)
     cleanupSwapChain();
-
-    // Cleanup depth resources
-    vkDestroyImageView(device, depthImageView, nullptr);
-    vkDestroyImage(device, depthImage, nullptr);
-    vkFreeMemory(device, depthImageMemory, nullptr);
+    destroyRenderPasses();
+    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 
     // Cleanup scene (this will clean up all meshes and textures)
     scene.reset();
-
-    // Cleanup uniform buffers
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        vkDestroyBuffer(device, uniformBuffers[i], nullptr);
-        vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
-    }
+    textureStreamer.reset();
+    pipelineLibrary.reset();
+    threadPool.reset();
+    occlusionWorker.reset();
+    stagingRing.reset();
+    bindlessTextures.reset();
+
+    hiZCuller.reset();
+    mipGenerator.reset();
+    renderGraph.reset();
+    // After the graph, whose framebuffers use its layer views
+    shadowRenderer.reset();
+    lightCuller.reset();
+    postProcessor.reset();
+    dynamicResolution.reset();
+
+    // Cleanup per-frame command buffers, synchronization objects and transient buffers
+    frames.clear();
 
     // Cleanup descriptor pool and layout
     vkDestroyDescriptorPool(device, descriptorPool, nullptr);
     vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
-
-    // Cleanup synchronization objects
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
-        vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-        vkDestroyFence(device, inFlightFences[i], nullptr);
-    }
+    vkDestroyDescriptorSetLayout(device, lightingSetLayout, nullptr);
 
     // Cleanup command pool
     vkDestroyCommandPool(device, commandPool, nullptr);
 
+    samplerCache.reset();
+
+    // Everything compiled this run is in the cache now
+    pipelineCache->save();
+    pipelineCache.reset();
+    gpuTimeline.reset();
+
     // Cleanup device
     vkDestroyDevice(device, nullptr);
 
@@ -9,6 +9,11 @@
 #include "../include/mesh/Mesh.h"
 #include <fstream>
 #include <chrono>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
@@ -19,6 +24,24 @@
 #include <set>
 
 #include "include/scene/Scene.h"
+#include "include/culling/HiZCuller.h"
+#include "include/culling/LightCuller.h"
+#include "include/culling/SoftwareOcclusion.h"
+#include "include/Utils/TripleBuffer.h"
+#include "include/Utils/ThreadPool.h"
+#include "include/texture/TextureStreamer.h"
+#include "include/texture/BindlessTextureTable.h"
+#include "include/texture/SamplerCache.h"
+#include "include/texture/MipGenerator.h"
+#include "include/pipeline/PipelineCache.h"
+#include "include/pipeline/PipelineLibrary.h"
+#include "include/texture/StagingRing.h"
+#include "include/render/FrameContext.h"
+#include "include/render/GpuTimeline.h"
+#include "include/render/RenderGraph.h"
+#include "include/render/ShadowRenderer.h"
+#include "include/render/PostProcessor.h"
+#include "include/render/DynamicResolution.h"
 
 
 struct SwapChainSupportDetails {
@@ -44,13 +67,25 @@ class VulkanRenderer
         glm::mat4 proj;
     };
 public: //texture related
-    // Update texture descriptor
-    void updateTextureDescriptor(const VkDescriptorImageInfo& imageInfo);
-    
-    // Get the current descriptor set
-    VkDescriptorSet getCurrentDescriptorSet() const { 
-        return descriptorSets[currentFrame]; 
+    // Write a draw's matrices into the frame's transient memory and bind set 0 at
+    // their offset. A texture gets the draw its own transient set (non-bindless
+    // path), otherwise the frame's set with the default texture is bound. Returns
+    // false when the frame is out of transient space; the draw must be skipped.
+    bool bindDrawUniforms(VkCommandBuffer commandBuffer, const glm::mat4& model,
+                          const glm::mat4& view, const glm::mat4& proj,
+                          const VkDescriptorImageInfo* texture = nullptr);
+
+    // Image info for the 1x1 white texture, bound while real textures are loading
+    VkDescriptorImageInfo getDefaultTextureImageInfo() const {
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfo.imageView = defaultTexture->getImageView();
+        imageInfo.sampler = defaultTexture->getSampler();
+        return imageInfo;
     }
+
+    // Pipeline variant for a material; the base pipeline while the variant compiles
+    VkPipeline getMaterialPipeline(const Material& material);
     
   
 private:
@@ -60,9 +95,13 @@ private:
     VkImage depthImage;
     VkDeviceMemory depthImageMemory;
     VkImageView depthImageView;
+    VkFormat depthFormat;
+    // Lit passes render HDR color; post-processing tonemaps it into the swapchain
+    VkFormat sceneColorFormat;
 
     // Helper methods for depth resources
     VkFormat findDepthFormat();
+    VkFormat findSceneColorFormat();
     VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates,
                                 VkImageTiling tiling,
                                 VkFormatFeatureFlags features);
@@ -73,26 +112,148 @@ private:
                     VkDeviceMemory& imageMemory);
     VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
     void createDepthResources();
+
+    // Hierarchical-Z occlusion culling: the early pass draws last frame's visible
+    // set, the late pass draws what the cull against the fresh pyramid revealed
+    std::unique_ptr<HiZCuller> hiZCuller;
+    bool occlusionCullingEnabled = true;
+    void addOcclusionCulledPasses(RenderGraph::ImageHandle color, RenderGraph::ImageHandle depth,
+                                  const FrameSnapshot& snapshot,
+                                  const glm::mat4& view, const glm::mat4& proj,
+                                  const std::vector<uint8_t>* visibility);
+
+    // CPU occlusion culling against designated occluder meshes (Scene::loadOccluderModel)
+    std::unique_ptr<SoftwareOcclusionCuller> softwareOcclusion;
+    // The cull's own worker: drawFrame waits on it, so it must never queue behind
+    // the decodes and pipeline compiles on the shared pool
+    std::unique_ptr<ThreadPool> occlusionWorker;
+    bool softwareOcclusionEnabled = false;
+    std::vector<uint8_t> softwareVisibility;
+
+    // Shadow maps for the scene's lights; static casters are cached across frames
+    std::unique_ptr<ShadowRenderer> shadowRenderer;
+    std::vector<RenderGraph::ImageHandle> shadowMaps;  // This frame's, read by the lit passes
+
+    // Bins local lights into view clusters; lit fragments only shade their cluster's
+    std::unique_ptr<LightCuller> lightCuller;
+    std::vector<GpuLight> frameLights;  // Directional lights first
+    RenderGraph::BufferHandle lightClusters{};
+    RenderGraph::BufferHandle lightIndices{};
+
+    // Tonemaps the HDR scene into the swapchain image, from compute when the
+    // swapchain can be a storage image
+    std::unique_ptr<PostProcessor> postProcessor;
+    bool storageImageWriteWithoutFormat = false;
+    bool swapChainStorage = false;
+
+    // The scene renders into the top-left renderExtent of its targets; with dynamic
+    // resolution that shrinks whenever GPU frame time goes over the target
+    std::unique_ptr<DynamicResolution> dynamicResolution;
+    bool dynamicResolutionEnabled = false;
+    float targetFrameTime = 1000.0f / 60.0f;
+    VkExtent2D renderExtent{};
+
+    // Lights and shadow maps (set 1). Each frame's set points at its transient
+    // buffer and light buffer; the frame's LightingData is bound at lightingOffset
+    static constexpr uint32_t LIGHTING_SET = 1;
+    VkDescriptorSetLayout lightingSetLayout;
+    std::vector<VkDescriptorSet> lightingSets;
+    uint32_t lightingOffset = 0;
+    void writeLightingData(FrameContext& frame, const FrameSnapshot& snapshot);
+    // Pipeline, lighting and bindless textures of the lit passes; set 0 is bound per draw
+    void bindLitPass(VkCommandBuffer commandBuffer);
+    // Declare the shadow maps and light clusters a lit pass reads
+    void readLighting(RenderGraph::PassBuilder& pass);
+
+    // Timeline of graphics queue submissions; frames and uploads wait on its values
+    std::unique_ptr<GpuTimeline> gpuTimeline;
+
+    // Worker threads for background jobs (texture decoding)
+    std::unique_ptr<ThreadPool> threadPool;
+
+    // Persistently mapped upload buffer texture decodes write into
+    std::unique_ptr<StagingRing> stagingRing;
+
+    // Samplers shared by textures and passes, created on first use per sampler state
+    std::unique_ptr<SamplerCache> samplerCache;
+
+    // Driver pipeline cache, loaded at startup and saved on shutdown
+    std::unique_ptr<PipelineCache> pipelineCache;
+
+    // Graphics pipelines by state hash, variants compiled on the thread pool
+    std::unique_ptr<PipelineLibrary> pipelineLibrary;
+
+    // Compute downsampler for texture mip chains and the Hi-Z pyramid
+    std::unique_ptr<MipGenerator> mipGenerator;
+
+    // Descriptor-indexed texture array; null when the device lacks descriptor indexing
+    std::unique_ptr<BindlessTextureTable> bindlessTextures;
+    bool bindlessTexturesSupported = false;
+
+    // Streams texture mips in and out; 0 budget means half the largest device-local heap
+    std::unique_ptr<TextureStreamer> textureStreamer;
+    VkDeviceSize textureBudget = 0;
+    VkDeviceSize getDefaultTextureBudget() const;
+
+    // Simulation produces frame snapshots, drawFrame renders the latest one. With
+    // threaded simulation, Scene::update runs on its own thread one frame ahead.
+    TripleBuffer<FrameSnapshot> frameSnapshots;
+    bool threadedSimulationEnabled = false;
+    std::thread simulationThread;
+    std::atomic<bool> simulationRunning{ false };
+    std::mutex simulationMutex;
+    std::condition_variable simulationCondition;
+    uint64_t simulationFrame = 0;
+    void simulateFrame(float deltaTime);
+    void simulationLoop();
+    void stopSimulationThread();
 public:
+    // Run Scene::update on a separate thread (set before run())
+    void setThreadedSimulation(bool enabled) { threadedSimulationEnabled = enabled; }
+
+    // VRAM available to streamed texture mips (set before run(), 0 = automatic)
+    void setTextureBudget(VkDeviceSize budget) { textureBudget = budget; }
+
+    // Frames the CPU may record ahead of the GPU (set before run()); more hides
+    // GPU stalls at the cost of latency and per-frame memory
+    void setFramesInFlight(uint32_t count) { framesInFlight = count > 0 ? count : 1; }
+    uint32_t getFramesInFlight() const { return framesInFlight; }
+
+    // Trade scene resolution (down to DynamicResolution::MIN_SCALE per axis) for
+    // holding a GPU frame time; post-processing upscales to the window
+    void setDynamicResolution(bool enabled, float targetFrameTimeMs = 1000.0f / 60.0f);
+    VkExtent2D getRenderExtent() const { return renderExtent; }
+
     VkDevice getDevice() const { return device; }
     VkPhysicalDevice getPhysicalDevice() const { return physicalDevice; }
     VkCommandPool getCommandPool() const { return commandPool; }
     VkQueue getGraphicsQueue() const { return graphicsQueue; }
+    GpuTimeline* getGpuTimeline() const { return gpuTimeline.get(); }
+    ThreadPool* getThreadPool() const { return threadPool.get(); }
+    TextureStreamer* getTextureStreamer() const { return textureStreamer.get(); }
+    BindlessTextureTable* getBindlessTextures() const { return bindlessTextures.get(); }
+    SamplerCache* getSamplerCache() const { return samplerCache.get(); }
+    MipGenerator* getMipGenerator() const { return mipGenerator.get(); }
+    VkPipelineCache getPipelineCache() const { return pipelineCache->get(); }
+    PipelineLibrary* getPipelineLibrary() const { return pipelineLibrary.get(); }
+    PostProcessor* getPostProcessor() const { return postProcessor.get(); }
+    StagingRing* getStagingRing() const { return stagingRing.get(); }
+    VkPipelineLayout getPipelineLayout() const { return pipelineLayout; }
     void recreateSwapChain();
     void cleanupSwapChain();
+    void destroyRenderPasses();
 
 private:
-   //TODO::need to refactor the code later
-    std::vector<VkBuffer> uniformBuffers;
-    std::vector<VkDeviceMemory> uniformBuffersMemory;
-    std::vector<void*> uniformBuffersMapped;
-    // Uniform buffer members
     float rotationAngle = 0.0f;
 
-    // Descriptor members
+    // Descriptor members; binding 0 of each frame's set is a dynamic uniform buffer
+    // over that frame's transient allocator, offset per draw
     VkDescriptorPool descriptorPool;
     VkDescriptorSetLayout descriptorSetLayout;
     std::vector<VkDescriptorSet> descriptorSets;
+    VkDeviceSize uniformAlignment = 256;  // minUniformBufferOffsetAlignment
+    void writeDescriptorSet(VkDescriptorSet descriptorSet, VkBuffer uniformBuffer,
+                            const VkDescriptorImageInfo& imageInfo);
 
     std::vector<MeshData> meshes;
 
@@ -121,19 +282,21 @@ private:
         VkFormat swapChainImageFormat;
         VkExtent2D swapChainExtent;
         std::vector<VkImageView> swapChainImageViews;
+        // Pipelines are built against it; graph passes with the same formats are compatible
         VkRenderPass renderPass;
         VkPipelineLayout pipelineLayout;
-        VkPipeline graphicsPipeline;
-        std::vector<VkFramebuffer> swapChainFramebuffers;
-        VkCommandPool commandPool;
-        std::vector<VkCommandBuffer> commandBuffers;
-
-        // Synchronization objects
-        std::vector<VkSemaphore> imageAvailableSemaphores;
-        std::vector<VkSemaphore> renderFinishedSemaphores;
-        std::vector<VkFence> inFlightFences;
+        VkPipeline graphicsPipeline;  // Owned by pipelineLibrary
+        GraphicsPipelineDesc basePipelineDesc;
+        VkCommandPool commandPool;  // One-off uploads; frames record into their own pools
+
+        // Command buffer, synchronization objects and transient memory per frame in flight
+        std::vector<std::unique_ptr<FrameContext>> frames;
         size_t currentFrame = 0;
-        const int MAX_FRAMES_IN_FLIGHT = 2;
+        uint32_t framesInFlight = 2;
+
+        // Passes of the frame, declared anew each frame; barriers, render passes and
+        // framebuffers come from what the passes read and write
+        std::unique_ptr<RenderGraph> renderGraph;
 
   
     
@@ -155,21 +318,17 @@ private:
         void createImageViews();
         void createRenderPass();
         void createGraphicsPipeline();
-        void createFramebuffers();
         void createCommandPool();
         
-        void createCommandBuffers();
-        void createSyncObjects();
+        void createFrameContexts();
         void run();
         void initWindow();
         void mainLoop();
         void drawFrame();
         void createDescriptorSetLayout();
        
-        void createUniformBuffers();
         void createDescriptorPool();
         void createDescriptorSets();
-    void updateMVPMatrices(const glm::mat4& model, const glm::mat4& view, const glm::mat4& proj);
         void cleanup();
 
         bool isDeviceSuitable(VkPhysicalDevice device);
@@ -266,13 +425,8 @@ public:
 
         vkEndCommandBuffer(commandBuffer);
 
-        VkSubmitInfo submitInfo{};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffer;
-
-        vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-        vkQueueWaitIdle(graphicsQueue);
+        // Unlike a queue drain, work submitted after the copy doesn't hold this up
+        gpuTimeline->wait(gpuTimeline->submit(commandBuffer));
 
         vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
     }
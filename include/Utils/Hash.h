@@ -0,0 +1,116 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+// Fast non-cryptographic hashing for content-addressed caches (XXH64). Equal
+// hashes are treated as equal content, so only use it where a 1 in 2^64
+// collision is acceptable.
+namespace Hash {
+    namespace detail {
+        constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+        constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+        constexpr uint64_t PRIME3 = 0x165667B19E3779F9ull;
+        constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+        constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ull;
+
+        inline uint64_t rotl(uint64_t value, int bits) {
+            return (value << bits) | (value >> (64 - bits));
+        }
+
+        inline uint64_t read64(const unsigned char* p) {
+            uint64_t value;
+            std::memcpy(&value, p, sizeof(value));
+            return value;
+        }
+
+        inline uint32_t read32(const unsigned char* p) {
+            uint32_t value;
+            std::memcpy(&value, p, sizeof(value));
+            return value;
+        }
+
+        inline uint64_t round(uint64_t acc, uint64_t input) {
+            acc += input * PRIME2;
+            acc = rotl(acc, 31);
+            return acc * PRIME1;
+        }
+
+        inline uint64_t mergeRound(uint64_t acc, uint64_t value) {
+            acc ^= round(0, value);
+            return acc * PRIME1 + PRIME4;
+        }
+    }
+
+    // XXH64 of a byte range (little-endian reads, as on every target we build for)
+    inline uint64_t bytes(const void* data, size_t size, uint64_t seed = 0) {
+        using namespace detail;
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        const unsigned char* end = p + size;
+        uint64_t hash;
+
+        if (size >= 32) {
+            uint64_t v1 = seed + PRIME1 + PRIME2;
+            uint64_t v2 = seed + PRIME2;
+            uint64_t v3 = seed;
+            uint64_t v4 = seed - PRIME1;
+            const unsigned char* limit = end - 32;
+            do {
+                v1 = round(v1, read64(p));
+                v2 = round(v2, read64(p + 8));
+                v3 = round(v3, read64(p + 16));
+                v4 = round(v4, read64(p + 24));
+                p += 32;
+            } while (p <= limit);
+
+            hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+            hash = mergeRound(hash, v1);
+            hash = mergeRound(hash, v2);
+            hash = mergeRound(hash, v3);
+            hash = mergeRound(hash, v4);
+        } else {
+            hash = seed + PRIME5;
+        }
+
+        hash += static_cast<uint64_t>(size);
+
+        while (p + 8 <= end) {
+            hash ^= round(0, read64(p));
+            hash = rotl(hash, 27) * PRIME1 + PRIME4;
+            p += 8;
+        }
+        if (p + 4 <= end) {
+            hash ^= static_cast<uint64_t>(read32(p)) * PRIME1;
+            hash = rotl(hash, 23) * PRIME2 + PRIME3;
+            p += 4;
+        }
+        while (p < end) {
+            hash ^= (*p) * PRIME5;
+            hash = rotl(hash, 11) * PRIME1;
+            p++;
+        }
+
+        hash ^= hash >> 33;
+        hash *= PRIME2;
+        hash ^= hash >> 29;
+        hash *= PRIME3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+    // Fold another value into a running hash
+    inline uint64_t combine(uint64_t hash, uint64_t value) {
+        return hash ^ (value + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2));
+    }
+}
+
+// What a content-hash cache saved by handing out an existing resource
+struct DedupStats {
+    uint32_t duplicates = 0;
+    uint64_t bytesSaved = 0;
+
+    void add(uint64_t bytes) {
+        duplicates++;
+        bytesSaved += bytes;
+    }
+};
@@ -0,0 +1,49 @@
+﻿#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Single producer / single consumer triple buffer.
+//
+// The writer fills back(), then publish() swaps it with the shared middle slot.
+// The reader calls acquire() to swap the middle slot into front() if a newer
+// value was published. Neither side ever blocks or sees a half-written value,
+// and slots are reused so their allocations survive from frame to frame.
+template<typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() = default;
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // Writer side
+    T& back() { return slots[backIndex]; }
+
+    void publish() {
+        uint8_t previous = middle.exchange(static_cast<uint8_t>(backIndex | DIRTY_BIT), std::memory_order_acq_rel);
+        backIndex = previous & INDEX_MASK;
+    }
+
+    // Reader side. Returns true if front() changed since the last call.
+    bool acquire() {
+        if (!(middle.load(std::memory_order_relaxed) & DIRTY_BIT)) {
+            return false;
+        }
+        uint8_t previous = middle.exchange(frontIndex, std::memory_order_acq_rel);
+        frontIndex = previous & INDEX_MASK;
+        return true;
+    }
+
+    const T& front() const { return slots[frontIndex]; }
+
+    // Whether the writer has published a value the reader hasn't picked up yet
+    bool hasPending() const { return (middle.load(std::memory_order_acquire) & DIRTY_BIT) != 0; }
+
+private:
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    static constexpr uint8_t DIRTY_BIT = 0x4;
+
+    T slots[3];
+    uint8_t backIndex = 0;
+    std::atomic<uint8_t> middle{ 1 };
+    uint8_t frontIndex = 2;
+};
@@ -0,0 +1,33 @@
+﻿#pragma once
+#include <glm/glm.hpp>
+#include <cfloat>
+
+// Axis-aligned bounding box used by the culling passes
+struct AABB {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    bool isValid() const { return min.x <= max.x && min.y <= max.y && min.z <= max.z; }
+
+    void expand(const glm::vec3& point) {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    glm::vec3 getCenter() const { return (min + max) * 0.5f; }
+    glm::vec3 getExtents() const { return (max - min) * 0.5f; }
+
+    // Transform the box and return the box enclosing the result
+    AABB transformed(const glm::mat4& matrix) const {
+        glm::vec3 center = glm::vec3(matrix * glm::vec4(getCenter(), 1.0f));
+        glm::mat3 absolute = glm::mat3(glm::abs(glm::vec3(matrix[0])),
+                                       glm::abs(glm::vec3(matrix[1])),
+                                       glm::abs(glm::vec3(matrix[2])));
+        glm::vec3 extents = absolute * getExtents();
+
+        AABB result;
+        result.min = center - extents;
+        result.max = center + extents;
+        return result;
+    }
+};
@@ -0,0 +1,118 @@
+﻿#pragma once
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <glm/glm.hpp>
+
+#include "../texture/MipGenerator.h"
+
+// Forward declarations
+class VulkanRenderer;
+
+// Per-instance record consumed by the cull shader (std430 layout)
+struct CullInstance {
+    glm::vec4 aabbMin;
+    glm::vec4 aabbMax;
+    uint32_t indexCount;
+    uint32_t padding[3];
+};
+
+// Hierarchical-Z occlusion culling.
+//
+// The depth buffer written by the early pass is reduced into a max-depth pyramid,
+// then every instance's world bounds are tested against it on the GPU. Results are
+// written as indirect draw commands:
+//   - early draws: instances visible last frame, drawn before the pyramid is built
+//   - late draws:  instances that became visible this frame (disocclusion), drawn
+//                  after the cull so they never pop in a frame late
+//
+// Records no barriers of its own: the renderer declares each step as a render
+// graph pass and the graph orders them against the depth buffer and the draws.
+class HiZCuller {
+public:
+    HiZCuller(VulkanRenderer* renderer, uint32_t framesInFlight);
+    ~HiZCuller();
+
+    // (Re)create the pyramid for a depth buffer of the given size
+    void resize(VkExtent2D depthExtent, VkImageView depthImageView);
+
+    // Upload this frame's instance bounds; grows the GPU buffers if needed
+    void updateInstances(uint32_t frameIndex, const std::vector<CullInstance>& instances);
+
+    // Fresh draw buffers hold garbage: nothing was visible last frame, so they are
+    // zeroed (transfer write) before the early pass and everything goes to the late one
+    bool needsDrawBufferClear() const { return drawBuffersNeedClear; }
+    void recordDrawBufferClear(VkCommandBuffer commandBuffer);
+
+    // Rewrite the early draws' indexCount/firstIndex from this frame's instances, keeping
+    // only last frame's visibility. Instance slots are dense and move when entities are
+    // removed, so a slot may now hold a different mesh. Recorded before the early pass
+    void recordEarlyRefresh(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+    // Reduce the depth buffer into the pyramid. Depth is sampled in
+    // DEPTH_STENCIL_READ_ONLY_OPTIMAL, every pyramid level is written in GENERAL
+    void recordPyramidBuild(VkCommandBuffer commandBuffer);
+
+    // Test all instances against the pyramid (sampled in GENERAL) and write the
+    // indirect draw commands: this frame's late draws and next frame's early draws.
+    // renderExtent is the top-left part of the depth buffer the frame drew into
+    void recordCull(VkCommandBuffer commandBuffer, uint32_t frameIndex, const glm::mat4& viewProj,
+                    VkExtent2D renderExtent);
+
+    VkBuffer getEarlyDrawBuffer() const { return earlyDrawBuffer; }
+    VkBuffer getLateDrawBuffer() const { return lateDrawBuffer; }
+    VkImage getPyramidImage() const { return pyramidImage; }
+    VkImageView getPyramidView() const { return pyramidView; }
+    VkExtent2D getPyramidExtent() const { return pyramidExtent; }
+    uint32_t getPyramidLevels() const { return pyramidLevels; }
+    static constexpr VkFormat PYRAMID_FORMAT = VK_FORMAT_R32_SFLOAT;
+
+private:
+    VulkanRenderer* renderer;
+    VkDevice device;
+    uint32_t framesInFlight;
+
+    // Depth pyramid
+    VkExtent2D depthExtent{};
+    VkImageView depthImageView = VK_NULL_HANDLE;
+    VkImage pyramidImage = VK_NULL_HANDLE;
+    VkDeviceMemory pyramidMemory = VK_NULL_HANDLE;
+    VkImageView pyramidView = VK_NULL_HANDLE;
+    VkExtent2D pyramidExtent{};
+    uint32_t pyramidLevels = 0;
+    // Built by the renderer's MipGenerator, all levels in one dispatch
+    MipGenerator::Chain pyramidChain;
+    VkSampler pyramidSampler = VK_NULL_HANDLE;  // Owned by the renderer's SamplerCache
+
+    // Instance bounds (one host-visible buffer per frame in flight)
+    std::vector<VkBuffer> instanceBuffers;
+    std::vector<VkDeviceMemory> instanceBuffersMemory;
+    std::vector<void*> instanceBuffersMapped;
+    uint32_t instanceCapacity = 0;
+    uint32_t instanceCount = 0;
+
+    // Indirect draw commands written by the cull shader
+    VkBuffer earlyDrawBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory earlyDrawBufferMemory = VK_NULL_HANDLE;
+    VkBuffer lateDrawBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory lateDrawBufferMemory = VK_NULL_HANDLE;
+    bool drawBuffersNeedClear = false;
+
+    // Pipelines
+    VkDescriptorSetLayout cullSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout cullPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline cullPipeline = VK_NULL_HANDLE;
+    VkPipeline refreshPipeline = VK_NULL_HANDLE;  // Shares the cull set and layout
+
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> cullSets;
+
+    void createPipelines();
+    VkPipeline createComputePipeline(const std::string& shaderFile, VkPipelineLayout layout);
+    void createPyramid();
+    void destroyPyramid();
+    void createBuffers(uint32_t capacity);
+    void destroyBuffers();
+    void createDescriptorSets();
+    void destroyDescriptorSets();
+};
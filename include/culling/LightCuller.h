@@ -0,0 +1,92 @@
+﻿#pragma once
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "../render/Lighting.h"
+
+// Forward declarations
+class VulkanRenderer;
+
+// Clustered light culling.
+//
+// The view frustum is split into CLUSTER_X x CLUSTER_Y screen tiles and CLUSTER_Z
+// exponential depth slices. A compute pass (shaders/light_cull.comp) lists the
+// local lights whose bounding sphere touches each cluster, packing the lists into
+// one shared index buffer. Lit fragments only shade the lights of their own
+// cluster, so the cost per fragment follows the lights nearby rather than the
+// lights in the scene. Directional lights come first in the light buffer and
+// aren't culled.
+//
+// Records no barriers of its own: the renderer declares the reset and the cull as
+// render graph passes and the lit passes as readers of the grid and indices.
+class LightCuller {
+public:
+    static constexpr uint32_t CLUSTER_X = 16;
+    static constexpr uint32_t CLUSTER_Y = 9;
+    static constexpr uint32_t CLUSTER_Z = 24;
+    static constexpr uint32_t CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+    // Longer lists are cut off (a fixed array per invocation in the shader)
+    static constexpr uint32_t MAX_LIGHTS_PER_CLUSTER = 128;
+    // Shared by every list, 32 lights per cluster on average; clusters that don't
+    // fit lose their lights
+    static constexpr uint32_t MAX_LIGHT_INDICES = CLUSTER_COUNT * 32;
+
+    LightCuller(VulkanRenderer* renderer, uint32_t framesInFlight);
+    ~LightCuller();
+
+    LightCuller(const LightCuller&) = delete;
+    LightCuller& operator=(const LightCuller&) = delete;
+
+    // Copy this frame's lights, directional ones first; past Lighting::MAX_LIGHTS
+    // are dropped. Returns how many were kept.
+    uint32_t updateLights(uint32_t frameIndex, const std::vector<GpuLight>& lights, uint32_t directionalCount);
+
+    // LightingData::clusterParams for a render target and camera depth range
+    static glm::vec4 getClusterParams(VkExtent2D extent, float nearPlane, float farPlane);
+
+    // Zero the shared index counter (transfer write)
+    void recordCounterReset(VkCommandBuffer commandBuffer);
+
+    // Rebuild every cluster's list (compute): reads and writes the counter, writes
+    // the grid and the indices
+    void recordCull(VkCommandBuffer commandBuffer, uint32_t frameIndex, const glm::mat4& view,
+                    float fovY, float aspectRatio, float nearPlane, float farPlane);
+
+    VkBuffer getLightBuffer(uint32_t frameIndex) const { return lightBuffers[frameIndex]; }
+    VkBuffer getGridBuffer() const { return gridBuffer; }
+    VkBuffer getIndexBuffer() const { return indexBuffer; }
+    VkBuffer getCounterBuffer() const { return counterBuffer; }
+
+private:
+    VulkanRenderer* renderer;
+    VkDevice device;
+    uint32_t framesInFlight;
+
+    // Lights (one host-visible buffer per frame in flight, Lighting::MAX_LIGHTS each)
+    std::vector<VkBuffer> lightBuffers;
+    std::vector<VkDeviceMemory> lightBuffersMemory;
+    std::vector<void*> lightBuffersMapped;
+    uint32_t lightCount = 0;
+    uint32_t firstLocalLight = 0;
+
+    // Offset and count into the index buffer per cluster, written by the cull shader
+    VkBuffer gridBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory gridBufferMemory = VK_NULL_HANDLE;
+    VkBuffer indexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory indexBufferMemory = VK_NULL_HANDLE;
+    VkBuffer counterBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory counterBufferMemory = VK_NULL_HANDLE;
+
+    VkDescriptorSetLayout cullSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout cullPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline cullPipeline = VK_NULL_HANDLE;
+
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> cullSets;
+
+    void createBuffers();
+    void createPipeline();
+    void createDescriptorSets();
+};
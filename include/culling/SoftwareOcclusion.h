@@ -0,0 +1,61 @@
+﻿#pragma once
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "Bounds.h"
+
+// CPU-side copy of an occluder's geometry (positions only)
+struct OccluderMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    glm::mat4 modelMatrix = glm::mat4(1.0f);
+};
+
+// Low resolution depth-only rasterizer for conservative draw rejection on the CPU.
+//
+// Occluders are transformed, binned into screen tiles and rasterized tile by tile
+// (four pixels per SSE step) into a nearest-depth buffer. Instance bounds are then
+// tested against that buffer: an instance is rejected only if every pixel under its
+// screen rectangle holds an occluder closer than the instance's nearest point.
+class SoftwareOcclusionCuller {
+public:
+    static const uint32_t TILE_WIDTH = 32;
+    static const uint32_t TILE_HEIGHT = 16;
+
+    SoftwareOcclusionCuller(uint32_t width = 256, uint32_t height = 128);
+
+    // Rasterize all occluders and test every instance; visibility[i] is 1 if bounds[i] may be visible
+    void cull(const std::vector<OccluderMesh>& occluders, const std::vector<AABB>& bounds,
+              const glm::mat4& viewProj, std::vector<uint8_t>& visibility);
+
+    // Individual steps, for callers that want to reuse one occlusion buffer
+    void clear();
+    void addOccluder(const OccluderMesh& occluder, const glm::mat4& viewProj);
+    void rasterize();
+    bool isVisible(const AABB& worldBounds, const glm::mat4& viewProj) const;
+
+    uint32_t getWidth() const { return width; }
+    uint32_t getHeight() const { return height; }
+    const std::vector<float>& getDepthBuffer() const { return depthBuffer; }
+
+private:
+    // Screen-space triangle with edge and depth plane equations
+    struct BinnedTriangle {
+        float edgeA[3], edgeB[3], edgeC[3];
+        float depthA, depthB, depthC;
+        int32_t minX, minY, maxX, maxY;
+    };
+
+    uint32_t width;
+    uint32_t height;
+    uint32_t tilesX;
+    uint32_t tilesY;
+
+    std::vector<float> depthBuffer;
+    std::vector<float> tileMaxDepth;
+    std::vector<std::vector<BinnedTriangle>> tileBins;
+    std::vector<glm::vec4> clipScratch;
+
+    void binTriangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2);
+    void rasterizeTile(uint32_t tileX, uint32_t tileY);
+};
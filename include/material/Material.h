@@ -19,6 +19,7 @@ struct Material {
     
     // Settings
     bool useTexture = false;
+    bool doubleSided = false;  // Draw back faces too
     
     // Constructor with default values
     Material() = default;
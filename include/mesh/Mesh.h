@@ -1,8 +1,11 @@
 ﻿#pragma once
 #include <vulkan/vulkan.h>
 #include <vector>
+#include <memory>
 #include "../material/Material.h" 
 #include "../loader/ModelLoader.h"  // For MeshData
+#include "../culling/Bounds.h"
+#include "../render/GpuTimeline.h"
 
 class Mesh {
 public:
@@ -10,10 +13,14 @@ public:
     Mesh(VkDevice device, VkPhysicalDevice physicalDevice, 
       const MeshData& meshData, 
       const Material& material = Material());
+
+    // Use the GPU buffers of a mesh with identical geometry, with a material of its own
+    Mesh(const std::shared_ptr<Mesh>& source, const Material& material);
     ~Mesh();
 
-    // Create GPU buffers for vertices and indices using provided command pool and graphics queue
-    void createBuffers(VkCommandPool commandPool, VkQueue graphicsQueue);
+    // Create GPU buffers for vertices and indices using provided command pool and graphics queue.
+    // With a timeline, the copies wait for their own submission instead of the queue going idle.
+    void createBuffers(VkCommandPool commandPool, VkQueue graphicsQueue, GpuTimeline* timeline = nullptr);
 
     // Bind vertex and index buffers to the given command buffer
     void bind(VkCommandBuffer commandBuffer) const;
@@ -21,6 +28,15 @@ public:
     // Issue draw command for this mesh
     void draw(VkCommandBuffer commandBuffer) const;
 
+    // Issue a draw whose parameters are read from a GPU-written indirect buffer
+    void drawIndirect(VkCommandBuffer commandBuffer, VkBuffer indirectBuffer, VkDeviceSize offset) const;
+
+    // Number of indices submitted by draw()
+    uint32_t getIndexCount() const { return indexCount; }
+
+    // Object-space bounds computed from the vertex data
+    const AABB& getBounds() const { return bounds; }
+
     // Get mesh material
     const Material& getMaterial() const { return material; }
     
@@ -36,6 +52,12 @@ private:
     VkBuffer indexBuffer;
     VkDeviceMemory indexBufferMemory;
     uint32_t indexCount;
+    AABB bounds;
+
+    GpuTimeline* timeline = nullptr;  // Only used during createBuffers
+
+    // Owner of the buffers when they are shared; this mesh must not destroy them
+    std::shared_ptr<Mesh> geometrySource;
 
     // Local copies of the mesh data
     std::vector<Vertex> vertices;
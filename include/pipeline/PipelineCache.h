@@ -0,0 +1,36 @@
+﻿#pragma once
+#include <vulkan/vulkan.h>
+#include <string>
+
+// VkPipelineCache persisted between runs.
+//
+// The file is the driver's cache blob as returned by vkGetPipelineCacheData. It is
+// only handed back to the driver when its header matches this device (vendor,
+// device and pipeline cache UUID, which changes with the driver version); anything
+// else starts an empty cache. Pass get() to every pipeline creation.
+class PipelineCache {
+public:
+    PipelineCache(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& path);
+    ~PipelineCache();
+
+    PipelineCache(const PipelineCache&) = delete;
+    PipelineCache& operator=(const PipelineCache&) = delete;
+
+    VkPipelineCache get() const { return cache; }
+
+    // Whether the cache started from a valid file (pipelines should compile quickly)
+    bool isWarm() const { return warm; }
+
+    // Write the cache to disk; returns false if it couldn't be written
+    bool save();
+
+private:
+    VkDevice device;
+    VkPhysicalDeviceProperties deviceProperties;
+    std::string path;
+    VkPipelineCache cache = VK_NULL_HANDLE;
+    bool warm = false;
+
+    // Whether data starts with a cache header written by this device and driver
+    bool isCompatible(const std::string& data) const;
+};
@@ -0,0 +1,109 @@
+﻿#pragma once
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+// Forward declarations
+class VulkanRenderer;
+class ThreadPool;
+
+// Everything that decides a graphics pipeline. Shaders are SPIR-V files; their
+// contents, not their paths, go into the hash. Viewport and scissor are always
+// dynamic, so the same pipeline works at any framebuffer size.
+struct GraphicsPipelineDesc {
+    std::string vertexShader;
+    std::string fragmentShader;  // Empty for depth-only passes
+
+    // Vertex layout
+    std::vector<VkVertexInputBindingDescription> vertexBindings;
+    std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    // Fixed-function state
+    VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+    VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+    VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    bool depthTest = true;
+    bool depthWrite = true;
+    VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+    // Depth bias in units of the depth format's resolution and of the slope;
+    // both 0 disables it (shadow maps use it against acne)
+    float depthBiasConstant = 0.0f;
+    float depthBiasSlope = 0.0f;
+    bool alphaBlend = false;
+    uint32_t colorAttachmentCount = 1;
+
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    uint32_t subpass = 0;
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+};
+
+// Graphics pipelines keyed by a hash of their GraphicsPipelineDesc. Each entry keeps
+// its desc and lookups compare it, so two descs that collide get their own pipelines.
+//
+// get() never blocks on compilation: a missing pipeline is compiled on the thread
+// pool while draws keep using a fallback (usually the base pipeline of the same
+// pass), so new materials and variants don't hitch the frame they first appear in.
+// All compilation goes through the renderer's pipeline cache.
+class PipelineLibrary {
+public:
+    PipelineLibrary(VulkanRenderer* renderer, ThreadPool* threadPool);
+    ~PipelineLibrary();
+
+    PipelineLibrary(const PipelineLibrary&) = delete;
+    PipelineLibrary& operator=(const PipelineLibrary&) = delete;
+
+    // The pipeline for desc if it's compiled. Otherwise it starts compiling on a
+    // worker and the pipeline for fallback is returned (compiled here if missing).
+    VkPipeline get(const GraphicsPipelineDesc& desc, const GraphicsPipelineDesc& fallback);
+
+    // The pipeline for desc, compiled on the calling thread if missing
+    VkPipeline getNow(const GraphicsPipelineDesc& desc);
+
+    // Destroy every pipeline, after waiting for compiles in flight. Call before
+    // the render passes or layouts they were built for are destroyed.
+    void clear();
+
+    uint64_t hash(const GraphicsPipelineDesc& desc);
+
+    size_t getPipelineCount();
+
+private:
+    struct Entry {
+        GraphicsPipelineDesc desc;
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        bool compiling = false;
+        bool failed = false;  // Keeps using the fallback instead of retrying every frame
+    };
+
+    // SPIR-V of one shader file and its content hash, loaded once
+    struct ShaderCode {
+        std::vector<char> code;
+        uint64_t hash = 0;
+    };
+
+    VulkanRenderer* renderer;
+    VkDevice device;
+    ThreadPool* threadPool;
+
+    std::mutex mutex;
+    std::condition_variable compileCondition;
+    uint32_t compilesInFlight = 0;
+    std::unordered_map<uint64_t, std::vector<Entry>> pipelines;
+    std::unordered_map<std::string, ShaderCode> shaders;
+
+    // Must be called with the mutex held; entries are never removed, so the
+    // reference stays valid after unlocking
+    const ShaderCode& getShader(const std::string& path);
+
+    // The entry for desc under key, created if missing. Must be called with the
+    // mutex held, and looked up again after unlocking: a bucket may grow meanwhile
+    Entry& findEntry(uint64_t key, const GraphicsPipelineDesc& desc);
+
+    VkPipeline compile(const GraphicsPipelineDesc& desc, const ShaderCode& vertexCode,
+                       const ShaderCode& fragmentCode);
+};
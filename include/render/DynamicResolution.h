@@ -0,0 +1,69 @@
+﻿#pragma once
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <cstdint>
+
+// Forward declarations
+class VulkanRenderer;
+
+// Picks the resolution the scene renders at to hold a GPU frame time.
+//
+// Every frame's command buffer is bracketed by two timestamps. Once the frame's
+// slot comes round again (after FrameContext::wait) its GPU time is read back and
+// turned into an estimate of what the frame would cost at full resolution, taking
+// cost to follow the pixel count. The scale is the one that estimate says fits the
+// target; it only moves in SCALE_STEP steps, so it doesn't hop between two sizes.
+//
+// Scaled frames draw into the top-left of full-size targets (RenderGraph render
+// areas), so a new scale never reallocates anything.
+class DynamicResolution {
+public:
+    // Per axis
+    static constexpr float MIN_SCALE = 0.5f;
+    static constexpr float MAX_SCALE = 1.0f;
+    static constexpr float SCALE_STEP = 0.05f;
+    // Aim below the target, GPU time isn't all that's in a frame
+    static constexpr float HEADROOM = 0.9f;
+
+    DynamicResolution(VulkanRenderer* renderer, uint32_t framesInFlight, uint32_t queueFamilyIndex);
+    ~DynamicResolution();
+
+    DynamicResolution(const DynamicResolution&) = delete;
+    DynamicResolution& operator=(const DynamicResolution&) = delete;
+
+    // Disabled, frames still get timed but always render at full resolution
+    void setEnabled(bool enabled) { this->enabled = enabled; }
+    bool isEnabled() const { return enabled && supported; }
+    void setTargetFrameTime(float milliseconds) { targetFrameTime = milliseconds; }
+
+    // Read back the last GPU time of this frame slot and pick the scale
+    void update(uint32_t frameIndex);
+
+    // First and last commands of the frame's command buffer
+    void recordBegin(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+    void recordEnd(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+    // Size the scene renders at this frame, never larger than the output
+    VkExtent2D getRenderExtent(VkExtent2D outputExtent) const;
+
+    float getScale() const { return scale; }
+    float getGpuFrameTime() const { return gpuFrameTime; }  // Milliseconds, 0 until measured
+
+private:
+    VulkanRenderer* renderer;
+    VkDevice device;
+
+    // Two timestamps per frame in flight
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    std::vector<bool> pending;          // Timestamps written and not read back yet
+    std::vector<float> frameScales;     // Scale each slot's frame rendered at
+    bool supported = false;
+    float timestampPeriod = 1.0f;       // Nanoseconds per tick
+    uint64_t timestampMask = ~0ull;
+
+    bool enabled = false;
+    float targetFrameTime = 1000.0f / 60.0f;
+    float scale = MAX_SCALE;
+    float gpuFrameTime = 0.0f;
+    float fullResolutionTime = 0.0f;    // Smoothed estimate at scale 1
+};
@@ -0,0 +1,61 @@
+﻿#pragma once
+#include <vulkan/vulkan.h>
+#include <memory>
+#include <cstdint>
+
+#include "LinearAllocator.h"
+
+// Forward declarations
+class VulkanRenderer;
+
+// Everything one frame in flight records into and keeps alive until its
+// submission completes: a command pool and buffer, the acquire/present
+// semaphores, a pool for transient descriptor sets and a linear allocator for
+// per-draw data.
+//
+// The renderer cycles through framesInFlight of these. Completion is tracked by
+// the renderer's GpuTimeline value for the frame's submission. Once wait()
+// returns, all of it is recycled wholesale - nothing transient is freed
+// individually.
+class FrameContext {
+public:
+    // Transient descriptor sets per frame (one per non-bindless textured draw)
+    static constexpr uint32_t MAX_TRANSIENT_SETS = 4096;
+    static constexpr uint32_t MAX_TRANSIENT_STORAGE_IMAGES = 16;
+
+    FrameContext(VulkanRenderer* renderer, VkDeviceSize transientCapacity);
+    ~FrameContext();
+
+    FrameContext(const FrameContext&) = delete;
+    FrameContext& operator=(const FrameContext&) = delete;
+
+    // Block until the previous submission from this frame has finished, then reset
+    // the command pool, transient descriptor sets and transient memory
+    void wait();
+
+    // Timeline value of the frame's latest submission
+    void setSubmitValue(uint64_t value) { submitValue = value; }
+    uint64_t getSubmitValue() const { return submitValue; }
+
+    // Returns VK_NULL_HANDLE when the frame ran out of transient sets
+    VkDescriptorSet allocateDescriptorSet(VkDescriptorSetLayout layout);
+
+    VkCommandBuffer getCommandBuffer() const { return commandBuffer; }
+    VkSemaphore getImageAvailableSemaphore() const { return imageAvailableSemaphore; }
+    VkSemaphore getRenderFinishedSemaphore() const { return renderFinishedSemaphore; }
+    LinearAllocator& getTransientAllocator() { return *transientAllocator; }
+
+private:
+    VulkanRenderer* renderer;
+    VkDevice device;
+
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+
+    VkSemaphore imageAvailableSemaphore = VK_NULL_HANDLE;
+    VkSemaphore renderFinishedSemaphore = VK_NULL_HANDLE;
+    uint64_t submitValue = 0;
+
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    std::unique_ptr<LinearAllocator> transientAllocator;
+};
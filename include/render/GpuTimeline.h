@@ -0,0 +1,58 @@
+﻿#pragma once
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+// Monotonic count of the work submitted to one queue, backed by a timeline semaphore.
+//
+// Every submit() signals the next value. Since a signal covers everything
+// submitted to the queue before it, "value N is complete" means all work up to
+// and including submission N has finished. Systems keep the value of the work
+// they care about and poll isComplete() (a counter read, no fences) or wait()
+// for exactly that work instead of draining the queue.
+class GpuTimeline {
+public:
+    // A semaphore a submission waits on: a value of another timeline (e.g. async
+    // compute), or a binary semaphore (the swapchain), whose value is ignored
+    struct Wait {
+        VkSemaphore semaphore = VK_NULL_HANDLE;
+        uint64_t value = 0;
+        VkPipelineStageFlags stageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    };
+
+    GpuTimeline(VkDevice device, VkQueue queue);
+    ~GpuTimeline();
+
+    GpuTimeline(const GpuTimeline&) = delete;
+    GpuTimeline& operator=(const GpuTimeline&) = delete;
+
+    // Thread-safe; returns the value the submission signals. Binary signals are
+    // only for presentation, which can't wait on a timeline.
+    uint64_t submit(const VkCommandBuffer* commandBuffers, uint32_t commandBufferCount,
+                    const std::vector<Wait>& waits = {},
+                    const std::vector<VkSemaphore>& binarySignals = {});
+    uint64_t submit(VkCommandBuffer commandBuffer) { return submit(&commandBuffer, 1); }
+
+    // Value 0 is always complete
+    bool isComplete(uint64_t value);
+    void wait(uint64_t value);
+
+    uint64_t getSubmittedValue() const { return submittedValue.load(); }
+    uint64_t getCompletedValue();
+
+    // For submissions to another queue that depend on this one
+    Wait makeWait(uint64_t value, VkPipelineStageFlags stageMask) const { return { semaphore, value, stageMask }; }
+
+private:
+    VkDevice device;
+    VkQueue queue;
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+
+    std::mutex submitMutex;  // Values must reach the queue in order
+    std::atomic<uint64_t> submittedValue{ 0 };
+    std::atomic<uint64_t> completedValue{ 0 };  // Last value read back; most polls stop here
+
+    void updateCompleted(uint64_t value);
+};
@@ -0,0 +1,37 @@
+﻿#pragma once
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// Lights as the fragment shaders see them (set 1, mirrored by shaders/lighting.glsl).
+// LightingData is binding 0, written into each frame's transient memory; the
+// lights themselves are a storage buffer (binding 3) filled by LightCuller.
+namespace Lighting {
+    // Lights shaded per frame, directional and local
+    static constexpr uint32_t MAX_LIGHTS = 4096;
+    // The first lights of a snapshot that can get shadow maps
+    static constexpr uint32_t MAX_SHADOWED_LIGHTS = 16;
+    // Layers of each shadow map array
+    static constexpr uint32_t MAX_SHADOW_MAPS = 16;
+    // Shadow maps per directional light; spot lights use one
+    static constexpr uint32_t CASCADE_COUNT = 4;
+}
+
+// std430 element of the light buffer
+struct GpuLight {
+    glm::vec4 position;   // xyz world position, w light type (LightType)
+    glm::vec4 color;      // rgb color, a intensity
+    glm::vec4 direction;  // xyz normalized direction, w range
+    glm::vec4 params;     // x cos(inner angle), y cos(outer angle), z first shadow map (-1 for none)
+};
+
+struct LightingData {
+    // World space to shadow map UV and depth, per shadow map layer
+    glm::mat4 shadowMatrices[Lighting::MAX_SHADOW_MAPS];
+    // View-space distance where each cascade ends
+    glm::vec4 cascadeSplits;
+    // x light count, y bit per shadow map sampled from the composited array,
+    // z directional lights (the first ones, never culled)
+    glm::uvec4 counts;
+    // Cluster of a fragment (LightCuller::getClusterParams)
+    glm::vec4 clusterParams;
+};
@@ -0,0 +1,49 @@
+﻿#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+
+// Forward declarations
+class VulkanRenderer;
+
+// Persistently mapped, host-visible buffer handed out front to back and freed
+// all at once.
+//
+// Each frame in flight owns one for its transient uniform and instance data and
+// resets it after the frame's fence has signaled, so per-draw data never needs
+// its own buffer or a free. Not thread-safe; only the render thread records.
+class LinearAllocator {
+public:
+    struct Allocation {
+        unsigned char* data = nullptr;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+
+        bool isValid() const { return data != nullptr; }
+    };
+
+    LinearAllocator(VulkanRenderer* renderer, VkDeviceSize capacity, VkBufferUsageFlags usage);
+    ~LinearAllocator();
+
+    LinearAllocator(const LinearAllocator&) = delete;
+    LinearAllocator& operator=(const LinearAllocator&) = delete;
+
+    // alignment must be a power of two; returns an invalid allocation when full
+    Allocation allocate(VkDeviceSize size, VkDeviceSize alignment);
+
+    // Only once the GPU is done with everything allocated since the last reset
+    void reset();
+
+    VkBuffer getBuffer() const { return buffer; }
+    VkDeviceSize getCapacity() const { return capacity; }
+    VkDeviceSize getUsed() const { return head; }
+
+private:
+    VulkanRenderer* renderer;
+    VkDeviceSize capacity;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    unsigned char* mapped = nullptr;
+
+    VkDeviceSize head = 0;          // Where the next allocation starts
+    bool overflowReported = false;  // Warn once, not every frame
+};
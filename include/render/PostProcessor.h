@@ -0,0 +1,82 @@
+﻿#pragma once
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+
+#include "RenderGraph.h"
+#include "../pipeline/PipelineLibrary.h"
+
+// Forward declarations
+class VulkanRenderer;
+class FrameContext;
+
+// Resolves the HDR scene color into the swapchain image: exposure, ACES tonemap,
+// saturation and gamma in a single pass, so the frame only crosses the full screen
+// once after lighting.
+//
+// When the swapchain can be written as a storage image (a UNORM format) this is one
+// compute dispatch writing it directly, with gamma applied in the shader. Otherwise
+// a fullscreen triangle (shaders/tonemapping.frag) renders into it as a color
+// attachment, and an sRGB swapchain does the gamma encode.
+//
+// The scene may only cover the top-left of its image (dynamic resolution); the
+// pass upscales that part to the whole output with bilinear filtering.
+class PostProcessor {
+public:
+    struct Settings {
+        float exposure = 1.0f;
+        float gamma = 2.2f;       // Ignored when the output format is sRGB
+        float saturation = 1.0f;
+    };
+
+    PostProcessor(VulkanRenderer* renderer, VkFormat outputFormat, bool storageOutput);
+    ~PostProcessor();
+
+    PostProcessor(const PostProcessor&) = delete;
+    PostProcessor& operator=(const PostProcessor&) = delete;
+
+    // The swapchain was recreated; rebuilds the fallback pass if its format changed
+    void setOutput(VkFormat outputFormat, bool storageOutput);
+
+    // Declare the pass that reads the sceneExtent part of sceneColor and overwrites output
+    void addPass(RenderGraph& graph, FrameContext& frame, RenderGraph::ImageHandle sceneColor,
+                 VkExtent2D sceneExtent, RenderGraph::ImageHandle output);
+
+    Settings& getSettings() { return settings; }
+    bool isCompute() const { return storageOutput; }
+
+private:
+    // Same layout as the push constants of both shaders
+    struct PushConstants {
+        float exposure;
+        float gamma;
+        float saturation;
+        float padding;
+        glm::vec2 uvScale;  // Output UV to the scene's part of its image
+        glm::vec2 uvMax;    // Last texel center of that part, so filtering stays inside
+    };
+
+    static constexpr uint32_t GROUP_SIZE = 8;
+
+    VulkanRenderer* renderer;
+    VkDevice device;
+    Settings settings;
+    VkFormat outputFormat = VK_FORMAT_UNDEFINED;
+    bool storageOutput = false;
+
+    // Compute path: scene color (sampled) and the output (storage image)
+    VkDescriptorSetLayout computeSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout computePipelineLayout = VK_NULL_HANDLE;
+    VkPipeline computePipeline = VK_NULL_HANDLE;
+
+    // Fullscreen path; the render pass only exists for pipeline compatibility
+    VkDescriptorSetLayout fullscreenSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout fullscreenPipelineLayout = VK_NULL_HANDLE;
+    VkRenderPass fullscreenRenderPass = VK_NULL_HANDLE;
+    GraphicsPipelineDesc fullscreenDesc;
+
+    void createLayouts();
+    void createComputePipeline();
+    void createFullscreenPipeline();
+    PushConstants getPushConstants(VkExtent2D sceneExtent, VkExtent2D imageExtent) const;
+    static bool isSrgb(VkFormat format);
+};
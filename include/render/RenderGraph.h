@@ -0,0 +1,261 @@
+﻿#pragma once
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <functional>
+#include <unordered_map>
+#include <cstdint>
+
+// Forward declarations
+class VulkanRenderer;
+
+// Frame graph: passes declare which images and buffers they read and write, and
+// the graph works out everything between them.
+//
+// Rebuilt every frame: reset(), import/create resources, add passes, compile(),
+// execute(). Compiling
+//   - culls passes whose results nothing reads (imported resources always count
+//     as read; passes marked with sideEffects() are always kept),
+//   - derives one merged vkCmdPipelineBarrier per pass from the declared
+//     accesses: layout transitions, write->read and write->write hazards, and
+//     execution-only dependencies for write-after-read; reads of data already
+//     visible to a stage get no barrier at all,
+//   - picks attachment store ops (DONT_CARE when nothing reads the result),
+//   - places transient images: images whose pass ranges don't overlap share
+//     memory, so a chain of passes costs only its widest point in VRAM.
+// Passes run in declaration order, which is always a valid order since a pass
+// can only read what an earlier pass declared.
+//
+// Render passes, framebuffers and transient images are cached across frames.
+// Render passes are single-subpass with every attachment in its optimal layout,
+// so pipelines built against a compatible VkRenderPass (same formats) work in
+// graph passes. Viewport and scissor are set to the attachment size, or to the
+// pass's render area when it draws to only part of its attachments.
+class RenderGraph {
+public:
+    struct ImageHandle {
+        uint32_t index = UINT32_MAX;
+        bool isValid() const { return index != UINT32_MAX; }
+    };
+
+    struct BufferHandle {
+        uint32_t index = UINT32_MAX;
+        bool isValid() const { return index != UINT32_MAX; }
+    };
+
+    // Graph-owned image that only lives for the frame
+    struct ImageDesc {
+        VkExtent2D extent{};
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        uint32_t mipLevels = 1;
+    };
+
+    // Where an imported resource comes from: its layout, and the stages and
+    // writes the graph's first access must wait for. Without write access the
+    // stages are reads, which later reads needn't wait for
+    struct ResourceState {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        VkAccessFlags access = 0;
+    };
+
+    enum class PassType {
+        Graphics,
+        Compute,
+        Transfer
+    };
+
+    class PassBuilder {
+    public:
+        PassBuilder& colorAttachment(ImageHandle image, VkAttachmentLoadOp loadOp,
+                                     VkClearColorValue clear = {});
+        PassBuilder& depthAttachment(ImageHandle image, VkAttachmentLoadOp loadOp,
+                                     VkClearDepthStencilValue clear = { 1.0f, 0 });
+        // Sampled read; depth formats default to DEPTH_STENCIL_READ_ONLY_OPTIMAL
+        PassBuilder& readImage(ImageHandle image, VkPipelineStageFlags stages,
+                               VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED);
+        // Storage image write (GENERAL); every level is overwritten, so the previous
+        // contents are discarded
+        PassBuilder& writeImage(ImageHandle image, VkPipelineStageFlags stages);
+        // Copy source / destination of transfer commands; the destination is
+        // overwritten completely
+        PassBuilder& transferRead(ImageHandle image);
+        PassBuilder& transferWrite(ImageHandle image);
+        PassBuilder& readBuffer(BufferHandle buffer, VkPipelineStageFlags stages, VkAccessFlags access);
+        PassBuilder& writeBuffer(BufferHandle buffer, VkPipelineStageFlags stages, VkAccessFlags access);
+        // Never culled, even when nothing reads what it writes
+        PassBuilder& sideEffects();
+        // Draw only the top-left extent of the attachments (dynamic resolution).
+        // Clears and stores are limited to it; the rest keeps whatever it held
+        PassBuilder& renderArea(VkExtent2D extent);
+
+    private:
+        friend class RenderGraph;
+        PassBuilder(RenderGraph* graph, uint32_t pass) : graph(graph), pass(pass) {}
+        RenderGraph* graph;
+        uint32_t pass;
+    };
+
+    using ExecuteFn = std::function<void(VkCommandBuffer)>;
+
+    explicit RenderGraph(VulkanRenderer* renderer);
+    ~RenderGraph();
+
+    RenderGraph(const RenderGraph&) = delete;
+    RenderGraph& operator=(const RenderGraph&) = delete;
+
+    // Start declaring a new frame
+    void reset();
+
+    ImageHandle createImage(const std::string& name, const ImageDesc& desc);
+    // finalLayout UNDEFINED means the contents aren't needed after the graph and
+    // the image is left in whatever layout its last pass used. Layers of an array
+    // image are imported one at a time, each with a view of just that layer.
+    ImageHandle importImage(const std::string& name, VkImage image, VkImageView view, VkFormat format,
+                            VkExtent2D extent, const ResourceState& initialState,
+                            VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED, uint32_t mipLevels = 1,
+                            uint32_t arrayLayer = 0);
+    // stages/access: the last use before the graph (the layout is ignored)
+    BufferHandle importBuffer(const std::string& name, VkBuffer buffer,
+                              VkPipelineStageFlags stages, VkAccessFlags access);
+
+    // The execute callback runs inside the render pass for graphics passes
+    PassBuilder addPass(const std::string& name, PassType type, ExecuteFn execute);
+
+    void compile();
+    void execute(VkCommandBuffer commandBuffer);
+
+    // Valid inside execute callbacks (transient images exist once compiled)
+    VkImage getImage(ImageHandle handle) const { return images[handle.index].image; }
+    VkImageView getImageView(ImageHandle handle) const { return images[handle.index].view; }
+    VkExtent2D getImageExtent(ImageHandle handle) const { return images[handle.index].extent; }
+
+    // Framebuffers name image views; drop them before those views are destroyed
+    void releaseFramebuffers();
+
+    uint32_t getCulledPassCount() const { return culledPassCount; }
+    uint32_t getBarrierCount() const { return barrierCount; }
+    VkDeviceSize getTransientMemorySize() const { return transientMemorySize; }
+
+private:
+    struct ImageResource {
+        std::string name;
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        VkExtent2D extent{};
+        uint32_t mipLevels = 1;
+        uint32_t arrayLayer = 0;
+        bool imported = false;
+        ResourceState initialState;
+        VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImageUsageFlags usage = 0;     // Transient images: every use declared this frame
+        uint32_t firstPass = UINT32_MAX; // Lifetime over the passes that survive culling
+        uint32_t lastPass = 0;
+        uint32_t memoryBlock = UINT32_MAX;
+    };
+
+    struct BufferResource {
+        std::string name;
+        VkBuffer buffer = VK_NULL_HANDLE;
+        ResourceState initialState;
+    };
+
+    struct Access {
+        uint32_t resource;
+        bool isImage;
+        bool write;
+        VkPipelineStageFlags stages;
+        VkAccessFlags access;
+        VkImageLayout layout;
+        bool discard;  // Write that doesn't need the previous contents
+    };
+
+    struct Attachment {
+        uint32_t image;
+        VkAttachmentLoadOp loadOp;
+        VkAttachmentStoreOp storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        VkClearValue clear;
+        bool depth;
+    };
+
+    struct Pass {
+        std::string name;
+        PassType type;
+        ExecuteFn execute;
+        std::vector<Access> accesses;
+        std::vector<Attachment> attachments;
+        bool sideEffects = false;
+        bool culled = false;
+        VkExtent2D renderArea{};  // Empty: the whole attachment
+
+        // Filled by compile()
+        std::vector<VkImageMemoryBarrier> imageBarriers;
+        VkMemoryBarrier memoryBarrier{};
+        VkPipelineStageFlags srcStages = 0;
+        VkPipelineStageFlags dstStages = 0;
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+        VkFramebuffer framebuffer = VK_NULL_HANDLE;
+        VkExtent2D extent{};
+    };
+
+    // Hazard tracking while compiling, per resource
+    struct TrackedState {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags writeStages = 0;   // Last write (or layout transition)
+        VkAccessFlags writeAccess = 0;
+        VkPipelineStageFlags readStages = 0;    // Reads since that write
+        VkPipelineStageFlags visibleStages = 0; // Where the write is already visible
+        VkAccessFlags visibleAccess = 0;
+    };
+
+    // Memory shared by transient images with disjoint lifetimes
+    struct MemoryBlock {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        uint32_t memoryTypeIndex = 0;
+        uint32_t lastPass = 0;
+        // Last use of the memory by any image, this frame or the one before
+        VkPipelineStageFlags lastStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        VkAccessFlags lastAccess = 0;
+    };
+
+    // Transient images and their memory, kept while the frame's declarations match
+    struct TransientCache {
+        uint64_t key = 0;
+        std::vector<VkImage> images;
+        std::vector<VkImageView> views;
+        std::vector<uint32_t> blocks;   // Memory block of each image
+        std::vector<MemoryBlock> memoryBlocks;
+    };
+
+    VulkanRenderer* renderer;
+    VkDevice device;
+
+    std::vector<ImageResource> images;
+    std::vector<BufferResource> buffers;
+    std::vector<Pass> passes;
+    // Imported images handed back in their final layout after the last pass
+    std::vector<VkImageMemoryBarrier> finalBarriers;
+    VkPipelineStageFlags finalSrcStages = 0;
+
+    std::unordered_map<uint64_t, VkRenderPass> renderPasses;
+    std::unordered_map<uint64_t, VkFramebuffer> framebuffers;
+    TransientCache transients;
+
+    uint32_t culledPassCount = 0;
+    uint32_t barrierCount = 0;
+    VkDeviceSize transientMemorySize = 0;
+
+    void cullPasses();
+    void placeTransients();
+    void destroyTransients();
+    void buildBarriers();
+    static TrackedState getInitialState(const ResourceState& initialState);
+    void addAccessBarrier(Pass& pass, const Access& access, TrackedState& state, const ImageResource* image);
+    VkRenderPass getRenderPass(const Pass& pass);
+    VkFramebuffer getFramebuffer(const Pass& pass);
+
+    static bool isDepthFormat(VkFormat format);
+    static VkImageAspectFlags getAspect(VkFormat format);
+};
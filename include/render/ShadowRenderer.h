@@ -0,0 +1,136 @@
+﻿#pragma once
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "Lighting.h"
+#include "RenderGraph.h"
+#include "../pipeline/PipelineLibrary.h"
+#include "../texture/SamplerCache.h"
+#include "../scene/FrameSnapshot.h"
+
+// Forward declarations
+class VulkanRenderer;
+
+// Shadow maps for directional lights (CASCADE_COUNT cascades each) and spot lights.
+//
+// Every map is one layer of two depth arrays. The static array caches what static
+// geometry (the Static component) casts, and a layer is only re-rendered when its
+// light changes, its cascade has to follow the camera out of the padded region it
+// covers, or a static caster inside it changes. Maps that moving geometry casts
+// into also get a layer in the composite array each frame: a copy of the cached
+// layer with the moving casters drawn on top. Maps nothing moves in are sampled
+// straight from the cache, so a still scene renders no shadow geometry at all.
+class ShadowRenderer {
+public:
+    // Each array takes MAP_SIZE^2 * MAX_SHADOW_MAPS * 2 bytes (32 MB)
+    static constexpr uint32_t MAP_SIZE = 1024;
+    static constexpr VkFormat FORMAT = VK_FORMAT_D16_UNORM;
+    // Cascades split the view up to here, or up to the far plane if it's closer
+    static constexpr float MAX_CASCADE_DISTANCE = 100.0f;
+    // A cascade covers this much more than its slice of the view, so the camera
+    // can move for a while before the cached map has to be re-rendered
+    static constexpr float CASCADE_PADDING = 1.5f;
+
+    explicit ShadowRenderer(VulkanRenderer* renderer);
+    ~ShadowRenderer();
+
+    ShadowRenderer(const ShadowRenderer&) = delete;
+    ShadowRenderer& operator=(const ShadowRenderer&) = delete;
+
+    // Comparison sampler both arrays are read with (2x2 PCF, lit outside the map)
+    static SamplerDesc getSamplerDesc();
+
+    // Give this frame's lights their maps and work out which need rendering.
+    // Point lights, lights past Lighting::MAX_SHADOWED_LIGHTS and lights past the
+    // free maps cast no shadow.
+    void update(const FrameSnapshot& snapshot, float aspectRatio);
+
+    // Declare the frame's shadow passes. Returns every layer the lighting set
+    // samples; lit passes declare them with readImage(FRAGMENT_SHADER).
+    std::vector<RenderGraph::ImageHandle> addPasses(RenderGraph& graph, const FrameSnapshot& snapshot);
+
+    // Shadow matrices, cascade splits and the composited-map mask of LightingData
+    void fillLightingData(LightingData& data) const;
+
+    // First map of snapshot light i (its cascades follow), -1 without one
+    int32_t getShadowMap(size_t lightIndex) const {
+        return lightIndex < lightShadowMaps.size() ? lightShadowMaps[lightIndex] : -1;
+    }
+
+    VkImageView getStaticArrayView() const { return staticArrayView; }
+    VkImageView getCompositeArrayView() const { return compositeArrayView; }
+
+    // Work done for shadows this frame
+    uint32_t getStaticRenderCount() const { return staticRenderCount; }
+    uint32_t getCompositeCount() const { return compositeCount; }
+
+private:
+    struct ShadowMap {
+        bool assigned = false;
+        uint64_t lightId = 0;
+        LightType type = LightType::Directional;
+        uint32_t cascade = 0;
+
+        // What the cached static layer was rendered with
+        bool cached = false;
+        uint64_t lightHash = 0;
+        uint64_t staticVersion = 0;
+        uint64_t casterHash = 0;
+        glm::mat4 viewProj = glm::mat4(1.0f);
+        // Cascades: the sphere the map covers and its depth range along the light
+        glm::vec3 center = glm::vec3(0.0f);
+        float radius = 0.0f;
+        float depthNear = 0.0f;
+        float depthFar = 0.0f;
+
+        // This frame
+        bool renderStatic = false;
+        std::vector<uint32_t> staticCasters;
+        std::vector<uint32_t> dynamicCasters;
+    };
+
+    VulkanRenderer* renderer;
+    VkDevice device;
+
+    // Both arrays always rest in DEPTH_STENCIL_READ_ONLY_OPTIMAL between frames
+    VkImage staticImage = VK_NULL_HANDLE;
+    VkDeviceMemory staticMemory = VK_NULL_HANDLE;
+    VkImage compositeImage = VK_NULL_HANDLE;
+    VkDeviceMemory compositeMemory = VK_NULL_HANDLE;
+    VkImageView staticArrayView = VK_NULL_HANDLE;
+    VkImageView compositeArrayView = VK_NULL_HANDLE;
+    // One view per layer, rendered to as a framebuffer attachment
+    std::array<VkImageView, Lighting::MAX_SHADOW_MAPS> staticLayerViews{};
+    std::array<VkImageView, Lighting::MAX_SHADOW_MAPS> compositeLayerViews{};
+
+    // Depth-only pipeline; the render pass only exists for pipeline compatibility
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    GraphicsPipelineDesc pipelineDesc;
+
+    std::array<ShadowMap, Lighting::MAX_SHADOW_MAPS> maps;
+    std::vector<int32_t> lightShadowMaps;
+    glm::vec4 cascadeSplits = glm::vec4(0.0f);
+
+    uint32_t staticRenderCount = 0;
+    uint32_t compositeCount = 0;
+
+    void createImages();
+    void createPipeline();
+    VkImage createArrayImage(VkDeviceMemory& memory);
+    VkImageView createView(VkImage image, VkImageViewType viewType, uint32_t firstLayer, uint32_t layerCount);
+
+    void assignMaps(const FrameSnapshot& snapshot);
+    // Fit a cascade to its slice of the view; returns true when the cached map no
+    // longer covered it (or force is set) and had to be moved
+    bool placeCascade(ShadowMap& map, const LightInstance& light, const FrameSnapshot& snapshot,
+                      float aspectRatio, const AABB& sceneBounds, bool force);
+    void placeSpot(ShadowMap& map, const LightInstance& light);
+    // Dynamic casters every frame, static ones (and renderStatic) when they may have changed
+    void findCasters(ShadowMap& map, const FrameSnapshot& snapshot, bool moved);
+    void drawCasters(VkCommandBuffer commandBuffer, VkPipeline pipeline, const ShadowMap& map,
+                     const std::vector<uint32_t>& casters, const FrameSnapshot& snapshot) const;
+};
@@ -0,0 +1,78 @@
+﻿#pragma once
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <glm/ext/matrix_transform.hpp>
+
+#include "../culling/Bounds.h"
+
+#include "EntityRegistry.h"
+
+// Forward declarations
+class Mesh;
+
+// Local transform of an entity
+struct Transform {
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 rotation = glm::vec3(0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+    
+    glm::mat4 getModelMatrix() const {
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, position);
+        model = glm::rotate(model, rotation.x, glm::vec3(1.0f, 0.0f, 0.0f));
+        model = glm::rotate(model, rotation.y, glm::vec3(0.0f, 1.0f, 0.0f));
+        model = glm::rotate(model, rotation.z, glm::vec3(0.0f, 0.0f, 1.0f));
+        model = glm::scale(model, scale);
+        return model;
+    }
+};
+
+// Model matrix resolved from the Transform once per update
+struct WorldMatrix {
+    glm::mat4 matrix = glm::mat4(1.0f);
+};
+
+// Mesh drawn by an entity. The pointer is owned by the scene's mesh table,
+// meshIndex is the entry in that table.
+struct Renderable {
+    Mesh* mesh = nullptr;
+    uint32_t meshIndex = 0;
+};
+
+// World-space bounds of a renderable, refreshed whenever its WorldMatrix changes
+struct WorldBounds {
+    AABB aabb;
+};
+
+// Parent in the scene hierarchy; the entity's Transform is relative to it
+struct Parent {
+    Entity entity;
+};
+
+// Geometry that doesn't move. Shadow maps keep it cached and only re-render it
+// when a static entity changes (FrameSnapshot::staticVersion); the demo
+// animation in Scene::update leaves it alone.
+struct Static {
+    glm::mat4 lastMatrix = glm::mat4(0.0f);  // World matrix seen by the last update
+};
+
+enum class LightType : uint32_t {
+    Directional = 0,
+    Spot = 1,
+    Point = 2   // Casts no shadows
+};
+
+// Light at the entity's world position, shining along direction (rotated by the
+// entity's world matrix)
+struct Light {
+    LightType type = LightType::Directional;
+    glm::vec3 color = glm::vec3(1.0f);
+    float intensity = 1.0f;
+    glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+    // Spot and point lights: reach. Spot lights: cone half-angles in radians
+    // (full intensity inside innerAngle, fading out towards outerAngle)
+    float range = 10.0f;
+    float innerAngle = 0.3f;
+    float outerAngle = 0.5f;
+    bool castShadows = true;
+};
@@ -0,0 +1,235 @@
+﻿#pragma once
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cassert>
+
+// Stable handle to an entity. The generation invalidates handles of destroyed
+// entities whose slot has been reused.
+struct Entity {
+    uint32_t index = UINT32_MAX;
+    uint32_t generation = 0;
+
+    bool isValid() const { return index != UINT32_MAX; }
+    bool operator==(const Entity& other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const Entity& other) const { return !(*this == other); }
+};
+
+class ComponentPoolBase {
+public:
+    virtual ~ComponentPoolBase() = default;
+    virtual void remove(uint32_t entityIndex) = 0;
+    virtual bool has(uint32_t entityIndex) const = 0;
+};
+
+// Sparse set: components live packed in a dense array, the sparse array maps an
+// entity index to its slot. Iterating a pool touches only that component type.
+template<typename T>
+class ComponentPool : public ComponentPoolBase {
+public:
+    static constexpr uint32_t INVALID_SLOT = UINT32_MAX;
+
+    T& add(uint32_t entityIndex, const T& value) {
+        if (entityIndex >= sparse.size()) {
+            sparse.resize(entityIndex + 1, INVALID_SLOT);
+        }
+        if (sparse[entityIndex] != INVALID_SLOT) {
+            dense[sparse[entityIndex]] = value;
+            return dense[sparse[entityIndex]];
+        }
+
+        sparse[entityIndex] = static_cast<uint32_t>(dense.size());
+        denseEntities.push_back(entityIndex);
+        dense.push_back(value);
+        return dense.back();
+    }
+
+    // Swap-remove keeps the dense array packed
+    void remove(uint32_t entityIndex) override {
+        if (!has(entityIndex)) {
+            return;
+        }
+
+        uint32_t slot = sparse[entityIndex];
+        uint32_t lastSlot = static_cast<uint32_t>(dense.size() - 1);
+        if (slot != lastSlot) {
+            dense[slot] = std::move(dense[lastSlot]);
+            denseEntities[slot] = denseEntities[lastSlot];
+            sparse[denseEntities[slot]] = slot;
+        }
+        dense.pop_back();
+        denseEntities.pop_back();
+        sparse[entityIndex] = INVALID_SLOT;
+    }
+
+    bool has(uint32_t entityIndex) const override {
+        return entityIndex < sparse.size() && sparse[entityIndex] != INVALID_SLOT;
+    }
+
+    T& get(uint32_t entityIndex) {
+        assert(has(entityIndex));
+        return dense[sparse[entityIndex]];
+    }
+
+    const T& get(uint32_t entityIndex) const {
+        assert(has(entityIndex));
+        return dense[sparse[entityIndex]];
+    }
+
+    void clear() {
+        sparse.clear();
+        dense.clear();
+        denseEntities.clear();
+    }
+
+    void reserve(size_t count) {
+        dense.reserve(count);
+        denseEntities.reserve(count);
+    }
+
+    size_t size() const { return dense.size(); }
+
+    // Packed component array and the entity index owning each element
+    std::vector<T>& components() { return dense; }
+    const std::vector<T>& components() const { return dense; }
+    const std::vector<uint32_t>& entities() const { return denseEntities; }
+
+private:
+    std::vector<uint32_t> sparse;
+    std::vector<uint32_t> denseEntities;
+    std::vector<T> dense;
+};
+
+class EntityRegistry {
+public:
+    Entity create() {
+        Entity entity;
+        if (!freeIndices.empty()) {
+            entity.index = freeIndices.back();
+            freeIndices.pop_back();
+        } else {
+            entity.index = static_cast<uint32_t>(generations.size());
+            generations.push_back(0);
+        }
+        entity.generation = generations[entity.index];
+        aliveCount++;
+        return entity;
+    }
+
+    void destroy(Entity entity) {
+        if (!isAlive(entity)) {
+            return;
+        }
+        for (auto& pool : pools) {
+            if (pool) {
+                pool->remove(entity.index);
+            }
+        }
+        generations[entity.index]++;
+        freeIndices.push_back(entity.index);
+        aliveCount--;
+    }
+
+    bool isAlive(Entity entity) const {
+        return entity.index < generations.size() && generations[entity.index] == entity.generation;
+    }
+
+    // Handle for an entity index found while iterating a pool
+    Entity getEntity(uint32_t entityIndex) const {
+        Entity entity;
+        entity.index = entityIndex;
+        entity.generation = generations[entityIndex];
+        return entity;
+    }
+
+    size_t getEntityCount() const { return aliveCount; }
+
+    template<typename T>
+    T& add(Entity entity, const T& value = T()) {
+        assert(isAlive(entity));
+        return pool<T>().add(entity.index, value);
+    }
+
+    template<typename T>
+    void remove(Entity entity) {
+        if (isAlive(entity)) {
+            pool<T>().remove(entity.index);
+        }
+    }
+
+    template<typename T>
+    bool has(Entity entity) const {
+        const ComponentPool<T>* existing = findPool<T>();
+        return isAlive(entity) && existing && existing->has(entity.index);
+    }
+
+    template<typename T>
+    T& get(Entity entity) {
+        assert(isAlive(entity));
+        return pool<T>().get(entity.index);
+    }
+
+    template<typename T>
+    ComponentPool<T>& pool() {
+        uint32_t id = componentTypeId<T>();
+        if (id >= pools.size()) {
+            pools.resize(id + 1);
+        }
+        if (!pools[id]) {
+            pools[id] = std::make_unique<ComponentPool<T>>();
+        }
+        return *static_cast<ComponentPool<T>*>(pools[id].get());
+    }
+
+    // Visit every entity owning all listed components. Iteration walks the first
+    // component's dense array, so list the component that drives the loop first.
+    template<typename First, typename... Others, typename Func>
+    void each(Func func) {
+        ComponentPool<First>& firstPool = pool<First>();
+        auto& components = firstPool.components();
+        const auto& entities = firstPool.entities();
+
+        for (size_t i = 0; i < components.size(); i++) {
+            uint32_t entityIndex = entities[i];
+            if (!(pool<Others>().has(entityIndex) && ...)) {
+                continue;
+            }
+            func(entityIndex, components[i], pool<Others>().get(entityIndex)...);
+        }
+    }
+
+    void clear() {
+        for (auto& pool : pools) {
+            pool.reset();
+        }
+        generations.clear();
+        freeIndices.clear();
+        aliveCount = 0;
+    }
+
+private:
+    std::vector<std::unique_ptr<ComponentPoolBase>> pools;
+    std::vector<uint32_t> generations;
+    std::vector<uint32_t> freeIndices;
+    size_t aliveCount = 0;
+
+    static uint32_t nextComponentTypeId() {
+        static uint32_t counter = 0;
+        return counter++;
+    }
+
+    template<typename T>
+    static uint32_t componentTypeId() {
+        static const uint32_t id = nextComponentTypeId();
+        return id;
+    }
+
+    template<typename T>
+    const ComponentPool<T>* findPool() const {
+        uint32_t id = componentTypeId<T>();
+        if (id >= pools.size() || !pools[id]) {
+            return nullptr;
+        }
+        return static_cast<const ComponentPool<T>*>(pools[id].get());
+    }
+};
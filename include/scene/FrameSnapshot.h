@@ -0,0 +1,54 @@
+﻿#pragma once
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "../culling/Bounds.h"
+#include "../culling/HiZCuller.h"
+#include "Components.h"
+
+// Forward declarations
+class Mesh;
+
+// Light in world space. The id stays the same for the light's lifetime, so the
+// renderer can keep per-light state (cached shadow maps) across frames.
+struct LightInstance {
+    uint64_t id = 0;
+    LightType type = LightType::Directional;
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);  // Normalized
+    glm::vec3 color = glm::vec3(1.0f);
+    float intensity = 1.0f;
+    float range = 10.0f;
+    float innerAngle = 0.3f;
+    float outerAngle = 0.5f;
+    bool castShadows = true;
+};
+
+// Immutable copy of everything the renderer needs from the simulation for one
+// frame. Renderables are stored in draw order, so index i in every array refers
+// to the same instance (and to indirect draw command i).
+struct FrameSnapshot {
+    uint64_t frameNumber = 0;
+    float deltaTime = 0.0f;
+
+    // Camera
+    glm::mat4 view = glm::mat4(1.0f);
+    float fov = 90.0f;
+    float nearPlane = 0.1f;
+    float farPlane = 10.0f;
+
+    // Renderables
+    std::vector<Mesh*> meshes;
+    std::vector<glm::mat4> modelMatrices;
+    std::vector<AABB> bounds;
+    std::vector<CullInstance> cullInstances;
+    std::vector<uint8_t> staticFlags;  // 1 for entities with the Static component
+
+    // Changes whenever a static renderable moves, appears or disappears
+    uint64_t staticVersion = 0;
+
+    std::vector<LightInstance> lights;
+
+    size_t getInstanceCount() const { return meshes.size(); }
+};
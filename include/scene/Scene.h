@@ -9,34 +9,23 @@
 #include "../include/mesh/Mesh.h"
 #include "../include/loader/ModelLoader.h"
 #include "../include/texture/Texture.h"  // New include
+#include "../texture/AsyncTextureLoader.h"
+#include "../texture/TextureAtlas.h"
+#include "../culling/HiZCuller.h"
+#include "../culling/SoftwareOcclusion.h"
+#include "EntityRegistry.h"
+#include "Components.h"
+#include "FrameSnapshot.h"
 
 // Forward declarations
 class VulkanRenderer;
+class SceneSerializer;
 
-// Struct to hold transform data for each mesh instance
-struct Transform {
-    glm::vec3 position = glm::vec3(0.0f);
-    glm::vec3 rotation = glm::vec3(0.0f);
-    glm::vec3 scale = glm::vec3(1.0f);
-    
-    glm::mat4 getModelMatrix() const {
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, position);
-        model = glm::rotate(model, rotation.x, glm::vec3(1.0f, 0.0f, 0.0f));
-        model = glm::rotate(model, rotation.y, glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::rotate(model, rotation.z, glm::vec3(0.0f, 0.0f, 1.0f));
-        model = glm::scale(model, scale);
-        return model;
-    }
-};
-
-// Struct to represent a mesh instance in the scene
-struct MeshInstance {
-    std::shared_ptr<Mesh> mesh;
-    Transform transform;
-    
-    MeshInstance(std::shared_ptr<Mesh> m, const Transform& t = Transform())
-        : mesh(m), transform(t) {}
+// Where a mesh in the mesh table came from, so scenes can be saved and reloaded
+struct MeshAsset {
+    std::string modelPath;
+    uint32_t subMesh = 0;
+    std::string texturePath;
 };
 
 class Scene {
@@ -51,28 +40,101 @@ public:
     bool loadTexturedModel(const std::string& modelFilename, const std::string& textureFilename, 
                           const Transform& transform = Transform());
     
+    // Load a model whose meshes are only used as CPU occluders (never drawn)
+    bool loadOccluderModel(const std::string& filename, const Transform& transform = Transform());
+
     // Add a single mesh instance to the scene
-    void addMeshInstance(std::shared_ptr<Mesh> mesh, const Transform& transform = Transform());
+    Entity addMeshInstance(std::shared_ptr<Mesh> mesh, const Transform& transform = Transform());
+
+    // Add a light; it follows the transform (and a parent, see setParent)
+    Entity addLight(const Light& light, const Transform& transform = Transform());
+
+    // Remove an entity and all its components; stale handles are ignored
+    void destroyEntity(Entity entity);
+
+    // Mark an entity as never moving, so shadow maps can cache it
+    void setStatic(Entity entity, bool isStatic);
+
+    // Make child's transform relative to parent (an invalid parent detaches it)
+    void setParent(Entity child, Entity parent);
     
     // Update all mesh transforms
     void update(float deltaTime);
     
-    // Record draw commands for all meshes
-    void draw(VkCommandBuffer commandBuffer, const glm::mat4& view, const glm::mat4& proj);
+    // Copy the render-facing state (draw order, model matrices, bounds) into a snapshot.
+    // The renderer only ever reads snapshots, so update() may run on another thread.
+    void buildSnapshot(FrameSnapshot& snapshot);
+
+    // Record draw commands for a snapshot. With an indirect buffer, instance i draws
+    // with the command at index i (written by the occlusion culling pass)
+    // Instances whose entry in visibility is 0 are skipped entirely
+    void draw(VkCommandBuffer commandBuffer, const FrameSnapshot& snapshot,
+              const glm::mat4& view, const glm::mat4& proj,
+              VkBuffer indirectBuffer = VK_NULL_HANDLE, const std::vector<uint8_t>* visibility = nullptr);
+
+    const std::vector<OccluderMesh>& getOccluders() const { return occluders; }
+
+    // Upload textures whose background decode has finished (render thread only)
+    uint32_t processTextureUploads();
+
+    // Resources shared because their content matched an earlier load
+    const DedupStats& getMeshDedupStats() const { return meshDedupStats; }
+    DedupStats getTextureDedupStats() const { return textureLoader->getDedupStats(); }
+
+    EntityRegistry& getRegistry() { return registry; }
+    size_t getRenderableCount() { return registry.pool<Renderable>().size(); }
 
 private:
+    friend class SceneSerializer;
+
     VulkanRenderer* renderer;
-    std::vector<MeshInstance> meshInstances;
+
+    // Entities and their components; renderables reference meshes in the mesh table
+    EntityRegistry registry;
+    std::vector<std::shared_ptr<Mesh>> meshes;
+    std::vector<MeshAsset> meshAssets;
+    std::unordered_map<const Mesh*, uint32_t> meshIndices;
+
+    // Meshes by vertex+index content hash; later meshes with byte-identical
+    // geometry reuse one, or share its buffers when their material differs. The
+    // geometry is kept so a hash collision is never taken for a match
+    struct CachedGeometry {
+        std::shared_ptr<Mesh> mesh;
+        MeshData data;
+    };
+    std::unordered_map<uint64_t, std::vector<CachedGeometry>> geometryCache;
+    DedupStats meshDedupStats;
+    std::vector<OccluderMesh> occluders;
+
+    // Bumped whenever static geometry changes; see FrameSnapshot::staticVersion
+    uint64_t staticVersion = 0;
     
-    // Storage for loaded textures to prevent duplicates
-    std::unordered_map<std::string, std::shared_ptr<Texture>> textureCache;
+    // Loaded textures, decoded on worker threads and deduplicated by path
+    std::unique_ptr<AsyncTextureLoader> textureLoader;
+    // Small textures packed into shared pages
+    std::unique_ptr<TextureAtlas> textureAtlas;
   
     ModelLoader modelLoader;
 
     // Helper to create mesh objects from loaded mesh data
     void createMeshesFromData(const std::vector<MeshData>& meshDataList, const Transform& transform, 
-                            const Material& material = Material());
+                            const std::string& modelPath = "", const std::string& texturePath = "");
+
+    // Create (or reuse) the mesh for one sub-mesh sampling texturePath, which may be empty
+    std::shared_ptr<Mesh> createMesh(const MeshData& meshData, const std::string& texturePath);
+
+    // Whether all UVs lie in [0, 1], so the texture can be moved into an atlas
+    static bool hasUnitUVs(const MeshData& meshData);
     
-    // Load or retrieve a cached texture
+    // Whether a mesh with material a can stand in for one with material b
+    static bool isSameMaterial(const Material& a, const Material& b);
+
+    // Register a mesh in the mesh table and return its index
+    uint32_t registerMesh(const std::shared_ptr<Mesh>& mesh, const MeshAsset& asset = MeshAsset());
+
+    // Local-to-world matrix of an entity's ancestors (identity for roots)
+    glm::mat4 getParentMatrix(Entity parent);
+
+    // Load or retrieve a cached texture; returns before the texture is ready
     std::shared_ptr<Texture> loadTexture(const std::string& filename);
 };
\ No newline at end of file
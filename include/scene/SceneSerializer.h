@@ -0,0 +1,91 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "Scene.h"
+
+// Saves and loads a Scene's entities, transforms, hierarchy, static flags, lights and
+// mesh asset references.
+//
+// Binary layout (little endian, tightly packed):
+//   SceneFileHeader
+//   SceneFileAsset[assetCount]     mesh table entries, paths are offsets into the string block
+//   SceneFileEntity[entityCount]   one record per entity, read in a single bulk copy
+//   SceneFileLight[lightCount]     Light components, keyed by entity index
+//   char[stringBytes]              null-terminated paths
+//
+// The text format holds the same data one record per line, for diffing and hand edits.
+// Static entities get a "static <entity>" line and lights a "light <entity> ..." line
+// after the entity records.
+class SceneSerializer {
+public:
+    static constexpr uint32_t FILE_VERSION = 2;
+    static constexpr uint32_t NO_INDEX = UINT32_MAX;
+
+    // SceneFileEntity::flags
+    static constexpr uint32_t ENTITY_STATIC = 1u << 0;
+
+    struct SceneFileHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t assetCount;
+        uint32_t entityCount;
+        uint32_t lightCount;
+        uint32_t stringBytes;
+    };
+
+    struct SceneFileAsset {
+        uint32_t modelPathOffset;
+        uint32_t texturePathOffset;
+        uint32_t subMesh;
+    };
+
+    struct SceneFileEntity {
+        float position[3];
+        float rotation[3];
+        float scale[3];
+        uint32_t meshIndex;     // index into the asset table, NO_INDEX if not renderable
+        uint32_t parent;        // index into the entity table, NO_INDEX for roots
+        uint32_t flags;         // ENTITY_* bits
+    };
+
+    struct SceneFileLight {
+        uint32_t entity;        // index into the entity table
+        uint32_t type;          // LightType
+        float color[3];
+        float intensity;
+        float direction[3];
+        float range;
+        float innerAngle;
+        float outerAngle;
+        uint32_t castShadows;
+    };
+
+    SceneSerializer(Scene* scene);
+
+    bool saveBinary(const std::string& filename);
+    bool loadBinary(const std::string& filename);
+
+    bool saveText(const std::string& filename);
+    bool loadText(const std::string& filename);
+
+private:
+    Scene* scene;
+
+    // Format-independent snapshot of a scene
+    struct SceneDescription {
+        std::vector<MeshAsset> assets;
+        std::vector<SceneFileEntity> entities;
+        std::vector<SceneFileLight> lights;
+    };
+
+    void capture(SceneDescription& description);
+    // False, with the scene's entities untouched, if any referenced asset, parent
+    // or light entity can't be resolved; a partly loaded scene is never reported as loaded
+    bool apply(const SceneDescription& description);
+
+    // Load every referenced mesh, opening each model file once. Returns false if
+    // any asset failed to load
+    bool resolveAssets(const std::vector<MeshAsset>& assets, std::vector<uint32_t>& meshIndices);
+};
@@ -0,0 +1,104 @@
+﻿#pragma once
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+
+#include "Texture.h"
+#include "../Utils/Hash.h"
+
+// Forward declarations
+class VulkanRenderer;
+class ThreadPool;
+class TextureStreamer;
+
+// Texture cache that decodes image files on the thread pool.
+//
+// request() returns immediately with a texture that is not ready yet; callers
+// sample the default texture until Texture::isReady(). Finished decodes are
+// uploaded by processUploads() on the render thread, many textures per command
+// buffer. Decodes write straight into the renderer's staging ring when it has
+// room, and uploads don't wait for the GPU; ring space comes back when the
+// renderer's GpuTimeline passes their submission. Repeated requests for a path share one texture, including
+// while its decode is still in flight. Different paths that decode to identical
+// pixels become aliases of the first uploaded one and are never uploaded
+// themselves; a content hash finds the candidates and a byte comparison against
+// the candidate's file confirms them.
+//
+// With a TextureStreamer, decodes also build the full mip chain and only the
+// small mips are uploaded; the streamer brings in the rest on demand.
+class AsyncTextureLoader {
+public:
+    AsyncTextureLoader(VulkanRenderer* renderer, ThreadPool* threadPool, StagingRing* stagingRing,
+                       TextureStreamer* streamer = nullptr);
+    ~AsyncTextureLoader();
+
+    std::shared_ptr<Texture> request(const std::string& filename);
+
+    // Upload decoded textures, up to maxBatchBytes of pixels per submission
+    // (and no more than fits in the staging ring).
+    // Returns the number of textures that became ready.
+    uint32_t processUploads(VkDeviceSize maxBatchBytes = 64 * 1024 * 1024);
+
+    // Block until every queued decode has finished (uploads still need processUploads)
+    void waitForDecodes();
+
+    // Also true while submitted uploads haven't completed
+    bool hasPendingWork();
+
+    // Textures aliased to identical content, and the decoded bytes they didn't upload
+    DedupStats getDedupStats();
+
+private:
+    struct DecodedTexture {
+        std::shared_ptr<Texture> texture;
+        TextureData data;
+        std::string filename;
+        uint64_t contentHash = 0;
+    };
+
+    // A texture that was uploaded, and the file its content can be re-read from
+    struct ContentEntry {
+        std::shared_ptr<Texture> texture;
+        std::string filename;
+    };
+
+    VulkanRenderer* renderer;
+    ThreadPool* threadPool;
+    StagingRing* stagingRing;
+    TextureStreamer* streamer;
+
+    // Submitted upload batches; their ring space is released once the timeline reaches them
+    struct PendingSubmission {
+        uint64_t timelineValue = 0;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        std::vector<StagingRing::Allocation> allocations;
+    };
+    std::vector<PendingSubmission> pendingSubmissions;
+    void retireSubmissions(bool wait);
+
+    std::mutex mutex;
+    std::condition_variable decodeCondition;
+    std::unordered_map<std::string, std::shared_ptr<Texture>> textureCache;
+    std::vector<DecodedTexture> decodedTextures;
+    uint32_t decodesInFlight = 0;
+
+    // Uploaded textures by content hash (several when hashes collide), and later
+    // duplicates waiting to be pointed at theirs on the render thread. Entries are
+    // only added once their upload has been recorded, so aliases never point at an
+    // image that won't become ready
+    std::unordered_map<uint64_t, std::vector<ContentEntry>> contentCache;
+    std::vector<std::pair<std::shared_ptr<Texture>, std::shared_ptr<Texture>>> pendingAliases;
+    DedupStats dedupStats;
+
+    static uint64_t hashContent(const TextureData& data);
+    // Decodes filename again and compares it byte for byte (hash hits only)
+    static bool isSameContent(const TextureData& data, const std::string& filename);
+    void registerContent(const DecodedTexture& decoded);
+
+    // Bytes staged for a decoded texture: everything, or only the initial mips when streaming
+    VkDeviceSize getUploadSize(const TextureData& data) const;
+};
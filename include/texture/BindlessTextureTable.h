@@ -0,0 +1,80 @@
+﻿#pragma once
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+
+#include "Texture.h"
+
+// Forward declarations
+class VulkanRenderer;
+
+// One large, partially bound array of combined image samplers (descriptor set 2)
+// shared by every draw. Textures get a slot the first time they are drawn and
+// keep it until they are destroyed or their image is replaced; draws select
+// their texture with a push constant. A slot is only written while no
+// submitted work can use it: replaced and destroyed textures' slots are reused
+// once the GpuTimeline has passed every frame that might. Slot 0 holds the
+// default texture, which also stands in for textures that are still loading.
+//
+// Requires Vulkan 1.2 descriptor indexing (see isSupported); without it the
+// renderer keeps writing the single texture binding of set 0 per draw.
+class BindlessTextureTable {
+public:
+    static constexpr uint32_t MAX_TEXTURES = 4096;
+    static constexpr uint32_t DEFAULT_TEXTURE_INDEX = 0;
+    // Set index in the renderer's pipeline layout (set 1 holds the lights)
+    static constexpr uint32_t SET = 2;
+
+    explicit BindlessTextureTable(VulkanRenderer* renderer);
+    ~BindlessTextureTable();
+
+    // Device features this path needs; enable the same ones at device creation
+    static bool isSupported(const VkPhysicalDeviceVulkan12Features& features);
+
+    void setDefaultTexture(const VkDescriptorImageInfo& imageInfo);
+
+    // Slot of the texture, writing a fresh one if it is new or was re-uploaded.
+    // Textures that aren't ready (or don't fit) use the default slot.
+    uint32_t getIndex(const std::shared_ptr<Texture>& texture);
+
+    // Once per frame: slots of destroyed textures are reused after the GPU work
+    // that may still sample them has finished
+    void update();
+
+    void bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) const;
+
+    VkDescriptorSetLayout getDescriptorSetLayout() const { return setLayout; }
+    uint32_t getCapacity() const { return capacity; }
+
+private:
+    struct Slot {
+        std::weak_ptr<Texture> texture;
+        uint32_t index = 0;
+        VkImageView imageView = VK_NULL_HANDLE;
+    };
+
+    struct PendingRelease {
+        uint32_t index;
+        uint64_t timelineValue;  // Free once the renderer's GpuTimeline reaches this
+    };
+
+    VulkanRenderer* renderer;
+    VkDevice device;
+    uint32_t capacity = MAX_TEXTURES;
+
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+
+    std::unordered_map<Texture*, Slot> slots;
+    std::vector<uint32_t> freeIndices;
+    std::vector<PendingRelease> pendingReleases;
+    uint32_t nextIndex = DEFAULT_TEXTURE_INDEX + 1;
+    bool reportedFull = false;
+
+    bool allocateIndex(uint32_t& index);
+    void writeDescriptor(uint32_t index, const VkDescriptorImageInfo& imageInfo);
+    void releaseSlot(uint32_t index);
+};
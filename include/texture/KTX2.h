@@ -0,0 +1,57 @@
+﻿#pragma once
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "Texture.h"
+
+// Reader for KTX2 containers holding a 2D texture with a pre-built mip chain.
+//
+// Supported payloads are uncompressed RGBA8 and the BC1/BC3/BC4/BC5/BC7 block
+// formats, uploaded as-is. Supercompressed files (Basis Universal, Zstandard)
+// are rejected; bake them without supercompression.
+class KTX2 {
+public:
+    static constexpr uint32_t SUPERCOMPRESSION_NONE = 0;
+
+    // File identifier: «KTX 20»\r\n\x1A\n
+    static const uint8_t IDENTIFIER[12];
+
+    struct Header {
+        uint8_t identifier[12];
+        uint32_t vkFormat;
+        uint32_t typeSize;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t layerCount;
+        uint32_t faceCount;
+        uint32_t levelCount;
+        uint32_t supercompressionScheme;
+
+        uint32_t dfdByteOffset;
+        uint32_t dfdByteLength;
+        uint32_t kvdByteOffset;
+        uint32_t kvdByteLength;
+        uint64_t sgdByteOffset;
+        uint64_t sgdByteLength;
+    };
+
+    struct LevelIndex {
+        uint64_t byteOffset;
+        uint64_t byteLength;
+        uint64_t uncompressedByteLength;
+    };
+
+    static bool isKTX2File(const std::string& filename);
+
+    // Parse a file into texture data; level offsets are realigned for upload
+    static bool load(const std::string& filename, TextureData& data);
+    static bool parse(const std::vector<char>& fileData, TextureData& data, const std::string& filename);
+
+    // Bytes per 4x4 block (compressed) or per texel (RGBA8); 0 if unsupported
+    static uint32_t getBlockBytes(VkFormat format);
+    static bool isBlockCompressed(VkFormat format);
+    static VkDeviceSize getLevelSize(VkFormat format, uint32_t width, uint32_t height);
+};
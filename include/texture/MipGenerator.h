@@ -0,0 +1,102 @@
+﻿#pragma once
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+// Forward declarations
+class VulkanRenderer;
+
+// Compute-based mip chain generation (shaders/spd_downsample.comp).
+//
+// One dispatch writes up to 12 levels: workgroups reduce 64x64 tiles through
+// shared memory and the last one to finish reduces the tile results. Works for
+// formats without linear blit support, filters sRGB images in linear space and
+// can keep the farthest depth instead of the average (depth pyramids).
+//
+// A Chain holds the views and descriptor sets for one image; create it once and
+// record it whenever the source changes.
+class MipGenerator {
+public:
+    enum class Reduction : uint32_t {
+        Average = 0,
+        AverageSRGB = 1,
+        MaxDepth = 2
+    };
+
+    static constexpr uint32_t LEVELS_PER_DISPATCH = 12;
+    // The last workgroup reduces at most 64x64 tile results; larger sources are
+    // split into more dispatches (textures fall back to blits instead)
+    static constexpr uint32_t MAX_TILE_GRID = 64;
+    static constexpr uint32_t TILE_SIZE = 64;
+
+    // Whether every workgroup of a dispatch over extent has a slot in the tile grid;
+    // partial tiles at the edges count
+    static bool fitsTileGrid(VkExtent2D extent) {
+        return (extent.width + TILE_SIZE - 1) / TILE_SIZE <= MAX_TILE_GRID &&
+               (extent.height + TILE_SIZE - 1) / TILE_SIZE <= MAX_TILE_GRID;
+    }
+
+    struct Dispatch {
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        VkExtent2D sourceExtent{};
+        uint32_t firstLevel = 0;
+        uint32_t levelCount = 0;
+    };
+
+    struct Chain {
+        VkImage image = VK_NULL_HANDLE;
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+        std::vector<VkImageView> views;
+        std::vector<Dispatch> dispatches;
+
+        bool isValid() const { return !dispatches.empty(); }
+    };
+
+    explicit MipGenerator(VulkanRenderer* renderer);
+    ~MipGenerator();
+
+    // Whether the mips of this format can be written by compute (sRGB through a UNORM view)
+    bool isFormatSupported(VkFormat format) const;
+
+    // Fill levels 1..mipLevels-1 of image from level 0. The image needs STORAGE usage,
+    // plus MUTABLE_FORMAT for sRGB formats. When recorded, level 0 must be in
+    // SHADER_READ_ONLY_OPTIMAL and the other levels in GENERAL.
+    Chain createChain(VkImage image, VkFormat format, VkExtent2D extent, uint32_t mipLevels);
+
+    // Fill levels 0..levelCount-1 of image from a separate source (a depth buffer),
+    // each level half the size of the one before. The source is read in sourceLayout.
+    Chain createChain(VkImageView sourceView, VkImageLayout sourceLayout, VkExtent2D sourceExtent,
+                      VkImage image, VkFormat format, uint32_t levelCount, Reduction reduction);
+
+    void destroyChain(Chain& chain);
+
+    // Record every dispatch of a chain; the written levels stay in GENERAL
+    void record(VkCommandBuffer commandBuffer, const Chain& chain);
+
+private:
+    VulkanRenderer* renderer;
+    VkDevice device;
+    VkSampler sampler;  // Owned by the renderer's SamplerCache
+
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    // One pipeline per storage format and reduction, created on first use
+    std::unordered_map<uint64_t, VkPipeline> pipelines;
+
+    // Tile results and the finished-workgroup counter, shared by every dispatch
+    VkBuffer globalBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory globalBufferMemory = VK_NULL_HANDLE;
+
+    Chain buildChain(VkImageView sourceView, VkImageLayout sourceLayout, VkExtent2D sourceExtent,
+                     VkImage image, VkFormat format, uint32_t firstLevel, uint32_t levelCount,
+                     Reduction reduction);
+    VkPipeline getPipeline(VkFormat storageFormat, Reduction reduction);
+    // A view of one level restricted to usage, so sRGB views don't claim storage support
+    VkImageView createLevelView(VkImage image, VkFormat format, uint32_t level, VkImageUsageFlags usage);
+
+    // Format written by the shader: sRGB images are stored through a UNORM view
+    static VkFormat getStorageFormat(VkFormat format);
+    static bool isSRGB(VkFormat format);
+};
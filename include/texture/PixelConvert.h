@@ -0,0 +1,21 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// Channel expansion of 8-bit images to RGBA8, the only uncompressed layout
+// textures are uploaded in. Gray is replicated to RGB and missing alpha is 255,
+// matching what stb_image produces for STBI_rgb_alpha.
+//
+// Uses SSSE3 shuffles (SSE2 for gray) when the CPU has them. No Vulkan
+// dependency, so tools can use it too.
+class PixelConvert {
+public:
+    // src and dst must not overlap; dst holds pixelCount * 4 bytes
+    static void expandToRGBA(const unsigned char* src, uint32_t channels, unsigned char* dst, size_t pixelCount);
+
+    // Plain per-byte loop, the reference the SIMD paths are checked against
+    static void expandToRGBAScalar(const unsigned char* src, uint32_t channels, unsigned char* dst, size_t pixelCount);
+
+    // Whether expandToRGBA takes the SIMD paths on this CPU
+    static bool hasSIMD();
+};
@@ -0,0 +1,80 @@
+﻿#pragma once
+#include <vulkan/vulkan.h>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+// Sampler state that textures and passes ask for. The default is the trilinear,
+// repeating, anisotropic sampler used for material textures.
+struct SamplerDesc {
+    VkFilter magFilter = VK_FILTER_LINEAR;
+    VkFilter minFilter = VK_FILTER_LINEAR;
+    VkSamplerMipmapMode mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    bool anisotropy = true;   // Uses the device maximum when supported
+    bool compare = false;     // Depth comparison (shadow maps)
+    VkCompareOp compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+    VkBorderColor borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+
+    bool operator==(const SamplerDesc& other) const {
+        return magFilter == other.magFilter && minFilter == other.minFilter &&
+               mipmapMode == other.mipmapMode && addressMode == other.addressMode &&
+               anisotropy == other.anisotropy && compare == other.compare &&
+               compareOp == other.compareOp && borderColor == other.borderColor;
+    }
+
+    // Nearest, clamped, for reading exact texels (depth pyramids, lookup tables)
+    static SamplerDesc nearestClamp() {
+        SamplerDesc desc;
+        desc.magFilter = VK_FILTER_NEAREST;
+        desc.minFilter = VK_FILTER_NEAREST;
+        desc.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        desc.addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        desc.anisotropy = false;
+        return desc;
+    }
+};
+
+struct SamplerDescHash {
+    size_t operator()(const SamplerDesc& desc) const {
+        size_t hash = 0;
+        auto combine = [&hash](uint32_t value) {
+            hash ^= value + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        };
+        combine(desc.magFilter);
+        combine(desc.minFilter);
+        combine(desc.mipmapMode);
+        combine(desc.addressMode);
+        combine(desc.anisotropy);
+        combine(desc.compare);
+        combine(desc.compareOp);
+        combine(desc.borderColor);
+        return hash;
+    }
+};
+
+// Hands out one VkSampler per distinct SamplerDesc. Samplers live as long as the
+// cache, so they can be shared by any number of textures and used as immutable
+// samplers in descriptor set layouts. Samplers don't clamp the LOD; the image
+// view decides which levels exist.
+class SamplerCache {
+public:
+    SamplerCache(VkDevice device, VkPhysicalDevice physicalDevice);
+    ~SamplerCache();
+
+    SamplerCache(const SamplerCache&) = delete;
+    SamplerCache& operator=(const SamplerCache&) = delete;
+
+    VkSampler get(const SamplerDesc& desc = SamplerDesc());
+
+    size_t getSamplerCount();
+
+private:
+    VkDevice device;
+    bool anisotropySupported = false;
+    float maxAnisotropy = 1.0f;
+
+    std::mutex mutex;
+    std::unordered_map<SamplerDesc, VkSampler, SamplerDescHash> samplers;
+};
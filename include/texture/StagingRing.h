@@ -0,0 +1,63 @@
+﻿#pragma once
+#include <vulkan/vulkan.h>
+#include <deque>
+#include <mutex>
+#include <cstdint>
+
+// Forward declarations
+class VulkanRenderer;
+
+// Persistently mapped, host-visible upload buffer shared by all texture uploads.
+//
+// Space is handed out in allocation order around a ring and returned with
+// release() once the GPU has consumed it; releases may come in any order; space
+// is reused only when the oldest allocation is gone. Allocation never blocks,
+// so decode workers can write straight into mapped memory and fall back to
+// system memory when the ring is full.
+class StagingRing {
+public:
+    static constexpr VkDeviceSize ALIGNMENT = 16;
+
+    struct Allocation {
+        unsigned char* data = nullptr;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        uint64_t id = 0;
+
+        bool isValid() const { return data != nullptr; }
+    };
+
+    StagingRing(VulkanRenderer* renderer, VkDeviceSize capacity);
+    ~StagingRing();
+
+    StagingRing(const StagingRing&) = delete;
+    StagingRing& operator=(const StagingRing&) = delete;
+
+    // Thread-safe; returns an invalid allocation when there isn't room
+    Allocation tryAllocate(VkDeviceSize size);
+
+    // Give the space back once nothing reads it anymore (after the upload's fence)
+    void release(const Allocation& allocation);
+
+    VkBuffer getBuffer() const { return buffer; }
+    VkDeviceSize getCapacity() const { return capacity; }
+
+private:
+    struct Block {
+        VkDeviceSize offset;
+        VkDeviceSize size;
+        uint64_t id;
+        bool released;
+    };
+
+    VulkanRenderer* renderer;
+    VkDeviceSize capacity;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    unsigned char* mapped = nullptr;
+
+    std::mutex mutex;
+    std::deque<Block> blocks;   // Live allocations, oldest first
+    VkDeviceSize head = 0;      // Where the next allocation starts
+    uint64_t nextId = 1;
+};
@@ -2,10 +2,50 @@
 #include <vulkan/vulkan.h>
 #include <string>
 #include <memory>
+#include <vector>
+
+#include "SamplerCache.h"
+#include "StagingRing.h"
+#include "MipGenerator.h"
+#include "../render/GpuTimeline.h"
+
+// Decoded texture data waiting for upload
+struct TextureData {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+
+    // Offsets of a pre-built mip chain in pixels (level 0 first). Empty means
+    // pixels holds level 0 only and the mips are generated on the GPU.
+    std::vector<VkDeviceSize> mipOffsets;
+    std::vector<unsigned char> pixels;
+
+    // Pixels decoded straight into the upload ring instead of into pixels
+    StagingRing::Allocation staging;
+
+    VkDeviceSize getSize() const {
+        return staging.isValid() ? staging.size : static_cast<VkDeviceSize>(pixels.size());
+    }
+    const unsigned char* getPixels() const { return staging.isValid() ? staging.data : pixels.data(); }
+};
 
 class Texture {
 public:
-    Texture(VkDevice device, VkPhysicalDevice physicalDevice);
+    // GPU resources of an image replaced by a re-upload; submissions made before the
+    // replacement may still sample them
+    struct RetiredImage {
+        VkImage image = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkSampler sampler = VK_NULL_HANDLE;  // Only when not owned by a sampler cache
+        MipGenerator::Chain mipChain;
+    };
+
+    // With a sampler cache the texture shares its sampler instead of creating its own.
+    // With a mip generator, mips are built by compute instead of blits where the format allows.
+    // With a timeline, blocking uploads wait for their own submission instead of the queue going idle.
+    Texture(VkDevice device, VkPhysicalDevice physicalDevice, SamplerCache* samplerCache = nullptr,
+            MipGenerator* mipGenerator = nullptr, GpuTimeline* timeline = nullptr);
     ~Texture();
 
     // Load texture from a file (use stb_image internally)
@@ -14,19 +54,81 @@ public:
     // For creating a texture from raw pixel data
     bool createFromPixels(const unsigned char* pixels, uint32_t width, uint32_t height, 
                          uint32_t channels, VkCommandPool commandPool, VkQueue graphicsQueue);
+
+    // Decode an image file on the calling thread; touches no Vulkan state.
+    // .ktx2 files keep their block-compressed format and mip chain. With a
+    // staging ring, pixels are expanded directly into it when there is room.
+    static bool decodeFile(const std::string& filepath, TextureData& data, StagingRing* stagingRing = nullptr);
+
+    // Dimensions of an image file from its header, without decoding (stb_image formats only)
+    static bool readFileInfo(const std::string& filepath, uint32_t& width, uint32_t& height);
+
+    // Whether the device can sample images of this format
+    bool isFormatSupported(VkFormat format) const;
+
+    // Batched upload: create the image and record the copy and mip chain into a
+    // caller-owned command buffer. Call finishUpload() once that buffer has executed.
+    // With firstMip > 0 only levels [firstMip, end) of a pre-built chain are uploaded,
+    // and the staging buffer holds just those levels.
+    void recordUpload(VkCommandBuffer commandBuffer, const TextureData& data,
+                      VkBuffer stagingBuffer, VkDeviceSize stagingOffset, uint32_t firstMip = 0);
+    void finishUpload();
+
+    // Overwrite rects of level 0 in place and rebuild the mips from it, recorded into a
+    // caller-owned command buffer. Frames submitted earlier may still sample the image;
+    // the barriers order the writes after them.
+    void recordRegionUpload(VkCommandBuffer commandBuffer, VkBuffer stagingBuffer,
+                            const std::vector<VkBufferImageCopy>& regions, uint32_t width, uint32_t height);
+
+    // Mip streaming: replace the GPU image with levels [firstMip, end) of data.
+    // Blocks on the upload's own submission, then releases the previous image.
+    void uploadMipRange(const TextureData& data, uint32_t firstMip, VkCommandPool commandPool, VkQueue graphicsQueue);
+
+    // Mip streaming without waiting: create the image for levels [firstMip, end) and
+    // record its upload from a staging buffer holding just those levels. The texture
+    // switches to the new image right away; the previous one is returned and must be
+    // kept until the timeline passes the submission of commandBuffer.
+    RetiredImage recordMipRange(VkCommandBuffer commandBuffer, const TextureData& data, uint32_t firstMip,
+                                VkBuffer stagingBuffer, VkDeviceSize stagingOffset);
+    static void destroyRetiredImage(VkDevice device, MipGenerator* mipGenerator, RetiredImage& retired);
+
+    // Build the mip chain on the CPU (RGBA8 only), so levels can be streamed individually
+    static void buildMipChain(TextureData& data);
+
+    // Bytes a pre-built chain needs from firstMip down
+    static VkDeviceSize getMipRangeSize(const TextureData& data, uint32_t firstMip);
+
+    uint32_t getResidentMip() const { return source ? source->getResidentMip() : residentMip; }
+    VkDeviceSize getResidentBytes() const { return source ? source->getResidentBytes() : residentBytes; }
+
+    // Content deduplication: an alias owns no image and reads everything from the
+    // texture holding identical pixels. Set on the render thread only.
+    void setSource(const std::shared_ptr<Texture>& texture) { source = texture; }
+    const std::shared_ptr<Texture>& getSource() const { return source; }
+
+    // False until the GPU image has been uploaded (asynchronous loads)
+    bool isReady() const { return source ? source->isReady() : textureImageView != VK_NULL_HANDLE; }
     
     // Get the texture image view for binding
-    VkImageView getImageView() const { return textureImageView; }
+    VkImageView getImageView() const { return source ? source->getImageView() : textureImageView; }
     
     // Get the texture sampler
-    VkSampler getSampler() const { return textureSampler; }
+    VkSampler getSampler() const { return source ? source->getSampler() : textureSampler; }
     
     // Get image layout
-    VkImageLayout getImageLayout() const { return imageLayout; }
+    VkImageLayout getImageLayout() const { return source ? source->getImageLayout() : imageLayout; }
 
 private:
     VkDevice device;
     VkPhysicalDevice physicalDevice;
+    SamplerCache* samplerCache;
+    MipGenerator* mipGenerator;
+    GpuTimeline* timeline;
+    std::shared_ptr<Texture> source;
+
+    // Views and descriptors of the compute mip generation, kept as long as the image
+    MipGenerator::Chain mipChain;
+    bool computeMips = false;
 
     VkImage textureImage = VK_NULL_HANDLE;
     VkDeviceMemory textureImageMemory = VK_NULL_HANDLE;
@@ -37,18 +139,30 @@ private:
     uint32_t mipLevels = 1;
     VkFormat imageFormat = VK_FORMAT_R8G8B8A8_SRGB;
 
+    // First level of the source data held by the GPU image (mip streaming)
+    uint32_t residentMip = 0;
+    VkDeviceSize residentBytes = 0;
+
     // Helper methods
+    RetiredImage releaseImage();
     void createTextureImage(const unsigned char* pixels, uint32_t width, uint32_t height, uint32_t channels,
                           VkCommandPool commandPool, VkQueue graphicsQueue);
+    void createImage(uint32_t width, uint32_t height);
     void createTextureImageView();
     void createTextureSampler();
-    void transitionImageLayout(VkImage image, VkFormat format,
-                             VkImageLayout oldLayout, VkImageLayout newLayout,
-                             VkCommandPool commandPool, VkQueue graphicsQueue);
-    void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height,
-                          VkCommandPool commandPool, VkQueue graphicsQueue);
-    void generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels,
-                       VkCommandPool commandPool, VkQueue graphicsQueue);
+    void transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image,
+                             VkImageLayout oldLayout, VkImageLayout newLayout);
+    void copyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset,
+                          VkImage image, uint32_t width, uint32_t height);
+    void copyMipChainToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset,
+                            VkImage image, const TextureData& data, uint32_t firstMip);
+    void uploadData(const TextureData& data, VkCommandPool commandPool, VkQueue graphicsQueue,
+                    uint32_t firstMip = 0);
+    void generateMipmaps(VkCommandBuffer commandBuffer, VkImage image, VkFormat imageFormat,
+                       int32_t texWidth, int32_t texHeight, uint32_t mipLevels);
+    void generateMipmapsCompute(VkCommandBuffer commandBuffer, uint32_t width, uint32_t height);
+    // Whether the next image's mips will be generated by compute (decides its usage flags)
+    bool canGenerateMipsCompute(uint32_t width, uint32_t height) const;
                        
     VkCommandBuffer beginSingleTimeCommands(VkCommandPool commandPool);
     void endSingleTimeCommands(VkCommandBuffer commandBuffer, VkCommandPool commandPool, VkQueue graphicsQueue);
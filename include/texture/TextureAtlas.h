@@ -0,0 +1,103 @@
+﻿#pragma once
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+
+#include "Texture.h"
+
+// Forward declarations
+class VulkanRenderer;
+class ThreadPool;
+
+// Packs small textures into shared atlas pages, so meshes using them share one
+// image, one descriptor and one draw state.
+//
+// pack() only reads the image header; the pixels are decoded on the thread pool
+// and copied into the page. Once all of a page's pending decodes are in,
+// processUploads() uploads it whole the first time and only its dirty rects after
+// that, through the staging ring and without waiting for the GPU. Meshes sampling
+// a packed texture must have their UVs remapped with the returned region and stay
+// within [0, 1] (no tiling).
+class TextureAtlas {
+public:
+    static constexpr uint32_t PAGE_SIZE = 2048;
+    // Larger textures gain little from packing and keep their own image
+    static constexpr uint32_t MAX_PACKED_SIZE = 256;
+    // Edge texels are repeated into the gutter so filtering and the first
+    // mips don't pick up neighbours; rects are kept 4-aligned for the same reason
+    static constexpr uint32_t PADDING = 4;
+
+    struct Region {
+        std::shared_ptr<Texture> page;
+        glm::vec2 uvOffset = glm::vec2(0.0f);
+        glm::vec2 uvScale = glm::vec2(1.0f);
+
+        glm::vec2 remap(const glm::vec2& uv) const { return uvOffset + uv * uvScale; }
+    };
+
+    TextureAtlas(VulkanRenderer* renderer, ThreadPool* threadPool);
+    ~TextureAtlas();
+
+    // Reserve space for an image file. Returns false if it is too large, block
+    // compressed or unreadable; the caller then loads it as its own texture.
+    bool pack(const std::string& filename, Region& region);
+
+    // Upload pages whose packed textures have all been decoded (render thread only).
+    // Pages that don't fit in the staging ring wait for a later call.
+    // Returns the number of pages uploaded.
+    uint32_t processUploads();
+
+    // Block until every queued decode has finished
+    void waitForDecodes();
+
+    size_t getPageCount();
+
+private:
+    struct Shelf {
+        uint32_t y = 0;
+        uint32_t height = 0;
+        uint32_t usedWidth = 0;
+    };
+
+    struct Page {
+        std::shared_ptr<Texture> texture;
+        TextureData data;
+        std::vector<Shelf> shelves;
+        uint32_t usedHeight = 0;
+        uint32_t decodesInFlight = 0;
+        // Padded rects blitted since the last upload
+        std::vector<VkRect2D> dirtyRects;
+    };
+
+    VulkanRenderer* renderer;
+    ThreadPool* threadPool;
+    StagingRing* stagingRing;
+
+    // Submitted uploads; their ring space is released once the timeline reaches them
+    struct PendingSubmission {
+        uint64_t timelineValue = 0;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        std::vector<StagingRing::Allocation> allocations;
+    };
+    std::vector<PendingSubmission> pendingSubmissions;
+    void retireSubmissions(bool wait);
+
+    std::mutex mutex;
+    std::condition_variable decodeCondition;
+    // Pages are referenced by index from decode jobs, so they are never erased
+    std::vector<std::unique_ptr<Page>> pages;
+    std::unordered_map<std::string, Region> regions;
+    uint32_t decodesInFlight = 0;
+
+    // Find room for a padded width x height rect; returns false if the page is full
+    static bool allocate(Page& page, uint32_t width, uint32_t height, uint32_t& x, uint32_t& y);
+    std::unique_ptr<Page> createPage();
+
+    // Copy decoded RGBA8 pixels into the page and fill the gutter around them
+    static void blit(Page& page, const TextureData& source, uint32_t x, uint32_t y);
+};
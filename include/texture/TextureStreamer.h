@@ -0,0 +1,90 @@
+﻿#pragma once
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+
+#include "Texture.h"
+
+// Forward declarations
+class VulkanRenderer;
+struct FrameSnapshot;
+
+// Keeps texture mips resident according to how large the textures appear on screen.
+//
+// Registered textures start with only their small mips on the GPU. addFeedback()
+// estimates the finest level each texture needs from the screen-space size of the
+// instances using it; update() streams finer levels in, a few per frame, and drops
+// the least recently used textures back to their small mips when the resident
+// total exceeds the budget. The full mip chain stays in system memory so levels
+// can be re-uploaded without touching the file again.
+//
+// Each update() stages its levels in the renderer's staging ring and uploads them
+// in one submission without waiting; textures switch to their new images at once
+// and the replaced images are destroyed when the GpuTimeline passes the upload.
+class TextureStreamer {
+public:
+    // Textures never drop below the mips whose largest side is at most this
+    static constexpr uint32_t MIN_RESIDENT_SIZE = 64;
+
+    TextureStreamer(VulkanRenderer* renderer, VkDeviceSize budget);
+    ~TextureStreamer();
+
+    // First mip that is uploaded when a texture is registered
+    static uint32_t getInitialMip(const TextureData& data);
+
+    // Take ownership of the decoded mip chain of a texture already uploaded from getInitialMip()
+    void registerTexture(const std::shared_ptr<Texture>& texture, TextureData&& data);
+
+    // Estimate the mip every visible texture needs this frame
+    void addFeedback(const FrameSnapshot& snapshot, float viewportHeight);
+
+    // Stream in and evict levels; at most maxUploadBytes are uploaded per call
+    void update(VkDeviceSize maxUploadBytes = 16 * 1024 * 1024);
+
+    void setBudget(VkDeviceSize newBudget) { budget = newBudget; }
+    VkDeviceSize getBudget() const { return budget; }
+    VkDeviceSize getResidentBytes() const { return residentBytes; }
+
+private:
+    struct StreamedTexture {
+        std::weak_ptr<Texture> texture;
+        TextureData data;
+        uint32_t residentMip = 0;     // Finest level currently on the GPU
+        uint32_t minResidentMip = 0;  // Coarsest level set kept on the GPU
+        uint32_t desiredMip = 0;      // Finest level requested by feedback
+        uint64_t lastUsedFrame = 0;
+    };
+
+    VulkanRenderer* renderer;
+    VkDeviceSize budget;
+    VkDeviceSize residentBytes = 0;
+    uint64_t currentFrame = 0;
+
+    std::unordered_map<Texture*, StreamedTexture> textures;
+
+    // Levels staged by this update(), recorded into one command buffer at its end
+    struct StagedUpload {
+        std::shared_ptr<Texture> texture;
+        const TextureData* data = nullptr;
+        uint32_t mip = 0;
+        StagingRing::Allocation allocation;
+    };
+    std::vector<StagedUpload> stagedUploads;
+
+    // Submitted uploads; their ring space and the images they replaced are released
+    // once the timeline reaches them
+    struct PendingSubmission {
+        uint64_t timelineValue = 0;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        std::vector<StagingRing::Allocation> allocations;
+        std::vector<Texture::RetiredImage> retiredImages;
+    };
+    std::vector<PendingSubmission> pendingSubmissions;
+
+    // False when the ring has no room this frame; the level is tried again later
+    bool setResidentMip(StreamedTexture& entry, uint32_t mip);
+    void submitStagedUploads();
+    void retireSubmissions(bool wait);
+};
@@ -1,10 +1,15 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
 
 // Input from vertex shader
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
 layout(location = 2) in vec3 fragNormal;
+layout(location = 3) in vec3 fragWorldPos;
+layout(location = 4) in float fragViewDepth;
+
+#include "lighting.glsl"
 
 // Texture sampler
 layout(binding = 1) uniform sampler2D texSampler;
@@ -20,15 +25,20 @@ void main() {
     float ambientStrength = 0.3;
     vec3 ambient = ambientStrength * vec3(1.0, 1.0, 1.0);
     
-    // Diffuse lighting
-    vec3 lightDir = normalize(vec3(1.0, 1.0, 1.0));
+    // Diffuse lighting from the scene's lights; scenes without any keep the
+    // fixed light from above
     vec3 normal = normalize(fragNormal);
-    float diff = max(dot(normal, lightDir), 0.0);
-    vec3 diffuse = diff * vec3(1.0, 1.0, 1.0);
+    vec3 diffuse;
+    if (lighting.counts.x > 0u) {
+        diffuse = computeLighting(fragWorldPos, normal, fragViewDepth);
+    } else {
+        vec3 lightDir = normalize(vec3(1.0, 1.0, 1.0));
+        float diff = max(dot(normal, lightDir), 0.0);
+        diffuse = diff * vec3(1.0, 1.0, 1.0);
+    }
     
     // Combine lighting with texture and vertex color
-    vec3 lighting = ambient + diffuse;
-    vec3 result = lighting * texColor.rgb * fragColor;
+    vec3 result = (ambient + diffuse) * texColor.rgb * fragColor;
     
     outColor = vec4(result, 1.0);
 }
\ No newline at end of file
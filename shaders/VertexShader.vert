@@ -18,10 +18,16 @@ layout(location = 3) in vec2 inTexCoord;
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
 layout(location = 2) out vec3 fragNormal;
+layout(location = 3) out vec3 fragWorldPos;    // Shadow map lookups
+layout(location = 4) out float fragViewDepth;  // Cascade selection
 
 void main() {
     // Transform the vertex position
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    vec4 worldPos = ubo.model * vec4(inPosition, 1.0);
+    vec4 viewPos = ubo.view * worldPos;
+    gl_Position = ubo.proj * viewPos;
+    fragWorldPos = worldPos.xyz;
+    fragViewDepth = -viewPos.z;
     
     // Pass color, texture coordinates and normals to fragment shader
     fragColor = inColor;
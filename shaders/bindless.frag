@@ -0,0 +1,50 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Input from vertex shader
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) in vec3 fragNormal;
+layout(location = 3) in vec3 fragWorldPos;
+layout(location = 4) in float fragViewDepth;
+
+#include "lighting.glsl"
+
+// Every texture in the scene (BindlessTextureTable), index 0 is the default texture
+layout(set = 2, binding = 0) uniform sampler2D textures[];
+
+// Texture of the current draw
+layout(push_constant) uniform PushConstants {
+    uint textureIndex;
+} pc;
+
+// Output color
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    // The index is the same for the whole draw, so no nonuniformEXT is needed
+    vec4 texColor = texture(textures[pc.textureIndex], fragTexCoord);
+    
+    // Ambient lighting
+    float ambientStrength = 0.3;
+    vec3 ambient = ambientStrength * vec3(1.0, 1.0, 1.0);
+    
+    // Diffuse lighting from the scene's lights; scenes without any keep the
+    // fixed light from above
+    vec3 normal = normalize(fragNormal);
+    vec3 diffuse;
+    if (lighting.counts.x > 0u) {
+        diffuse = computeLighting(fragWorldPos, normal, fragViewDepth);
+    } else {
+        vec3 lightDir = normalize(vec3(1.0, 1.0, 1.0));
+        float diff = max(dot(normal, lightDir), 0.0);
+        diffuse = diff * vec3(1.0, 1.0, 1.0);
+    }
+    
+    // Combine lighting with texture and vertex color
+    vec3 result = (ambient + diffuse) * texColor.rgb * fragColor;
+    
+    outColor = vec4(result, 1.0);
+}
@@ -0,0 +1,118 @@
+// Lights and shadow maps (set 1), shared by the forward fragment shaders.
+// Mirrors include/render/Lighting.h and include/culling/LightCuller.h.
+
+#define MAX_SHADOW_MAPS 16
+#define CASCADE_COUNT 4
+
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+
+#define LIGHT_DIRECTIONAL 0
+#define LIGHT_SPOT 1
+#define LIGHT_POINT 2
+
+struct Light {
+    vec4 position;   // xyz world position, w type
+    vec4 color;      // rgb color, a intensity
+    vec4 direction;  // xyz direction, w range
+    vec4 params;     // x cos(inner angle), y cos(outer angle), z first shadow map (-1 for none)
+};
+
+layout(set = 1, binding = 0) uniform LightingData {
+    mat4 shadowMatrices[MAX_SHADOW_MAPS];
+    vec4 cascadeSplits;
+    uvec4 counts;         // x light count, y bit per shadow map sampled from the composited array,
+                          // z directional lights (the first ones)
+    vec4 clusterParams;   // xy depth slice scale and bias (of log depth), zw clusters per pixel
+} lighting;
+
+// Cached maps of static geometry, and copies with the moving casters drawn on top.
+// A map only has a composited layer when something moving casts into it.
+layout(set = 1, binding = 1) uniform sampler2DArrayShadow staticShadowMaps;
+layout(set = 1, binding = 2) uniform sampler2DArrayShadow compositeShadowMaps;
+
+layout(std430, set = 1, binding = 3) readonly buffer Lights {
+    Light lights[];
+};
+
+// Written by the light cull pass (shaders/light_cull.comp): per cluster an offset
+// into lightIndices and a count
+layout(std430, set = 1, binding = 4) readonly buffer ClusterGrid {
+    uvec2 clusters[];
+};
+
+layout(std430, set = 1, binding = 5) readonly buffer LightIndices {
+    uint lightIndices[];
+};
+
+// 1 when lit, 0 when in shadow (2x2 PCF from the comparison sampler)
+float sampleShadow(int map, vec3 worldPos) {
+    vec4 coord = lighting.shadowMatrices[map] * vec4(worldPos, 1.0);
+    coord.xyz /= coord.w;
+    if (coord.z <= 0.0 || coord.z >= 1.0) {
+        return 1.0;
+    }
+
+    vec4 lookup = vec4(coord.xy, float(map), coord.z);
+    if ((lighting.counts.y & (1u << uint(map))) != 0u) {
+        return texture(compositeShadowMaps, lookup);
+    }
+    return texture(staticShadowMaps, lookup);
+}
+
+// Diffuse light one light brings to a surface point, shadow included
+vec3 shadeLight(Light light, vec3 worldPos, vec3 normal, float viewDepth) {
+    uint type = uint(light.position.w);
+    int map = int(light.params.z);
+    vec3 toLight;
+    float attenuation = 1.0;
+
+    if (type == LIGHT_DIRECTIONAL) {
+        toLight = -light.direction.xyz;
+        if (map >= 0) {
+            // Nearest cascade that still covers this distance
+            int cascade = 0;
+            while (cascade < CASCADE_COUNT - 1 && viewDepth > lighting.cascadeSplits[cascade]) {
+                cascade++;
+            }
+            map += cascade;
+        }
+    } else {
+        vec3 offset = light.position.xyz - worldPos;
+        float distance = length(offset);
+        toLight = offset / max(distance, 0.0001);
+
+        float falloff = clamp(1.0 - distance / light.direction.w, 0.0, 1.0);
+        attenuation = falloff * falloff;
+        if (type == LIGHT_SPOT) {
+            attenuation *= clamp((dot(-toLight, light.direction.xyz) - light.params.y) /
+                                 max(light.params.x - light.params.y, 0.0001), 0.0, 1.0);
+        }
+    }
+
+    float diffuse = max(dot(normal, toLight), 0.0) * attenuation;
+    if (diffuse <= 0.0) {
+        return vec3(0.0);
+    }
+    float shadow = map >= 0 ? sampleShadow(map, worldPos) : 1.0;
+    return light.color.rgb * light.color.a * diffuse * shadow;
+}
+
+// Diffuse light reaching a surface point: every directional light, and the local
+// lights the cull pass listed for this fragment's cluster
+vec3 computeLighting(vec3 worldPos, vec3 normal, float viewDepth) {
+    vec3 result = vec3(0.0);
+    for (uint i = 0u; i < lighting.counts.z; i++) {
+        result += shadeLight(lights[i], worldPos, normal, viewDepth);
+    }
+
+    uvec2 tile = min(uvec2(gl_FragCoord.xy * lighting.clusterParams.zw), uvec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+    float slice = log(max(viewDepth, 0.0001)) * lighting.clusterParams.x + lighting.clusterParams.y;
+    uint z = uint(clamp(slice, 0.0, float(CLUSTER_Z - 1)));
+    uvec2 cluster = clusters[(z * CLUSTER_Y + tile.y) * CLUSTER_X + tile.x];
+    for (uint i = 0u; i < cluster.y; i++) {
+        result += shadeLight(lights[lightIndices[cluster.x + i]], worldPos, normal, viewDepth);
+    }
+    return result;
+}
@@ -10,6 +10,8 @@ layout(push_constant) uniform PushConstants {
     float gamma;
     float saturation;
     float padding;
+    vec2 uvScale;   // The scene may only cover the top-left of its image
+    vec2 uvMax;
 } push;
 
 vec3 reinhardTonemap(vec3 color) {
@@ -31,7 +33,7 @@ vec3 adjustSaturation(vec3 color, float saturation) {
 }
 
 void main() {
-    vec3 color = texture(inputImage, fragTexCoord).rgb;
+    vec3 color = texture(inputImage, min(fragTexCoord * push.uvScale, push.uvMax)).rgb;
     
     // Exposure
     color *= push.exposure;
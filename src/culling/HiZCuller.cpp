@@ -0,0 +1,377 @@
+﻿#include "../include/culling/HiZCuller.h"
+#include "../VulkanRenderer.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+    struct CullPushConstants {
+        glm::mat4 viewProj;
+        glm::vec2 depthSize;
+        uint32_t instanceCount;
+        uint32_t pyramidLevels;
+    };
+
+    const uint32_t CULL_GROUP_SIZE = 64;
+}
+
+HiZCuller::HiZCuller(VulkanRenderer* renderer, uint32_t framesInFlight)
+    : renderer(renderer), device(renderer->getDevice()), framesInFlight(framesInFlight) {
+    // Nearest sampling, the shaders only use texelFetch
+    pyramidSampler = renderer->getSamplerCache()->get(SamplerDesc::nearestClamp());
+
+    createPipelines();
+}
+
+HiZCuller::~HiZCuller() {
+    destroyDescriptorSets();
+    destroyBuffers();
+    destroyPyramid();
+
+    vkDestroyPipeline(device, cullPipeline, nullptr);
+    vkDestroyPipeline(device, refreshPipeline, nullptr);
+    vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, cullSetLayout, nullptr);
+}
+
+void HiZCuller::resize(VkExtent2D extent, VkImageView imageView) {
+    destroyDescriptorSets();
+    destroyPyramid();
+
+    depthExtent = extent;
+    depthImageView = imageView;
+
+    createPyramid();
+    createDescriptorSets();
+}
+
+void HiZCuller::updateInstances(uint32_t frameIndex, const std::vector<CullInstance>& instances) {
+    uint32_t count = static_cast<uint32_t>(instances.size());
+
+    if (count > instanceCapacity) {
+        // Growing happens rarely (new instances), so waiting for all submitted work is acceptable here
+        GpuTimeline* timeline = renderer->getGpuTimeline();
+        timeline->wait(timeline->getSubmittedValue());
+        destroyDescriptorSets();
+        destroyBuffers();
+        createBuffers(std::max({ count, instanceCapacity * 2, 64u }));
+        createDescriptorSets();
+    }
+
+    if (count > 0) {
+        memcpy(instanceBuffersMapped[frameIndex], instances.data(), sizeof(CullInstance) * count);
+    }
+    instanceCount = count;
+}
+
+void HiZCuller::recordDrawBufferClear(VkCommandBuffer commandBuffer) {
+    VkDeviceSize size = sizeof(VkDrawIndexedIndirectCommand) * instanceCapacity;
+    vkCmdFillBuffer(commandBuffer, earlyDrawBuffer, 0, size, 0);
+    vkCmdFillBuffer(commandBuffer, lateDrawBuffer, 0, size, 0);
+    drawBuffersNeedClear = false;
+}
+
+void HiZCuller::recordEarlyRefresh(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+    if (instanceCount == 0) {
+        return;
+    }
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, refreshPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout,
+        0, 1, &cullSets[frameIndex], 0, nullptr);
+    vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT,
+        offsetof(CullPushConstants, instanceCount), sizeof(uint32_t), &instanceCount);
+
+    vkCmdDispatch(commandBuffer, (instanceCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+}
+
+void HiZCuller::recordPyramidBuild(VkCommandBuffer commandBuffer) {
+    // Every level in one pass instead of one dispatch and barrier per level
+    renderer->getMipGenerator()->record(commandBuffer, pyramidChain);
+}
+
+void HiZCuller::recordCull(VkCommandBuffer commandBuffer, uint32_t frameIndex, const glm::mat4& viewProj,
+                           VkExtent2D renderExtent) {
+    if (instanceCount == 0) {
+        return;
+    }
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout,
+        0, 1, &cullSets[frameIndex], 0, nullptr);
+
+    CullPushConstants push{};
+    push.viewProj = viewProj;
+    // Screen UVs map onto the drawn part only. Pyramid texels straddling its edge
+    // also hold stale depth, which only raises their max: still conservative
+    push.depthSize = glm::vec2(static_cast<float>(renderExtent.width), static_cast<float>(renderExtent.height));
+    push.instanceCount = instanceCount;
+    push.pyramidLevels = pyramidLevels;
+    vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT,
+        0, sizeof(push), &push);
+
+    vkCmdDispatch(commandBuffer, (instanceCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+}
+
+void HiZCuller::createPipelines() {
+    // Cull: pyramid + instances + early/late draw commands
+    std::array<VkDescriptorSetLayoutBinding, 4> cullBindings{};
+    cullBindings[0].binding = 0;
+    cullBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    cullBindings[0].descriptorCount = 1;
+    cullBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    cullBindings[0].pImmutableSamplers = &pyramidSampler;
+    for (uint32_t i = 1; i < cullBindings.size(); i++) {
+        cullBindings[i].binding = i;
+        cullBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        cullBindings[i].descriptorCount = 1;
+        cullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(cullBindings.size());
+    layoutInfo.pBindings = cullBindings.data();
+
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &cullSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create occlusion cull descriptor set layout!");
+    }
+
+    VkPushConstantRange pushRange{};
+    pushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushRange.offset = 0;
+    pushRange.size = sizeof(CullPushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &cullSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushRange;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &cullPipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create occlusion cull pipeline layout!");
+    }
+
+    cullPipeline = createComputePipeline("shaders/hiz_cull_comp.spv", cullPipelineLayout);
+    refreshPipeline = createComputePipeline("shaders/hiz_refresh_comp.spv", cullPipelineLayout);
+}
+
+VkPipeline HiZCuller::createComputePipeline(const std::string& shaderFile, VkPipelineLayout layout) {
+    auto code = renderer->readFile(shaderFile);
+    VkShaderModule module = renderer->createShaderModule(code);
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = module;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = layout;
+
+    VkPipeline pipeline;
+    if (vkCreateComputePipelines(device, renderer->getPipelineCache(), 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create compute pipeline: " + shaderFile);
+    }
+
+    vkDestroyShaderModule(device, module, nullptr);
+    return pipeline;
+}
+
+void HiZCuller::createPyramid() {
+    // Level 0 is half the depth resolution, each level halves again down to 1x1
+    pyramidExtent = { std::max(depthExtent.width / 2, 1u), std::max(depthExtent.height / 2, 1u) };
+    pyramidLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(pyramidExtent.width, pyramidExtent.height)))) + 1;
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = pyramidExtent.width;
+    imageInfo.extent.height = pyramidExtent.height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = pyramidLevels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = PYRAMID_FORMAT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateImage(device, &imageInfo, nullptr, &pyramidImage) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create depth pyramid image!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(device, pyramidImage, &memRequirements);
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = renderer->findMemoryType(memRequirements.memoryTypeBits,
+                                                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    if (vkAllocateMemory(device, &allocInfo, nullptr, &pyramidMemory) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate depth pyramid memory!");
+    }
+    vkBindImageMemory(device, pyramidImage, pyramidMemory, 0);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = pyramidImage;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = PYRAMID_FORMAT;
+    viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, pyramidLevels, 0, 1 };
+
+    if (vkCreateImageView(device, &viewInfo, nullptr, &pyramidView) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create depth pyramid view!");
+    }
+
+    pyramidChain = renderer->getMipGenerator()->createChain(depthImageView,
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, depthExtent, pyramidImage, PYRAMID_FORMAT,
+        pyramidLevels, MipGenerator::Reduction::MaxDepth);
+}
+
+void HiZCuller::destroyPyramid() {
+    renderer->getMipGenerator()->destroyChain(pyramidChain);
+    pyramidLevels = 0;
+
+    if (pyramidView != VK_NULL_HANDLE) {
+        vkDestroyImageView(device, pyramidView, nullptr);
+        pyramidView = VK_NULL_HANDLE;
+    }
+    if (pyramidImage != VK_NULL_HANDLE) {
+        vkDestroyImage(device, pyramidImage, nullptr);
+        pyramidImage = VK_NULL_HANDLE;
+    }
+    if (pyramidMemory != VK_NULL_HANDLE) {
+        vkFreeMemory(device, pyramidMemory, nullptr);
+        pyramidMemory = VK_NULL_HANDLE;
+    }
+}
+
+void HiZCuller::createBuffers(uint32_t capacity) {
+    instanceCapacity = capacity;
+
+    VkDeviceSize instanceSize = sizeof(CullInstance) * capacity;
+    instanceBuffers.resize(framesInFlight);
+    instanceBuffersMemory.resize(framesInFlight);
+    instanceBuffersMapped.resize(framesInFlight);
+
+    for (uint32_t i = 0; i < framesInFlight; i++) {
+        renderer->createBuffer(instanceSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            instanceBuffers[i], instanceBuffersMemory[i]);
+        vkMapMemory(device, instanceBuffersMemory[i], 0, instanceSize, 0, &instanceBuffersMapped[i]);
+    }
+
+    VkDeviceSize drawSize = sizeof(VkDrawIndexedIndirectCommand) * capacity;
+    VkBufferUsageFlags drawUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                   VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    renderer->createBuffer(drawSize, drawUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        earlyDrawBuffer, earlyDrawBufferMemory);
+    renderer->createBuffer(drawSize, drawUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        lateDrawBuffer, lateDrawBufferMemory);
+
+    drawBuffersNeedClear = true;
+}
+
+void HiZCuller::destroyBuffers() {
+    for (size_t i = 0; i < instanceBuffers.size(); i++) {
+        vkUnmapMemory(device, instanceBuffersMemory[i]);
+        vkDestroyBuffer(device, instanceBuffers[i], nullptr);
+        vkFreeMemory(device, instanceBuffersMemory[i], nullptr);
+    }
+    instanceBuffers.clear();
+    instanceBuffersMemory.clear();
+    instanceBuffersMapped.clear();
+
+    if (earlyDrawBuffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device, earlyDrawBuffer, nullptr);
+        vkFreeMemory(device, earlyDrawBufferMemory, nullptr);
+        earlyDrawBuffer = VK_NULL_HANDLE;
+    }
+    if (lateDrawBuffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device, lateDrawBuffer, nullptr);
+        vkFreeMemory(device, lateDrawBufferMemory, nullptr);
+        lateDrawBuffer = VK_NULL_HANDLE;
+    }
+    instanceCapacity = 0;
+}
+
+void HiZCuller::createDescriptorSets() {
+    // Both halves are needed; whichever arrives last builds the sets
+    if (pyramidImage == VK_NULL_HANDLE || earlyDrawBuffer == VK_NULL_HANDLE) {
+        return;
+    }
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[0].descriptorCount = framesInFlight;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[1].descriptorCount = framesInFlight * 3;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = framesInFlight;
+
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create occlusion culling descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> cullLayouts(framesInFlight, cullSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = framesInFlight;
+    allocInfo.pSetLayouts = cullLayouts.data();
+
+    cullSets.resize(framesInFlight);
+    if (vkAllocateDescriptorSets(device, &allocInfo, cullSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate occlusion cull descriptor sets!");
+    }
+
+    for (uint32_t i = 0; i < framesInFlight; i++) {
+        VkDescriptorImageInfo pyramidInfo{};
+        pyramidInfo.sampler = pyramidSampler;
+        pyramidInfo.imageView = pyramidView;
+        pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        std::array<VkDescriptorBufferInfo, 3> bufferInfos{};
+        bufferInfos[0] = { instanceBuffers[i], 0, VK_WHOLE_SIZE };
+        bufferInfos[1] = { earlyDrawBuffer, 0, VK_WHOLE_SIZE };
+        bufferInfos[2] = { lateDrawBuffer, 0, VK_WHOLE_SIZE };
+
+        std::array<VkWriteDescriptorSet, 4> writes{};
+        writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[0].dstSet = cullSets[i];
+        writes[0].dstBinding = 0;
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[0].descriptorCount = 1;
+        writes[0].pImageInfo = &pyramidInfo;
+
+        for (uint32_t b = 0; b < bufferInfos.size(); b++) {
+            writes[b + 1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[b + 1].dstSet = cullSets[i];
+            writes[b + 1].dstBinding = b + 1;
+            writes[b + 1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[b + 1].descriptorCount = 1;
+            writes[b + 1].pBufferInfo = &bufferInfos[b];
+        }
+
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+}
+
+void HiZCuller::destroyDescriptorSets() {
+    if (descriptorPool != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+        descriptorPool = VK_NULL_HANDLE;
+    }
+    cullSets.clear();
+}
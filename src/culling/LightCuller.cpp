@@ -0,0 +1,207 @@
+﻿#include "../include/culling/LightCuller.h"
+#include "../VulkanRenderer.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+    struct CullPushConstants {
+        glm::mat4 view;
+        glm::vec4 frustum;  // xy tan of the half field of view, z near, w far
+        uint32_t firstLight;
+        uint32_t lightCount;
+        uint32_t indexCapacity;
+    };
+
+    const uint32_t CULL_GROUP_SIZE = 64;
+}
+
+LightCuller::LightCuller(VulkanRenderer* renderer, uint32_t framesInFlight)
+    : renderer(renderer), device(renderer->getDevice()), framesInFlight(framesInFlight) {
+    createBuffers();
+    createPipeline();
+    createDescriptorSets();
+}
+
+LightCuller::~LightCuller() {
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    vkDestroyPipeline(device, cullPipeline, nullptr);
+    vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, cullSetLayout, nullptr);
+
+    for (uint32_t i = 0; i < framesInFlight; i++) {
+        vkUnmapMemory(device, lightBuffersMemory[i]);
+        vkDestroyBuffer(device, lightBuffers[i], nullptr);
+        vkFreeMemory(device, lightBuffersMemory[i], nullptr);
+    }
+    vkDestroyBuffer(device, gridBuffer, nullptr);
+    vkFreeMemory(device, gridBufferMemory, nullptr);
+    vkDestroyBuffer(device, indexBuffer, nullptr);
+    vkFreeMemory(device, indexBufferMemory, nullptr);
+    vkDestroyBuffer(device, counterBuffer, nullptr);
+    vkFreeMemory(device, counterBufferMemory, nullptr);
+}
+
+uint32_t LightCuller::updateLights(uint32_t frameIndex, const std::vector<GpuLight>& lights, uint32_t directionalCount) {
+    lightCount = static_cast<uint32_t>(std::min<size_t>(lights.size(), Lighting::MAX_LIGHTS));
+    firstLocalLight = std::min(directionalCount, lightCount);
+    if (lightCount > 0) {
+        memcpy(lightBuffersMapped[frameIndex], lights.data(), sizeof(GpuLight) * lightCount);
+    }
+    return lightCount;
+}
+
+glm::vec4 LightCuller::getClusterParams(VkExtent2D extent, float nearPlane, float farPlane) {
+    // slice = log(depth / near) / log(far / near) * CLUSTER_Z, as scale * log(depth) + bias
+    float scale = CLUSTER_Z / std::log(farPlane / nearPlane);
+    return glm::vec4(scale, -scale * std::log(nearPlane),
+                     static_cast<float>(CLUSTER_X) / extent.width,
+                     static_cast<float>(CLUSTER_Y) / extent.height);
+}
+
+void LightCuller::recordCounterReset(VkCommandBuffer commandBuffer) {
+    vkCmdFillBuffer(commandBuffer, counterBuffer, 0, sizeof(uint32_t), 0);
+}
+
+void LightCuller::recordCull(VkCommandBuffer commandBuffer, uint32_t frameIndex, const glm::mat4& view,
+                             float fovY, float aspectRatio, float nearPlane, float farPlane) {
+    // Runs without local lights too: every cluster still needs its empty list
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout,
+        0, 1, &cullSets[frameIndex], 0, nullptr);
+
+    float tanY = std::tan(fovY * 0.5f);
+    CullPushConstants push{};
+    push.view = view;
+    push.frustum = glm::vec4(tanY * aspectRatio, tanY, nearPlane, farPlane);
+    push.firstLight = firstLocalLight;
+    push.lightCount = lightCount;
+    push.indexCapacity = MAX_LIGHT_INDICES;
+    vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT,
+        0, sizeof(push), &push);
+
+    vkCmdDispatch(commandBuffer, (CLUSTER_COUNT + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+}
+
+void LightCuller::createBuffers() {
+    VkDeviceSize lightSize = sizeof(GpuLight) * Lighting::MAX_LIGHTS;
+    lightBuffers.resize(framesInFlight);
+    lightBuffersMemory.resize(framesInFlight);
+    lightBuffersMapped.resize(framesInFlight);
+
+    for (uint32_t i = 0; i < framesInFlight; i++) {
+        renderer->createBuffer(lightSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            lightBuffers[i], lightBuffersMemory[i]);
+        vkMapMemory(device, lightBuffersMemory[i], 0, lightSize, 0, &lightBuffersMapped[i]);
+    }
+
+    renderer->createBuffer(sizeof(glm::uvec2) * CLUSTER_COUNT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, gridBuffer, gridBufferMemory);
+    renderer->createBuffer(sizeof(uint32_t) * MAX_LIGHT_INDICES, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
+    renderer->createBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, counterBuffer, counterBufferMemory);
+}
+
+void LightCuller::createPipeline() {
+    // Lights + cluster grid + light indices + index counter
+    std::array<VkDescriptorSetLayoutBinding, 4> cullBindings{};
+    for (uint32_t i = 0; i < cullBindings.size(); i++) {
+        cullBindings[i].binding = i;
+        cullBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        cullBindings[i].descriptorCount = 1;
+        cullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(cullBindings.size());
+    layoutInfo.pBindings = cullBindings.data();
+
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &cullSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create light cull descriptor set layout!");
+    }
+
+    VkPushConstantRange pushRange{};
+    pushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushRange.offset = 0;
+    pushRange.size = sizeof(CullPushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &cullSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushRange;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &cullPipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create light cull pipeline layout!");
+    }
+
+    auto code = renderer->readFile("shaders/light_cull_comp.spv");
+    VkShaderModule module = renderer->createShaderModule(code);
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = module;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = cullPipelineLayout;
+
+    if (vkCreateComputePipelines(device, renderer->getPipelineCache(), 1, &pipelineInfo, nullptr, &cullPipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create compute pipeline: shaders/light_cull_comp.spv");
+    }
+    vkDestroyShaderModule(device, module, nullptr);
+}
+
+void LightCuller::createDescriptorSets() {
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount = framesInFlight * 4;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = framesInFlight;
+
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create light cull descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> cullLayouts(framesInFlight, cullSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = framesInFlight;
+    allocInfo.pSetLayouts = cullLayouts.data();
+
+    cullSets.resize(framesInFlight);
+    if (vkAllocateDescriptorSets(device, &allocInfo, cullSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate light cull descriptor sets!");
+    }
+
+    for (uint32_t i = 0; i < framesInFlight; i++) {
+        std::array<VkDescriptorBufferInfo, 4> bufferInfos{};
+        bufferInfos[0] = { lightBuffers[i], 0, VK_WHOLE_SIZE };
+        bufferInfos[1] = { gridBuffer, 0, VK_WHOLE_SIZE };
+        bufferInfos[2] = { indexBuffer, 0, VK_WHOLE_SIZE };
+        bufferInfos[3] = { counterBuffer, 0, VK_WHOLE_SIZE };
+
+        std::array<VkWriteDescriptorSet, 4> writes{};
+        for (uint32_t b = 0; b < bufferInfos.size(); b++) {
+            writes[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[b].dstSet = cullSets[i];
+            writes[b].dstBinding = b;
+            writes[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[b].descriptorCount = 1;
+            writes[b].pBufferInfo = &bufferInfos[b];
+        }
+
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+}
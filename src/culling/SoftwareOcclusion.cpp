@@ -0,0 +1,304 @@
+﻿#include "../include/culling/SoftwareOcclusion.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define MI_OCCLUSION_SSE 1
+#endif
+
+namespace {
+    // Vertices closer than this are treated as crossing the near plane
+    const float MIN_CLIP_W = 1e-5f;
+}
+
+SoftwareOcclusionCuller::SoftwareOcclusionCuller(uint32_t width, uint32_t height) {
+    // Whole tiles keep the SIMD loops free of edge cases
+    tilesX = std::max((width + TILE_WIDTH - 1) / TILE_WIDTH, 1u);
+    tilesY = std::max((height + TILE_HEIGHT - 1) / TILE_HEIGHT, 1u);
+    this->width = tilesX * TILE_WIDTH;
+    this->height = tilesY * TILE_HEIGHT;
+
+    depthBuffer.resize(static_cast<size_t>(this->width) * this->height);
+    tileMaxDepth.resize(static_cast<size_t>(tilesX) * tilesY);
+    tileBins.resize(static_cast<size_t>(tilesX) * tilesY);
+    clear();
+}
+
+void SoftwareOcclusionCuller::cull(const std::vector<OccluderMesh>& occluders, const std::vector<AABB>& bounds,
+                                   const glm::mat4& viewProj, std::vector<uint8_t>& visibility) {
+    clear();
+    for (const auto& occluder : occluders) {
+        addOccluder(occluder, viewProj);
+    }
+    rasterize();
+
+    visibility.resize(bounds.size());
+    for (size_t i = 0; i < bounds.size(); i++) {
+        visibility[i] = isVisible(bounds[i], viewProj) ? 1 : 0;
+    }
+}
+
+void SoftwareOcclusionCuller::clear() {
+    std::fill(depthBuffer.begin(), depthBuffer.end(), 1.0f);
+    std::fill(tileMaxDepth.begin(), tileMaxDepth.end(), 1.0f);
+    for (auto& bin : tileBins) {
+        bin.clear();
+    }
+}
+
+void SoftwareOcclusionCuller::addOccluder(const OccluderMesh& occluder, const glm::mat4& viewProj) {
+    glm::mat4 modelViewProj = viewProj * occluder.modelMatrix;
+
+    clipScratch.resize(occluder.positions.size());
+    for (size_t i = 0; i < occluder.positions.size(); i++) {
+        clipScratch[i] = modelViewProj * glm::vec4(occluder.positions[i], 1.0f);
+    }
+
+    for (size_t i = 0; i + 2 < occluder.indices.size(); i += 3) {
+        binTriangle(clipScratch[occluder.indices[i]],
+                    clipScratch[occluder.indices[i + 1]],
+                    clipScratch[occluder.indices[i + 2]]);
+    }
+}
+
+void SoftwareOcclusionCuller::binTriangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2) {
+    // Dropping an occluder triangle is always safe, so no near-plane clipping
+    if (c0.w < MIN_CLIP_W || c1.w < MIN_CLIP_W || c2.w < MIN_CLIP_W) {
+        return;
+    }
+
+    glm::vec3 v[3];
+    const glm::vec4* clip[3] = { &c0, &c1, &c2 };
+    for (int i = 0; i < 3; i++) {
+        float invW = 1.0f / clip[i]->w;
+        v[i].x = (clip[i]->x * invW * 0.5f + 0.5f) * width;
+        v[i].y = (clip[i]->y * invW * 0.5f + 0.5f) * height;
+        v[i].z = clip[i]->z * invW;
+    }
+
+    // Entirely beyond the far plane or off screen
+    if (v[0].z > 1.0f && v[1].z > 1.0f && v[2].z > 1.0f) {
+        return;
+    }
+
+    float minXf = std::min({ v[0].x, v[1].x, v[2].x });
+    float maxXf = std::max({ v[0].x, v[1].x, v[2].x });
+    float minYf = std::min({ v[0].y, v[1].y, v[2].y });
+    float maxYf = std::max({ v[0].y, v[1].y, v[2].y });
+
+    // Pixel centers covered by the bounding box
+    int32_t minX = std::max(static_cast<int32_t>(std::ceil(minXf - 0.5f)), 0);
+    int32_t maxX = std::min(static_cast<int32_t>(std::floor(maxXf - 0.5f)), static_cast<int32_t>(width) - 1);
+    int32_t minY = std::max(static_cast<int32_t>(std::ceil(minYf - 0.5f)), 0);
+    int32_t maxY = std::min(static_cast<int32_t>(std::floor(maxYf - 0.5f)), static_cast<int32_t>(height) - 1);
+    if (minX > maxX || minY > maxY) {
+        return;
+    }
+
+    BinnedTriangle tri;
+    // Edge i is opposite vertex i: E(x, y) = A*x + B*y + C
+    for (int i = 0; i < 3; i++) {
+        const glm::vec3& a = v[(i + 1) % 3];
+        const glm::vec3& b = v[(i + 2) % 3];
+        tri.edgeA[i] = a.y - b.y;
+        tri.edgeB[i] = b.x - a.x;
+        tri.edgeC[i] = a.x * b.y - a.y * b.x;
+    }
+
+    float area = tri.edgeA[0] * v[0].x + tri.edgeB[0] * v[0].y + tri.edgeC[0];
+    if (std::fabs(area) < 1e-8f) {
+        return;
+    }
+
+    // Occluders are rendered double sided: flip edges so the inside is always positive
+    if (area < 0.0f) {
+        for (int i = 0; i < 3; i++) {
+            tri.edgeA[i] = -tri.edgeA[i];
+            tri.edgeB[i] = -tri.edgeB[i];
+            tri.edgeC[i] = -tri.edgeC[i];
+        }
+        area = -area;
+    }
+
+    // z = z0 + (E1 * (z1 - z0) + E2 * (z2 - z0)) / area, expanded into a plane
+    float invArea = 1.0f / area;
+    float dz1 = (v[1].z - v[0].z) * invArea;
+    float dz2 = (v[2].z - v[0].z) * invArea;
+    tri.depthA = tri.edgeA[1] * dz1 + tri.edgeA[2] * dz2;
+    tri.depthB = tri.edgeB[1] * dz1 + tri.edgeB[2] * dz2;
+    tri.depthC = v[0].z + tri.edgeC[1] * dz1 + tri.edgeC[2] * dz2;
+
+    tri.minX = minX;
+    tri.maxX = maxX;
+    tri.minY = minY;
+    tri.maxY = maxY;
+
+    uint32_t tileMinX = minX / TILE_WIDTH;
+    uint32_t tileMaxX = maxX / TILE_WIDTH;
+    uint32_t tileMinY = minY / TILE_HEIGHT;
+    uint32_t tileMaxY = maxY / TILE_HEIGHT;
+    for (uint32_t ty = tileMinY; ty <= tileMaxY; ty++) {
+        for (uint32_t tx = tileMinX; tx <= tileMaxX; tx++) {
+            tileBins[ty * tilesX + tx].push_back(tri);
+        }
+    }
+}
+
+void SoftwareOcclusionCuller::rasterize() {
+    // Tiles are independent; walking them in order keeps each tile's depth in cache
+    for (uint32_t ty = 0; ty < tilesY; ty++) {
+        for (uint32_t tx = 0; tx < tilesX; tx++) {
+            rasterizeTile(tx, ty);
+        }
+    }
+}
+
+void SoftwareOcclusionCuller::rasterizeTile(uint32_t tileX, uint32_t tileY) {
+    const auto& bin = tileBins[tileY * tilesX + tileX];
+    if (bin.empty()) {
+        return;
+    }
+
+    int32_t tileMinX = static_cast<int32_t>(tileX * TILE_WIDTH);
+    int32_t tileMinY = static_cast<int32_t>(tileY * TILE_HEIGHT);
+    int32_t tileMaxX = tileMinX + static_cast<int32_t>(TILE_WIDTH) - 1;
+    int32_t tileMaxY = tileMinY + static_cast<int32_t>(TILE_HEIGHT) - 1;
+
+    for (const auto& tri : bin) {
+        // Start on a 4-pixel boundary; extra lanes fall outside the triangle's edges
+        int32_t x0 = std::max(tri.minX, tileMinX) & ~3;
+        int32_t x1 = std::min(tri.maxX, tileMaxX);
+        int32_t y0 = std::max(tri.minY, tileMinY);
+        int32_t y1 = std::min(tri.maxY, tileMaxY);
+
+        for (int32_t y = y0; y <= y1; y++) {
+            float py = static_cast<float>(y) + 0.5f;
+            float* row = &depthBuffer[static_cast<size_t>(y) * width];
+
+#ifdef MI_OCCLUSION_SSE
+            __m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+            __m128 zero = _mm_setzero_ps();
+            __m128 rowE0 = _mm_set1_ps(tri.edgeB[0] * py + tri.edgeC[0]);
+            __m128 rowE1 = _mm_set1_ps(tri.edgeB[1] * py + tri.edgeC[1]);
+            __m128 rowE2 = _mm_set1_ps(tri.edgeB[2] * py + tri.edgeC[2]);
+            __m128 rowZ = _mm_set1_ps(tri.depthB * py + tri.depthC);
+            __m128 a0 = _mm_set1_ps(tri.edgeA[0]);
+            __m128 a1 = _mm_set1_ps(tri.edgeA[1]);
+            __m128 a2 = _mm_set1_ps(tri.edgeA[2]);
+            __m128 az = _mm_set1_ps(tri.depthA);
+
+            for (int32_t x = x0; x <= x1; x += 4) {
+                __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+                __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, px), rowE0);
+                __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, px), rowE1);
+                __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, px), rowE2);
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)),
+                                           _mm_cmpge_ps(e2, zero));
+                if (_mm_movemask_ps(inside) == 0) {
+                    continue;
+                }
+
+                __m128 z = _mm_add_ps(_mm_mul_ps(az, px), rowZ);
+                __m128 current = _mm_loadu_ps(row + x);
+                __m128 nearest = _mm_min_ps(current, z);
+                __m128 result = _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, current));
+                _mm_storeu_ps(row + x, result);
+            }
+#else
+            for (int32_t x = x0; x <= x1; x++) {
+                float px = static_cast<float>(x) + 0.5f;
+                float e0 = tri.edgeA[0] * px + tri.edgeB[0] * py + tri.edgeC[0];
+                float e1 = tri.edgeA[1] * px + tri.edgeB[1] * py + tri.edgeC[1];
+                float e2 = tri.edgeA[2] * px + tri.edgeB[2] * py + tri.edgeC[2];
+                if (e0 >= 0.0f && e1 >= 0.0f && e2 >= 0.0f) {
+                    float z = tri.depthA * px + tri.depthB * py + tri.depthC;
+                    row[x] = std::min(row[x], z);
+                }
+            }
+#endif
+        }
+    }
+
+    // Farthest depth in the tile, used to reject whole tiles when testing
+    float maxDepth = 0.0f;
+    for (int32_t y = tileMinY; y <= tileMaxY; y++) {
+        const float* row = &depthBuffer[static_cast<size_t>(y) * width];
+        for (int32_t x = tileMinX; x <= tileMaxX; x++) {
+            maxDepth = std::max(maxDepth, row[x]);
+        }
+    }
+    tileMaxDepth[tileY * tilesX + tileX] = maxDepth;
+}
+
+bool SoftwareOcclusionCuller::isVisible(const AABB& worldBounds, const glm::mat4& viewProj) const {
+    glm::vec3 ndcMin(FLT_MAX);
+    glm::vec3 ndcMax(-FLT_MAX);
+
+    for (int i = 0; i < 8; i++) {
+        glm::vec3 corner((i & 1) ? worldBounds.max.x : worldBounds.min.x,
+                         (i & 2) ? worldBounds.max.y : worldBounds.min.y,
+                         (i & 4) ? worldBounds.max.z : worldBounds.min.z);
+        glm::vec4 clip = viewProj * glm::vec4(corner, 1.0f);
+
+        // Crossing the near plane: can't be tested
+        if (clip.w < MIN_CLIP_W) {
+            return true;
+        }
+
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        ndcMin = glm::min(ndcMin, ndc);
+        ndcMax = glm::max(ndcMax, ndc);
+    }
+
+    if (ndcMax.x < -1.0f || ndcMin.x > 1.0f || ndcMax.y < -1.0f || ndcMin.y > 1.0f || ndcMin.z > 1.0f) {
+        return false;
+    }
+
+    // Every pixel the rectangle touches, rounded outwards
+    int32_t x0 = std::max(static_cast<int32_t>(std::floor((ndcMin.x * 0.5f + 0.5f) * width)), 0);
+    int32_t x1 = std::min(static_cast<int32_t>(std::floor((ndcMax.x * 0.5f + 0.5f) * width)), static_cast<int32_t>(width) - 1);
+    int32_t y0 = std::max(static_cast<int32_t>(std::floor((ndcMin.y * 0.5f + 0.5f) * height)), 0);
+    int32_t y1 = std::min(static_cast<int32_t>(std::floor((ndcMax.y * 0.5f + 0.5f) * height)), static_cast<int32_t>(height) - 1);
+    float nearestDepth = ndcMin.z;
+
+    for (int32_t tileY = y0 / TILE_HEIGHT; tileY <= y1 / static_cast<int32_t>(TILE_HEIGHT); tileY++) {
+        for (int32_t tileX = x0 / TILE_WIDTH; tileX <= x1 / static_cast<int32_t>(TILE_WIDTH); tileX++) {
+            // Every pixel of this tile is in front of the instance
+            if (tileMaxDepth[tileY * tilesX + tileX] < nearestDepth) {
+                continue;
+            }
+
+            int32_t rx0 = std::max(x0, tileX * static_cast<int32_t>(TILE_WIDTH));
+            int32_t rx1 = std::min(x1, (tileX + 1) * static_cast<int32_t>(TILE_WIDTH) - 1);
+            int32_t ry0 = std::max(y0, tileY * static_cast<int32_t>(TILE_HEIGHT));
+            int32_t ry1 = std::min(y1, (tileY + 1) * static_cast<int32_t>(TILE_HEIGHT) - 1);
+
+            for (int32_t y = ry0; y <= ry1; y++) {
+                const float* row = &depthBuffer[static_cast<size_t>(y) * width];
+#ifdef MI_OCCLUSION_SSE
+                __m128 nearest = _mm_set1_ps(nearestDepth);
+                __m128 lanes = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+                __m128 first = _mm_set1_ps(static_cast<float>(rx0));
+                __m128 last = _mm_set1_ps(static_cast<float>(rx1));
+                for (int32_t x = rx0 & ~3; x <= rx1; x += 4) {
+                    __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), lanes);
+                    __m128 inRect = _mm_and_ps(_mm_cmpge_ps(px, first), _mm_cmple_ps(px, last));
+                    __m128 notOccluded = _mm_cmpge_ps(_mm_loadu_ps(row + x), nearest);
+                    if (_mm_movemask_ps(_mm_and_ps(inRect, notOccluded)) != 0) {
+                        return true;
+                    }
+                }
+#else
+                for (int32_t x = rx0; x <= rx1; x++) {
+                    if (row[x] >= nearestDepth) {
+                        return true;
+                    }
+                }
+#endif
+            }
+        }
+    }
+
+    return false;
+}
@@ -32,6 +32,10 @@ ModelLoader::~ModelLoader() {
 }
 
 bool ModelLoader::LoadModel(const std::string& filename) {
+    // Start from an empty scene so meshes of earlier loads aren't returned again
+    meshes.clear();
+    fbxScene->Clear();
+
     // Create an importer using the FBX SDK.
     FbxImporter* importer = FbxImporter::Create(fbxManager, "");
     if (!importer->Initialize(filename.c_str(), -1, fbxManager->GetIOSettings())) {
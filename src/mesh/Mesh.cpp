@@ -11,8 +11,28 @@ Mesh::Mesh(VkDevice device, VkPhysicalDevice physicalDevice, const MeshData& mes
       material(material)
 {
     indexCount = static_cast<uint32_t>(indices.size());
+
+    // Bounds have to be taken now, the vertex copy is released after upload
+    for (const auto& vertex : vertices) {
+        bounds.expand(glm::vec3(vertex.pos[0], vertex.pos[1], vertex.pos[2]));
+    }
+}
+
+Mesh::Mesh(const std::shared_ptr<Mesh>& source, const Material& material)
+    : device(source->device), physicalDevice(source->physicalDevice),
+      material(material),
+      vertexBuffer(source->vertexBuffer), vertexBufferMemory(VK_NULL_HANDLE),
+      indexBuffer(source->indexBuffer), indexBufferMemory(VK_NULL_HANDLE),
+      indexCount(source->indexCount), bounds(source->bounds),
+      geometrySource(source->geometrySource ? source->geometrySource : source)
+{
 }
+
 Mesh::~Mesh() {
+    // Shared buffers are destroyed with their owner
+    if (geometrySource) {
+        return;
+    }
     if (vertexBuffer != VK_NULL_HANDLE) {
         vkDestroyBuffer(device, vertexBuffer, nullptr);
     }
@@ -27,7 +47,8 @@ Mesh::~Mesh() {
     }
 }
 
-void Mesh::createBuffers(VkCommandPool commandPool, VkQueue graphicsQueue) {
+void Mesh::createBuffers(VkCommandPool commandPool, VkQueue graphicsQueue, GpuTimeline* timeline) {
+    this->timeline = timeline;
     createVertexBuffer(commandPool, graphicsQueue);
     createIndexBuffer(commandPool, graphicsQueue);
     //clear memeroy
@@ -154,13 +175,18 @@ void Mesh::copyBuffer(VkCommandPool commandPool, VkQueue graphicsQueue,
     
     vkEndCommandBuffer(commandBuffer);
     
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-    
-    vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(graphicsQueue);
+    if (timeline) {
+        // Waits for this copy and the work before it, not for later submissions
+        timeline->wait(timeline->submit(commandBuffer));
+    } else {
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+
+        vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+        vkQueueWaitIdle(graphicsQueue);
+    }
     
     vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
 }
@@ -175,3 +201,7 @@ void Mesh::bind(VkCommandBuffer commandBuffer) const {
 void Mesh::draw(VkCommandBuffer commandBuffer) const {
     vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
 }
+
+void Mesh::drawIndirect(VkCommandBuffer commandBuffer, VkBuffer indirectBuffer, VkDeviceSize offset) const {
+    vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer, offset, 1, sizeof(VkDrawIndexedIndirectCommand));
+}
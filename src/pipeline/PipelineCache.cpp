@@ -0,0 +1,96 @@
+﻿#include "../include/pipeline/PipelineCache.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    // VkPipelineCacheHeaderVersionOne: header size, version, vendor, device, UUID
+    const size_t CACHE_HEADER_SIZE = 16 + VK_UUID_SIZE;
+}
+
+PipelineCache::PipelineCache(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& path)
+    : device(device), path(path) {
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+    std::string data;
+    std::ifstream file(path, std::ios::binary);
+    if (file) {
+        data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        if (!isCompatible(data)) {
+            // Another GPU or driver: its pipelines would be rebuilt anyway
+            std::cout << "Ignoring pipeline cache from another device or driver: " << path << std::endl;
+            data.clear();
+        }
+    }
+
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = data.size();
+    cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+    if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache) != VK_SUCCESS) {
+        // The driver may still reject the contents; fall back to an empty cache
+        cacheInfo.initialDataSize = 0;
+        cacheInfo.pInitialData = nullptr;
+        data.clear();
+        if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline cache!");
+        }
+    }
+    warm = !data.empty();
+}
+
+PipelineCache::~PipelineCache() {
+    vkDestroyPipelineCache(device, cache, nullptr);
+}
+
+bool PipelineCache::save() {
+    size_t size = 0;
+    if (vkGetPipelineCacheData(device, cache, &size, nullptr) != VK_SUCCESS || size == 0) {
+        return false;
+    }
+    std::vector<char> data(size);
+    if (vkGetPipelineCacheData(device, cache, &size, data.data()) != VK_SUCCESS) {
+        return false;
+    }
+
+    // Write next to the old file and swap, so a crash mid-write never leaves a torn cache
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.write(data.data(), static_cast<std::streamsize>(size))) {
+            std::cerr << "Failed to write pipeline cache: " << tempPath << std::endl;
+            return false;
+        }
+    }
+    std::remove(path.c_str());
+    if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        std::cerr << "Failed to write pipeline cache: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool PipelineCache::isCompatible(const std::string& data) const {
+    if (data.size() < CACHE_HEADER_SIZE) {
+        return false;
+    }
+
+    // The header is little-endian uint32s on every platform we run on
+    uint32_t header[4];
+    std::memcpy(header, data.data(), sizeof(header));
+    uint32_t headerSize = header[0];
+    uint32_t headerVersion = header[1];
+    uint32_t vendorID = header[2];
+    uint32_t deviceID = header[3];
+
+    return headerSize >= CACHE_HEADER_SIZE && headerSize <= data.size() &&
+           headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           vendorID == deviceProperties.vendorID &&
+           deviceID == deviceProperties.deviceID &&
+           std::memcmp(data.data() + 16, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
@@ -0,0 +1,327 @@
+﻿#include "../include/pipeline/PipelineLibrary.h"
+#include "../include/Utils/Hash.h"
+#include "../include/Utils/ThreadPool.h"
+#include "../VulkanRenderer.h"
+#include <array>
+#include <iostream>
+#include <stdexcept>
+
+// Shader paths stand in for their code: each path is only ever read once
+static bool sameDesc(const GraphicsPipelineDesc& a, const GraphicsPipelineDesc& b) {
+    if (a.vertexShader != b.vertexShader || a.fragmentShader != b.fragmentShader ||
+        a.vertexBindings.size() != b.vertexBindings.size() ||
+        a.vertexAttributes.size() != b.vertexAttributes.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.vertexBindings.size(); i++) {
+        const VkVertexInputBindingDescription& x = a.vertexBindings[i];
+        const VkVertexInputBindingDescription& y = b.vertexBindings[i];
+        if (x.binding != y.binding || x.stride != y.stride || x.inputRate != y.inputRate) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < a.vertexAttributes.size(); i++) {
+        const VkVertexInputAttributeDescription& x = a.vertexAttributes[i];
+        const VkVertexInputAttributeDescription& y = b.vertexAttributes[i];
+        if (x.location != y.location || x.binding != y.binding || x.format != y.format || x.offset != y.offset) {
+            return false;
+        }
+    }
+    return a.topology == b.topology && a.polygonMode == b.polygonMode && a.cullMode == b.cullMode &&
+           a.frontFace == b.frontFace && a.depthTest == b.depthTest && a.depthWrite == b.depthWrite &&
+           a.depthCompareOp == b.depthCompareOp && a.depthBiasConstant == b.depthBiasConstant &&
+           a.depthBiasSlope == b.depthBiasSlope && a.alphaBlend == b.alphaBlend &&
+           a.colorAttachmentCount == b.colorAttachmentCount && a.renderPass == b.renderPass &&
+           a.subpass == b.subpass && a.layout == b.layout;
+}
+
+PipelineLibrary::PipelineLibrary(VulkanRenderer* renderer, ThreadPool* threadPool)
+    : renderer(renderer), device(renderer->getDevice()), threadPool(threadPool) {
+}
+
+PipelineLibrary::~PipelineLibrary() {
+    clear();
+}
+
+VkPipeline PipelineLibrary::get(const GraphicsPipelineDesc& desc, const GraphicsPipelineDesc& fallback) {
+    uint64_t key = hash(desc);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Entry& entry = findEntry(key, desc);
+        if (entry.pipeline != VK_NULL_HANDLE) {
+            return entry.pipeline;
+        }
+
+        if (!entry.compiling && !entry.failed) {
+            const ShaderCode& vertexCode = getShader(desc.vertexShader);
+            const ShaderCode& fragmentCode = getShader(desc.fragmentShader);
+            entry.compiling = true;
+            compilesInFlight++;
+
+            threadPool->enqueue([this, key, desc, &vertexCode, &fragmentCode]() {
+                VkPipeline pipeline = VK_NULL_HANDLE;
+                try {
+                    pipeline = compile(desc, vertexCode, fragmentCode);
+                } catch (const std::exception& e) {
+                    std::cerr << "Pipeline variant failed to compile, keeping its fallback: "
+                              << e.what() << std::endl;
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                Entry& entry = findEntry(key, desc);
+                entry.pipeline = pipeline;
+                entry.compiling = false;
+                entry.failed = pipeline == VK_NULL_HANDLE;
+                compilesInFlight--;
+                compileCondition.notify_all();
+            });
+        }
+    }
+
+    return getNow(fallback);
+}
+
+VkPipeline PipelineLibrary::getNow(const GraphicsPipelineDesc& desc) {
+    uint64_t key = hash(desc);
+    std::unique_lock<std::mutex> lock(mutex);
+
+    // A worker may already be on it; waiting is cheaper than compiling twice
+    compileCondition.wait(lock, [this, key, &desc]() { return !findEntry(key, desc).compiling; });
+    Entry& entry = findEntry(key, desc);
+    if (entry.pipeline != VK_NULL_HANDLE) {
+        return entry.pipeline;
+    }
+
+    const ShaderCode& vertexCode = getShader(desc.vertexShader);
+    const ShaderCode& fragmentCode = getShader(desc.fragmentShader);
+    entry.compiling = true;
+    lock.unlock();
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    try {
+        pipeline = compile(desc, vertexCode, fragmentCode);
+    } catch (...) {
+        lock.lock();
+        findEntry(key, desc).compiling = false;
+        compileCondition.notify_all();
+        throw;
+    }
+
+    lock.lock();
+    Entry& compiled = findEntry(key, desc);
+    compiled.pipeline = pipeline;
+    compiled.compiling = false;
+    compileCondition.notify_all();
+    return pipeline;
+}
+
+void PipelineLibrary::clear() {
+    std::unique_lock<std::mutex> lock(mutex);
+    compileCondition.wait(lock, [this]() { return compilesInFlight == 0; });
+
+    for (auto& pair : pipelines) {
+        for (Entry& entry : pair.second) {
+            if (entry.pipeline != VK_NULL_HANDLE) {
+                vkDestroyPipeline(device, entry.pipeline, nullptr);
+            }
+        }
+    }
+    pipelines.clear();
+}
+
+uint64_t PipelineLibrary::hash(const GraphicsPipelineDesc& desc) {
+    uint64_t vertexHash;
+    uint64_t fragmentHash;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        vertexHash = getShader(desc.vertexShader).hash;
+        fragmentHash = getShader(desc.fragmentShader).hash;
+    }
+
+    uint64_t result = Hash::combine(vertexHash, fragmentHash);
+    for (const VkVertexInputBindingDescription& binding : desc.vertexBindings) {
+        result = Hash::combine(result, (static_cast<uint64_t>(binding.binding) << 40) |
+                                       (static_cast<uint64_t>(binding.inputRate) << 32) | binding.stride);
+    }
+    for (const VkVertexInputAttributeDescription& attribute : desc.vertexAttributes) {
+        result = Hash::combine(result, (static_cast<uint64_t>(attribute.location) << 40) |
+                                       (static_cast<uint64_t>(attribute.binding) << 32) | attribute.offset);
+        result = Hash::combine(result, attribute.format);
+    }
+    result = Hash::combine(result, desc.topology);
+    result = Hash::combine(result, desc.polygonMode);
+    result = Hash::combine(result, desc.cullMode);
+    result = Hash::combine(result, desc.frontFace);
+    result = Hash::combine(result, (static_cast<uint64_t>(desc.depthTest) << 2) |
+                                   (static_cast<uint64_t>(desc.depthWrite) << 1) | desc.alphaBlend);
+    result = Hash::combine(result, desc.depthCompareOp);
+    float depthBias[] = { desc.depthBiasConstant, desc.depthBiasSlope };
+    result = Hash::combine(result, Hash::bytes(depthBias, sizeof(depthBias)));
+    result = Hash::combine(result, desc.colorAttachmentCount);
+    // Handles identify objects for as long as they live, which covers every
+    // pipeline built for them (clear() runs before they are destroyed)
+    result = Hash::combine(result, reinterpret_cast<uint64_t>(desc.renderPass));
+    result = Hash::combine(result, desc.subpass);
+    return Hash::combine(result, reinterpret_cast<uint64_t>(desc.layout));
+}
+
+size_t PipelineLibrary::getPipelineCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t count = 0;
+    for (const auto& pair : pipelines) {
+        for (const Entry& entry : pair.second) {
+            if (entry.pipeline != VK_NULL_HANDLE) {
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+PipelineLibrary::Entry& PipelineLibrary::findEntry(uint64_t key, const GraphicsPipelineDesc& desc) {
+    std::vector<Entry>& bucket = pipelines[key];
+    for (Entry& entry : bucket) {
+        if (sameDesc(entry.desc, desc)) {
+            return entry;
+        }
+    }
+    bucket.emplace_back();
+    bucket.back().desc = desc;
+    return bucket.back();
+}
+
+const PipelineLibrary::ShaderCode& PipelineLibrary::getShader(const std::string& path) {
+    auto it = shaders.find(path);
+    if (it != shaders.end()) {
+        return it->second;
+    }
+    if (path.empty()) {
+        // No stage: empty code, hash 0
+        return shaders[path];
+    }
+
+    ShaderCode shader;
+    shader.code = renderer->readFile(path);
+    shader.hash = Hash::bytes(shader.code.data(), shader.code.size());
+    return shaders.emplace(path, std::move(shader)).first->second;
+}
+
+VkPipeline PipelineLibrary::compile(const GraphicsPipelineDesc& desc, const ShaderCode& vertexCode,
+                                    const ShaderCode& fragmentCode) {
+    VkShaderModule vertModule = renderer->createShaderModule(vertexCode.code);
+    VkShaderModule fragModule = VK_NULL_HANDLE;
+    if (!fragmentCode.code.empty()) {
+        fragModule = renderer->createShaderModule(fragmentCode.code);
+    }
+
+    VkPipelineShaderStageCreateInfo shaderStages[2]{};
+    shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shaderStages[0].module = vertModule;
+    shaderStages[0].pName = "main";
+    shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shaderStages[1].module = fragModule;
+    shaderStages[1].pName = "main";
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(desc.vertexBindings.size());
+    vertexInputInfo.pVertexBindingDescriptions = desc.vertexBindings.data();
+    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(desc.vertexAttributes.size());
+    vertexInputInfo.pVertexAttributeDescriptions = desc.vertexAttributes.data();
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = desc.topology;
+    inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+    // Set with vkCmdSetViewport/vkCmdSetScissor when recording
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+
+    std::array<VkDynamicState, 2> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+    dynamicState.pDynamicStates = dynamicStates.data();
+
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.depthClampEnable = VK_FALSE;
+    rasterizer.rasterizerDiscardEnable = VK_FALSE;
+    rasterizer.polygonMode = desc.polygonMode;
+    rasterizer.lineWidth = 1.f;
+    rasterizer.cullMode = desc.cullMode;
+    rasterizer.frontFace = desc.frontFace;
+    rasterizer.depthBiasEnable = desc.depthBiasConstant != 0.0f || desc.depthBiasSlope != 0.0f;
+    rasterizer.depthBiasConstantFactor = desc.depthBiasConstant;
+    rasterizer.depthBiasSlopeFactor = desc.depthBiasSlope;
+
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.sampleShadingEnable = VK_FALSE;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    // Every color attachment blends the same way
+    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+    colorBlendAttachment.colorWriteMask =
+        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+        VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachment.blendEnable = desc.alphaBlend ? VK_TRUE : VK_FALSE;
+    colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+    std::vector<VkPipelineColorBlendAttachmentState> colorBlendAttachments(desc.colorAttachmentCount,
+                                                                           colorBlendAttachment);
+
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.logicOpEnable = VK_FALSE;
+    colorBlending.attachmentCount = static_cast<uint32_t>(colorBlendAttachments.size());
+    colorBlending.pAttachments = colorBlendAttachments.data();
+
+    VkPipelineDepthStencilStateCreateInfo depthStencil{};
+    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencil.depthTestEnable = desc.depthTest ? VK_TRUE : VK_FALSE;
+    depthStencil.depthWriteEnable = desc.depthWrite ? VK_TRUE : VK_FALSE;
+    depthStencil.depthCompareOp = desc.depthCompareOp;
+    depthStencil.depthBoundsTestEnable = VK_FALSE;
+    depthStencil.stencilTestEnable = VK_FALSE;
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = fragModule != VK_NULL_HANDLE ? 2 : 1;
+    pipelineInfo.pStages = shaderStages;
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDepthStencilState = &depthStencil;
+    pipelineInfo.pDynamicState = &dynamicState;
+    pipelineInfo.layout = desc.layout;
+    pipelineInfo.renderPass = desc.renderPass;
+    pipelineInfo.subpass = desc.subpass;
+
+    // The pipeline cache is internally synchronized, so workers share it
+    VkPipeline pipeline;
+    VkResult result = vkCreateGraphicsPipelines(device, renderer->getPipelineCache(), 1, &pipelineInfo,
+                                                nullptr, &pipeline);
+
+    if (fragModule != VK_NULL_HANDLE) {
+        vkDestroyShaderModule(device, fragModule, nullptr);
+    }
+    vkDestroyShaderModule(device, vertModule, nullptr);
+
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to create graphics pipeline!");
+    }
+    return pipeline;
+}
@@ -0,0 +1,112 @@
+﻿#include "../include/render/DynamicResolution.h"
+#include "../VulkanRenderer.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+    // Smoothing of the full-resolution estimate: slow when the GPU gets faster,
+    // quick when it gets slower, so spikes are answered the frame they show up
+    const float FALLING_WEIGHT = 0.1f;
+    const float RISING_WEIGHT = 0.5f;
+}
+
+DynamicResolution::DynamicResolution(VulkanRenderer* renderer, uint32_t framesInFlight, uint32_t queueFamilyIndex)
+    : renderer(renderer), device(renderer->getDevice()),
+      pending(framesInFlight, false), frameScales(framesInFlight, MAX_SCALE) {
+    VkPhysicalDevice physicalDevice = renderer->getPhysicalDevice();
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    timestampPeriod = properties.limits.timestampPeriod;
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+    uint32_t validBits = queueFamilies[queueFamilyIndex].timestampValidBits;
+
+    // Without timestamps on the graphics queue the scale stays at 1
+    supported = validBits > 0 && timestampPeriod > 0.0f;
+    if (!supported) {
+        return;
+    }
+    timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    VkQueryPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = 2 * framesInFlight;
+    if (vkCreateQueryPool(device, &poolInfo, nullptr, &queryPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create timestamp query pool!");
+    }
+}
+
+DynamicResolution::~DynamicResolution() {
+    vkDestroyQueryPool(device, queryPool, nullptr);
+}
+
+void DynamicResolution::update(uint32_t frameIndex) {
+    if (!supported || !pending[frameIndex]) {
+        return;
+    }
+    pending[frameIndex] = false;
+
+    // The frame has completed (its slot was waited for), so this never blocks
+    uint64_t timestamps[2];
+    if (vkGetQueryPoolResults(device, queryPool, 2 * frameIndex, 2, sizeof(timestamps), timestamps,
+                              sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+        return;
+    }
+    uint64_t ticks = (timestamps[1] - timestamps[0]) & timestampMask;
+    gpuFrameTime = static_cast<float>(static_cast<double>(ticks) * timestampPeriod * 1e-6);
+
+    // What the frame would have cost at full resolution
+    float frameScale = frameScales[frameIndex];
+    float estimate = gpuFrameTime / (frameScale * frameScale);
+    if (fullResolutionTime <= 0.0f) {
+        fullResolutionTime = estimate;
+    } else {
+        float weight = estimate > fullResolutionTime ? RISING_WEIGHT : FALLING_WEIGHT;
+        fullResolutionTime += (estimate - fullResolutionTime) * weight;
+    }
+
+    if (!enabled) {
+        scale = MAX_SCALE;
+        return;
+    }
+
+    // Largest scale whose pixel count fits the target
+    float ideal = std::sqrt(targetFrameTime * HEADROOM / std::max(fullResolutionTime, 1e-3f));
+    ideal = std::clamp(ideal, MIN_SCALE, MAX_SCALE);
+    if (std::abs(ideal - scale) >= SCALE_STEP) {
+        scale = std::clamp(std::floor(ideal / SCALE_STEP + 1e-4f) * SCALE_STEP, MIN_SCALE, MAX_SCALE);
+    }
+}
+
+void DynamicResolution::recordBegin(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+    if (!supported) {
+        return;
+    }
+    vkCmdResetQueryPool(commandBuffer, queryPool, 2 * frameIndex, 2);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 2 * frameIndex);
+}
+
+void DynamicResolution::recordEnd(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+    if (!supported) {
+        return;
+    }
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 2 * frameIndex + 1);
+    pending[frameIndex] = true;
+    frameScales[frameIndex] = isEnabled() ? scale : MAX_SCALE;
+}
+
+VkExtent2D DynamicResolution::getRenderExtent(VkExtent2D outputExtent) const {
+    float renderScale = isEnabled() ? scale : MAX_SCALE;
+    VkExtent2D extent;
+    extent.width = std::max(1u, static_cast<uint32_t>(outputExtent.width * renderScale + 0.5f));
+    extent.height = std::max(1u, static_cast<uint32_t>(outputExtent.height * renderScale + 0.5f));
+    extent.width = std::min(extent.width, outputExtent.width);
+    extent.height = std::min(extent.height, outputExtent.height);
+    return extent;
+}
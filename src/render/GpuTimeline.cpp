@@ -0,0 +1,102 @@
+﻿#include "../include/render/GpuTimeline.h"
+
+#include <stdexcept>
+
+GpuTimeline::GpuTimeline(VkDevice device, VkQueue queue) : device(device), queue(queue) {
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    createInfo.pNext = &typeInfo;
+    if (vkCreateSemaphore(device, &createInfo, nullptr, &semaphore) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create timeline semaphore!");
+    }
+}
+
+GpuTimeline::~GpuTimeline() {
+    vkDestroySemaphore(device, semaphore, nullptr);
+}
+
+uint64_t GpuTimeline::submit(const VkCommandBuffer* commandBuffers, uint32_t commandBufferCount,
+                             const std::vector<Wait>& waits,
+                             const std::vector<VkSemaphore>& binarySignals) {
+    std::vector<VkSemaphore> waitSemaphores;
+    std::vector<uint64_t> waitValues;
+    std::vector<VkPipelineStageFlags> waitStages;
+    for (const Wait& wait : waits) {
+        waitSemaphores.push_back(wait.semaphore);
+        waitValues.push_back(wait.value);
+        waitStages.push_back(wait.stageMask);
+    }
+
+    // Values for binary semaphores are ignored but have to be there
+    std::vector<VkSemaphore> signalSemaphores(binarySignals);
+    std::vector<uint64_t> signalValues(binarySignals.size(), 0);
+
+    std::lock_guard<std::mutex> lock(submitMutex);
+    uint64_t value = submittedValue.load() + 1;
+    signalSemaphores.push_back(semaphore);
+    signalValues.push_back(value);
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+    timelineInfo.pWaitSemaphoreValues = waitValues.data();
+    timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+    timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+    submitInfo.pWaitSemaphores = waitSemaphores.data();
+    submitInfo.pWaitDstStageMask = waitStages.data();
+    submitInfo.commandBufferCount = commandBufferCount;
+    submitInfo.pCommandBuffers = commandBuffers;
+    submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+    submitInfo.pSignalSemaphores = signalSemaphores.data();
+
+    if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit command buffer!");
+    }
+    submittedValue.store(value);
+    return value;
+}
+
+bool GpuTimeline::isComplete(uint64_t value) {
+    if (value <= completedValue.load()) {
+        return true;
+    }
+    return getCompletedValue() >= value;
+}
+
+void GpuTimeline::wait(uint64_t value) {
+    if (isComplete(value)) {
+        return;
+    }
+
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &semaphore;
+    waitInfo.pValues = &value;
+    vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+    updateCompleted(value);
+}
+
+uint64_t GpuTimeline::getCompletedValue() {
+    uint64_t value = 0;
+    vkGetSemaphoreCounterValue(device, semaphore, &value);
+    updateCompleted(value);
+    return value;
+}
+
+void GpuTimeline::updateCompleted(uint64_t value) {
+    // Other threads may have read a newer value in the meantime
+    uint64_t known = completedValue.load();
+    while (value > known && !completedValue.compare_exchange_weak(known, value)) {
+    }
+}
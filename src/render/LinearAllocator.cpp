@@ -0,0 +1,44 @@
+﻿#include "../include/render/LinearAllocator.h"
+#include "../VulkanRenderer.h"
+
+LinearAllocator::LinearAllocator(VulkanRenderer* renderer, VkDeviceSize capacity, VkBufferUsageFlags usage)
+    : renderer(renderer), capacity(capacity) {
+    renderer->createBuffer(capacity, usage,
+                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                           buffer, memory);
+
+    void* data;
+    vkMapMemory(renderer->getDevice(), memory, 0, capacity, 0, &data);
+    mapped = static_cast<unsigned char*>(data);
+}
+
+LinearAllocator::~LinearAllocator() {
+    VkDevice device = renderer->getDevice();
+    vkUnmapMemory(device, memory);
+    vkDestroyBuffer(device, buffer, nullptr);
+    vkFreeMemory(device, memory, nullptr);
+}
+
+LinearAllocator::Allocation LinearAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment) {
+    Allocation allocation;
+    VkDeviceSize offset = (head + alignment - 1) & ~(alignment - 1);
+    if (size == 0 || offset + size > capacity) {
+        if (size != 0 && !overflowReported) {
+            std::cerr << "Frame transient buffer full (" << capacity / 1024
+                      << " KB), dropping allocations until the next frame" << std::endl;
+            overflowReported = true;
+        }
+        return allocation;
+    }
+
+    head = offset + size;
+
+    allocation.data = mapped + offset;
+    allocation.offset = offset;
+    allocation.size = size;
+    return allocation;
+}
+
+void LinearAllocator::reset() {
+    head = 0;
+}
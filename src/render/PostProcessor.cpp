@@ -0,0 +1,257 @@
+﻿#include "../include/render/PostProcessor.h"
+#include "../include/render/FrameContext.h"
+#include "../VulkanRenderer.h"
+#include <array>
+#include <stdexcept>
+
+PostProcessor::PostProcessor(VulkanRenderer* renderer, VkFormat outputFormat, bool storageOutput)
+    : renderer(renderer), device(renderer->getDevice()) {
+    createLayouts();
+    setOutput(outputFormat, storageOutput);
+}
+
+PostProcessor::~PostProcessor() {
+    // The fullscreen pipeline belongs to the renderer's PipelineLibrary
+    vkDestroyPipeline(device, computePipeline, nullptr);
+    vkDestroyRenderPass(device, fullscreenRenderPass, nullptr);
+    vkDestroyPipelineLayout(device, computePipelineLayout, nullptr);
+    vkDestroyPipelineLayout(device, fullscreenPipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, computeSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, fullscreenSetLayout, nullptr);
+}
+
+bool PostProcessor::isSrgb(VkFormat format) {
+    return format == VK_FORMAT_B8G8R8A8_SRGB || format == VK_FORMAT_R8G8B8A8_SRGB ||
+           format == VK_FORMAT_A8B8G8R8_SRGB_PACK32;
+}
+
+void PostProcessor::setOutput(VkFormat format, bool storage) {
+    if (format == outputFormat && storage == storageOutput) {
+        return;
+    }
+    outputFormat = format;
+    storageOutput = storage;
+
+    // Only the path in use is built: the compute shader writes a storage image
+    // without a format qualifier, which the device may not support
+    if (storageOutput) {
+        if (computePipeline == VK_NULL_HANDLE) {
+            createComputePipeline();
+        }
+    } else {
+        createFullscreenPipeline();
+    }
+}
+
+void PostProcessor::createLayouts() {
+    // Bilinear and clamped, so a scene rendered below the output size is upscaled
+    SamplerDesc samplerDesc;
+    samplerDesc.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerDesc.addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerDesc.anisotropy = false;
+    VkSampler sampler = renderer->getSamplerCache()->get(samplerDesc);
+
+    // Compute: scene color + output image
+    std::array<VkDescriptorSetLayoutBinding, 2> computeBindings{};
+    computeBindings[0].binding = 0;
+    computeBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    computeBindings[0].descriptorCount = 1;
+    computeBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    computeBindings[0].pImmutableSamplers = &sampler;
+    computeBindings[1].binding = 1;
+    computeBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    computeBindings[1].descriptorCount = 1;
+    computeBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(computeBindings.size());
+    layoutInfo.pBindings = computeBindings.data();
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &computeSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create post-processing descriptor set layout!");
+    }
+
+    // Fullscreen: scene color only
+    VkDescriptorSetLayoutBinding fullscreenBinding = computeBindings[0];
+    fullscreenBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &fullscreenBinding;
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &fullscreenSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create post-processing descriptor set layout!");
+    }
+
+    VkPushConstantRange pushRange{};
+    pushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushRange.offset = 0;
+    pushRange.size = sizeof(PushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &computeSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushRange;
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &computePipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create post-processing pipeline layout!");
+    }
+
+    pushRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    pipelineLayoutInfo.pSetLayouts = &fullscreenSetLayout;
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &fullscreenPipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create post-processing pipeline layout!");
+    }
+}
+
+void PostProcessor::createComputePipeline() {
+    auto code = renderer->readFile("shaders/postprocess_comp.spv");
+    VkShaderModule module = renderer->createShaderModule(code);
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = module;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = computePipelineLayout;
+
+    VkResult result = vkCreateComputePipelines(device, renderer->getPipelineCache(), 1, &pipelineInfo,
+                                               nullptr, &computePipeline);
+    vkDestroyShaderModule(device, module, nullptr);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to create compute pipeline: shaders/postprocess_comp.spv");
+    }
+}
+
+void PostProcessor::createFullscreenPipeline() {
+    // Color-only pass in the output format, compatible with the graph's post pass
+    vkDestroyRenderPass(device, fullscreenRenderPass, nullptr);
+
+    VkAttachmentDescription colorAttachment{};
+    colorAttachment.format = outputFormat;
+    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference colorRef = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorRef;
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = 1;
+    renderPassInfo.pAttachments = &colorAttachment;
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+    if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &fullscreenRenderPass) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create post-processing render pass!");
+    }
+
+    // One triangle covering the screen, generated from gl_VertexIndex
+    fullscreenDesc.vertexShader = "shaders/fullscreen_vert.spv";
+    fullscreenDesc.fragmentShader = "shaders/tonemapping_frag.spv";
+    fullscreenDesc.cullMode = VK_CULL_MODE_NONE;
+    fullscreenDesc.depthTest = false;
+    fullscreenDesc.depthWrite = false;
+    fullscreenDesc.renderPass = fullscreenRenderPass;
+    fullscreenDesc.layout = fullscreenPipelineLayout;
+    renderer->getPipelineLibrary()->getNow(fullscreenDesc);
+}
+
+PostProcessor::PushConstants PostProcessor::getPushConstants(VkExtent2D sceneExtent, VkExtent2D imageExtent) const {
+    // An sRGB output encodes on store; gamma on top would encode twice
+    PushConstants push{};
+    push.exposure = settings.exposure;
+    push.gamma = isSrgb(outputFormat) ? 1.0f : settings.gamma;
+    push.saturation = settings.saturation;
+
+    glm::vec2 imageSize(static_cast<float>(imageExtent.width), static_cast<float>(imageExtent.height));
+    glm::vec2 sceneSize(static_cast<float>(sceneExtent.width), static_cast<float>(sceneExtent.height));
+    push.uvScale = sceneSize / imageSize;
+    push.uvMax = (sceneSize - 0.5f) / imageSize;
+    return push;
+}
+
+void PostProcessor::addPass(RenderGraph& graph, FrameContext& frame, RenderGraph::ImageHandle sceneColor,
+                            VkExtent2D sceneExtent, RenderGraph::ImageHandle output) {
+    PushConstants push = getPushConstants(sceneExtent, graph.getImageExtent(sceneColor));
+
+    if (storageOutput) {
+        graph.addPass("post", RenderGraph::PassType::Compute,
+            [this, &graph, &frame, sceneColor, output, push](VkCommandBuffer commandBuffer) {
+                VkDescriptorSet set = frame.allocateDescriptorSet(computeSetLayout);
+                if (set == VK_NULL_HANDLE) {
+                    return;
+                }
+
+                VkDescriptorImageInfo sceneInfo{};
+                sceneInfo.imageView = graph.getImageView(sceneColor);
+                sceneInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+                VkDescriptorImageInfo outputInfo{};
+                outputInfo.imageView = graph.getImageView(output);
+                outputInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+                std::array<VkWriteDescriptorSet, 2> writes{};
+                for (uint32_t i = 0; i < writes.size(); i++) {
+                    writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                    writes[i].dstSet = set;
+                    writes[i].dstBinding = i;
+                    writes[i].descriptorCount = 1;
+                }
+                writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                writes[0].pImageInfo = &sceneInfo;
+                writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+                writes[1].pImageInfo = &outputInfo;
+                vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout,
+                    0, 1, &set, 0, nullptr);
+                vkCmdPushConstants(commandBuffer, computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT,
+                    0, sizeof(PushConstants), &push);
+
+                VkExtent2D extent = graph.getImageExtent(output);
+                vkCmdDispatch(commandBuffer, (extent.width + GROUP_SIZE - 1) / GROUP_SIZE,
+                              (extent.height + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+            })
+            .readImage(sceneColor, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+            .writeImage(output, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        return;
+    }
+
+    VkPipeline pipeline = renderer->getPipelineLibrary()->getNow(fullscreenDesc);
+    graph.addPass("post", RenderGraph::PassType::Graphics,
+        [this, &graph, &frame, sceneColor, pipeline, push](VkCommandBuffer commandBuffer) {
+            VkDescriptorSet set = frame.allocateDescriptorSet(fullscreenSetLayout);
+            if (set == VK_NULL_HANDLE) {
+                return;
+            }
+
+            VkDescriptorImageInfo sceneInfo{};
+            sceneInfo.imageView = graph.getImageView(sceneColor);
+            sceneInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            VkWriteDescriptorSet write{};
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = set;
+            write.dstBinding = 0;
+            write.descriptorCount = 1;
+            write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write.pImageInfo = &sceneInfo;
+            vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, fullscreenPipelineLayout,
+                0, 1, &set, 0, nullptr);
+            vkCmdPushConstants(commandBuffer, fullscreenPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT,
+                0, sizeof(PushConstants), &push);
+            vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+        })
+        .colorAttachment(output, VK_ATTACHMENT_LOAD_OP_DONT_CARE)
+        .readImage(sceneColor, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+}
@@ -0,0 +1,788 @@
+﻿#include "../include/render/RenderGraph.h"
+#include "../include/Utils/Hash.h"
+#include "../VulkanRenderer.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+    const VkAccessFlags WRITE_ACCESS =
+        VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT |
+        VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::colorAttachment(ImageHandle image, VkAttachmentLoadOp loadOp,
+                                                                    VkClearColorValue clear) {
+    Pass& p = graph->passes[pass];
+    Attachment attachment{};
+    attachment.image = image.index;
+    attachment.loadOp = loadOp;
+    attachment.clear.color = clear;
+    attachment.depth = false;
+    p.attachments.push_back(attachment);
+
+    VkAccessFlags access = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    if (loadOp == VK_ATTACHMENT_LOAD_OP_LOAD) {
+        access |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+    }
+    p.accesses.push_back({ image.index, true, true, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, access,
+                           VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, loadOp != VK_ATTACHMENT_LOAD_OP_LOAD });
+    graph->images[image.index].usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::depthAttachment(ImageHandle image, VkAttachmentLoadOp loadOp,
+                                                                    VkClearDepthStencilValue clear) {
+    Pass& p = graph->passes[pass];
+    Attachment attachment{};
+    attachment.image = image.index;
+    attachment.loadOp = loadOp;
+    attachment.clear.depthStencil = clear;
+    attachment.depth = true;
+    p.attachments.push_back(attachment);
+
+    // The depth test reads even when the previous contents are cleared
+    p.accesses.push_back({ image.index, true, true,
+                           VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                           VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                           VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, loadOp != VK_ATTACHMENT_LOAD_OP_LOAD });
+    graph->images[image.index].usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::readImage(ImageHandle image, VkPipelineStageFlags stages,
+                                                              VkImageLayout layout) {
+    ImageResource& resource = graph->images[image.index];
+    if (layout == VK_IMAGE_LAYOUT_UNDEFINED) {
+        layout = isDepthFormat(resource.format) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+                                                : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+    graph->passes[pass].accesses.push_back({ image.index, true, false, stages, VK_ACCESS_SHADER_READ_BIT,
+                                             layout, false });
+    resource.usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::writeImage(ImageHandle image, VkPipelineStageFlags stages) {
+    graph->passes[pass].accesses.push_back({ image.index, true, true, stages, VK_ACCESS_SHADER_WRITE_BIT,
+                                             VK_IMAGE_LAYOUT_GENERAL, true });
+    graph->images[image.index].usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::transferRead(ImageHandle image) {
+    graph->passes[pass].accesses.push_back({ image.index, true, false, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                             VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                             false });
+    graph->images[image.index].usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::transferWrite(ImageHandle image) {
+    graph->passes[pass].accesses.push_back({ image.index, true, true, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                             VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                             true });
+    graph->images[image.index].usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::readBuffer(BufferHandle buffer, VkPipelineStageFlags stages,
+                                                               VkAccessFlags access) {
+    graph->passes[pass].accesses.push_back({ buffer.index, false, false, stages, access,
+                                             VK_IMAGE_LAYOUT_UNDEFINED, false });
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::writeBuffer(BufferHandle buffer, VkPipelineStageFlags stages,
+                                                                VkAccessFlags access) {
+    // Buffers may be written partially, so earlier contents are kept
+    graph->passes[pass].accesses.push_back({ buffer.index, false, true, stages, access,
+                                             VK_IMAGE_LAYOUT_UNDEFINED, false });
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::sideEffects() {
+    graph->passes[pass].sideEffects = true;
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::renderArea(VkExtent2D extent) {
+    graph->passes[pass].renderArea = extent;
+    return *this;
+}
+
+RenderGraph::RenderGraph(VulkanRenderer* renderer)
+    : renderer(renderer), device(renderer->getDevice()) {
+}
+
+RenderGraph::~RenderGraph() {
+    destroyTransients();
+    for (auto& entry : renderPasses) {
+        vkDestroyRenderPass(device, entry.second, nullptr);
+    }
+}
+
+void RenderGraph::reset() {
+    images.clear();
+    buffers.clear();
+    passes.clear();
+    finalBarriers.clear();
+    finalSrcStages = 0;
+    culledPassCount = 0;
+    barrierCount = 0;
+}
+
+RenderGraph::ImageHandle RenderGraph::createImage(const std::string& name, const ImageDesc& desc) {
+    ImageResource resource;
+    resource.name = name;
+    resource.format = desc.format;
+    resource.extent = desc.extent;
+    resource.mipLevels = desc.mipLevels;
+    images.push_back(resource);
+    return { static_cast<uint32_t>(images.size() - 1) };
+}
+
+RenderGraph::ImageHandle RenderGraph::importImage(const std::string& name, VkImage image, VkImageView view,
+                                                  VkFormat format, VkExtent2D extent,
+                                                  const ResourceState& initialState,
+                                                  VkImageLayout finalLayout, uint32_t mipLevels,
+                                                  uint32_t arrayLayer) {
+    ImageResource resource;
+    resource.name = name;
+    resource.image = image;
+    resource.view = view;
+    resource.format = format;
+    resource.extent = extent;
+    resource.mipLevels = mipLevels;
+    resource.arrayLayer = arrayLayer;
+    resource.imported = true;
+    resource.initialState = initialState;
+    resource.finalLayout = finalLayout;
+    images.push_back(resource);
+    return { static_cast<uint32_t>(images.size() - 1) };
+}
+
+RenderGraph::BufferHandle RenderGraph::importBuffer(const std::string& name, VkBuffer buffer,
+                                                    VkPipelineStageFlags stages, VkAccessFlags access) {
+    BufferResource resource;
+    resource.name = name;
+    resource.buffer = buffer;
+    resource.initialState.stages = stages;
+    resource.initialState.access = access;
+    buffers.push_back(resource);
+    return { static_cast<uint32_t>(buffers.size() - 1) };
+}
+
+RenderGraph::PassBuilder RenderGraph::addPass(const std::string& name, PassType type, ExecuteFn execute) {
+    Pass pass;
+    pass.name = name;
+    pass.type = type;
+    pass.execute = std::move(execute);
+    passes.push_back(std::move(pass));
+    return PassBuilder(this, static_cast<uint32_t>(passes.size() - 1));
+}
+
+void RenderGraph::compile() {
+    cullPasses();
+    placeTransients();
+    buildBarriers();
+
+    for (Pass& pass : passes) {
+        if (pass.culled || pass.type != PassType::Graphics) {
+            continue;
+        }
+        if (pass.attachments.empty()) {
+            throw std::runtime_error("render graph pass has no attachments: " + pass.name);
+        }
+        pass.extent = images[pass.attachments[0].image].extent;
+        pass.renderPass = getRenderPass(pass);
+        pass.framebuffer = getFramebuffer(pass);
+    }
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer) {
+    std::vector<VkClearValue> clearValues;
+
+    for (const Pass& pass : passes) {
+        if (pass.culled) {
+            continue;
+        }
+
+        bool globalBarrier = pass.memoryBarrier.srcAccessMask != 0 || pass.memoryBarrier.dstAccessMask != 0;
+        if (pass.srcStages != 0) {
+            vkCmdPipelineBarrier(commandBuffer, pass.srcStages, pass.dstStages, 0,
+                globalBarrier ? 1 : 0, globalBarrier ? &pass.memoryBarrier : nullptr,
+                0, nullptr,
+                static_cast<uint32_t>(pass.imageBarriers.size()), pass.imageBarriers.data());
+        }
+
+        if (pass.type != PassType::Graphics) {
+            pass.execute(commandBuffer);
+            continue;
+        }
+
+        clearValues.clear();
+        for (const Attachment& attachment : pass.attachments) {
+            clearValues.push_back(attachment.clear);
+        }
+
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = pass.renderPass;
+        renderPassInfo.framebuffer = pass.framebuffer;
+        // Framebuffers always cover the attachments, so a render area that changes
+        // every frame doesn't create new ones
+        VkExtent2D area = pass.extent;
+        if (pass.renderArea.width > 0 && pass.renderArea.height > 0) {
+            area.width = std::min(pass.renderArea.width, pass.extent.width);
+            area.height = std::min(pass.renderArea.height, pass.extent.height);
+        }
+
+        renderPassInfo.renderArea.offset = { 0, 0 };
+        renderPassInfo.renderArea.extent = area;
+        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+        renderPassInfo.pClearValues = clearValues.data();
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+        VkViewport viewport{};
+        viewport.width = static_cast<float>(area.width);
+        viewport.height = static_cast<float>(area.height);
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        VkRect2D scissor{};
+        scissor.extent = area;
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+        pass.execute(commandBuffer);
+        vkCmdEndRenderPass(commandBuffer);
+    }
+
+    if (!finalBarriers.empty()) {
+        vkCmdPipelineBarrier(commandBuffer, finalSrcStages, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+            0, nullptr,
+            0, nullptr,
+            static_cast<uint32_t>(finalBarriers.size()), finalBarriers.data());
+    }
+}
+
+void RenderGraph::releaseFramebuffers() {
+    for (auto& entry : framebuffers) {
+        vkDestroyFramebuffer(device, entry.second, nullptr);
+    }
+    framebuffers.clear();
+}
+
+void RenderGraph::cullPasses() {
+    // Walk backwards: a pass survives if it writes something a surviving later pass
+    // (or whoever uses an imported resource after the graph) reads
+    std::vector<bool> imageNeeded(images.size());
+    std::vector<bool> bufferNeeded(buffers.size(), true);
+    // Same walk, but only counting reads of the contents: decides the store ops
+    std::vector<bool> imageStored(images.size());
+    for (size_t i = 0; i < images.size(); i++) {
+        imageNeeded[i] = images[i].imported;
+        imageStored[i] = images[i].imported && images[i].finalLayout != VK_IMAGE_LAYOUT_UNDEFINED;
+    }
+
+    for (size_t p = passes.size(); p-- > 0;) {
+        Pass& pass = passes[p];
+
+        bool needed = pass.sideEffects;
+        for (const Access& access : pass.accesses) {
+            if (access.write && (access.isImage ? imageNeeded[access.resource] : bufferNeeded[access.resource])) {
+                needed = true;
+            }
+        }
+        pass.culled = !needed;
+        if (pass.culled) {
+            culledPassCount++;
+            continue;
+        }
+
+        for (Attachment& attachment : pass.attachments) {
+            attachment.storeOp = imageStored[attachment.image] ? VK_ATTACHMENT_STORE_OP_STORE
+                                                               : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        }
+
+        // Overwritten contents aren't needed before this pass, read contents are
+        for (const Access& access : pass.accesses) {
+            if (access.isImage && access.discard) {
+                imageNeeded[access.resource] = false;
+                imageStored[access.resource] = false;
+            }
+        }
+        for (const Access& access : pass.accesses) {
+            if (access.discard) {
+                continue;
+            }
+            if (access.isImage) {
+                imageNeeded[access.resource] = true;
+                imageStored[access.resource] = true;
+            } else {
+                bufferNeeded[access.resource] = true;
+            }
+        }
+    }
+
+    // Lifetimes over the surviving passes
+    for (uint32_t p = 0; p < passes.size(); p++) {
+        if (passes[p].culled) {
+            continue;
+        }
+        for (const Access& access : passes[p].accesses) {
+            if (!access.isImage) {
+                continue;
+            }
+            ImageResource& image = images[access.resource];
+            image.firstPass = std::min(image.firstPass, p);
+            image.lastPass = std::max(image.lastPass, p);
+        }
+    }
+}
+
+void RenderGraph::placeTransients() {
+    // Same declarations as last frame: keep the images and their memory
+    uint64_t key = Hash::combine(0, images.size());
+    for (const ImageResource& image : images) {
+        if (image.imported) {
+            key = Hash::combine(key, 0);
+            continue;
+        }
+        uint64_t values[] = { static_cast<uint64_t>(image.format), image.extent.width, image.extent.height, image.mipLevels,
+                              image.usage, image.firstPass, image.lastPass };
+        key = Hash::combine(key, Hash::bytes(values, sizeof(values)));
+    }
+
+    if (key != transients.key || transients.images.size() != images.size()) {
+        if (!transients.images.empty()) {
+            // Earlier frames may still be using the old images
+            GpuTimeline* timeline = renderer->getGpuTimeline();
+            timeline->wait(timeline->getSubmittedValue());
+            destroyTransients();
+        }
+        transients.key = key;
+        transients.images.assign(images.size(), VK_NULL_HANDLE);
+        transients.views.assign(images.size(), VK_NULL_HANDLE);
+        transients.blocks.assign(images.size(), UINT32_MAX);
+
+        // Greedy interval placement in order of first use: an image takes the first
+        // block of its memory type that is free again by the time it's needed
+        std::vector<uint32_t> order;
+        for (uint32_t i = 0; i < images.size(); i++) {
+            if (!images[i].imported && images[i].firstPass != UINT32_MAX) {
+                order.push_back(i);
+            }
+        }
+        std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+            return images[a].firstPass < images[b].firstPass;
+        });
+
+        std::vector<VkMemoryRequirements> requirements(images.size());
+        for (uint32_t i : order) {
+            const ImageResource& image = images[i];
+
+            VkImageCreateInfo imageInfo{};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.extent = { image.extent.width, image.extent.height, 1 };
+            imageInfo.mipLevels = image.mipLevels;
+            imageInfo.arrayLayers = 1;
+            imageInfo.format = image.format;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            imageInfo.usage = image.usage;
+            imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+            if (vkCreateImage(device, &imageInfo, nullptr, &transients.images[i]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create render graph image: " + image.name);
+            }
+            vkGetImageMemoryRequirements(device, transients.images[i], &requirements[i]);
+
+            uint32_t memoryTypeIndex = renderer->findMemoryType(requirements[i].memoryTypeBits,
+                                                                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            uint32_t block = UINT32_MAX;
+            for (uint32_t b = 0; b < transients.memoryBlocks.size(); b++) {
+                const MemoryBlock& candidate = transients.memoryBlocks[b];
+                if (candidate.memoryTypeIndex == memoryTypeIndex && candidate.lastPass < image.firstPass) {
+                    block = b;
+                    break;
+                }
+            }
+            if (block == UINT32_MAX) {
+                MemoryBlock newBlock;
+                newBlock.memoryTypeIndex = memoryTypeIndex;
+                transients.memoryBlocks.push_back(newBlock);
+                block = static_cast<uint32_t>(transients.memoryBlocks.size() - 1);
+            }
+
+            // Everything is bound at offset 0, so the block only has to be big enough
+            MemoryBlock& target = transients.memoryBlocks[block];
+            VkDeviceSize alignedSize = (requirements[i].size + requirements[i].alignment - 1) /
+                                       requirements[i].alignment * requirements[i].alignment;
+            target.size = std::max(target.size, alignedSize);
+            target.lastPass = image.lastPass;
+            transients.blocks[i] = block;
+        }
+
+        transientMemorySize = 0;
+        for (MemoryBlock& block : transients.memoryBlocks) {
+            VkMemoryAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            allocInfo.allocationSize = block.size;
+            allocInfo.memoryTypeIndex = block.memoryTypeIndex;
+            if (vkAllocateMemory(device, &allocInfo, nullptr, &block.memory) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate render graph memory!");
+            }
+            transientMemorySize += block.size;
+        }
+
+        for (uint32_t i : order) {
+            const ImageResource& image = images[i];
+            vkBindImageMemory(device, transients.images[i], transients.memoryBlocks[transients.blocks[i]].memory, 0);
+
+            VkImageViewCreateInfo viewInfo{};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = transients.images[i];
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = image.format;
+            viewInfo.subresourceRange = { getAspect(image.format), 0, image.mipLevels, 0, 1 };
+            if (vkCreateImageView(device, &viewInfo, nullptr, &transients.views[i]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create render graph image view: " + image.name);
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < images.size(); i++) {
+        if (!images[i].imported) {
+            images[i].image = transients.images[i];
+            images[i].view = transients.views[i];
+            images[i].memoryBlock = transients.blocks[i];
+        }
+    }
+}
+
+void RenderGraph::destroyTransients() {
+    // Framebuffers may name the views
+    releaseFramebuffers();
+
+    for (VkImageView view : transients.views) {
+        if (view != VK_NULL_HANDLE) {
+            vkDestroyImageView(device, view, nullptr);
+        }
+    }
+    for (VkImage image : transients.images) {
+        if (image != VK_NULL_HANDLE) {
+            vkDestroyImage(device, image, nullptr);
+        }
+    }
+    for (MemoryBlock& block : transients.memoryBlocks) {
+        vkFreeMemory(device, block.memory, nullptr);
+    }
+    transients = TransientCache();
+    transientMemorySize = 0;
+}
+
+void RenderGraph::buildBarriers() {
+    std::vector<TrackedState> imageStates(images.size());
+    std::vector<TrackedState> bufferStates(buffers.size());
+    for (size_t i = 0; i < images.size(); i++) {
+        if (images[i].imported) {
+            imageStates[i] = getInitialState(images[i].initialState);
+        }
+    }
+    for (size_t i = 0; i < buffers.size(); i++) {
+        bufferStates[i] = getInitialState(buffers[i].initialState);
+    }
+
+    // Aliased images take over their block from whichever image used it last,
+    // this frame or the previous one
+    std::vector<TrackedState> blockStates(transients.memoryBlocks.size());
+    for (size_t b = 0; b < blockStates.size(); b++) {
+        blockStates[b].writeStages = transients.memoryBlocks[b].lastStages;
+        blockStates[b].writeAccess = transients.memoryBlocks[b].lastAccess;
+    }
+
+    for (uint32_t p = 0; p < passes.size(); p++) {
+        Pass& pass = passes[p];
+        if (pass.culled) {
+            continue;
+        }
+        pass.memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+
+        for (const Access& access : pass.accesses) {
+            if (!access.isImage) {
+                addAccessBarrier(pass, access, bufferStates[access.resource], nullptr);
+                continue;
+            }
+
+            const ImageResource& image = images[access.resource];
+            TrackedState& state = imageStates[access.resource];
+            if (!image.imported && image.firstPass == p) {
+                const TrackedState& block = blockStates[image.memoryBlock];
+                state.writeStages = block.writeStages;
+                state.writeAccess = block.writeAccess;
+            }
+            addAccessBarrier(pass, access, state, &image);
+            if (!image.imported && image.lastPass == p) {
+                TrackedState& block = blockStates[image.memoryBlock];
+                block.writeStages = state.writeStages | state.readStages;
+                block.writeAccess = state.writeAccess;
+            }
+        }
+
+        if (pass.srcStages != 0) {
+            barrierCount++;
+        }
+    }
+
+    for (size_t b = 0; b < blockStates.size(); b++) {
+        transients.memoryBlocks[b].lastStages = blockStates[b].writeStages;
+        transients.memoryBlocks[b].lastAccess = blockStates[b].writeAccess;
+    }
+
+    // Hand imported images over in the layout their next user expects
+    for (size_t i = 0; i < images.size(); i++) {
+        const ImageResource& image = images[i];
+        const TrackedState& state = imageStates[i];
+        if (!image.imported || image.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED || image.finalLayout == state.layout) {
+            continue;
+        }
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = state.writeAccess;
+        barrier.dstAccessMask = 0;
+        barrier.oldLayout = state.layout;
+        barrier.newLayout = image.finalLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image.image;
+        barrier.subresourceRange = { getAspect(image.format), 0, image.mipLevels, image.arrayLayer, 1 };
+        finalBarriers.push_back(barrier);
+        finalSrcStages |= state.writeStages | state.readStages;
+    }
+    if (!finalBarriers.empty()) {
+        if (finalSrcStages == 0) {
+            finalSrcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        }
+        barrierCount++;
+    }
+}
+
+RenderGraph::TrackedState RenderGraph::getInitialState(const ResourceState& initialState) {
+    TrackedState state;
+    state.layout = initialState.layout;
+    if (initialState.access & WRITE_ACCESS) {
+        state.writeStages = initialState.stages;
+        state.writeAccess = initialState.access & WRITE_ACCESS;
+    } else {
+        // Only read before the graph (a cached shadow map): reads in the same
+        // layout go ahead, writes and transitions wait for the earlier reads
+        state.readStages = initialState.stages;
+    }
+    return state;
+}
+
+void RenderGraph::addAccessBarrier(Pass& pass, const Access& access, TrackedState& state,
+                                   const ImageResource* image) {
+    bool layoutChange = image && state.layout != access.layout;
+    VkPipelineStageFlags srcStages;
+    VkAccessFlags srcAccess;
+
+    if (access.write || layoutChange) {
+        // Wait for the last write and every read since (a layout transition is a write)
+        srcStages = state.writeStages | state.readStages;
+        srcAccess = state.writeAccess;
+    } else {
+        // Read: nothing to wait for when the last write is already visible to this stage
+        bool visible = (state.visibleStages & access.stages) == access.stages &&
+                       (state.visibleAccess & access.access) == access.access;
+        if (state.writeStages == 0 || visible) {
+            state.readStages |= access.stages;
+            return;
+        }
+        srcStages = state.writeStages;
+        srcAccess = state.writeAccess;
+    }
+
+    if (srcStages == 0) {
+        srcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    }
+    pass.srcStages |= srcStages;
+    pass.dstStages |= access.stages;
+
+    if (image) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = access.access;
+        // Contents that are about to be overwritten needn't survive the transition
+        barrier.oldLayout = access.discard ? VK_IMAGE_LAYOUT_UNDEFINED : state.layout;
+        barrier.newLayout = access.layout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image->image;
+        barrier.subresourceRange = { getAspect(image->format), 0, image->mipLevels, image->arrayLayer, 1 };
+        pass.imageBarriers.push_back(barrier);
+    } else {
+        // Buffers share one global barrier per pass
+        pass.memoryBarrier.srcAccessMask |= srcAccess;
+        pass.memoryBarrier.dstAccessMask |= access.access;
+    }
+
+    state.layout = access.layout;
+    if (access.write) {
+        state.writeStages = access.stages;
+        state.writeAccess = access.access & WRITE_ACCESS;
+        state.readStages = 0;
+        state.visibleStages = 0;
+        state.visibleAccess = 0;
+    } else {
+        // After a transition the image is visible to this stage, and later readers
+        // still have to wait for the transition itself
+        state.writeStages = layoutChange ? access.stages : state.writeStages;
+        state.writeAccess = layoutChange ? 0 : state.writeAccess;
+        state.readStages = layoutChange ? access.stages : (state.readStages | access.stages);
+        state.visibleStages = layoutChange ? access.stages : (state.visibleStages | access.stages);
+        state.visibleAccess = layoutChange ? access.access : (state.visibleAccess | access.access);
+    }
+}
+
+VkRenderPass RenderGraph::getRenderPass(const Pass& pass) {
+    uint64_t key = 0;
+    for (const Attachment& attachment : pass.attachments) {
+        uint64_t values[] = { static_cast<uint64_t>(images[attachment.image].format), static_cast<uint64_t>(attachment.loadOp),
+                              static_cast<uint64_t>(attachment.storeOp), attachment.depth };
+        key = Hash::combine(key, Hash::bytes(values, sizeof(values)));
+    }
+
+    auto it = renderPasses.find(key);
+    if (it != renderPasses.end()) {
+        return it->second;
+    }
+
+    // Colors first, depth last, like the renderer's base pass the pipelines are built against.
+    // The graph's barriers do the layout transitions, so each attachment stays in one layout
+    std::vector<VkAttachmentDescription> attachments;
+    std::vector<VkAttachmentReference> colorRefs;
+    VkAttachmentReference depthRef{};
+    bool hasDepth = false;
+    for (const Attachment& attachment : pass.attachments) {
+        if (attachment.depth) {
+            continue;
+        }
+        VkAttachmentDescription description{};
+        description.format = images[attachment.image].format;
+        description.samples = VK_SAMPLE_COUNT_1_BIT;
+        description.loadOp = attachment.loadOp;
+        description.storeOp = attachment.storeOp;
+        description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        description.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        description.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        colorRefs.push_back({ static_cast<uint32_t>(attachments.size()), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
+        attachments.push_back(description);
+    }
+    for (const Attachment& attachment : pass.attachments) {
+        if (!attachment.depth) {
+            continue;
+        }
+        VkAttachmentDescription description{};
+        description.format = images[attachment.image].format;
+        description.samples = VK_SAMPLE_COUNT_1_BIT;
+        description.loadOp = attachment.loadOp;
+        description.storeOp = attachment.storeOp;
+        description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        description.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        description.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        depthRef = { static_cast<uint32_t>(attachments.size()), VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+        attachments.push_back(description);
+        hasDepth = true;
+    }
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = static_cast<uint32_t>(colorRefs.size());
+    subpass.pColorAttachments = colorRefs.data();
+    subpass.pDepthStencilAttachment = hasDepth ? &depthRef : nullptr;
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    renderPassInfo.pAttachments = attachments.data();
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+
+    VkRenderPass renderPass;
+    if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create render pass for: " + pass.name);
+    }
+    renderPasses[key] = renderPass;
+    return renderPass;
+}
+
+VkFramebuffer RenderGraph::getFramebuffer(const Pass& pass) {
+    // Same attachment order as getRenderPass
+    std::vector<VkImageView> views;
+    for (int depth = 0; depth < 2; depth++) {
+        for (const Attachment& attachment : pass.attachments) {
+            if (attachment.depth == (depth == 1)) {
+                views.push_back(images[attachment.image].view);
+            }
+        }
+    }
+
+    uint64_t key = Hash::combine(Hash::bytes(&pass.renderPass, sizeof(pass.renderPass)),
+                                 Hash::bytes(views.data(), views.size() * sizeof(VkImageView)));
+    key = Hash::combine(key, (static_cast<uint64_t>(pass.extent.width) << 32) | pass.extent.height);
+
+    auto it = framebuffers.find(key);
+    if (it != framebuffers.end()) {
+        return it->second;
+    }
+
+    VkFramebufferCreateInfo framebufferInfo{};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = pass.renderPass;
+    framebufferInfo.attachmentCount = static_cast<uint32_t>(views.size());
+    framebufferInfo.pAttachments = views.data();
+    framebufferInfo.width = pass.extent.width;
+    framebufferInfo.height = pass.extent.height;
+    framebufferInfo.layers = 1;
+
+    VkFramebuffer framebuffer;
+    if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &framebuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create framebuffer for: " + pass.name);
+    }
+    framebuffers[key] = framebuffer;
+    return framebuffer;
+}
+
+bool RenderGraph::isDepthFormat(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_X8_D24_UNORM_PACK32:
+        case VK_FORMAT_D32_SFLOAT:
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+VkImageAspectFlags RenderGraph::getAspect(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        default:
+            return isDepthFormat(format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+}
@@ -0,0 +1,602 @@
+﻿#include "../include/render/ShadowRenderer.h"
+#include "../include/Utils/Hash.h"
+#include "../VulkanRenderer.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+    // Against shadow acne: in units of the D16 depth step, and scaled by the slope
+    const float DEPTH_BIAS_CONSTANT = 1.25f;
+    const float DEPTH_BIAS_SLOPE = 1.75f;
+
+    // Blend of logarithmic (1) and uniform (0) cascade splits
+    const float CASCADE_SPLIT_LAMBDA = 0.75f;
+
+    glm::vec4 getRow(const glm::mat4& matrix, int row) {
+        return glm::vec4(matrix[0][row], matrix[1][row], matrix[2][row], matrix[3][row]);
+    }
+
+    // Whether a box touches the frustum of a view-projection matrix (depth 0..1)
+    bool intersectsFrustum(const glm::mat4& viewProj, const AABB& box) {
+        glm::vec4 x = getRow(viewProj, 0);
+        glm::vec4 y = getRow(viewProj, 1);
+        glm::vec4 z = getRow(viewProj, 2);
+        glm::vec4 w = getRow(viewProj, 3);
+        const glm::vec4 planes[] = { w + x, w - x, w + y, w - y, z, w - z };
+
+        glm::vec3 center = box.getCenter();
+        glm::vec3 extents = box.getExtents();
+        for (const glm::vec4& plane : planes) {
+            glm::vec3 normal(plane);
+            if (glm::dot(normal, center) + plane.w + glm::dot(glm::abs(normal), extents) < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Any up vector that isn't parallel to the light
+    glm::vec3 getLightUp(const glm::vec3& direction) {
+        return std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+
+    // Everything a light's shadow maps depend on
+    uint64_t hashLight(const LightInstance& light) {
+        // Directional maps don't depend on where the light is placed
+        glm::vec3 position = light.type == LightType::Spot ? light.position : glm::vec3(0.0f);
+        float values[] = { position.x, position.y, position.z,
+                           light.direction.x, light.direction.y, light.direction.z,
+                           light.range, light.outerAngle };
+        return Hash::combine(Hash::bytes(values, sizeof(values)), static_cast<uint64_t>(light.type));
+    }
+
+    // Extent of the bounds along direction, measured from center
+    void getDepthRange(const AABB& bounds, const glm::vec3& center, const glm::vec3& direction,
+                       float& nearDepth, float& farDepth) {
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 point((corner & 1) ? bounds.max.x : bounds.min.x,
+                            (corner & 2) ? bounds.max.y : bounds.min.y,
+                            (corner & 4) ? bounds.max.z : bounds.min.z);
+            float depth = glm::dot(point - center, direction);
+            nearDepth = std::min(nearDepth, depth);
+            farDepth = std::max(farDepth, depth);
+        }
+    }
+}
+
+ShadowRenderer::ShadowRenderer(VulkanRenderer* renderer)
+    : renderer(renderer), device(renderer->getDevice()) {
+    createImages();
+    createPipeline();
+}
+
+ShadowRenderer::~ShadowRenderer() {
+    // The pipeline belongs to the renderer's PipelineLibrary
+    for (uint32_t i = 0; i < Lighting::MAX_SHADOW_MAPS; i++) {
+        vkDestroyImageView(device, staticLayerViews[i], nullptr);
+        vkDestroyImageView(device, compositeLayerViews[i], nullptr);
+    }
+    vkDestroyImageView(device, staticArrayView, nullptr);
+    vkDestroyImageView(device, compositeArrayView, nullptr);
+    vkDestroyImage(device, staticImage, nullptr);
+    vkDestroyImage(device, compositeImage, nullptr);
+    vkFreeMemory(device, staticMemory, nullptr);
+    vkFreeMemory(device, compositeMemory, nullptr);
+
+    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    vkDestroyRenderPass(device, renderPass, nullptr);
+}
+
+SamplerDesc ShadowRenderer::getSamplerDesc() {
+    // Linear filtering of a comparison gives 2x2 PCF for free
+    SamplerDesc desc;
+    desc.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    desc.addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+    desc.anisotropy = false;
+    desc.compare = true;
+    desc.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+    desc.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    return desc;
+}
+
+void ShadowRenderer::createImages() {
+    staticImage = createArrayImage(staticMemory);
+    compositeImage = createArrayImage(compositeMemory);
+
+    staticArrayView = createView(staticImage, VK_IMAGE_VIEW_TYPE_2D_ARRAY, 0, Lighting::MAX_SHADOW_MAPS);
+    compositeArrayView = createView(compositeImage, VK_IMAGE_VIEW_TYPE_2D_ARRAY, 0, Lighting::MAX_SHADOW_MAPS);
+    for (uint32_t i = 0; i < Lighting::MAX_SHADOW_MAPS; i++) {
+        staticLayerViews[i] = createView(staticImage, VK_IMAGE_VIEW_TYPE_2D, i, 1);
+        compositeLayerViews[i] = createView(compositeImage, VK_IMAGE_VIEW_TYPE_2D, i, 1);
+    }
+
+    // Start cleared to the far plane (unshadowed), in the layout maps rest in
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = renderer->getCommandPool();
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate shadow map command buffer!");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+    VkImageSubresourceRange range = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, Lighting::MAX_SHADOW_MAPS };
+    VkImage images[] = { staticImage, compositeImage };
+    VkImageMemoryBarrier barriers[2]{};
+    for (int i = 0; i < 2; i++) {
+        barriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barriers[i].srcAccessMask = 0;
+        barriers[i].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barriers[i].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barriers[i].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barriers[i].image = images[i];
+        barriers[i].subresourceRange = range;
+    }
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        0, nullptr, 0, nullptr, 2, barriers);
+
+    VkClearDepthStencilValue clear = { 1.0f, 0 };
+    for (VkImage image : images) {
+        vkCmdClearDepthStencilImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clear, 1, &range);
+    }
+
+    for (int i = 0; i < 2; i++) {
+        barriers[i].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barriers[i].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barriers[i].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barriers[i].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    }
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+        0, nullptr, 0, nullptr, 2, barriers);
+
+    vkEndCommandBuffer(commandBuffer);
+
+    GpuTimeline* timeline = renderer->getGpuTimeline();
+    timeline->wait(timeline->submit(commandBuffer));
+    vkFreeCommandBuffers(device, renderer->getCommandPool(), 1, &commandBuffer);
+}
+
+VkImage ShadowRenderer::createArrayImage(VkDeviceMemory& memory) {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = { MAP_SIZE, MAP_SIZE, 1 };
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = Lighting::MAX_SHADOW_MAPS;
+    imageInfo.format = FORMAT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    // Static layers are copied into composites; both are cleared once at creation
+    imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT |
+                      VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkImage image;
+    if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create shadow map image!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(device, image, &memRequirements);
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = renderer->findMemoryType(memRequirements.memoryTypeBits,
+                                                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate shadow map memory!");
+    }
+    vkBindImageMemory(device, image, memory, 0);
+    return image;
+}
+
+VkImageView ShadowRenderer::createView(VkImage image, VkImageViewType viewType, uint32_t firstLayer,
+                                       uint32_t layerCount) {
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = viewType;
+    viewInfo.format = FORMAT;
+    viewInfo.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, firstLayer, layerCount };
+
+    VkImageView view;
+    if (vkCreateImageView(device, &viewInfo, nullptr, &view) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create shadow map view!");
+    }
+    return view;
+}
+
+void ShadowRenderer::createPipeline() {
+    // Depth-only pass in the shadow format, compatible with the graph's shadow passes
+    VkAttachmentDescription depthAttachment{};
+    depthAttachment.format = FORMAT;
+    depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference depthRef = { 0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.pDepthStencilAttachment = &depthRef;
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = 1;
+    renderPassInfo.pAttachments = &depthAttachment;
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+    if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create shadow render pass!");
+    }
+
+    // Light matrix and model matrix (shaders/shadow.vert)
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = 2 * sizeof(glm::mat4);
+
+    VkPipelineLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (vkCreatePipelineLayout(device, &layoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create shadow pipeline layout!");
+    }
+
+    // Positions only, no fragment shader. Not culled: open meshes cast from both sides
+    pipelineDesc.vertexShader = "shaders/shadow_vert.spv";
+    pipelineDesc.vertexBindings = { Vertex::getBindingDescription() };
+    pipelineDesc.vertexAttributes = { Vertex::getAttributeDescriptions()[0] };
+    pipelineDesc.cullMode = VK_CULL_MODE_NONE;
+    pipelineDesc.depthBiasConstant = DEPTH_BIAS_CONSTANT;
+    pipelineDesc.depthBiasSlope = DEPTH_BIAS_SLOPE;
+    pipelineDesc.colorAttachmentCount = 0;
+    pipelineDesc.renderPass = renderPass;
+    pipelineDesc.layout = pipelineLayout;
+    renderer->getPipelineLibrary()->getNow(pipelineDesc);
+}
+
+void ShadowRenderer::update(const FrameSnapshot& snapshot, float aspectRatio) {
+    staticRenderCount = 0;
+    compositeCount = 0;
+    assignMaps(snapshot);
+
+    // Cascades reach through everything that renders along the light
+    AABB sceneBounds;
+    for (const AABB& bounds : snapshot.bounds) {
+        if (bounds.isValid()) {
+            sceneBounds.expand(bounds.min);
+            sceneBounds.expand(bounds.max);
+        }
+    }
+
+    float nearPlane = snapshot.nearPlane;
+    float distance = std::min(snapshot.farPlane, MAX_CASCADE_DISTANCE);
+    for (uint32_t c = 0; c < Lighting::CASCADE_COUNT; c++) {
+        float fraction = static_cast<float>(c + 1) / Lighting::CASCADE_COUNT;
+        float logSplit = nearPlane * std::pow(distance / nearPlane, fraction);
+        float uniformSplit = nearPlane + (distance - nearPlane) * fraction;
+        cascadeSplits[c] = CASCADE_SPLIT_LAMBDA * logSplit + (1.0f - CASCADE_SPLIT_LAMBDA) * uniformSplit;
+    }
+
+    for (size_t i = 0; i < lightShadowMaps.size(); i++) {
+        if (lightShadowMaps[i] < 0) {
+            continue;
+        }
+        const LightInstance& light = snapshot.lights[i];
+        uint64_t lightHash = hashLight(light);
+        uint32_t mapCount = light.type == LightType::Directional ? Lighting::CASCADE_COUNT : 1;
+
+        for (uint32_t m = 0; m < mapCount; m++) {
+            ShadowMap& map = maps[lightShadowMaps[i] + m];
+            bool moved = !map.cached || map.lightHash != lightHash;
+            map.lightHash = lightHash;
+            if (light.type == LightType::Directional) {
+                moved = placeCascade(map, light, snapshot, aspectRatio, sceneBounds, moved);
+            } else if (moved) {
+                placeSpot(map, light);
+            }
+
+            findCasters(map, snapshot, moved);
+            if (map.renderStatic) {
+                staticRenderCount++;
+            }
+            if (!map.dynamicCasters.empty()) {
+                compositeCount++;
+            }
+        }
+    }
+}
+
+void ShadowRenderer::assignMaps(const FrameSnapshot& snapshot) {
+    size_t lightCount = std::min<size_t>(snapshot.lights.size(), Lighting::MAX_SHADOWED_LIGHTS);
+    lightShadowMaps.assign(lightCount, -1);
+
+    // A light keeps its maps (and their cached contents) for as long as it casts shadows
+    for (uint32_t m = 0; m < Lighting::MAX_SHADOW_MAPS; m++) {
+        ShadowMap& map = maps[m];
+        if (!map.assigned) {
+            continue;
+        }
+        bool kept = false;
+        for (size_t i = 0; i < lightCount; i++) {
+            const LightInstance& light = snapshot.lights[i];
+            if (light.castShadows && light.id == map.lightId && light.type == map.type) {
+                kept = true;
+                if (map.cascade == 0) {
+                    lightShadowMaps[i] = static_cast<int32_t>(m);
+                }
+            }
+        }
+        if (!kept) {
+            map = ShadowMap();
+        }
+    }
+
+    // New lights take the first run of free maps long enough for their cascades
+    for (size_t i = 0; i < lightCount; i++) {
+        const LightInstance& light = snapshot.lights[i];
+        // No cube maps: point lights cast no shadows
+        if (!light.castShadows || light.type == LightType::Point || lightShadowMaps[i] >= 0) {
+            continue;
+        }
+        uint32_t mapCount = light.type == LightType::Directional ? Lighting::CASCADE_COUNT : 1;
+        for (uint32_t first = 0; first + mapCount <= Lighting::MAX_SHADOW_MAPS; first++) {
+            bool free = true;
+            for (uint32_t m = first; m < first + mapCount; m++) {
+                free = free && !maps[m].assigned;
+            }
+            if (!free) {
+                continue;
+            }
+
+            for (uint32_t m = 0; m < mapCount; m++) {
+                ShadowMap& map = maps[first + m];
+                map = ShadowMap();
+                map.assigned = true;
+                map.lightId = light.id;
+                map.type = light.type;
+                map.cascade = m;
+            }
+            lightShadowMaps[i] = static_cast<int32_t>(first);
+            break;
+        }
+    }
+}
+
+bool ShadowRenderer::placeCascade(ShadowMap& map, const LightInstance& light, const FrameSnapshot& snapshot,
+                                  float aspectRatio, const AABB& sceneBounds, bool force) {
+    // Bounding sphere of the cascade's slice of the view frustum. Its radius doesn't
+    // change as the camera turns, so neither does the texel size.
+    float sliceNear = map.cascade == 0 ? snapshot.nearPlane : cascadeSplits[map.cascade - 1];
+    float sliceFar = cascadeSplits[map.cascade];
+    glm::mat4 cameraToWorld = glm::inverse(snapshot.view);
+    float tanY = std::tan(glm::radians(snapshot.fov) * 0.5f);
+    float tanX = tanY * aspectRatio;
+
+    glm::vec3 corners[8];
+    glm::vec3 sliceCenter(0.0f);
+    for (int c = 0; c < 8; c++) {
+        float depth = (c & 4) ? sliceFar : sliceNear;
+        glm::vec3 viewCorner(((c & 1) ? 1.0f : -1.0f) * tanX * depth,
+                             ((c & 2) ? 1.0f : -1.0f) * tanY * depth, -depth);
+        corners[c] = glm::vec3(cameraToWorld * glm::vec4(viewCorner, 1.0f));
+        sliceCenter += corners[c] / 8.0f;
+    }
+    float sliceRadius = 0.0f;
+    for (const glm::vec3& corner : corners) {
+        sliceRadius = std::max(sliceRadius, glm::length(corner - sliceCenter));
+    }
+
+    // Keep the cached map while it still covers the slice (and isn't needlessly
+    // coarse) and the scene still fits its depth range
+    if (!force && glm::length(sliceCenter - map.center) + sliceRadius <= map.radius &&
+        sliceRadius * CASCADE_PADDING >= map.radius * 0.5f) {
+        float sceneNear = map.depthNear;
+        float sceneFar = map.depthFar;
+        if (sceneBounds.isValid()) {
+            getDepthRange(sceneBounds, map.center, light.direction, sceneNear, sceneFar);
+        }
+        if (sceneNear >= map.depthNear && sceneFar <= map.depthFar) {
+            return false;
+        }
+    }
+
+    // Re-centre with room to spare, snapped to whole texels of the light's view
+    float radius = sliceRadius * CASCADE_PADDING;
+    glm::vec3 up = getLightUp(light.direction);
+    glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), light.direction, up);
+    glm::vec3 lightCenter = glm::vec3(lightRotation * glm::vec4(sliceCenter, 1.0f));
+    float texelSize = 2.0f * radius / MAP_SIZE;
+    lightCenter.x = std::floor(lightCenter.x / texelSize) * texelSize;
+    lightCenter.y = std::floor(lightCenter.y / texelSize) * texelSize;
+    map.center = glm::vec3(glm::inverse(lightRotation) * glm::vec4(lightCenter, 1.0f));
+    map.radius = radius;
+
+    // Casters between the light and the slice must land in the map too; the
+    // slack lets moving objects wander before the range has to grow
+    float nearDepth = -radius;
+    float farDepth = radius;
+    if (sceneBounds.isValid()) {
+        getDepthRange(sceneBounds, map.center, light.direction, nearDepth, farDepth);
+    }
+    map.depthNear = nearDepth - radius;
+    map.depthFar = farDepth + radius;
+
+    // Vulkan depth range regardless of the including file's GLM configuration
+    glm::mat4 view = glm::lookAt(map.center, map.center + light.direction, up);
+    glm::mat4 proj = glm::orthoRH_ZO(-radius, radius, -radius, radius, map.depthNear, map.depthFar);
+    map.viewProj = proj * view;
+    return true;
+}
+
+void ShadowRenderer::placeSpot(ShadowMap& map, const LightInstance& light) {
+    float nearPlane = std::max(light.range * 0.01f, 0.05f);
+    float fov = 2.0f * std::min(light.outerAngle, glm::radians(85.0f));
+    glm::mat4 view = glm::lookAt(light.position, light.position + light.direction, getLightUp(light.direction));
+    glm::mat4 proj = glm::perspectiveRH_ZO(fov, 1.0f, nearPlane, light.range);
+    map.viewProj = proj * view;
+}
+
+void ShadowRenderer::findCasters(ShadowMap& map, const FrameSnapshot& snapshot, bool moved) {
+    // Static casters only need looking at when something static changed somewhere
+    bool checkStatic = moved || !map.cached || map.staticVersion != snapshot.staticVersion;
+    map.dynamicCasters.clear();
+    if (checkStatic) {
+        map.staticCasters.clear();
+    }
+
+    uint64_t casterHash = 0;
+    for (uint32_t i = 0; i < snapshot.getInstanceCount(); i++) {
+        bool isStatic = snapshot.staticFlags[i] != 0;
+        if ((isStatic && !checkStatic) || !intersectsFrustum(map.viewProj, snapshot.bounds[i])) {
+            continue;
+        }
+        if (isStatic) {
+            map.staticCasters.push_back(i);
+            casterHash = Hash::combine(casterHash, Hash::bytes(&snapshot.meshes[i], sizeof(Mesh*)));
+            casterHash = Hash::combine(casterHash, Hash::bytes(&snapshot.modelMatrices[i], sizeof(glm::mat4)));
+        } else {
+            map.dynamicCasters.push_back(i);
+        }
+    }
+
+    // A static change elsewhere in the scene leaves this map's cache alone
+    map.renderStatic = false;
+    if (checkStatic) {
+        map.renderStatic = moved || !map.cached || casterHash != map.casterHash;
+        map.casterHash = casterHash;
+        map.staticVersion = snapshot.staticVersion;
+        map.cached = true;
+    }
+}
+
+std::vector<RenderGraph::ImageHandle> ShadowRenderer::addPasses(RenderGraph& graph, const FrameSnapshot& snapshot) {
+    std::vector<RenderGraph::ImageHandle> sampled;
+    std::array<RenderGraph::ImageHandle, Lighting::MAX_SHADOW_MAPS> staticLayers;
+    std::array<RenderGraph::ImageHandle, Lighting::MAX_SHADOW_MAPS> compositeLayers;
+    std::vector<uint32_t> composited;
+
+    // Last used by the previous frame's lit passes
+    const RenderGraph::ResourceState restingState = {
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0 };
+    const VkExtent2D extent = { MAP_SIZE, MAP_SIZE };
+
+    // Fetched every frame: the library owns it
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    if (staticRenderCount > 0 || compositeCount > 0) {
+        pipeline = renderer->getPipelineLibrary()->getNow(pipelineDesc);
+    }
+
+    for (uint32_t m = 0; m < Lighting::MAX_SHADOW_MAPS; m++) {
+        const ShadowMap& map = maps[m];
+        if (!map.assigned) {
+            continue;
+        }
+
+        staticLayers[m] = graph.importImage("shadow-static", staticImage, staticLayerViews[m], FORMAT, extent,
+            restingState, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, 1, m);
+        sampled.push_back(staticLayers[m]);
+        if (map.renderStatic) {
+            graph.addPass("shadow-static", RenderGraph::PassType::Graphics,
+                [this, m, pipeline, &snapshot](VkCommandBuffer commandBuffer) {
+                    drawCasters(commandBuffer, pipeline, maps[m], maps[m].staticCasters, snapshot);
+                })
+                .depthAttachment(staticLayers[m], VK_ATTACHMENT_LOAD_OP_CLEAR);
+        }
+
+        if (!map.dynamicCasters.empty()) {
+            compositeLayers[m] = graph.importImage("shadow-composite", compositeImage, compositeLayerViews[m],
+                FORMAT, extent, restingState, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, 1, m);
+            sampled.push_back(compositeLayers[m]);
+            composited.push_back(m);
+        }
+    }
+
+    if (composited.empty()) {
+        return sampled;
+    }
+
+    // Every composite starts as a copy of its cached layer, all in one pass
+    RenderGraph::PassBuilder copy = graph.addPass("shadow-copy", RenderGraph::PassType::Transfer,
+        [this, composited](VkCommandBuffer commandBuffer) {
+            std::vector<VkImageCopy> regions;
+            for (uint32_t m : composited) {
+                VkImageCopy region{};
+                region.srcSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, m, 1 };
+                region.dstSubresource = region.srcSubresource;
+                region.extent = { MAP_SIZE, MAP_SIZE, 1 };
+                regions.push_back(region);
+            }
+            vkCmdCopyImage(commandBuffer, staticImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                compositeImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                static_cast<uint32_t>(regions.size()), regions.data());
+        });
+    for (uint32_t m : composited) {
+        copy.transferRead(staticLayers[m]).transferWrite(compositeLayers[m]);
+    }
+
+    // Then the moving casters on top
+    for (uint32_t m : composited) {
+        graph.addPass("shadow-dynamic", RenderGraph::PassType::Graphics,
+            [this, m, pipeline, &snapshot](VkCommandBuffer commandBuffer) {
+                drawCasters(commandBuffer, pipeline, maps[m], maps[m].dynamicCasters, snapshot);
+            })
+            .depthAttachment(compositeLayers[m], VK_ATTACHMENT_LOAD_OP_LOAD);
+    }
+    return sampled;
+}
+
+void ShadowRenderer::drawCasters(VkCommandBuffer commandBuffer, VkPipeline pipeline, const ShadowMap& map,
+                                 const std::vector<uint32_t>& casters, const FrameSnapshot& snapshot) const {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+    // Push constants of shaders/shadow.vert
+    struct {
+        glm::mat4 lightSpaceMatrix;
+        glm::mat4 model;
+    } push;
+    push.lightSpaceMatrix = map.viewProj;
+
+    for (uint32_t i : casters) {
+        push.model = snapshot.modelMatrices[i];
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push), &push);
+        snapshot.meshes[i]->bind(commandBuffer);
+        snapshot.meshes[i]->draw(commandBuffer);
+    }
+}
+
+void ShadowRenderer::fillLightingData(LightingData& data) const {
+    // Clip space to texture coordinates; depth is already 0..1
+    glm::mat4 clipToUV = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f, 0.5f, 0.0f)) *
+                         glm::scale(glm::mat4(1.0f), glm::vec3(0.5f, 0.5f, 1.0f));
+
+    data.counts.y = 0;
+    for (uint32_t m = 0; m < Lighting::MAX_SHADOW_MAPS; m++) {
+        if (!maps[m].assigned) {
+            continue;
+        }
+        data.shadowMatrices[m] = clipToUV * maps[m].viewProj;
+        if (!maps[m].dynamicCasters.empty()) {
+            data.counts.y |= 1u << m;
+        }
+    }
+    data.cascadeSplits = cascadeSplits;
+}
@@ -1,13 +1,24 @@
 ﻿#include "../include/scene/Scene.h"
 #include "../VulkanRenderer.h"
+#include "../include/Utils/Hash.h"
+#include <cstring>
 #include <iostream>
 
 Scene::Scene(VulkanRenderer* renderer) : renderer(renderer) {
+    textureLoader = std::make_unique<AsyncTextureLoader>(renderer, renderer->getThreadPool(),
+                                                         renderer->getStagingRing(),
+                                                         renderer->getTextureStreamer());
+    textureAtlas = std::make_unique<TextureAtlas>(renderer, renderer->getThreadPool());
 }
 
 Scene::~Scene() {
-    meshInstances.clear();
-    textureCache.clear();
+    registry.clear();
+    meshIndices.clear();
+    meshAssets.clear();
+    geometryCache.clear();
+    meshes.clear();
+    textureAtlas.reset();
+    textureLoader.reset();
 }
 
 bool Scene::loadModel(const std::string& filename, const Transform& transform) {
@@ -22,7 +33,7 @@ bool Scene::loadModel(const std::string& filename, const Transform& transform) {
         return false;
     }
     
-    createMeshesFromData(meshDataList, transform);
+    createMeshesFromData(meshDataList, transform, filename);
     return true;
 }
 
@@ -39,85 +50,372 @@ bool Scene::loadTexturedModel(const std::string& modelFilename, const std::strin
         return false;
     }
     
-    // Load texture
-    std::shared_ptr<Texture> texture = loadTexture(textureFilename);
-    if (!texture) {
-        std::cerr << "Failed to load texture: " << textureFilename << std::endl;
-        // Continue without texture
-        createMeshesFromData(meshDataList, transform);
-        return true;
+    // Create meshes sampling the texture, packed into an atlas page when it is small
+    createMeshesFromData(meshDataList, transform, modelFilename, textureFilename);
+    return true;
+}
+
+bool Scene::loadOccluderModel(const std::string& filename, const Transform& transform) {
+    if (!modelLoader.LoadModel(filename)) {
+        std::cerr << "Failed to load occluder model: " << filename << std::endl;
+        return false;
+    }
+
+    const std::vector<MeshData>& meshDataList = modelLoader.GetMeshData();
+    if (meshDataList.empty()) {
+        std::cerr << "No meshes found in occluder model: " << filename << std::endl;
+        return false;
+    }
+
+    // Only positions are kept, the rasterizer doesn't need anything else
+    for (const auto& meshData : meshDataList) {
+        OccluderMesh occluder;
+        occluder.positions.reserve(meshData.vertices.size());
+        for (const auto& vertex : meshData.vertices) {
+            occluder.positions.emplace_back(vertex.pos[0], vertex.pos[1], vertex.pos[2]);
+        }
+        occluder.indices.assign(meshData.indices.begin(), meshData.indices.end());
+        occluder.modelMatrix = transform.getModelMatrix();
+        occluders.push_back(std::move(occluder));
     }
-    
-    // Create material with texture
-    Material material(texture);
-    
-    // Create meshes with the material
-    createMeshesFromData(meshDataList, transform, material);
     return true;
 }
 
 std::shared_ptr<Texture> Scene::loadTexture(const std::string& filename) {
-    // Check if texture is already loaded
-    auto it = textureCache.find(filename);
-    if (it != textureCache.end()) {
+    // Decoding happens on the thread pool, meshes sample the default texture until it's uploaded
+    return textureLoader->request(filename);
+}
+
+uint32_t Scene::processTextureUploads() {
+    return textureLoader->processUploads() + textureAtlas->processUploads();
+}
+
+void Scene::createMeshesFromData(const std::vector<MeshData>& meshDataList, const Transform& transform,
+                               const std::string& modelPath, const std::string& texturePath) {
+    for (size_t i = 0; i < meshDataList.size(); i++) {
+        std::shared_ptr<Mesh> mesh = createMesh(meshDataList[i], texturePath);
+
+        MeshAsset asset;
+        asset.modelPath = modelPath;
+        asset.subMesh = static_cast<uint32_t>(i);
+        asset.texturePath = texturePath;
+        registerMesh(mesh, asset);
+        
+        // Create an entity for this mesh
+        addMeshInstance(mesh, transform);
+    }
+}
+
+std::shared_ptr<Mesh> Scene::createMesh(const MeshData& sourceData, const std::string& texturePath) {
+    Material material;
+    const MeshData* geometry = &sourceData;
+    MeshData remapped;
+
+    if (!texturePath.empty()) {
+        // Small textures share an atlas page when the UVs don't tile; the UVs are
+        // moved into the texture's rect on the page
+        TextureAtlas::Region region;
+        if (hasUnitUVs(sourceData) && textureAtlas->pack(texturePath, region)) {
+            remapped = sourceData;
+            for (Vertex& vertex : remapped.vertices) {
+                glm::vec2 uv = region.remap(glm::vec2(vertex.uv[0], vertex.uv[1]));
+                vertex.uv[0] = uv.x;
+                vertex.uv[1] = uv.y;
+            }
+            geometry = &remapped;
+            material = Material(region.page);
+        } else if (std::shared_ptr<Texture> texture = loadTexture(texturePath)) {
+            material = Material(texture);
+        } else {
+            // Continue without texture
+            std::cerr << "Failed to load texture: " << texturePath << std::endl;
+        }
+    }
+
+    const MeshData& meshData = *geometry;
+    size_t vertexBytes = meshData.vertices.size() * sizeof(Vertex);
+    size_t indexBytes = meshData.indices.size() * sizeof(unsigned int);
+    uint64_t geometryHash = Hash::combine(Hash::bytes(meshData.vertices.data(), vertexBytes),
+                                          Hash::bytes(meshData.indices.data(), indexBytes));
+
+    std::vector<CachedGeometry>& candidates = geometryCache[geometryHash];
+    for (const CachedGeometry& cached : candidates) {
+        bool identical = cached.data.vertices.size() == meshData.vertices.size() &&
+                         cached.data.indices.size() == meshData.indices.size() &&
+                         std::memcmp(cached.data.vertices.data(), meshData.vertices.data(), vertexBytes) == 0 &&
+                         std::memcmp(cached.data.indices.data(), meshData.indices.data(), indexBytes) == 0;
+        if (!identical) {
+            continue;
+        }
+
+        // Identical geometry is already on the GPU
+        meshDedupStats.add(vertexBytes + indexBytes);
+        if (isSameMaterial(cached.mesh->getMaterial(), material)) {
+            return cached.mesh;
+        }
+        return std::make_shared<Mesh>(cached.mesh, material);
+    }
+
+    // Create a new mesh with the provided material
+    std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>(renderer->getDevice(), renderer->getPhysicalDevice(),
+                                                        meshData, material);
+    mesh->createBuffers(renderer->getCommandPool(), renderer->getGraphicsQueue(),
+                        renderer->getGpuTimeline());
+    candidates.push_back({ mesh, meshData });
+    return mesh;
+}
+
+bool Scene::hasUnitUVs(const MeshData& meshData) {
+    // A little slack for exporters that write 1.0000001
+    const float epsilon = 1e-4f;
+    for (const Vertex& vertex : meshData.vertices) {
+        if (vertex.uv[0] < -epsilon || vertex.uv[0] > 1.0f + epsilon ||
+            vertex.uv[1] < -epsilon || vertex.uv[1] > 1.0f + epsilon) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Scene::isSameMaterial(const Material& a, const Material& b) {
+    return a.diffuseTexture == b.diffuseTexture && a.normalTexture == b.normalTexture &&
+           a.useTexture == b.useTexture && a.diffuseColor == b.diffuseColor && a.alpha == b.alpha &&
+           a.metallic == b.metallic && a.roughness == b.roughness && a.emissiveColor == b.emissiveColor &&
+           a.doubleSided == b.doubleSided;
+}
+
+uint32_t Scene::registerMesh(const std::shared_ptr<Mesh>& mesh, const MeshAsset& asset) {
+    auto it = meshIndices.find(mesh.get());
+    if (it != meshIndices.end()) {
         return it->second;
     }
-    
-    // Create new texture
-    auto texture = std::make_shared<Texture>(renderer->getDevice(), renderer->getPhysicalDevice());
-    
-    // Load texture from file
-    if (!texture->loadFromFile(filename, renderer->getCommandPool(), renderer->getGraphicsQueue())) {
-        return nullptr;
+
+    uint32_t index = static_cast<uint32_t>(meshes.size());
+    meshes.push_back(mesh);
+    meshAssets.push_back(asset);
+    meshIndices[mesh.get()] = index;
+    return index;
+}
+
+Entity Scene::addMeshInstance(std::shared_ptr<Mesh> mesh, const Transform& transform) {
+    Entity entity = registry.create();
+
+    Renderable renderable;
+    renderable.meshIndex = registerMesh(mesh);
+    renderable.mesh = mesh.get();
+
+    WorldMatrix world;
+    world.matrix = transform.getModelMatrix();
+
+    WorldBounds bounds;
+    bounds.aabb = mesh->getBounds().transformed(world.matrix);
+
+    registry.add<Transform>(entity, transform);
+    registry.add<WorldMatrix>(entity, world);
+    registry.add<Renderable>(entity, renderable);
+    registry.add<WorldBounds>(entity, bounds);
+    return entity;
+}
+
+Entity Scene::addLight(const Light& light, const Transform& transform) {
+    Entity entity = registry.create();
+
+    WorldMatrix world;
+    world.matrix = transform.getModelMatrix();
+
+    registry.add<Transform>(entity, transform);
+    registry.add<WorldMatrix>(entity, world);
+    registry.add<Light>(entity, light);
+    return entity;
+}
+
+void Scene::destroyEntity(Entity entity) {
+    if (registry.has<Static>(entity)) {
+        staticVersion++;
     }
-    
-    // Cache the texture
-    textureCache[filename] = texture;
-    
-    return texture;
+    // Meshes stay in the mesh table, other entities may still reference them
+    registry.destroy(entity);
 }
 
-void Scene::createMeshesFromData(const std::vector<MeshData>& meshDataList, const Transform& transform,
-                               const Material& material) {
-    for (const auto& meshData : meshDataList) {
-        // Create a new mesh with the provided material
-        auto mesh = std::make_shared<Mesh>(renderer->getDevice(), renderer->getPhysicalDevice(), 
-                                        meshData, material);
-        mesh->createBuffers(renderer->getCommandPool(), renderer->getGraphicsQueue());
-        
-        // Create an instance of this mesh
-        meshInstances.emplace_back(mesh, transform);
+void Scene::setStatic(Entity entity, bool isStatic) {
+    if (!registry.isAlive(entity) || registry.has<Static>(entity) == isStatic) {
+        return;
+    }
+    if (isStatic) {
+        // The next update records its matrix and bumps the version
+        registry.add<Static>(entity);
+    } else {
+        registry.remove<Static>(entity);
+        staticVersion++;
     }
 }
 
-void Scene::addMeshInstance(std::shared_ptr<Mesh> mesh, const Transform& transform) {
-    meshInstances.emplace_back(mesh, transform);
+void Scene::setParent(Entity child, Entity parent) {
+    if (!registry.isAlive(child)) {
+        return;
+    }
+    if (registry.isAlive(parent) && parent != child) {
+        Parent link;
+        link.entity = parent;
+        registry.add<Parent>(child, link);
+    } else {
+        registry.remove<Parent>(child);
+    }
+}
+
+glm::mat4 Scene::getParentMatrix(Entity parent) {
+    // Hierarchies are shallow, walking up the local transforms is cheaper than
+    // keeping the pools sorted parent-first. The depth limit guards against cycles.
+    ComponentPool<Transform>& transforms = registry.pool<Transform>();
+    ComponentPool<Parent>& parents = registry.pool<Parent>();
+
+    glm::mat4 matrix(1.0f);
+    for (int depth = 0; depth < 64 && registry.isAlive(parent); depth++) {
+        if (transforms.has(parent.index)) {
+            matrix = transforms.get(parent.index).getModelMatrix() * matrix;
+        }
+        if (!parents.has(parent.index)) {
+            break;
+        }
+        parent = parents.get(parent.index).entity;
+    }
+    return matrix;
 }
 
 void Scene::update(float deltaTime) {
     // Update transforms or animations if needed
-    for (auto& instance : meshInstances) {
-        // Example: rotate each mesh
-        instance.transform.rotation.y += deltaTime * 0.5f; // Rotate around Y axis
+    ComponentPool<Static>& statics = registry.pool<Static>();
+    ComponentPool<Light>& lights = registry.pool<Light>();
+    registry.each<Transform>([deltaTime, &statics, &lights](uint32_t entity, Transform& transform) {
+        // Example: rotate each mesh, except static ones (lights stay where they were put)
+        if (statics.has(entity) || lights.has(entity)) {
+            return;
+        }
+        transform.rotation.y += deltaTime * 0.5f; // Rotate around Y axis
+    });
+
+    // Resolve model matrices
+    registry.each<WorldMatrix, Transform>([](uint32_t, WorldMatrix& world, const Transform& transform) {
+        world.matrix = transform.getModelMatrix();
+    });
+
+    // Children are relative to their parent chain
+    registry.each<Parent, WorldMatrix>([this](uint32_t, const Parent& parent, WorldMatrix& world) {
+        world.matrix = getParentMatrix(parent.entity) * world.matrix;
+    });
+
+    // Static entities can still be moved explicitly; cached shadow maps must notice
+    registry.each<Static, WorldMatrix>([this](uint32_t, Static& fixed, const WorldMatrix& world) {
+        if (fixed.lastMatrix != world.matrix) {
+            fixed.lastMatrix = world.matrix;
+            staticVersion++;
+        }
+    });
+
+    // Refresh world bounds of everything that renders
+    registry.each<WorldBounds, Renderable, WorldMatrix>(
+        [](uint32_t, WorldBounds& bounds, const Renderable& renderable, const WorldMatrix& world) {
+            bounds.aabb = renderable.mesh->getBounds().transformed(world.matrix);
+        });
+}
+
+// Draw order is the dense order of the Renderable pool
+void Scene::buildSnapshot(FrameSnapshot& snapshot) {
+    ComponentPool<Renderable>& renderables = registry.pool<Renderable>();
+    ComponentPool<WorldMatrix>& worldMatrices = registry.pool<WorldMatrix>();
+    ComponentPool<WorldBounds>& worldBounds = registry.pool<WorldBounds>();
+    ComponentPool<Static>& statics = registry.pool<Static>();
+    const auto& entities = renderables.entities();
+    size_t count = renderables.size();
+
+    // resize keeps the capacity of the recycled snapshot, so this doesn't allocate
+    snapshot.meshes.resize(count);
+    snapshot.modelMatrices.resize(count);
+    snapshot.bounds.resize(count);
+    snapshot.cullInstances.resize(count);
+    snapshot.staticFlags.resize(count);
+    snapshot.staticVersion = staticVersion;
+
+    for (size_t i = 0; i < count; i++) {
+        Mesh* mesh = renderables.components()[i].mesh;
+        const AABB& bounds = worldBounds.get(entities[i]).aabb;
+
+        snapshot.meshes[i] = mesh;
+        snapshot.modelMatrices[i] = worldMatrices.get(entities[i]).matrix;
+        snapshot.bounds[i] = bounds;
+        snapshot.cullInstances[i].aabbMin = glm::vec4(bounds.min, 1.0f);
+        snapshot.cullInstances[i].aabbMax = glm::vec4(bounds.max, 1.0f);
+        snapshot.cullInstances[i].indexCount = mesh->getIndexCount();
+        snapshot.staticFlags[i] = statics.has(entities[i]) ? 1 : 0;
     }
+
+    snapshot.lights.clear();
+    registry.each<Light, WorldMatrix>([this, &snapshot](uint32_t entity, const Light& light, const WorldMatrix& world) {
+        Entity handle = registry.getEntity(entity);
+
+        LightInstance instance;
+        instance.id = (static_cast<uint64_t>(handle.generation) << 32) | handle.index;
+        instance.type = light.type;
+        instance.position = glm::vec3(world.matrix[3]);
+        instance.direction = glm::normalize(glm::mat3(world.matrix) * light.direction);
+        instance.color = light.color;
+        instance.intensity = light.intensity;
+        instance.range = light.range;
+        instance.innerAngle = light.innerAngle;
+        instance.outerAngle = light.outerAngle;
+        instance.castShadows = light.castShadows;
+        snapshot.lights.push_back(instance);
+    });
 }
 
-void Scene::draw(VkCommandBuffer commandBuffer, const glm::mat4& view, const glm::mat4& proj) {
-    for (const auto& instance : meshInstances) {
+void Scene::draw(VkCommandBuffer commandBuffer, const FrameSnapshot& snapshot,
+                 const glm::mat4& view, const glm::mat4& proj,
+                 VkBuffer indirectBuffer, const std::vector<uint8_t>* visibility) {
+    BindlessTextureTable* bindlessTextures = renderer->getBindlessTextures();
+    VkPipeline boundPipeline = VK_NULL_HANDLE;
+    for (size_t i = 0; i < snapshot.getInstanceCount(); i++) {
+        if (visibility && i < visibility->size() && !(*visibility)[i]) {
+            continue;
+        }
+        Mesh* mesh = snapshot.meshes[i];
+
         // Get the model matrix for this instance
-        glm::mat4 model = instance.transform.getModelMatrix();
-        
-        // Update uniform buffer with MVP matrices
-        renderer->updateMVPMatrices(model, view, proj);
+        const glm::mat4& model = snapshot.modelMatrices[i];
         
-        // Update descriptor set with mesh's texture (if any)
-        if (instance.mesh->getMaterial().useTexture && 
-            instance.mesh->getMaterial().diffuseTexture) {
-            renderer->updateTextureDescriptor(instance.mesh->getMaterial().getTextureImageInfo());
+        // Material variants share the base pipeline's layout, so the bound sets stay valid
+        const Material& material = mesh->getMaterial();
+        VkPipeline pipeline = renderer->getMaterialPipeline(material);
+        if (pipeline != boundPipeline) {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+            boundPipeline = pipeline;
+        }
+
+        // Select the mesh's texture (if any)
+        VkDescriptorImageInfo textureInfo{};
+        bool ownTexture = false;
+        if (bindlessTextures) {
+            // Loading textures resolve to the default slot
+            uint32_t textureIndex = material.useTexture ?
+                bindlessTextures->getIndex(material.diffuseTexture) : BindlessTextureTable::DEFAULT_TEXTURE_INDEX;
+            vkCmdPushConstants(commandBuffer, renderer->getPipelineLayout(), VK_SHADER_STAGE_FRAGMENT_BIT,
+                               0, sizeof(uint32_t), &textureIndex);
+        } else if (material.useTexture && material.diffuseTexture && material.diffuseTexture->isReady()) {
+            // Textures still loading in the background use the default white texture
+            textureInfo = material.getTextureImageInfo();
+            ownTexture = true;
+        }
+
+        // MVP matrices go to the frame's transient memory; when it is full the draw is dropped
+        if (!renderer->bindDrawUniforms(commandBuffer, model, view, proj, ownTexture ? &textureInfo : nullptr)) {
+            continue;
         }
         
         // Draw the mesh
-        instance.mesh->bind(commandBuffer);
-        instance.mesh->draw(commandBuffer);
+        mesh->bind(commandBuffer);
+        if (indirectBuffer != VK_NULL_HANDLE) {
+            mesh->drawIndirect(commandBuffer, indirectBuffer, i * sizeof(VkDrawIndexedIndirectCommand));
+        } else {
+            mesh->draw(commandBuffer);
+        }
     }
-}
\ No newline at end of file
+}
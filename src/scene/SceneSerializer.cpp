@@ -0,0 +1,478 @@
+﻿#include "../include/scene/SceneSerializer.h"
+#include "../VulkanRenderer.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <limits>
+#include <cstring>
+#include <iostream>
+
+static const char SCENE_MAGIC[4] = { 'M', 'I', 'S', 'C' };
+
+SceneSerializer::SceneSerializer(Scene* scene) : scene(scene) {
+}
+
+void SceneSerializer::capture(SceneDescription& description) {
+    EntityRegistry& registry = scene->registry;
+    ComponentPool<Transform>& transforms = registry.pool<Transform>();
+    ComponentPool<Renderable>& renderables = registry.pool<Renderable>();
+    ComponentPool<Parent>& parents = registry.pool<Parent>();
+    ComponentPool<Light>& lights = registry.pool<Light>();
+
+    description.assets = scene->meshAssets;
+    for (size_t i = 0; i < description.assets.size(); i++) {
+        if (description.assets[i].modelPath.empty()) {
+            std::cerr << "Mesh " << i << " was not loaded from a file, its instances are saved without geometry" << std::endl;
+        }
+    }
+
+    // Entities are written in Transform pool order; parents are remapped to that order
+    const auto& entities = transforms.entities();
+    std::unordered_map<uint32_t, uint32_t> fileIndices;
+    fileIndices.reserve(entities.size());
+    for (size_t i = 0; i < entities.size(); i++) {
+        fileIndices[entities[i]] = static_cast<uint32_t>(i);
+    }
+
+    description.entities.resize(entities.size());
+    for (size_t i = 0; i < entities.size(); i++) {
+        const Transform& transform = transforms.components()[i];
+        SceneFileEntity& record = description.entities[i];
+        for (int axis = 0; axis < 3; axis++) {
+            record.position[axis] = transform.position[axis];
+            record.rotation[axis] = transform.rotation[axis];
+            record.scale[axis] = transform.scale[axis];
+        }
+
+        record.meshIndex = NO_INDEX;
+        if (renderables.has(entities[i])) {
+            uint32_t meshIndex = renderables.get(entities[i]).meshIndex;
+            if (!description.assets[meshIndex].modelPath.empty()) {
+                record.meshIndex = meshIndex;
+            }
+        }
+
+        record.parent = NO_INDEX;
+        if (parents.has(entities[i])) {
+            Entity parent = parents.get(entities[i]).entity;
+            auto it = fileIndices.find(parent.index);
+            if (registry.isAlive(parent) && it != fileIndices.end()) {
+                record.parent = it->second;
+            }
+        }
+
+        record.flags = registry.has<Static>(entities[i]) ? ENTITY_STATIC : 0;
+    }
+
+    for (size_t i = 0; i < lights.size(); i++) {
+        auto it = fileIndices.find(lights.entities()[i]);
+        if (it == fileIndices.end()) {
+            continue;
+        }
+        const Light& light = lights.components()[i];
+        SceneFileLight record;
+        record.entity = it->second;
+        record.type = static_cast<uint32_t>(light.type);
+        for (int axis = 0; axis < 3; axis++) {
+            record.color[axis] = light.color[axis];
+            record.direction[axis] = light.direction[axis];
+        }
+        record.intensity = light.intensity;
+        record.range = light.range;
+        record.innerAngle = light.innerAngle;
+        record.outerAngle = light.outerAngle;
+        record.castShadows = light.castShadows ? 1 : 0;
+        description.lights.push_back(record);
+    }
+}
+
+bool SceneSerializer::resolveAssets(const std::vector<MeshAsset>& assets, std::vector<uint32_t>& meshIndices) {
+    meshIndices.assign(assets.size(), NO_INDEX);
+    bool resolved = true;
+
+    // Reuse meshes the scene already holds
+    std::unordered_map<std::string, uint32_t> loaded;
+    auto assetKey = [](const MeshAsset& asset) {
+        return asset.modelPath + '\n' + std::to_string(asset.subMesh) + '\n' + asset.texturePath;
+    };
+    for (size_t i = 0; i < scene->meshAssets.size(); i++) {
+        if (!scene->meshAssets[i].modelPath.empty()) {
+            loaded[assetKey(scene->meshAssets[i])] = static_cast<uint32_t>(i);
+        }
+    }
+
+    // Group the remaining assets by model so each file is parsed only once
+    std::unordered_map<std::string, std::vector<uint32_t>> byModel;
+    std::vector<std::string> modelOrder;
+    for (size_t i = 0; i < assets.size(); i++) {
+        if (assets[i].modelPath.empty()) {
+            continue;
+        }
+        auto it = loaded.find(assetKey(assets[i]));
+        if (it != loaded.end()) {
+            meshIndices[i] = it->second;
+            continue;
+        }
+        auto& group = byModel[assets[i].modelPath];
+        if (group.empty()) {
+            modelOrder.push_back(assets[i].modelPath);
+        }
+        group.push_back(static_cast<uint32_t>(i));
+    }
+
+    for (const auto& modelPath : modelOrder) {
+        if (!scene->modelLoader.LoadModel(modelPath)) {
+            std::cerr << "Failed to load model: " << modelPath << std::endl;
+            resolved = false;
+            continue;
+        }
+        const std::vector<MeshData>& meshDataList = scene->modelLoader.GetMeshData();
+
+        for (uint32_t assetIndex : byModel[modelPath]) {
+            const MeshAsset& asset = assets[assetIndex];
+            auto it = loaded.find(assetKey(asset));
+            if (it != loaded.end()) {
+                meshIndices[assetIndex] = it->second;
+                continue;
+            }
+            if (asset.subMesh >= meshDataList.size()) {
+                std::cerr << "Model " << modelPath << " has no sub-mesh " << asset.subMesh << std::endl;
+                resolved = false;
+                continue;
+            }
+
+            // Same path as a fresh load: atlas packing and content deduplication apply
+            std::shared_ptr<Mesh> mesh = scene->createMesh(meshDataList[asset.subMesh], asset.texturePath);
+
+            meshIndices[assetIndex] = scene->registerMesh(mesh, asset);
+            loaded[assetKey(asset)] = meshIndices[assetIndex];
+        }
+    }
+    return resolved;
+}
+
+bool SceneSerializer::apply(const SceneDescription& description) {
+    std::vector<uint32_t> meshIndices;
+    if (!resolveAssets(description.assets, meshIndices)) {
+        return false;
+    }
+
+    // Check every reference before the first entity is created
+    size_t count = description.entities.size();
+    for (size_t i = 0; i < count; i++) {
+        const SceneFileEntity& record = description.entities[i];
+        if (record.meshIndex != NO_INDEX &&
+            (record.meshIndex >= meshIndices.size() || meshIndices[record.meshIndex] == NO_INDEX)) {
+            std::cerr << "Scene entity " << i << " references a missing mesh " << record.meshIndex << std::endl;
+            return false;
+        }
+        if (record.parent != NO_INDEX && record.parent >= count) {
+            std::cerr << "Scene entity " << i << " has an invalid parent " << record.parent << std::endl;
+            return false;
+        }
+    }
+    for (const SceneFileLight& light : description.lights) {
+        if (light.entity >= count || light.type > static_cast<uint32_t>(LightType::Point)) {
+            std::cerr << "Scene light on entity " << light.entity << " is invalid" << std::endl;
+            return false;
+        }
+    }
+
+    EntityRegistry& registry = scene->registry;
+    ComponentPool<Transform>& transforms = registry.pool<Transform>();
+    ComponentPool<WorldMatrix>& worldMatrices = registry.pool<WorldMatrix>();
+    ComponentPool<Renderable>& renderables = registry.pool<Renderable>();
+    ComponentPool<WorldBounds>& worldBounds = registry.pool<WorldBounds>();
+    transforms.reserve(transforms.size() + count);
+    worldMatrices.reserve(worldMatrices.size() + count);
+    renderables.reserve(renderables.size() + count);
+    worldBounds.reserve(worldBounds.size() + count);
+
+    std::vector<Entity> entities(count);
+    for (size_t i = 0; i < count; i++) {
+        const SceneFileEntity& record = description.entities[i];
+        Entity entity = registry.create();
+        entities[i] = entity;
+
+        Transform transform;
+        transform.position = glm::vec3(record.position[0], record.position[1], record.position[2]);
+        transform.rotation = glm::vec3(record.rotation[0], record.rotation[1], record.rotation[2]);
+        transform.scale = glm::vec3(record.scale[0], record.scale[1], record.scale[2]);
+
+        WorldMatrix world;
+        world.matrix = transform.getModelMatrix();
+        transforms.add(entity.index, transform);
+        worldMatrices.add(entity.index, world);
+
+        if (record.meshIndex != NO_INDEX) {
+            uint32_t meshIndex = meshIndices[record.meshIndex];
+            Renderable renderable;
+            renderable.meshIndex = meshIndex;
+            renderable.mesh = scene->meshes[meshIndex].get();
+
+            WorldBounds bounds;
+            bounds.aabb = renderable.mesh->getBounds().transformed(world.matrix);
+            renderables.add(entity.index, renderable);
+            worldBounds.add(entity.index, bounds);
+        }
+
+        if (record.flags & ENTITY_STATIC) {
+            scene->setStatic(entity, true);
+        }
+    }
+
+    for (const SceneFileLight& record : description.lights) {
+        Light light;
+        light.type = static_cast<LightType>(record.type);
+        light.color = glm::vec3(record.color[0], record.color[1], record.color[2]);
+        light.intensity = record.intensity;
+        light.direction = glm::vec3(record.direction[0], record.direction[1], record.direction[2]);
+        light.range = record.range;
+        light.innerAngle = record.innerAngle;
+        light.outerAngle = record.outerAngle;
+        light.castShadows = record.castShadows != 0;
+        registry.add<Light>(entities[record.entity], light);
+    }
+
+    // Parents may come after their children in the file, link once all exist
+    for (size_t i = 0; i < count; i++) {
+        uint32_t parent = description.entities[i].parent;
+        if (parent != NO_INDEX) {
+            scene->setParent(entities[i], entities[parent]);
+        }
+    }
+    return true;
+}
+
+bool SceneSerializer::saveBinary(const std::string& filename) {
+    SceneDescription description;
+    capture(description);
+
+    std::string strings;
+    std::vector<SceneFileAsset> assets(description.assets.size());
+    for (size_t i = 0; i < description.assets.size(); i++) {
+        assets[i].modelPathOffset = static_cast<uint32_t>(strings.size());
+        strings.append(description.assets[i].modelPath).push_back('\0');
+        assets[i].texturePathOffset = static_cast<uint32_t>(strings.size());
+        strings.append(description.assets[i].texturePath).push_back('\0');
+        assets[i].subMesh = description.assets[i].subMesh;
+    }
+
+    SceneFileHeader header{};
+    std::memcpy(header.magic, SCENE_MAGIC, sizeof(SCENE_MAGIC));
+    header.version = FILE_VERSION;
+    header.assetCount = static_cast<uint32_t>(assets.size());
+    header.entityCount = static_cast<uint32_t>(description.entities.size());
+    header.lightCount = static_cast<uint32_t>(description.lights.size());
+    header.stringBytes = static_cast<uint32_t>(strings.size());
+
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open scene file for writing: " << filename << std::endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(assets.data()), assets.size() * sizeof(SceneFileAsset));
+    file.write(reinterpret_cast<const char*>(description.entities.data()),
+               description.entities.size() * sizeof(SceneFileEntity));
+    file.write(reinterpret_cast<const char*>(description.lights.data()),
+               description.lights.size() * sizeof(SceneFileLight));
+    file.write(strings.data(), strings.size());
+
+    if (!file) {
+        std::cerr << "Failed to write scene file: " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool SceneSerializer::loadBinary(const std::string& filename) {
+    std::ifstream file(filename, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open scene file: " << filename << std::endl;
+        return false;
+    }
+
+    // One read for the whole file, everything else is parsed from memory
+    size_t fileSize = static_cast<size_t>(file.tellg());
+    std::vector<char> buffer(fileSize);
+    file.seekg(0);
+    file.read(buffer.data(), fileSize);
+    if (!file || fileSize < sizeof(SceneFileHeader)) {
+        std::cerr << "Failed to read scene file: " << filename << std::endl;
+        return false;
+    }
+
+    SceneFileHeader header;
+    std::memcpy(&header, buffer.data(), sizeof(header));
+    if (std::memcmp(header.magic, SCENE_MAGIC, sizeof(SCENE_MAGIC)) != 0 || header.version != FILE_VERSION) {
+        std::cerr << "Not a supported scene file: " << filename << std::endl;
+        return false;
+    }
+
+    size_t assetsOffset = sizeof(SceneFileHeader);
+    size_t entitiesOffset = assetsOffset + size_t(header.assetCount) * sizeof(SceneFileAsset);
+    size_t lightsOffset = entitiesOffset + size_t(header.entityCount) * sizeof(SceneFileEntity);
+    size_t stringsOffset = lightsOffset + size_t(header.lightCount) * sizeof(SceneFileLight);
+    if (stringsOffset + header.stringBytes > fileSize) {
+        std::cerr << "Scene file is truncated: " << filename << std::endl;
+        return false;
+    }
+
+    const char* strings = buffer.data() + stringsOffset;
+    auto readString = [&](uint32_t offset, std::string& out) {
+        if (offset >= header.stringBytes) {
+            return false;
+        }
+        size_t length = strnlen(strings + offset, header.stringBytes - offset);
+        out.assign(strings + offset, length);
+        return true;
+    };
+
+    SceneDescription description;
+    description.assets.resize(header.assetCount);
+    for (uint32_t i = 0; i < header.assetCount; i++) {
+        SceneFileAsset asset;
+        std::memcpy(&asset, buffer.data() + assetsOffset + i * sizeof(SceneFileAsset), sizeof(asset));
+        if (!readString(asset.modelPathOffset, description.assets[i].modelPath) ||
+            !readString(asset.texturePathOffset, description.assets[i].texturePath)) {
+            std::cerr << "Scene file has a corrupt asset table: " << filename << std::endl;
+            return false;
+        }
+        description.assets[i].subMesh = asset.subMesh;
+    }
+
+    description.entities.resize(header.entityCount);
+    std::memcpy(description.entities.data(), buffer.data() + entitiesOffset,
+                size_t(header.entityCount) * sizeof(SceneFileEntity));
+    description.lights.resize(header.lightCount);
+    std::memcpy(description.lights.data(), buffer.data() + lightsOffset,
+                size_t(header.lightCount) * sizeof(SceneFileLight));
+
+    return apply(description);
+}
+
+bool SceneSerializer::saveText(const std::string& filename) {
+    SceneDescription description;
+    capture(description);
+
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open scene file for writing: " << filename << std::endl;
+        return false;
+    }
+
+    // Enough digits for floats to survive the round trip
+    file << std::setprecision(std::numeric_limits<float>::max_digits10);
+    file << "miscene " << FILE_VERSION << "\n";
+
+    for (const auto& asset : description.assets) {
+        file << "asset " << std::quoted(asset.modelPath) << " " << asset.subMesh << " "
+             << std::quoted(asset.texturePath) << "\n";
+    }
+
+    for (const auto& entity : description.entities) {
+        file << "entity "
+             << (entity.meshIndex == NO_INDEX ? -1 : int64_t(entity.meshIndex)) << " "
+             << (entity.parent == NO_INDEX ? -1 : int64_t(entity.parent));
+        for (float value : entity.position) file << " " << value;
+        for (float value : entity.rotation) file << " " << value;
+        for (float value : entity.scale) file << " " << value;
+        file << "\n";
+    }
+
+    for (size_t i = 0; i < description.entities.size(); i++) {
+        if (description.entities[i].flags & ENTITY_STATIC) {
+            file << "static " << i << "\n";
+        }
+    }
+
+    for (const auto& light : description.lights) {
+        file << "light " << light.entity << " " << light.type;
+        for (float value : light.color) file << " " << value;
+        file << " " << light.intensity;
+        for (float value : light.direction) file << " " << value;
+        file << " " << light.range << " " << light.innerAngle << " " << light.outerAngle
+             << " " << light.castShadows << "\n";
+    }
+
+    if (!file) {
+        std::cerr << "Failed to write scene file: " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool SceneSerializer::loadText(const std::string& filename) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open scene file: " << filename << std::endl;
+        return false;
+    }
+
+    SceneDescription description;
+    std::string line;
+    uint32_t lineNumber = 0;
+    bool headerRead = false;
+
+    while (std::getline(file, line)) {
+        lineNumber++;
+        std::istringstream stream(line);
+        std::string keyword;
+        if (!(stream >> keyword) || keyword[0] == '#') {
+            continue;
+        }
+
+        bool valid = false;
+        if (keyword == "miscene") {
+            uint32_t version = 0;
+            valid = (stream >> version) && version == FILE_VERSION;
+            headerRead = valid;
+        } else if (!headerRead) {
+            valid = false;
+        } else if (keyword == "asset") {
+            MeshAsset asset;
+            valid = static_cast<bool>(stream >> std::quoted(asset.modelPath) >> asset.subMesh
+                                             >> std::quoted(asset.texturePath));
+            description.assets.push_back(asset);
+        } else if (keyword == "entity") {
+            SceneFileEntity entity;
+            int64_t meshIndex = -1;
+            int64_t parent = -1;
+            valid = static_cast<bool>(stream >> meshIndex >> parent);
+            for (float& value : entity.position) valid = valid && (stream >> value);
+            for (float& value : entity.rotation) valid = valid && (stream >> value);
+            for (float& value : entity.scale) valid = valid && (stream >> value);
+            entity.meshIndex = meshIndex < 0 ? NO_INDEX : static_cast<uint32_t>(meshIndex);
+            entity.parent = parent < 0 ? NO_INDEX : static_cast<uint32_t>(parent);
+            entity.flags = 0;
+            description.entities.push_back(entity);
+        } else if (keyword == "static") {
+            // Refers back to an entity record above it
+            uint32_t index = 0;
+            valid = (stream >> index) && index < description.entities.size();
+            if (valid) {
+                description.entities[index].flags |= ENTITY_STATIC;
+            }
+        } else if (keyword == "light") {
+            SceneFileLight light;
+            valid = static_cast<bool>(stream >> light.entity >> light.type);
+            for (float& value : light.color) valid = valid && (stream >> value);
+            valid = valid && (stream >> light.intensity);
+            for (float& value : light.direction) valid = valid && (stream >> value);
+            valid = valid && (stream >> light.range >> light.innerAngle >> light.outerAngle >> light.castShadows);
+            description.lights.push_back(light);
+        }
+
+        if (!valid) {
+            std::cerr << filename << ":" << lineNumber << ": invalid scene record" << std::endl;
+            return false;
+        }
+    }
+
+    if (!headerRead) {
+        std::cerr << "Not a supported scene file: " << filename << std::endl;
+        return false;
+    }
+    return apply(description);
+}
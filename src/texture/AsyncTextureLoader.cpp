@@ -0,0 +1,295 @@
+﻿#include "../include/texture/AsyncTextureLoader.h"
+#include "../include/texture/TextureStreamer.h"
+#include "../include/Utils/ThreadPool.h"
+#include "../VulkanRenderer.h"
+#include <cstring>
+#include <iostream>
+
+AsyncTextureLoader::AsyncTextureLoader(VulkanRenderer* renderer, ThreadPool* threadPool,
+                                       StagingRing* stagingRing, TextureStreamer* streamer)
+    : renderer(renderer), threadPool(threadPool), stagingRing(stagingRing), streamer(streamer) {
+}
+
+AsyncTextureLoader::~AsyncTextureLoader() {
+    // Workers reference this object, let them finish before it goes away
+    waitForDecodes();
+    retireSubmissions(true);
+    for (DecodedTexture& decoded : decodedTextures) {
+        stagingRing->release(decoded.data.staging);
+    }
+    decodedTextures.clear();
+    pendingAliases.clear();
+    contentCache.clear();
+    textureCache.clear();
+}
+
+std::shared_ptr<Texture> AsyncTextureLoader::request(const std::string& filename) {
+    if (filename.empty()) {
+        return nullptr;
+    }
+
+    std::shared_ptr<Texture> texture;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // Check if texture is already loaded or being loaded
+        auto it = textureCache.find(filename);
+        if (it != textureCache.end()) {
+            return it->second;
+        }
+
+        texture = std::make_shared<Texture>(renderer->getDevice(), renderer->getPhysicalDevice(),
+                                            renderer->getSamplerCache(), renderer->getMipGenerator(),
+                                            renderer->getGpuTimeline());
+        textureCache[filename] = texture;
+        decodesInFlight++;
+    }
+
+    threadPool->enqueue([this, filename, texture]() {
+        DecodedTexture decoded;
+        decoded.texture = texture;
+        decoded.filename = filename;
+        // Streamed textures keep their pixels in system memory, the rest decode into the ring
+        bool success = Texture::decodeFile(filename, decoded.data, streamer ? nullptr : stagingRing);
+
+        if (success) {
+            decoded.contentHash = hashContent(decoded.data);
+            std::vector<ContentEntry> candidates;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto it = contentCache.find(decoded.contentHash);
+                if (it != contentCache.end()) {
+                    candidates = it->second;
+                }
+            }
+
+            // Same pixels under another path: share that texture's image. A hash
+            // match alone could be a collision between different assets
+            for (const ContentEntry& candidate : candidates) {
+                if (isSameContent(decoded.data, candidate.filename)) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    dedupStats.add(decoded.data.getSize());
+                    stagingRing->release(decoded.data.staging);
+                    pendingAliases.emplace_back(texture, candidate.texture);
+                    decodesInFlight--;
+                    decodeCondition.notify_all();
+                    return;
+                }
+            }
+        }
+
+        if (success && streamer) {
+            // Streamed levels are uploaded individually, so the chain is built here
+            Texture::buildMipChain(decoded.data);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (success) {
+            decodedTextures.push_back(std::move(decoded));
+        } else {
+            // The texture stays unready and keeps sampling the default texture
+            std::cerr << "Texture will use the default texture: " << filename << std::endl;
+        }
+        decodesInFlight--;
+        decodeCondition.notify_all();
+    });
+
+    return texture;
+}
+
+uint32_t AsyncTextureLoader::processUploads(VkDeviceSize maxBatchBytes) {
+    // Staging space and command buffers of finished uploads can be reused
+    retireSubmissions(false);
+
+    std::vector<DecodedTexture> batch;
+    std::vector<StagingRing::Allocation> allocations;
+    DecodedTexture oversized;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // Aliases are resolved here so the draw code never sees one change mid-frame
+        for (auto& alias : pendingAliases) {
+            alias.first->setSource(alias.second);
+        }
+        pendingAliases.clear();
+
+        if (decodedTextures.empty()) {
+            return 0;
+        }
+
+        // Textures decoded into the ring are already staged; the others are
+        // copied in while there is room. Ones that don't fit wait, without
+        // holding back the staged textures behind them.
+        VkDeviceSize batchBytes = 0;
+        std::vector<DecodedTexture> waiting;
+        for (DecodedTexture& decoded : decodedTextures) {
+            VkDeviceSize size = getUploadSize(decoded.data);
+            bool fits = batch.empty() || batchBytes + size <= maxBatchBytes;
+
+            StagingRing::Allocation allocation = decoded.data.staging;
+            if (fits && !allocation.isValid()) {
+                allocation = stagingRing->tryAllocate(size);
+            }
+            if (!fits || !allocation.isValid()) {
+                waiting.push_back(std::move(decoded));
+                continue;
+            }
+
+            allocations.push_back(allocation);
+            batch.push_back(std::move(decoded));
+            batchBytes += size;
+        }
+        decodedTextures = std::move(waiting);
+
+        if (batch.empty()) {
+            // Uploads in flight free ring space, so only images larger than the
+            // whole ring need their own staging buffer
+            if (getUploadSize(decodedTextures.front().data) <= stagingRing->getCapacity()) {
+                return 0;
+            }
+            oversized = std::move(decodedTextures.front());
+            decodedTextures.erase(decodedTextures.begin());
+        }
+    }
+
+    if (oversized.texture) {
+        if (!oversized.texture->isFormatSupported(oversized.data.format)) {
+            std::cerr << "Texture format " << oversized.data.format << " not supported by this device" << std::endl;
+            return 0;
+        }
+        uint32_t firstMip = streamer ? TextureStreamer::getInitialMip(oversized.data) : 0;
+        oversized.texture->uploadMipRange(oversized.data, firstMip,
+                                          renderer->getCommandPool(), renderer->getGraphicsQueue());
+        registerContent(oversized);
+        if (streamer) {
+            streamer->registerTexture(oversized.texture, std::move(oversized.data));
+        }
+        return 1;
+    }
+
+    // Copy pixels decoded into system memory; only the levels being uploaded,
+    // which are at the end of the pixel data
+    for (size_t i = 0; i < batch.size(); i++) {
+        const TextureData& data = batch[i].data;
+        if (!data.staging.isValid()) {
+            VkDeviceSize size = allocations[i].size;
+            std::memcpy(allocations[i].data, data.getPixels() + (data.getSize() - size), size);
+        }
+    }
+
+    VkDevice device = renderer->getDevice();
+
+    // One command buffer and one submission for every copy and mip chain
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = renderer->getCommandPool();
+    allocInfo.commandBufferCount = 1;
+
+    PendingSubmission submission;
+    if (vkAllocateCommandBuffers(device, &allocInfo, &submission.commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate texture upload command buffer!");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(submission.commandBuffer, &beginInfo);
+
+    std::vector<bool> uploaded(batch.size(), false);
+    for (size_t i = 0; i < batch.size(); i++) {
+        // Block-compressed textures need textureCompressionBC; without it they stay on the default
+        if (!batch[i].texture->isFormatSupported(batch[i].data.format)) {
+            std::cerr << "Texture format " << batch[i].data.format << " not supported by this device" << std::endl;
+            continue;
+        }
+        uint32_t firstMip = streamer ? TextureStreamer::getInitialMip(batch[i].data) : 0;
+        batch[i].texture->recordUpload(submission.commandBuffer, batch[i].data, stagingRing->getBuffer(),
+                                       allocations[i].offset, firstMip);
+        uploaded[i] = true;
+    }
+
+    vkEndCommandBuffer(submission.commandBuffer);
+
+    // No wait: the upload's barriers order it before frames submitted after it,
+    // and its timeline value tells when the ring space can be reused
+    submission.timelineValue = renderer->getGpuTimeline()->submit(submission.commandBuffer);
+    submission.allocations = std::move(allocations);
+    pendingSubmissions.push_back(std::move(submission));
+
+    uint32_t readyCount = 0;
+    for (size_t i = 0; i < batch.size(); i++) {
+        if (uploaded[i]) {
+            batch[i].texture->finishUpload();
+            registerContent(batch[i]);
+            if (streamer) {
+                streamer->registerTexture(batch[i].texture, std::move(batch[i].data));
+            }
+            readyCount++;
+        }
+    }
+    return readyCount;
+}
+
+void AsyncTextureLoader::retireSubmissions(bool wait) {
+    VkDevice device = renderer->getDevice();
+    GpuTimeline* timeline = renderer->getGpuTimeline();
+    for (auto it = pendingSubmissions.begin(); it != pendingSubmissions.end();) {
+        if (wait) {
+            timeline->wait(it->timelineValue);
+        } else if (!timeline->isComplete(it->timelineValue)) {
+            ++it;
+            continue;
+        }
+
+        for (const StagingRing::Allocation& allocation : it->allocations) {
+            stagingRing->release(allocation);
+        }
+        vkFreeCommandBuffers(device, renderer->getCommandPool(), 1, &it->commandBuffer);
+        it = pendingSubmissions.erase(it);
+    }
+}
+
+VkDeviceSize AsyncTextureLoader::getUploadSize(const TextureData& data) const {
+    return streamer ? Texture::getMipRangeSize(data, TextureStreamer::getInitialMip(data)) : data.getSize();
+}
+
+void AsyncTextureLoader::waitForDecodes() {
+    std::unique_lock<std::mutex> lock(mutex);
+    decodeCondition.wait(lock, [this]() { return decodesInFlight == 0; });
+}
+
+bool AsyncTextureLoader::hasPendingWork() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return decodesInFlight > 0 || !decodedTextures.empty() || !pendingAliases.empty() ||
+           !pendingSubmissions.empty();
+}
+
+DedupStats AsyncTextureLoader::getDedupStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return dedupStats;
+}
+
+void AsyncTextureLoader::registerContent(const DecodedTexture& decoded) {
+    std::lock_guard<std::mutex> lock(mutex);
+    contentCache[decoded.contentHash].push_back({ decoded.texture, decoded.filename });
+}
+
+bool AsyncTextureLoader::isSameContent(const TextureData& data, const std::string& filename) {
+    TextureData other;
+    if (!Texture::decodeFile(filename, other)) {
+        return false;
+    }
+    return data.width == other.width && data.height == other.height && data.format == other.format &&
+           data.mipOffsets == other.mipOffsets && data.getSize() == other.getSize() &&
+           std::memcmp(data.getPixels(), other.getPixels(), static_cast<size_t>(data.getSize())) == 0;
+}
+
+uint64_t AsyncTextureLoader::hashContent(const TextureData& data) {
+    // Dimensions and format are part of the content; the same bytes laid out
+    // differently are a different texture
+    uint64_t hash = Hash::bytes(data.getPixels(), static_cast<size_t>(data.getSize()));
+    hash = Hash::combine(hash, (static_cast<uint64_t>(data.width) << 32) | data.height);
+    hash = Hash::combine(hash, static_cast<uint64_t>(data.format));
+    return Hash::combine(hash, data.mipOffsets.size());
+}
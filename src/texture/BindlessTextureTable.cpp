@@ -0,0 +1,202 @@
+﻿#include "../include/texture/BindlessTextureTable.h"
+#include "../VulkanRenderer.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+BindlessTextureTable::BindlessTextureTable(VulkanRenderer* renderer)
+    : renderer(renderer), device(renderer->getDevice()) {
+    // Stay within what the device allows for update-after-bind samplers
+    VkPhysicalDeviceVulkan12Properties properties12{};
+    properties12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &properties12;
+    vkGetPhysicalDeviceProperties2(renderer->getPhysicalDevice(), &properties);
+
+    capacity = std::min({ MAX_TEXTURES,
+                          properties12.maxPerStageDescriptorUpdateAfterBindSamplers,
+                          properties12.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                          properties12.maxDescriptorSetUpdateAfterBindSamplers,
+                          properties12.maxDescriptorSetUpdateAfterBindSampledImages });
+
+    // Scene textures all use the default cached sampler, so it is immutable in the layout
+    std::vector<VkSampler> immutableSamplers(capacity, renderer->getSamplerCache()->get());
+
+    VkDescriptorSetLayoutBinding binding{};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = capacity;
+    binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    binding.pImmutableSamplers = immutableSamplers.data();
+
+    // Unused slots may be empty, and slots may be written while the set is bound
+    VkDescriptorBindingFlags bindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+                                            VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                                            VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+    bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    bindingFlagsInfo.bindingCount = 1;
+    bindingFlagsInfo.pBindingFlags = &bindingFlags;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = &bindingFlagsInfo;
+    layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &binding;
+
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &setLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create bindless texture set layout!");
+    }
+
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSize.descriptorCount = capacity;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = 1;
+
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create bindless texture descriptor pool!");
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &setLayout;
+
+    if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate bindless texture descriptor set!");
+    }
+}
+
+BindlessTextureTable::~BindlessTextureTable() {
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+}
+
+bool BindlessTextureTable::isSupported(const VkPhysicalDeviceVulkan12Features& features) {
+    return features.runtimeDescriptorArray &&
+           features.descriptorBindingPartiallyBound &&
+           features.descriptorBindingSampledImageUpdateAfterBind &&
+           features.descriptorBindingUpdateUnusedWhilePending;
+}
+
+void BindlessTextureTable::setDefaultTexture(const VkDescriptorImageInfo& imageInfo) {
+    writeDescriptor(DEFAULT_TEXTURE_INDEX, imageInfo);
+}
+
+uint32_t BindlessTextureTable::getIndex(const std::shared_ptr<Texture>& texture) {
+    if (!texture || !texture->isReady()) {
+        return DEFAULT_TEXTURE_INDEX;
+    }
+    // Aliases of identical content share their source's slot
+    if (texture->getSource()) {
+        return getIndex(texture->getSource());
+    }
+
+    auto it = slots.find(texture.get());
+    if (it != slots.end() && it->second.texture.lock() != texture) {
+        // A destroyed texture's address was reused; its slot is retired normally
+        releaseSlot(it->second.index);
+        slots.erase(it);
+        it = slots.end();
+    }
+
+    // Streaming replaces the image view when mips change. Frames in flight may still
+    // use the old slot, so the new view gets a fresh one and the old slot is retired
+    if (it != slots.end() && it->second.imageView != texture->getImageView()) {
+        releaseSlot(it->second.index);
+        slots.erase(it);
+        it = slots.end();
+    }
+
+    if (it == slots.end()) {
+        uint32_t index;
+        if (!allocateIndex(index)) {
+            return DEFAULT_TEXTURE_INDEX;
+        }
+
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfo.imageView = texture->getImageView();
+        imageInfo.sampler = texture->getSampler();
+        writeDescriptor(index, imageInfo);
+
+        Slot slot;
+        slot.texture = texture;
+        slot.index = index;
+        slot.imageView = imageInfo.imageView;
+        it = slots.emplace(texture.get(), slot).first;
+    }
+    return it->second.index;
+}
+
+bool BindlessTextureTable::allocateIndex(uint32_t& index) {
+    if (!freeIndices.empty()) {
+        index = freeIndices.back();
+        freeIndices.pop_back();
+        return true;
+    }
+    if (nextIndex < capacity) {
+        index = nextIndex++;
+        return true;
+    }
+    if (!reportedFull) {
+        std::cerr << "Bindless texture table is full (" << capacity << " textures)" << std::endl;
+        reportedFull = true;
+    }
+    return false;
+}
+
+void BindlessTextureTable::update() {
+    for (auto it = slots.begin(); it != slots.end();) {
+        if (it->second.texture.expired()) {
+            releaseSlot(it->second.index);
+            it = slots.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    GpuTimeline* timeline = renderer->getGpuTimeline();
+    auto released = std::remove_if(pendingReleases.begin(), pendingReleases.end(),
+        [this, timeline](const PendingRelease& release) {
+            if (!timeline->isComplete(release.timelineValue)) {
+                return false;
+            }
+            freeIndices.push_back(release.index);
+            return true;
+        });
+    pendingReleases.erase(released, pendingReleases.end());
+}
+
+void BindlessTextureTable::bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) const {
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+        pipelineLayout, SET, 1, &descriptorSet, 0, nullptr);
+}
+
+void BindlessTextureTable::writeDescriptor(uint32_t index, const VkDescriptorImageInfo& imageInfo) {
+    VkWriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = descriptorSet;
+    descriptorWrite.dstBinding = 0;
+    descriptorWrite.dstArrayElement = index;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pImageInfo = &imageInfo;
+
+    vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+}
+
+void BindlessTextureTable::releaseSlot(uint32_t index) {
+    // Work already submitted may still index this slot
+    pendingReleases.push_back({ index, renderer->getGpuTimeline()->getSubmittedValue() });
+}
@@ -0,0 +1,148 @@
+﻿#include "../include/texture/KTX2.h"
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+const uint8_t KTX2::IDENTIFIER[12] = {
+    0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+};
+
+// Copy offsets must be a multiple of the block size; 16 covers every supported format
+static const VkDeviceSize LEVEL_ALIGNMENT = 16;
+
+bool KTX2::isKTX2File(const std::string& filename) {
+    if (filename.size() < 5) {
+        return false;
+    }
+    std::string extension = filename.substr(filename.size() - 5);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension == ".ktx2";
+}
+
+uint32_t KTX2::getBlockBytes(VkFormat format) {
+    switch (format) {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+        return 4;
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+    case VK_FORMAT_BC4_SNORM_BLOCK:
+        return 8;
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+    case VK_FORMAT_BC5_SNORM_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+bool KTX2::isBlockCompressed(VkFormat format) {
+    return getBlockBytes(format) != 0 && format != VK_FORMAT_R8G8B8A8_UNORM && format != VK_FORMAT_R8G8B8A8_SRGB;
+}
+
+VkDeviceSize KTX2::getLevelSize(VkFormat format, uint32_t width, uint32_t height) {
+    VkDeviceSize blockBytes = getBlockBytes(format);
+    if (isBlockCompressed(format)) {
+        return VkDeviceSize((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+    }
+    return VkDeviceSize(width) * height * blockBytes;
+}
+
+bool KTX2::load(const std::string& filename, TextureData& data) {
+    std::ifstream file(filename, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open KTX2 file: " << filename << std::endl;
+        return false;
+    }
+
+    size_t fileSize = static_cast<size_t>(file.tellg());
+    std::vector<char> fileData(fileSize);
+    file.seekg(0);
+    file.read(fileData.data(), fileSize);
+    if (!file) {
+        std::cerr << "Failed to read KTX2 file: " << filename << std::endl;
+        return false;
+    }
+
+    return parse(fileData, data, filename);
+}
+
+bool KTX2::parse(const std::vector<char>& fileData, TextureData& data, const std::string& filename) {
+    Header header;
+    if (fileData.size() < sizeof(Header)) {
+        std::cerr << "KTX2 file is truncated: " << filename << std::endl;
+        return false;
+    }
+    std::memcpy(&header, fileData.data(), sizeof(Header));
+
+    if (std::memcmp(header.identifier, IDENTIFIER, sizeof(IDENTIFIER)) != 0) {
+        std::cerr << "Not a KTX2 file: " << filename << std::endl;
+        return false;
+    }
+    if (header.supercompressionScheme != SUPERCOMPRESSION_NONE) {
+        std::cerr << "Supercompressed KTX2 files are not supported: " << filename << std::endl;
+        return false;
+    }
+
+    VkFormat format = static_cast<VkFormat>(header.vkFormat);
+    if (getBlockBytes(format) == 0) {
+        std::cerr << "Unsupported KTX2 format " << header.vkFormat << ": " << filename << std::endl;
+        return false;
+    }
+    if (header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelDepth > 1 ||
+        header.layerCount > 1 || header.faceCount != 1) {
+        std::cerr << "Only 2D KTX2 textures are supported: " << filename << std::endl;
+        return false;
+    }
+
+    // levelCount 0 asks the loader to generate mips; we only upload what's stored
+    uint32_t levelCount = std::max(header.levelCount, 1u);
+    uint32_t maxLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(header.pixelWidth, header.pixelHeight)))) + 1;
+    if (levelCount > maxLevels) {
+        std::cerr << "KTX2 has more levels than its size allows: " << filename << std::endl;
+        return false;
+    }
+    size_t levelIndexOffset = sizeof(Header);
+    if (fileData.size() < levelIndexOffset + levelCount * sizeof(LevelIndex)) {
+        std::cerr << "KTX2 level index is truncated: " << filename << std::endl;
+        return false;
+    }
+
+    data.width = header.pixelWidth;
+    data.height = header.pixelHeight;
+    data.format = format;
+    data.mipOffsets.clear();
+    data.pixels.clear();
+
+    // Level 0 first, each level padded to the copy alignment
+    for (uint32_t level = 0; level < levelCount; level++) {
+        LevelIndex index;
+        std::memcpy(&index, fileData.data() + levelIndexOffset + level * sizeof(LevelIndex), sizeof(LevelIndex));
+
+        uint32_t levelWidth = std::max(header.pixelWidth >> level, 1u);
+        uint32_t levelHeight = std::max(header.pixelHeight >> level, 1u);
+        VkDeviceSize expectedSize = getLevelSize(format, levelWidth, levelHeight);
+        // Compared without adding to byteOffset, which comes from the file and may overflow
+        if (index.byteLength < expectedSize || index.byteOffset > fileData.size() ||
+            expectedSize > fileData.size() - index.byteOffset) {
+            std::cerr << "KTX2 level " << level << " is truncated: " << filename << std::endl;
+            return false;
+        }
+
+        VkDeviceSize offset = (data.pixels.size() + LEVEL_ALIGNMENT - 1) & ~(LEVEL_ALIGNMENT - 1);
+        data.mipOffsets.push_back(offset);
+        data.pixels.resize(static_cast<size_t>(offset + expectedSize));
+        std::memcpy(data.pixels.data() + offset, fileData.data() + index.byteOffset, static_cast<size_t>(expectedSize));
+    }
+
+    return true;
+}
@@ -0,0 +1,369 @@
+﻿#include "../include/texture/MipGenerator.h"
+#include "../VulkanRenderer.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+    struct PushConstants {
+        int32_t sourceSize[2];
+        uint32_t levelCount;
+        uint32_t groupCount;
+    };
+
+    // finishedGroups + padding, then one vec4 per tile
+    const VkDeviceSize GLOBAL_BUFFER_SIZE = 16 + MipGenerator::MAX_TILE_GRID * MipGenerator::MAX_TILE_GRID * 16;
+    // Each workgroup covers 32x32 texels of the first level it writes
+    const uint32_t GROUP_LEVEL1_SIZE = MipGenerator::TILE_SIZE / 2;
+}
+
+MipGenerator::MipGenerator(VulkanRenderer* renderer)
+    : renderer(renderer), device(renderer->getDevice()) {
+    // Nearest sampling, the shader only uses texelFetch
+    sampler = renderer->getSamplerCache()->get(SamplerDesc::nearestClamp());
+
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[0].pImmutableSamplers = &sampler;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[1].descriptorCount = LEVELS_PER_DISPATCH;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[2].binding = 2;
+    bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[2].descriptorCount = 1;
+    bindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create mip generator descriptor set layout!");
+    }
+
+    VkPushConstantRange pushRange{};
+    pushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushRange.offset = 0;
+    pushRange.size = sizeof(PushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushRange;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create mip generator pipeline layout!");
+    }
+
+    renderer->createBuffer(GLOBAL_BUFFER_SIZE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, globalBuffer, globalBufferMemory);
+
+    // The finished-workgroup counter starts at zero; the last workgroup of every
+    // dispatch resets it
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    renderer->createBuffer(GLOBAL_BUFFER_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        stagingBuffer, stagingBufferMemory);
+    void* data;
+    vkMapMemory(device, stagingBufferMemory, 0, GLOBAL_BUFFER_SIZE, 0, &data);
+    memset(data, 0, static_cast<size_t>(GLOBAL_BUFFER_SIZE));
+    vkUnmapMemory(device, stagingBufferMemory);
+    renderer->copyBuffer(stagingBuffer, globalBuffer, GLOBAL_BUFFER_SIZE);
+    vkDestroyBuffer(device, stagingBuffer, nullptr);
+    vkFreeMemory(device, stagingBufferMemory, nullptr);
+}
+
+MipGenerator::~MipGenerator() {
+    for (auto& pair : pipelines) {
+        vkDestroyPipeline(device, pair.second, nullptr);
+    }
+    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+    vkDestroyBuffer(device, globalBuffer, nullptr);
+    vkFreeMemory(device, globalBufferMemory, nullptr);
+}
+
+bool MipGenerator::isFormatSupported(VkFormat format) const {
+    VkFormat storageFormat = getStorageFormat(format);
+    if (storageFormat != VK_FORMAT_R8G8B8A8_UNORM && storageFormat != VK_FORMAT_R16G16B16A16_SFLOAT &&
+        storageFormat != VK_FORMAT_R32_SFLOAT) {
+        return false;
+    }
+
+    VkFormatProperties storageProperties;
+    vkGetPhysicalDeviceFormatProperties(renderer->getPhysicalDevice(), storageFormat, &storageProperties);
+    VkFormatProperties sampledProperties;
+    vkGetPhysicalDeviceFormatProperties(renderer->getPhysicalDevice(), format, &sampledProperties);
+    return (storageProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) != 0 &&
+           (sampledProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+}
+
+MipGenerator::Chain MipGenerator::createChain(VkImage image, VkFormat format, VkExtent2D extent,
+                                              uint32_t mipLevels) {
+    VkImageView sourceView = createLevelView(image, format, 0, VK_IMAGE_USAGE_SAMPLED_BIT);
+    Chain chain = buildChain(sourceView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, extent, image, format,
+                             1, mipLevels - 1, isSRGB(format) ? Reduction::AverageSRGB : Reduction::Average);
+    chain.views.push_back(sourceView);
+    return chain;
+}
+
+MipGenerator::Chain MipGenerator::createChain(VkImageView sourceView, VkImageLayout sourceLayout,
+                                              VkExtent2D sourceExtent, VkImage image, VkFormat format,
+                                              uint32_t levelCount, Reduction reduction) {
+    return buildChain(sourceView, sourceLayout, sourceExtent, image, format, 0, levelCount, reduction);
+}
+
+MipGenerator::Chain MipGenerator::buildChain(VkImageView sourceView, VkImageLayout sourceLayout,
+                                             VkExtent2D sourceExtent, VkImage image, VkFormat format,
+                                             uint32_t firstLevel, uint32_t levelCount, Reduction reduction) {
+    Chain chain;
+    chain.image = image;
+    if (levelCount == 0) {
+        return chain;
+    }
+    chain.pipeline = getPipeline(getStorageFormat(format), reduction);
+
+    // Split into dispatches of up to 12 levels; each continues from the last level of the previous
+    VkExtent2D extent = sourceExtent;
+    uint32_t level = firstLevel;
+    uint32_t remaining = levelCount;
+    while (remaining > 0) {
+        Dispatch dispatch;
+        dispatch.sourceExtent = extent;
+        dispatch.firstLevel = level;
+        dispatch.levelCount = std::min(remaining, LEVELS_PER_DISPATCH);
+        if (!fitsTileGrid(extent)) {
+            dispatch.levelCount = std::min(dispatch.levelCount, 6u);
+        }
+        chain.dispatches.push_back(dispatch);
+
+        level += dispatch.levelCount;
+        remaining -= dispatch.levelCount;
+        extent = { std::max(extent.width >> dispatch.levelCount, 1u),
+                   std::max(extent.height >> dispatch.levelCount, 1u) };
+    }
+
+    uint32_t dispatchCount = static_cast<uint32_t>(chain.dispatches.size());
+    std::array<VkDescriptorPoolSize, 3> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[0].descriptorCount = dispatchCount;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[1].descriptorCount = dispatchCount * LEVELS_PER_DISPATCH;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[2].descriptorCount = dispatchCount;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = dispatchCount;
+
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &chain.descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create mip generator descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(dispatchCount, descriptorSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = chain.descriptorPool;
+    allocInfo.descriptorSetCount = dispatchCount;
+    allocInfo.pSetLayouts = layouts.data();
+
+    std::vector<VkDescriptorSet> sets(dispatchCount);
+    if (vkAllocateDescriptorSets(device, &allocInfo, sets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate mip generator descriptor sets!");
+    }
+
+    VkFormat storageFormat = getStorageFormat(format);
+    for (uint32_t i = 0; i < dispatchCount; i++) {
+        Dispatch& dispatch = chain.dispatches[i];
+        dispatch.descriptorSet = sets[i];
+
+        VkDescriptorImageInfo sourceInfo{};
+        sourceInfo.sampler = sampler;
+        if (i == 0) {
+            sourceInfo.imageView = sourceView;
+            sourceInfo.imageLayout = sourceLayout;
+        } else {
+            // Read through the image's own format, so sRGB levels decode to linear
+            sourceInfo.imageView = createLevelView(image, format, dispatch.firstLevel - 1,
+                                                    VK_IMAGE_USAGE_SAMPLED_BIT);
+            sourceInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+            chain.views.push_back(sourceInfo.imageView);
+        }
+
+        // Slots past the last level are never written, but every slot needs a valid view
+        std::array<VkDescriptorImageInfo, LEVELS_PER_DISPATCH> levelInfos{};
+        for (uint32_t slot = 0; slot < LEVELS_PER_DISPATCH; slot++) {
+            if (slot < dispatch.levelCount) {
+                levelInfos[slot].imageView = createLevelView(image, storageFormat, dispatch.firstLevel + slot,
+                                                              VK_IMAGE_USAGE_STORAGE_BIT);
+                chain.views.push_back(levelInfos[slot].imageView);
+            } else {
+                levelInfos[slot].imageView = levelInfos[dispatch.levelCount - 1].imageView;
+            }
+            levelInfos[slot].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        }
+
+        VkDescriptorBufferInfo bufferInfo{ globalBuffer, 0, VK_WHOLE_SIZE };
+
+        std::array<VkWriteDescriptorSet, 3> writes{};
+        writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[0].dstSet = dispatch.descriptorSet;
+        writes[0].dstBinding = 0;
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[0].descriptorCount = 1;
+        writes[0].pImageInfo = &sourceInfo;
+
+        writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[1].dstSet = dispatch.descriptorSet;
+        writes[1].dstBinding = 1;
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writes[1].descriptorCount = LEVELS_PER_DISPATCH;
+        writes[1].pImageInfo = levelInfos.data();
+
+        writes[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[2].dstSet = dispatch.descriptorSet;
+        writes[2].dstBinding = 2;
+        writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[2].descriptorCount = 1;
+        writes[2].pBufferInfo = &bufferInfo;
+
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+
+    return chain;
+}
+
+void MipGenerator::destroyChain(Chain& chain) {
+    for (VkImageView view : chain.views) {
+        vkDestroyImageView(device, view, nullptr);
+    }
+    if (chain.descriptorPool != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(device, chain.descriptorPool, nullptr);
+    }
+    chain = Chain();
+}
+
+void MipGenerator::record(VkCommandBuffer commandBuffer, const Chain& chain) {
+    if (!chain.isValid()) {
+        return;
+    }
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, chain.pipeline);
+
+    for (const Dispatch& dispatch : chain.dispatches) {
+        // Dispatches share the tile buffer, and a dispatch reads the level the one
+        // before it wrote last
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            1, &barrier,
+            0, nullptr,
+            0, nullptr);
+
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout,
+            0, 1, &dispatch.descriptorSet, 0, nullptr);
+
+        uint32_t groupsX = (std::max(dispatch.sourceExtent.width / 2, 1u) + GROUP_LEVEL1_SIZE - 1) / GROUP_LEVEL1_SIZE;
+        uint32_t groupsY = (std::max(dispatch.sourceExtent.height / 2, 1u) + GROUP_LEVEL1_SIZE - 1) / GROUP_LEVEL1_SIZE;
+
+        PushConstants push{};
+        push.sourceSize[0] = static_cast<int32_t>(dispatch.sourceExtent.width);
+        push.sourceSize[1] = static_cast<int32_t>(dispatch.sourceExtent.height);
+        push.levelCount = dispatch.levelCount;
+        push.groupCount = groupsX * groupsY;
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+
+        vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+    }
+}
+
+VkPipeline MipGenerator::getPipeline(VkFormat storageFormat, Reduction reduction) {
+    uint64_t key = (static_cast<uint64_t>(storageFormat) << 8) | static_cast<uint64_t>(reduction);
+    auto it = pipelines.find(key);
+    if (it != pipelines.end()) {
+        return it->second;
+    }
+
+    std::string shaderFile;
+    switch (storageFormat) {
+        case VK_FORMAT_R8G8B8A8_UNORM: shaderFile = "shaders/spd_rgba8_comp.spv"; break;
+        case VK_FORMAT_R16G16B16A16_SFLOAT: shaderFile = "shaders/spd_rgba16f_comp.spv"; break;
+        case VK_FORMAT_R32_SFLOAT: shaderFile = "shaders/spd_r32f_comp.spv"; break;
+        default: throw std::runtime_error("mip generator has no shader for this format!");
+    }
+
+    auto code = renderer->readFile(shaderFile);
+    VkShaderModule module = renderer->createShaderModule(code);
+
+    // The reduction is a specialization constant, so unused modes compile away
+    uint32_t reductionValue = static_cast<uint32_t>(reduction);
+    VkSpecializationMapEntry mapEntry{ 0, 0, sizeof(uint32_t) };
+    VkSpecializationInfo specialization{};
+    specialization.mapEntryCount = 1;
+    specialization.pMapEntries = &mapEntry;
+    specialization.dataSize = sizeof(uint32_t);
+    specialization.pData = &reductionValue;
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = module;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.stage.pSpecializationInfo = &specialization;
+    pipelineInfo.layout = pipelineLayout;
+
+    VkPipeline pipeline;
+    if (vkCreateComputePipelines(device, renderer->getPipelineCache(), 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create compute pipeline: " + shaderFile);
+    }
+
+    vkDestroyShaderModule(device, module, nullptr);
+    pipelines[key] = pipeline;
+    return pipeline;
+}
+
+VkImageView MipGenerator::createLevelView(VkImage image, VkFormat format, uint32_t level,
+                                          VkImageUsageFlags usage) {
+    VkImageViewUsageCreateInfo usageInfo{};
+    usageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO;
+    usageInfo.usage = usage;
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.pNext = &usageInfo;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = format;
+    viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+
+    VkImageView view;
+    if (vkCreateImageView(device, &viewInfo, nullptr, &view) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create mip level view!");
+    }
+    return view;
+}
+
+VkFormat MipGenerator::getStorageFormat(VkFormat format) {
+    return format == VK_FORMAT_R8G8B8A8_SRGB ? VK_FORMAT_R8G8B8A8_UNORM : format;
+}
+
+bool MipGenerator::isSRGB(VkFormat format) {
+    return format == VK_FORMAT_R8G8B8A8_SRGB;
+}
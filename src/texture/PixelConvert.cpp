@@ -0,0 +1,142 @@
+﻿#include "../include/texture/PixelConvert.h"
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#define MI_PIXEL_SSE 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define MI_TARGET_SSSE3
+#else
+#include <cpuid.h>
+#define MI_TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+#endif
+
+namespace {
+#ifdef MI_PIXEL_SSE
+    // SSSE3 isn't part of the x86-64 baseline, so it is checked once at runtime
+    bool detectSSSE3() {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 9)) != 0;
+#else
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+            return false;
+        }
+        return (ecx & bit_SSSE3) != 0;
+#endif
+    }
+
+    const bool hasSSSE3 = detectSSSE3();
+
+    // 16 gray pixels -> 64 bytes
+    size_t expandGraySSE2(const unsigned char* src, unsigned char* dst, size_t pixelCount) {
+        const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+        size_t i = 0;
+        for (; i + 16 <= pixelCount; i += 16) {
+            __m128i gray = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            __m128i lo = _mm_unpacklo_epi8(gray, gray);
+            __m128i hi = _mm_unpackhi_epi8(gray, gray);
+            __m128i* out = reinterpret_cast<__m128i*>(dst + i * 4);
+            _mm_storeu_si128(out + 0, _mm_or_si128(_mm_unpacklo_epi16(lo, lo), alpha));
+            _mm_storeu_si128(out + 1, _mm_or_si128(_mm_unpackhi_epi16(lo, lo), alpha));
+            _mm_storeu_si128(out + 2, _mm_or_si128(_mm_unpacklo_epi16(hi, hi), alpha));
+            _mm_storeu_si128(out + 3, _mm_or_si128(_mm_unpackhi_epi16(hi, hi), alpha));
+        }
+        return i;
+    }
+
+    // 8 gray+alpha pixels -> 32 bytes
+    MI_TARGET_SSSE3 size_t expandGrayAlphaSSSE3(const unsigned char* src, unsigned char* dst, size_t pixelCount) {
+        const __m128i lowMask = _mm_setr_epi8(0, 0, 0, 1, 2, 2, 2, 3, 4, 4, 4, 5, 6, 6, 6, 7);
+        const __m128i highMask = _mm_setr_epi8(8, 8, 8, 9, 10, 10, 10, 11, 12, 12, 12, 13, 14, 14, 14, 15);
+        size_t i = 0;
+        for (; i + 8 <= pixelCount; i += 8) {
+            __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+            __m128i* out = reinterpret_cast<__m128i*>(dst + i * 4);
+            _mm_storeu_si128(out + 0, _mm_shuffle_epi8(pixels, lowMask));
+            _mm_storeu_si128(out + 1, _mm_shuffle_epi8(pixels, highMask));
+        }
+        return i;
+    }
+
+    // 16 RGB pixels (48 bytes, three loads) -> 64 bytes. Each output register
+    // takes 12 source bytes; alignr lines them up at the start of a register.
+    MI_TARGET_SSSE3 size_t expandRGBSSSE3(const unsigned char* src, unsigned char* dst, size_t pixelCount) {
+        const __m128i mask = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+        size_t i = 0;
+        for (; i + 16 <= pixelCount; i += 16) {
+            const __m128i* in = reinterpret_cast<const __m128i*>(src + i * 3);
+            __m128i a = _mm_loadu_si128(in + 0);
+            __m128i b = _mm_loadu_si128(in + 1);
+            __m128i c = _mm_loadu_si128(in + 2);
+            __m128i* out = reinterpret_cast<__m128i*>(dst + i * 4);
+            _mm_storeu_si128(out + 0, _mm_or_si128(_mm_shuffle_epi8(a, mask), alpha));
+            _mm_storeu_si128(out + 1, _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), mask), alpha));
+            _mm_storeu_si128(out + 2, _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(c, b, 8), mask), alpha));
+            _mm_storeu_si128(out + 3, _mm_or_si128(_mm_shuffle_epi8(_mm_srli_si128(c, 4), mask), alpha));
+        }
+        return i;
+    }
+#endif
+}
+
+void PixelConvert::expandToRGBA(const unsigned char* src, uint32_t channels, unsigned char* dst, size_t pixelCount) {
+    if (channels == 4) {
+        std::memcpy(dst, src, pixelCount * 4);
+        return;
+    }
+
+    size_t done = 0;
+#ifdef MI_PIXEL_SSE
+    if (channels == 1) {
+        done = expandGraySSE2(src, dst, pixelCount);
+    } else if (hasSSSE3 && channels == 2) {
+        done = expandGrayAlphaSSSE3(src, dst, pixelCount);
+    } else if (hasSSSE3 && channels == 3) {
+        done = expandRGBSSSE3(src, dst, pixelCount);
+    }
+#endif
+
+    // Remainder (or everything, without SIMD)
+    expandToRGBAScalar(src + done * channels, channels, dst + done * 4, pixelCount - done);
+}
+
+void PixelConvert::expandToRGBAScalar(const unsigned char* src, uint32_t channels, unsigned char* dst, size_t pixelCount) {
+    for (size_t i = 0; i < pixelCount; i++) {
+        const unsigned char* in = src + i * channels;
+        unsigned char* out = dst + i * 4;
+        switch (channels) {
+        case 1:
+            out[0] = out[1] = out[2] = in[0];
+            out[3] = 255;
+            break;
+        case 2:
+            out[0] = out[1] = out[2] = in[0];
+            out[3] = in[1];
+            break;
+        case 3:
+            out[0] = in[0];
+            out[1] = in[1];
+            out[2] = in[2];
+            out[3] = 255;
+            break;
+        default:
+            std::memcpy(out, in, 4);
+            break;
+        }
+    }
+}
+
+bool PixelConvert::hasSIMD() {
+#ifdef MI_PIXEL_SSE
+    return hasSSSE3;
+#else
+    return false;
+#endif
+}
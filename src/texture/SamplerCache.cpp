@@ -0,0 +1,67 @@
+﻿#include "../include/texture/SamplerCache.h"
+#include <stdexcept>
+
+SamplerCache::SamplerCache(VkDevice device, VkPhysicalDevice physicalDevice)
+    : device(device) {
+    // Query once instead of for every sampler
+    VkPhysicalDeviceFeatures deviceFeatures;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &deviceFeatures);
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+    anisotropySupported = deviceFeatures.samplerAnisotropy == VK_TRUE;
+    maxAnisotropy = deviceProperties.limits.maxSamplerAnisotropy;
+}
+
+SamplerCache::~SamplerCache() {
+    for (auto& pair : samplers) {
+        vkDestroySampler(device, pair.second, nullptr);
+    }
+}
+
+VkSampler SamplerCache::get(const SamplerDesc& desc) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = samplers.find(desc);
+    if (it != samplers.end()) {
+        return it->second;
+    }
+
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = desc.magFilter;
+    samplerInfo.minFilter = desc.minFilter;
+    samplerInfo.mipmapMode = desc.mipmapMode;
+    samplerInfo.addressModeU = desc.addressMode;
+    samplerInfo.addressModeV = desc.addressMode;
+    samplerInfo.addressModeW = desc.addressMode;
+
+    // Enable anisotropic filtering if supported
+    if (desc.anisotropy && anisotropySupported) {
+        samplerInfo.anisotropyEnable = VK_TRUE;
+        samplerInfo.maxAnisotropy = maxAnisotropy;
+    } else {
+        samplerInfo.anisotropyEnable = VK_FALSE;
+        samplerInfo.maxAnisotropy = 1.0f;
+    }
+
+    samplerInfo.borderColor = desc.borderColor;
+    samplerInfo.unnormalizedCoordinates = VK_FALSE;
+    samplerInfo.compareEnable = desc.compare ? VK_TRUE : VK_FALSE;
+    samplerInfo.compareOp = desc.compare ? desc.compareOp : VK_COMPARE_OP_ALWAYS;
+    samplerInfo.mipLodBias = 0.0f;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+    VkSampler sampler;
+    if (vkCreateSampler(device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create texture sampler!");
+    }
+    samplers.emplace(desc, sampler);
+    return sampler;
+}
+
+size_t SamplerCache::getSamplerCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return samplers.size();
+}
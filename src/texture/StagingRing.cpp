@@ -0,0 +1,82 @@
+﻿#include "../include/texture/StagingRing.h"
+#include "../VulkanRenderer.h"
+
+StagingRing::StagingRing(VulkanRenderer* renderer, VkDeviceSize capacity)
+    : renderer(renderer), capacity(capacity) {
+    renderer->createBuffer(capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                           buffer, memory);
+
+    void* data;
+    vkMapMemory(renderer->getDevice(), memory, 0, capacity, 0, &data);
+    mapped = static_cast<unsigned char*>(data);
+}
+
+StagingRing::~StagingRing() {
+    VkDevice device = renderer->getDevice();
+    vkUnmapMemory(device, memory);
+    vkDestroyBuffer(device, buffer, nullptr);
+    vkFreeMemory(device, memory, nullptr);
+}
+
+StagingRing::Allocation StagingRing::tryAllocate(VkDeviceSize size) {
+    Allocation allocation;
+    VkDeviceSize alignedSize = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    if (size == 0 || alignedSize > capacity) {
+        return allocation;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    VkDeviceSize offset;
+    if (blocks.empty()) {
+        offset = 0;
+    } else {
+        // Free space is [head, tail) if wrapped, else [head, capacity) plus [0, tail)
+        VkDeviceSize tail = blocks.front().offset;
+        if (head > tail) {
+            if (head + alignedSize <= capacity) {
+                offset = head;
+            } else if (alignedSize <= tail) {
+                offset = 0;  // The end of the buffer is skipped until the ring comes around
+            } else {
+                return allocation;
+            }
+        } else if (head < tail && head + alignedSize <= tail) {
+            offset = head;
+        } else {
+            return allocation;
+        }
+    }
+
+    head = offset + alignedSize;
+    blocks.push_back({ offset, alignedSize, nextId, false });
+
+    allocation.data = mapped + offset;
+    allocation.offset = offset;
+    allocation.size = size;
+    allocation.id = nextId++;
+    return allocation;
+}
+
+void StagingRing::release(const Allocation& allocation) {
+    if (!allocation.isValid()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Block& block : blocks) {
+        if (block.id == allocation.id) {
+            block.released = true;
+            break;
+        }
+    }
+
+    // The tail only moves past released blocks at the front
+    while (!blocks.empty() && blocks.front().released) {
+        blocks.pop_front();
+    }
+    if (blocks.empty()) {
+        head = 0;
+    }
+}
@@ -1,17 +1,28 @@
 ﻿#include "../include//texture/Texture.h"
+#include "../include/texture/KTX2.h"
+#include "../include/texture/PixelConvert.h"
 #include <stdexcept>
 #include <iostream>
+#include <algorithm>
+#include <array>
+#include <cmath>
 
 // Include stb_image for texture loading
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
-Texture::Texture(VkDevice device, VkPhysicalDevice physicalDevice)
-    : device(device), physicalDevice(physicalDevice) {
+Texture::Texture(VkDevice device, VkPhysicalDevice physicalDevice, SamplerCache* samplerCache,
+                 MipGenerator* mipGenerator, GpuTimeline* timeline)
+    : device(device), physicalDevice(physicalDevice), samplerCache(samplerCache), mipGenerator(mipGenerator),
+      timeline(timeline) {
 }
 
 Texture::~Texture() {
-    if (textureSampler != VK_NULL_HANDLE) {
+    if (mipGenerator) {
+        mipGenerator->destroyChain(mipChain);
+    }
+    // Cached samplers belong to the cache
+    if (textureSampler != VK_NULL_HANDLE && !samplerCache) {
         vkDestroySampler(device, textureSampler, nullptr);
     }
     if (textureImageView != VK_NULL_HANDLE) {
@@ -26,29 +37,308 @@ Texture::~Texture() {
 }
 
 bool Texture::loadFromFile(const std::string& filepath, VkCommandPool commandPool, VkQueue graphicsQueue) {
-    // Use stb_image to load the texture file
+    TextureData data;
+    if (!decodeFile(filepath, data)) {
+        return false;
+    }
+    if (!isFormatSupported(data.format)) {
+        std::cerr << "Texture format not supported by this device: " << filepath << std::endl;
+        return false;
+    }
+    
+    // Upload the decoded data (and its mip chain, if the file had one)
+    uploadData(data, commandPool, graphicsQueue);
+    return true;
+}
+
+bool Texture::decodeFile(const std::string& filepath, TextureData& data, StagingRing* stagingRing) {
+    // Pre-compressed textures are uploaded as stored
+    if (KTX2::isKTX2File(filepath)) {
+        return KTX2::load(filepath, data);
+    }
+
+    // Use stb_image to load the texture file at its own channel count; the
+    // RGBA expansion below is faster than stb's and writes to the final place
     int texWidth, texHeight, texChannels;
-    stbi_uc* pixels = stbi_load(filepath.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+    stbi_uc* pixels = stbi_load(filepath.c_str(), &texWidth, &texHeight, &texChannels, 0);
     
     if (!pixels) {
         std::cerr << "Failed to load texture image: " << filepath << std::endl;
         return false;
     }
+
+    data.width = static_cast<uint32_t>(texWidth);
+    data.height = static_cast<uint32_t>(texHeight);
+    data.format = VK_FORMAT_R8G8B8A8_SRGB;
+    data.mipOffsets.clear();
+
+    size_t pixelCount = static_cast<size_t>(texWidth) * texHeight;
+    unsigned char* destination = nullptr;
+    if (stagingRing) {
+        data.staging = stagingRing->tryAllocate(pixelCount * 4);
+        destination = data.staging.data;
+    }
+    if (!destination) {
+        // Ring full (or none): keep the pixels in system memory until upload
+        data.pixels.resize(pixelCount * 4);
+        destination = data.pixels.data();
+    }
+    PixelConvert::expandToRGBA(pixels, static_cast<uint32_t>(texChannels), destination, pixelCount);
     
-    // Calculate number of mip levels
-    mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
-    
-    // Create the texture from the loaded pixels
-    createTextureImage(pixels, texWidth, texHeight, 4, commandPool, graphicsQueue);
-    
-    // Free the pixel data as it's now on the GPU
+    // Free the stb copy, the caller owns the pixels now
     stbi_image_free(pixels);
-    
+    return true;
+}
+
+bool Texture::readFileInfo(const std::string& filepath, uint32_t& width, uint32_t& height) {
+    int texWidth, texHeight, texChannels;
+    if (!stbi_info(filepath.c_str(), &texWidth, &texHeight, &texChannels)) {
+        return false;
+    }
+    width = static_cast<uint32_t>(texWidth);
+    height = static_cast<uint32_t>(texHeight);
+    return true;
+}
+
+bool Texture::isFormatSupported(VkFormat format) const {
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+    return (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+}
+
+void Texture::recordUpload(VkCommandBuffer commandBuffer, const TextureData& data,
+                           VkBuffer stagingBuffer, VkDeviceSize stagingOffset, uint32_t firstMip) {
+    imageFormat = data.format;
+    residentMip = data.mipOffsets.empty() ? 0 : firstMip;
+    residentBytes = getMipRangeSize(data, residentMip);
+    uint32_t width = std::max(data.width >> residentMip, 1u);
+    uint32_t height = std::max(data.height >> residentMip, 1u);
+
+    // Calculate number of mip levels, unless the data brings its own
+    if (!data.mipOffsets.empty()) {
+        mipLevels = static_cast<uint32_t>(data.mipOffsets.size()) - residentMip;
+    } else {
+        mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+    }
+    computeMips = data.mipOffsets.empty() && canGenerateMipsCompute(width, height);
+
+    createImage(width, height);
+    transitionImageLayout(commandBuffer, textureImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    if (!data.mipOffsets.empty()) {
+        copyMipChainToImage(commandBuffer, stagingBuffer, stagingOffset, textureImage, data, residentMip);
+        transitionImageLayout(commandBuffer, textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                              VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    } else {
+        copyBufferToImage(commandBuffer, stagingBuffer, stagingOffset, textureImage, width, height);
+        generateMipmaps(commandBuffer, textureImage, imageFormat, width, height, mipLevels);
+    }
+
+    imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+}
+
+void Texture::recordRegionUpload(VkCommandBuffer commandBuffer, VkBuffer stagingBuffer,
+                                 const std::vector<VkBufferImageCopy>& regions, uint32_t width, uint32_t height) {
+    transitionImageLayout(commandBuffer, textureImage, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           static_cast<uint32_t>(regions.size()), regions.data());
+    // Same path as the first upload, so the image's usage flags still match
+    generateMipmaps(commandBuffer, textureImage, imageFormat, static_cast<int32_t>(width),
+                    static_cast<int32_t>(height), mipLevels);
+}
+
+void Texture::finishUpload() {
     // Create image view and sampler
     createTextureImageView();
     createTextureSampler();
-    
-    return true;
+}
+
+void Texture::uploadMipRange(const TextureData& data, uint32_t firstMip, VkCommandPool commandPool,
+                             VkQueue graphicsQueue) {
+    if (data.mipOffsets.empty()) {
+        // No pre-built chain: the whole image is generated on the GPU
+        uploadData(data, commandPool, graphicsQueue);
+        return;
+    }
+    uploadData(data, commandPool, graphicsQueue,
+               std::min(firstMip, static_cast<uint32_t>(data.mipOffsets.size()) - 1));
+}
+
+Texture::RetiredImage Texture::recordMipRange(VkCommandBuffer commandBuffer, const TextureData& data,
+                                              uint32_t firstMip, VkBuffer stagingBuffer,
+                                              VkDeviceSize stagingOffset) {
+    if (!data.mipOffsets.empty()) {
+        firstMip = std::min(firstMip, static_cast<uint32_t>(data.mipOffsets.size()) - 1);
+    }
+
+    // The upload's barriers order it before every frame submitted after it, so the
+    // new image can be used from now on
+    RetiredImage retired = releaseImage();
+    recordUpload(commandBuffer, data, stagingBuffer, stagingOffset, firstMip);
+    finishUpload();
+    return retired;
+}
+
+Texture::RetiredImage Texture::releaseImage() {
+    RetiredImage retired;
+    retired.image = textureImage;
+    retired.memory = textureImageMemory;
+    retired.view = textureImageView;
+    retired.sampler = samplerCache ? VK_NULL_HANDLE : textureSampler;
+    retired.mipChain = mipChain;
+
+    mipChain = MipGenerator::Chain();
+    textureImage = VK_NULL_HANDLE;
+    textureImageMemory = VK_NULL_HANDLE;
+    textureImageView = VK_NULL_HANDLE;
+    textureSampler = VK_NULL_HANDLE;
+    return retired;
+}
+
+void Texture::destroyRetiredImage(VkDevice device, MipGenerator* mipGenerator, RetiredImage& retired) {
+    if (retired.sampler != VK_NULL_HANDLE) vkDestroySampler(device, retired.sampler, nullptr);
+    if (retired.view != VK_NULL_HANDLE) vkDestroyImageView(device, retired.view, nullptr);
+    if (retired.image != VK_NULL_HANDLE) vkDestroyImage(device, retired.image, nullptr);
+    if (retired.memory != VK_NULL_HANDLE) vkFreeMemory(device, retired.memory, nullptr);
+    if (mipGenerator) mipGenerator->destroyChain(retired.mipChain);
+    retired = RetiredImage();
+}
+
+VkDeviceSize Texture::getMipRangeSize(const TextureData& data, uint32_t firstMip) {
+    if (data.mipOffsets.empty() || firstMip == 0) {
+        return data.getSize();
+    }
+    return data.getSize() - data.mipOffsets[firstMip];
+}
+
+void Texture::buildMipChain(TextureData& data) {
+    if (!data.mipOffsets.empty() ||
+        (data.format != VK_FORMAT_R8G8B8A8_SRGB && data.format != VK_FORMAT_R8G8B8A8_UNORM)) {
+        return;
+    }
+
+    // Average in linear space so dark/bright edges don't shift with distance
+    bool srgb = data.format == VK_FORMAT_R8G8B8A8_SRGB;
+    static float toLinear[256];
+    static uint8_t toSrgb[4096];
+    static bool tablesReady = [] {
+        for (int i = 0; i < 256; i++) {
+            float c = i / 255.0f;
+            toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        for (int i = 0; i < 4096; i++) {
+            float c = i / 4095.0f;
+            float encoded = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+            toSrgb[i] = static_cast<uint8_t>(encoded * 255.0f + 0.5f);
+        }
+        return true;
+    }();
+    (void)tablesReady;
+
+    data.mipOffsets.push_back(0);
+    uint32_t width = data.width;
+    uint32_t height = data.height;
+    while (width > 1 || height > 1) {
+        uint32_t nextWidth = std::max(width / 2, 1u);
+        uint32_t nextHeight = std::max(height / 2, 1u);
+        size_t source = static_cast<size_t>(data.mipOffsets.back());
+        size_t target = (data.pixels.size() + 15) & ~size_t(15);
+        data.pixels.resize(target + size_t(nextWidth) * nextHeight * 4);
+        data.mipOffsets.push_back(target);
+
+        for (uint32_t y = 0; y < nextHeight; y++) {
+            uint32_t y0 = std::min(y * 2, height - 1);
+            uint32_t y1 = std::min(y * 2 + 1, height - 1);
+            for (uint32_t x = 0; x < nextWidth; x++) {
+                uint32_t x0 = std::min(x * 2, width - 1);
+                uint32_t x1 = std::min(x * 2 + 1, width - 1);
+                const unsigned char* texels[4] = {
+                    &data.pixels[source + (size_t(y0) * width + x0) * 4],
+                    &data.pixels[source + (size_t(y0) * width + x1) * 4],
+                    &data.pixels[source + (size_t(y1) * width + x0) * 4],
+                    &data.pixels[source + (size_t(y1) * width + x1) * 4]
+                };
+                unsigned char* out = &data.pixels[target + (size_t(y) * nextWidth + x) * 4];
+                for (int c = 0; c < 4; c++) {
+                    if (srgb && c < 3) {
+                        float sum = toLinear[texels[0][c]] + toLinear[texels[1][c]] +
+                                    toLinear[texels[2][c]] + toLinear[texels[3][c]];
+                        out[c] = toSrgb[static_cast<int>(sum * 0.25f * 4095.0f + 0.5f)];
+                    } else {
+                        out[c] = static_cast<unsigned char>(
+                            (texels[0][c] + texels[1][c] + texels[2][c] + texels[3][c] + 2) / 4);
+                    }
+                }
+            }
+        }
+        width = nextWidth;
+        height = nextHeight;
+    }
+}
+
+void Texture::uploadData(const TextureData& data, VkCommandPool commandPool, VkQueue graphicsQueue,
+                         uint32_t firstMip) {
+    // Only the requested levels are staged
+    VkDeviceSize dataSize = getMipRangeSize(data, firstMip);
+    VkDeviceSize dataOffset = data.getSize() - dataSize;
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = dataSize;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkBuffer stagingBuffer;
+    if (vkCreateBuffer(device, &bufferInfo, nullptr, &stagingBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create staging buffer for texture!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, stagingBuffer, &memRequirements);
+
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+    VkMemoryPropertyFlags hostFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    uint32_t memoryTypeIndex = 0;
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+        if ((memRequirements.memoryTypeBits & (1 << i)) &&
+            (memProperties.memoryTypes[i].propertyFlags & hostFlags) == hostFlags) {
+            memoryTypeIndex = i;
+            break;
+        }
+    }
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+    VkDeviceMemory stagingBufferMemory;
+    if (vkAllocateMemory(device, &allocInfo, nullptr, &stagingBufferMemory) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate staging buffer memory for texture!");
+    }
+    vkBindBufferMemory(device, stagingBuffer, stagingBufferMemory, 0);
+
+    void* mapped;
+    vkMapMemory(device, stagingBufferMemory, 0, dataSize, 0, &mapped);
+    memcpy(mapped, data.getPixels() + dataOffset, static_cast<size_t>(dataSize));
+    vkUnmapMemory(device, stagingBufferMemory);
+
+    // A re-upload replaces the current image; frames in flight may still sample it
+    RetiredImage retired = releaseImage();
+
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(commandPool);
+    recordUpload(commandBuffer, data, stagingBuffer, 0, firstMip);
+    endSingleTimeCommands(commandBuffer, commandPool, graphicsQueue);
+
+    // endSingleTimeCommands waited for everything submitted up to the upload, which
+    // includes every frame that could sample the old image
+    destroyRetiredImage(device, mipGenerator, retired);
+
+    vkDestroyBuffer(device, stagingBuffer, nullptr);
+    vkFreeMemory(device, stagingBufferMemory, nullptr);
+
+    finishUpload();
 }
 
 bool Texture::createFromPixels(const unsigned char* pixels, uint32_t width, uint32_t height, 
@@ -119,25 +409,33 @@ void Texture::createTextureImage(const unsigned char* pixels, uint32_t width, ui
     vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
     
     // Convert to RGBA if needed
-    if (channels == 4) {
-        memcpy(data, pixels, imageSize);
-    } else {
-        // Manual conversion for RGB to RGBA
-        unsigned char* dest = static_cast<unsigned char*>(data);
-        for (uint32_t i = 0; i < width * height; i++) {
-            for (uint32_t c = 0; c < channels; c++) {
-                dest[i * 4 + c] = pixels[i * channels + c];
-            }
-            // Set alpha to 255 if not provided
-            if (channels < 4) {
-                dest[i * 4 + 3] = 255;
-            }
-        }
-    }
+    PixelConvert::expandToRGBA(pixels, channels, static_cast<unsigned char*>(data),
+                               static_cast<size_t>(width) * height);
     
     vkUnmapMemory(device, stagingBufferMemory);
     
     // Create the texture image
+    computeMips = canGenerateMipsCompute(width, height);
+    createImage(width, height);
+    
+    // Copy data from staging buffer to image and generate mipmaps in one submission
+    // (the mip chain also transitions to SHADER_READ_ONLY_OPTIMAL)
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(commandPool);
+    transitionImageLayout(commandBuffer, textureImage, VK_IMAGE_LAYOUT_UNDEFINED, 
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    copyBufferToImage(commandBuffer, stagingBuffer, 0, textureImage, width, height);
+    generateMipmaps(commandBuffer, textureImage, imageFormat, width, height, mipLevels);
+    endSingleTimeCommands(commandBuffer, commandPool, graphicsQueue);
+    
+    // Clean up staging buffer
+    vkDestroyBuffer(device, stagingBuffer, nullptr);
+    vkFreeMemory(device, stagingBufferMemory, nullptr);
+    
+    // Update the current image layout
+    imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+}
+
+void Texture::createImage(uint32_t width, uint32_t height) {
     VkImageCreateInfo imageInfo{};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -153,18 +451,25 @@ void Texture::createTextureImage(const unsigned char* pixels, uint32_t width, ui
     imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
     imageInfo.flags = 0;
+    if (computeMips) {
+        // The mip levels are written as storage images, sRGB ones through a UNORM view;
+        // extended usage allows storage usage on a format that only its views support
+        imageInfo.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+        imageInfo.flags |= VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT;
+    }
     
     if (vkCreateImage(device, &imageInfo, nullptr, &textureImage) != VK_SUCCESS) {
         throw std::runtime_error("failed to create texture image!");
     }
     
     // Get memory requirements for the image
+    VkMemoryRequirements memRequirements;
     vkGetImageMemoryRequirements(device, textureImage, &memRequirements);
     
-    // Allocate memory for the image
-    allocInfo.allocationSize = memRequirements.size;
-    
     // Find memory type that is device local
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+    uint32_t memoryTypeIndex = 0;
     for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
         if ((memRequirements.memoryTypeBits & (1 << i)) &&
             (memProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) ==
@@ -173,6 +478,10 @@ void Texture::createTextureImage(const unsigned char* pixels, uint32_t width, ui
             break;
         }
     }
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
     allocInfo.memoryTypeIndex = memoryTypeIndex;
     
     if (vkAllocateMemory(device, &allocInfo, nullptr, &textureImageMemory) != VK_SUCCESS) {
@@ -180,23 +489,6 @@ void Texture::createTextureImage(const unsigned char* pixels, uint32_t width, ui
     }
     
     vkBindImageMemory(device, textureImage, textureImageMemory, 0);
-    
-    // Transition image layout for copying
-    transitionImageLayout(textureImage, imageFormat, VK_IMAGE_LAYOUT_UNDEFINED, 
-                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, commandPool, graphicsQueue);
-    
-    // Copy data from staging buffer to image
-    copyBufferToImage(stagingBuffer, textureImage, width, height, commandPool, graphicsQueue);
-    
-    // Generate mipmaps (which also transitions to SHADER_READ_ONLY_OPTIMAL)
-    generateMipmaps(textureImage, imageFormat, width, height, mipLevels, commandPool, graphicsQueue);
-    
-    // Clean up staging buffer
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
-    
-    // Update the current image layout
-    imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 }
 
 void Texture::createTextureImageView() {
@@ -210,6 +502,14 @@ void Texture::createTextureImageView() {
     viewInfo.subresourceRange.levelCount = mipLevels;
     viewInfo.subresourceRange.baseArrayLayer = 0;
     viewInfo.subresourceRange.layerCount = 1;
+
+    // Storage usage is only for the mip generator's views, not this (possibly sRGB) one
+    VkImageViewUsageCreateInfo usageInfo{};
+    usageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO;
+    usageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+    if (computeMips) {
+        viewInfo.pNext = &usageInfo;
+    }
     
     if (vkCreateImageView(device, &viewInfo, nullptr, &textureImageView) != VK_SUCCESS) {
         throw std::runtime_error("failed to create texture image view!");
@@ -217,6 +517,11 @@ void Texture::createTextureImageView() {
 }
 
 void Texture::createTextureSampler() {
+    if (samplerCache) {
+        textureSampler = samplerCache->get();
+        return;
+    }
+
     // Check if anisotropic filtering is supported
     VkPhysicalDeviceFeatures deviceFeatures;
     vkGetPhysicalDeviceFeatures(physicalDevice, &deviceFeatures);
@@ -256,10 +561,8 @@ void Texture::createTextureSampler() {
     }
 }
 
-void Texture::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, 
-                                 VkImageLayout newLayout, VkCommandPool commandPool, VkQueue graphicsQueue) {
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands(commandPool);
-    
+void Texture::transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image,
+                                 VkImageLayout oldLayout, VkImageLayout newLayout) {
     VkImageMemoryBarrier barrier{};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
     barrier.oldLayout = oldLayout;
@@ -288,6 +591,13 @@ void Texture::transitionImageLayout(VkImage image, VkFormat format, VkImageLayou
         
         sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
         destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    } else if (oldLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
+        // In-place update: earlier frames' reads must finish before the writes
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+        sourceStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
     } else {
         throw std::runtime_error("unsupported layout transition!");
     }
@@ -300,16 +610,12 @@ void Texture::transitionImageLayout(VkImage image, VkFormat format, VkImageLayou
         0, nullptr,
         1, &barrier
     );
-    
-    endSingleTimeCommands(commandBuffer, commandPool, graphicsQueue);
 }
 
-void Texture::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height,
-                             VkCommandPool commandPool, VkQueue graphicsQueue) {
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands(commandPool);
-    
+void Texture::copyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset,
+                             VkImage image, uint32_t width, uint32_t height) {
     VkBufferImageCopy region{};
-    region.bufferOffset = 0;
+    region.bufferOffset = offset;
     region.bufferRowLength = 0;
     region.bufferImageHeight = 0;
     
@@ -329,12 +635,39 @@ void Texture::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width,
         1,
         &region
     );
-    
-    endSingleTimeCommands(commandBuffer, commandPool, graphicsQueue);
 }
 
-void Texture::generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, 
-                           uint32_t mipLevels, VkCommandPool commandPool, VkQueue graphicsQueue) {
+void Texture::copyMipChainToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset,
+                                  VkImage image, const TextureData& data, uint32_t firstMip) {
+    // Image level i holds source level firstMip + i; the buffer starts at firstMip
+    std::vector<VkBufferImageCopy> regions(data.mipOffsets.size() - firstMip);
+    for (uint32_t i = 0; i < regions.size(); i++) {
+        uint32_t level = firstMip + i;
+        VkBufferImageCopy& region = regions[i];
+        region.bufferOffset = offset + data.mipOffsets[level] - data.mipOffsets[firstMip];
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = i;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+
+        region.imageOffset = {0, 0, 0};
+        region.imageExtent = {std::max(data.width >> level, 1u), std::max(data.height >> level, 1u), 1};
+    }
+
+    vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           static_cast<uint32_t>(regions.size()), regions.data());
+}
+
+void Texture::generateMipmaps(VkCommandBuffer commandBuffer, VkImage image, VkFormat imageFormat,
+                           int32_t texWidth, int32_t texHeight, uint32_t mipLevels) {
+    if (computeMips) {
+        generateMipmapsCompute(commandBuffer, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
+        return;
+    }
+
     // Check if image format supports linear blitting
     VkFormatProperties formatProperties;
     vkGetPhysicalDeviceFormatProperties(physicalDevice, imageFormat, &formatProperties);
@@ -343,8 +676,6 @@ void Texture::generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWi
         throw std::runtime_error("texture image format does not support linear blitting!");
     }
     
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands(commandPool);
-    
     VkImageMemoryBarrier barrier{};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
     barrier.image = image;
@@ -417,8 +748,64 @@ void Texture::generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWi
         0, nullptr,
         0, nullptr,
         1, &barrier);
-        
-    endSingleTimeCommands(commandBuffer, commandPool, graphicsQueue);
+}
+
+bool Texture::canGenerateMipsCompute(uint32_t width, uint32_t height) const {
+    if (!mipGenerator || mipLevels <= 1 || !mipGenerator->isFormatSupported(imageFormat)) {
+        return false;
+    }
+    if (MipGenerator::fitsTileGrid({ width, height })) {
+        return true;
+    }
+
+    // Too many tiles for one dispatch: blit, unless the format cannot be filtered
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, imageFormat, &formatProperties);
+    return (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) == 0;
+}
+
+void Texture::generateMipmapsCompute(VkCommandBuffer commandBuffer, uint32_t width, uint32_t height) {
+    // Level 0 is read by the downsampler, the other levels are written by it
+    std::array<VkImageMemoryBarrier, 2> barriers{};
+    for (auto& barrier : barriers) {
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = textureImage;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    }
+    barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[0].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    barriers[1].srcAccessMask = 0;
+    barriers[1].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barriers[1].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 1, mipLevels - 1, 0, 1 };
+
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+        0, nullptr,
+        0, nullptr,
+        static_cast<uint32_t>(barriers.size()), barriers.data());
+
+    // In-place updates reuse the chain; earlier submissions may still be using it
+    if (!mipChain.isValid()) {
+        mipChain = mipGenerator->createChain(textureImage, imageFormat, { width, height }, mipLevels);
+    }
+    mipGenerator->record(commandBuffer, mipChain);
+
+    VkImageMemoryBarrier barrier = barriers[1];
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+        0, nullptr,
+        0, nullptr,
+        1, &barrier);
 }
 
 VkCommandBuffer Texture::beginSingleTimeCommands(VkCommandPool commandPool) {
@@ -443,13 +830,18 @@ VkCommandBuffer Texture::beginSingleTimeCommands(VkCommandPool commandPool) {
 void Texture::endSingleTimeCommands(VkCommandBuffer commandBuffer, VkCommandPool commandPool, VkQueue graphicsQueue) {
     vkEndCommandBuffer(commandBuffer);
     
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-    
-    vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(graphicsQueue);
+    if (timeline) {
+        // Waits for this submission and the work before it, not for later ones
+        timeline->wait(timeline->submit(commandBuffer));
+    } else {
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+
+        vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+        vkQueueWaitIdle(graphicsQueue);
+    }
     
     vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
 }
\ No newline at end of file
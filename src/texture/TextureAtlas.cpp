@@ -0,0 +1,304 @@
+﻿#include "../include/texture/TextureAtlas.h"
+#include "../include/texture/KTX2.h"
+#include "../include/Utils/ThreadPool.h"
+#include "../VulkanRenderer.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+TextureAtlas::TextureAtlas(VulkanRenderer* renderer, ThreadPool* threadPool)
+    : renderer(renderer), threadPool(threadPool), stagingRing(renderer->getStagingRing()) {
+}
+
+TextureAtlas::~TextureAtlas() {
+    // Decode jobs write into the pages
+    waitForDecodes();
+    retireSubmissions(true);
+}
+
+bool TextureAtlas::pack(const std::string& filename, Region& region) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = regions.find(filename);
+        if (it != regions.end()) {
+            region = it->second;
+            return true;
+        }
+    }
+
+    // Block-compressed files are uploaded as stored, they can't be blitted into a page
+    uint32_t width, height;
+    if (filename.empty() || KTX2::isKTX2File(filename) || !Texture::readFileInfo(filename, width, height)) {
+        return false;
+    }
+    if (width > MAX_PACKED_SIZE || height > MAX_PACKED_SIZE) {
+        return false;
+    }
+
+    uint32_t pageIndex = 0;
+    uint32_t x = 0, y = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // Another thread may have packed the same file meanwhile
+        auto it = regions.find(filename);
+        if (it != regions.end()) {
+            region = it->second;
+            return true;
+        }
+
+        bool placed = false;
+        for (pageIndex = 0; pageIndex < pages.size(); pageIndex++) {
+            if (allocate(*pages[pageIndex], width, height, x, y)) {
+                placed = true;
+                break;
+            }
+        }
+        if (!placed) {
+            pages.push_back(createPage());
+            pageIndex = static_cast<uint32_t>(pages.size() - 1);
+            allocate(*pages[pageIndex], width, height, x, y);
+        }
+
+        Page& page = *pages[pageIndex];
+        region.page = page.texture;
+        region.uvOffset = glm::vec2(x + PADDING, y + PADDING) / static_cast<float>(PAGE_SIZE);
+        region.uvScale = glm::vec2(width, height) / static_cast<float>(PAGE_SIZE);
+        regions[filename] = region;
+
+        page.decodesInFlight++;
+        decodesInFlight++;
+    }
+
+    threadPool->enqueue([this, filename, pageIndex, x, y, width, height]() {
+        TextureData data;
+        bool success = Texture::decodeFile(filename, data) && data.format == VK_FORMAT_R8G8B8A8_SRGB &&
+                       data.width == width && data.height == height;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        Page& page = *pages[pageIndex];
+        if (success) {
+            blit(page, data, x, y);
+            page.dirtyRects.push_back({ { static_cast<int32_t>(x), static_cast<int32_t>(y) },
+                                        { width + 2 * PADDING, height + 2 * PADDING } });
+        } else {
+            // The region stays transparent black
+            std::cerr << "Failed to pack texture into atlas: " << filename << std::endl;
+        }
+        page.decodesInFlight--;
+        decodesInFlight--;
+        decodeCondition.notify_all();
+    });
+
+    return true;
+}
+
+uint32_t TextureAtlas::processUploads() {
+    // Ring space and command buffers of finished uploads can be reused
+    retireSubmissions(false);
+
+    struct PageUpload {
+        std::shared_ptr<Texture> texture;
+        // Set for a page's first upload, which creates its image from the whole page
+        TextureData fullPage;
+        std::vector<VkBufferImageCopy> regions;
+    };
+    std::vector<PageUpload> uploads;
+    PendingSubmission submission;
+    {
+        // Pixels are copied into the ring under the lock; decodes may write into the
+        // pages again while the uploads are recorded
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& page : pages) {
+            if (page->dirtyRects.empty() || page->decodesInFlight > 0) {
+                continue;
+            }
+
+            bool firstUpload = !page->texture->isReady();
+            VkDeviceSize size = 0;
+            if (firstUpload) {
+                size = page->data.getSize();
+            } else {
+                for (const VkRect2D& rect : page->dirtyRects) {
+                    size += static_cast<VkDeviceSize>(rect.extent.width) * rect.extent.height * 4;
+                }
+            }
+
+            // Uploads in flight free ring space; the page stays dirty until then
+            StagingRing::Allocation allocation = stagingRing->tryAllocate(size);
+            if (!allocation.isValid()) {
+                continue;
+            }
+
+            PageUpload upload;
+            upload.texture = page->texture;
+            if (firstUpload) {
+                std::memcpy(allocation.data, page->data.pixels.data(), static_cast<size_t>(size));
+                upload.fullPage.width = page->data.width;
+                upload.fullPage.height = page->data.height;
+                upload.fullPage.format = page->data.format;
+                upload.fullPage.staging = allocation;
+            } else {
+                VkDeviceSize offset = 0;
+                for (const VkRect2D& rect : page->dirtyRects) {
+                    size_t rowBytes = static_cast<size_t>(rect.extent.width) * 4;
+                    for (uint32_t row = 0; row < rect.extent.height; row++) {
+                        size_t source = (static_cast<size_t>(rect.offset.y + row) * PAGE_SIZE + rect.offset.x) * 4;
+                        std::memcpy(allocation.data + offset + row * rowBytes, page->data.pixels.data() + source, rowBytes);
+                    }
+
+                    VkBufferImageCopy region{};
+                    region.bufferOffset = allocation.offset + offset;
+                    region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+                    region.imageOffset = { rect.offset.x, rect.offset.y, 0 };
+                    region.imageExtent = { rect.extent.width, rect.extent.height, 1 };
+                    upload.regions.push_back(region);
+                    offset += static_cast<VkDeviceSize>(rowBytes) * rect.extent.height;
+                }
+            }
+            page->dirtyRects.clear();
+
+            uploads.push_back(std::move(upload));
+            submission.allocations.push_back(allocation);
+        }
+    }
+
+    if (uploads.empty()) {
+        return 0;
+    }
+
+    VkDevice device = renderer->getDevice();
+
+    // One command buffer and one submission for every page
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = renderer->getCommandPool();
+    allocInfo.commandBufferCount = 1;
+
+    if (vkAllocateCommandBuffers(device, &allocInfo, &submission.commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate atlas upload command buffer!");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(submission.commandBuffer, &beginInfo);
+
+    // The mips are generated from the whole page either way
+    for (PageUpload& upload : uploads) {
+        if (upload.fullPage.staging.isValid()) {
+            upload.texture->recordUpload(submission.commandBuffer, upload.fullPage, stagingRing->getBuffer(),
+                                         upload.fullPage.staging.offset);
+        } else {
+            upload.texture->recordRegionUpload(submission.commandBuffer, stagingRing->getBuffer(), upload.regions,
+                                               PAGE_SIZE, PAGE_SIZE);
+        }
+    }
+
+    vkEndCommandBuffer(submission.commandBuffer);
+
+    // No wait: the upload's barriers order it against the frames around it
+    submission.timelineValue = renderer->getGpuTimeline()->submit(submission.commandBuffer);
+    pendingSubmissions.push_back(std::move(submission));
+
+    for (PageUpload& upload : uploads) {
+        if (upload.fullPage.staging.isValid()) {
+            upload.texture->finishUpload();
+        }
+    }
+    return static_cast<uint32_t>(uploads.size());
+}
+
+void TextureAtlas::retireSubmissions(bool wait) {
+    VkDevice device = renderer->getDevice();
+    GpuTimeline* timeline = renderer->getGpuTimeline();
+    for (auto it = pendingSubmissions.begin(); it != pendingSubmissions.end();) {
+        if (wait) {
+            timeline->wait(it->timelineValue);
+        } else if (!timeline->isComplete(it->timelineValue)) {
+            ++it;
+            continue;
+        }
+
+        for (const StagingRing::Allocation& allocation : it->allocations) {
+            stagingRing->release(allocation);
+        }
+        vkFreeCommandBuffers(device, renderer->getCommandPool(), 1, &it->commandBuffer);
+        it = pendingSubmissions.erase(it);
+    }
+}
+
+void TextureAtlas::waitForDecodes() {
+    std::unique_lock<std::mutex> lock(mutex);
+    decodeCondition.wait(lock, [this]() { return decodesInFlight == 0; });
+}
+
+size_t TextureAtlas::getPageCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pages.size();
+}
+
+bool TextureAtlas::allocate(Page& page, uint32_t width, uint32_t height, uint32_t& x, uint32_t& y) {
+    uint32_t paddedWidth = (width + 2 * PADDING + 3) & ~3u;
+    uint32_t paddedHeight = (height + 2 * PADDING + 3) & ~3u;
+
+    // Shelf packing: the lowest shelf that is tall enough and has room wins
+    Shelf* best = nullptr;
+    for (Shelf& shelf : page.shelves) {
+        if (shelf.height >= paddedHeight && shelf.usedWidth + paddedWidth <= PAGE_SIZE &&
+            (!best || shelf.height < best->height)) {
+            best = &shelf;
+        }
+    }
+
+    if (!best) {
+        if (page.usedHeight + paddedHeight > PAGE_SIZE) {
+            return false;
+        }
+        Shelf shelf;
+        shelf.y = page.usedHeight;
+        shelf.height = paddedHeight;
+        page.shelves.push_back(shelf);
+        page.usedHeight += paddedHeight;
+        best = &page.shelves.back();
+    }
+
+    x = best->usedWidth;
+    y = best->y;
+    best->usedWidth += paddedWidth;
+    return true;
+}
+
+std::unique_ptr<TextureAtlas::Page> TextureAtlas::createPage() {
+    auto page = std::make_unique<Page>();
+    page->texture = std::make_shared<Texture>(renderer->getDevice(), renderer->getPhysicalDevice(),
+                                              renderer->getSamplerCache(), renderer->getMipGenerator(),
+                                              renderer->getGpuTimeline());
+    page->data.width = PAGE_SIZE;
+    page->data.height = PAGE_SIZE;
+    page->data.format = VK_FORMAT_R8G8B8A8_SRGB;
+    page->data.pixels.assign(static_cast<size_t>(PAGE_SIZE) * PAGE_SIZE * 4, 0);
+    return page;
+}
+
+void TextureAtlas::blit(Page& page, const TextureData& source, uint32_t x, uint32_t y) {
+    const unsigned char* pixels = source.getPixels();
+    unsigned char* destination = page.data.pixels.data();
+    int32_t width = static_cast<int32_t>(source.width);
+    int32_t height = static_cast<int32_t>(source.height);
+    int32_t padding = static_cast<int32_t>(PADDING);
+
+    // Rows and columns outside the image clamp to its edge
+    for (int32_t row = -padding; row < height + padding; row++) {
+        int32_t sourceRow = std::clamp(row, 0, height - 1);
+        const unsigned char* sourceLine = pixels + static_cast<size_t>(sourceRow) * width * 4;
+        unsigned char* line = destination + (static_cast<size_t>(y + PADDING + row) * PAGE_SIZE + x + PADDING) * 4;
+
+        std::memcpy(line, sourceLine, static_cast<size_t>(width) * 4);
+        for (int32_t column = 1; column <= padding; column++) {
+            std::memcpy(line - column * 4, sourceLine, 4);
+            std::memcpy(line + (width - 1 + column) * 4, sourceLine + (width - 1) * 4, 4);
+        }
+    }
+}
@@ -0,0 +1,258 @@
+﻿#include "../include/texture/TextureStreamer.h"
+#include "../include/scene/FrameSnapshot.h"
+#include "../include/mesh/Mesh.h"
+#include "../VulkanRenderer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+TextureStreamer::TextureStreamer(VulkanRenderer* renderer, VkDeviceSize budget)
+    : renderer(renderer), budget(budget) {
+}
+
+TextureStreamer::~TextureStreamer() {
+    retireSubmissions(true);
+}
+
+uint32_t TextureStreamer::getInitialMip(const TextureData& data) {
+    if (data.mipOffsets.empty()) {
+        return 0;
+    }
+
+    uint32_t mip = 0;
+    uint32_t lastMip = static_cast<uint32_t>(data.mipOffsets.size()) - 1;
+    while (mip < lastMip && std::max(data.width >> mip, data.height >> mip) > MIN_RESIDENT_SIZE) {
+        mip++;
+    }
+    return mip;
+}
+
+void TextureStreamer::registerTexture(const std::shared_ptr<Texture>& texture, TextureData&& data) {
+    // Single-level textures have nothing to stream
+    if (!texture || data.mipOffsets.size() < 2) {
+        return;
+    }
+
+    StreamedTexture& entry = textures[texture.get()];
+    entry.texture = texture;
+    entry.residentMip = texture->getResidentMip();
+    entry.minResidentMip = getInitialMip(data);
+    entry.desiredMip = entry.minResidentMip;
+    entry.lastUsedFrame = currentFrame;
+    entry.data = std::move(data);
+}
+
+void TextureStreamer::addFeedback(const FrameSnapshot& snapshot, float viewportHeight) {
+    currentFrame++;
+
+    glm::vec3 cameraPos = glm::vec3(glm::inverse(snapshot.view)[3]);
+    float pixelsPerUnit = viewportHeight / (2.0f * std::tan(glm::radians(snapshot.fov) * 0.5f));
+
+    for (size_t i = 0; i < snapshot.getInstanceCount(); i++) {
+        const std::shared_ptr<Texture>& texture = snapshot.meshes[i]->getMaterial().diffuseTexture;
+        if (!texture) {
+            continue;
+        }
+        // Deduplicated textures are streamed through the one holding the image
+        Texture* streamed = texture->getSource() ? texture->getSource().get() : texture.get();
+        auto it = textures.find(streamed);
+        if (it == textures.end() || !snapshot.bounds[i].isValid()) {
+            continue;
+        }
+        StreamedTexture& entry = it->second;
+
+        // Projected diameter of the bounding sphere, assuming the texture spans the
+        // object once. One texel per pixel picks the level.
+        const AABB& bounds = snapshot.bounds[i];
+        float radius = glm::length(bounds.getExtents());
+        float distance = std::max(glm::length(bounds.getCenter() - cameraPos) - radius, snapshot.nearPlane);
+        float projectedPixels = std::max(2.0f * radius / distance * pixelsPerUnit, 1.0f);
+        float texels = static_cast<float>(std::max(entry.data.width, entry.data.height));
+
+        uint32_t mip = 0;
+        if (texels > projectedPixels) {
+            mip = static_cast<uint32_t>(std::floor(std::log2(texels / projectedPixels)));
+        }
+        mip = std::min(mip, entry.minResidentMip);
+
+        // The largest instance this frame decides
+        if (entry.lastUsedFrame != currentFrame) {
+            entry.desiredMip = mip;
+            entry.lastUsedFrame = currentFrame;
+        } else {
+            entry.desiredMip = std::min(entry.desiredMip, mip);
+        }
+    }
+}
+
+void TextureStreamer::update(VkDeviceSize maxUploadBytes) {
+    // Staging space and images replaced by finished uploads can be released
+    retireSubmissions(false);
+
+    // Forget textures whose owner released them
+    residentBytes = 0;
+    for (auto it = textures.begin(); it != textures.end();) {
+        if (it->second.texture.expired()) {
+            it = textures.erase(it);
+        } else {
+            residentBytes += Texture::getMipRangeSize(it->second.data, it->second.residentMip);
+            ++it;
+        }
+    }
+
+    // Least recently used textures first; these give memory back when over budget
+    std::vector<StreamedTexture*> evictionOrder;
+    for (auto& pair : textures) {
+        evictionOrder.push_back(&pair.second);
+    }
+    std::sort(evictionOrder.begin(), evictionOrder.end(), [](const StreamedTexture* a, const StreamedTexture* b) {
+        return a->lastUsedFrame < b->lastUsedFrame;
+    });
+    size_t nextEviction = 0;
+
+    auto evictUntil = [&](VkDeviceSize required) {
+        while (residentBytes + required > budget && nextEviction < evictionOrder.size()) {
+            StreamedTexture& entry = *evictionOrder[nextEviction++];
+            if (entry.lastUsedFrame == currentFrame || entry.residentMip >= entry.minResidentMip) {
+                continue;
+            }
+            residentBytes -= Texture::getMipRangeSize(entry.data, entry.residentMip);
+            setResidentMip(entry, entry.minResidentMip);
+            residentBytes += Texture::getMipRangeSize(entry.data, entry.residentMip);
+        }
+    };
+
+    // A lowered budget evicts even without new requests
+    evictUntil(0);
+
+    // Textures missing the most levels are streamed first
+    std::vector<StreamedTexture*> upgrades;
+    for (auto& pair : textures) {
+        StreamedTexture& entry = pair.second;
+        if (entry.lastUsedFrame == currentFrame && entry.desiredMip < entry.residentMip) {
+            upgrades.push_back(&entry);
+        }
+    }
+    std::sort(upgrades.begin(), upgrades.end(), [](const StreamedTexture* a, const StreamedTexture* b) {
+        return a->residentMip - a->desiredMip > b->residentMip - b->desiredMip;
+    });
+
+    VkDeviceSize uploadedBytes = 0;
+    for (StreamedTexture* entry : upgrades) {
+        VkDeviceSize currentBytes = Texture::getMipRangeSize(entry->data, entry->residentMip);
+        VkDeviceSize targetBytes = Texture::getMipRangeSize(entry->data, entry->desiredMip);
+        if (uploadedBytes > 0 && uploadedBytes + targetBytes > maxUploadBytes) {
+            break;
+        }
+
+        evictUntil(targetBytes - currentBytes);
+
+        // Settle for a coarser level when the budget can't hold the one asked for
+        uint32_t targetMip = entry->desiredMip;
+        while (targetMip < entry->residentMip && residentBytes - currentBytes + targetBytes > budget) {
+            targetMip++;
+            targetBytes = Texture::getMipRangeSize(entry->data, targetMip);
+        }
+        if (targetMip >= entry->residentMip) {
+            continue;
+        }
+
+        if (!setResidentMip(*entry, targetMip)) {
+            break;
+        }
+        residentBytes = residentBytes - currentBytes + targetBytes;
+        uploadedBytes += targetBytes;
+    }
+
+    submitStagedUploads();
+}
+
+bool TextureStreamer::setResidentMip(StreamedTexture& entry, uint32_t mip) {
+    std::shared_ptr<Texture> texture = entry.texture.lock();
+    if (!texture) {
+        return false;
+    }
+
+    // Only the requested levels are staged; they are at the end of the pixel data
+    VkDeviceSize size = Texture::getMipRangeSize(entry.data, mip);
+    StagingRing* stagingRing = renderer->getStagingRing();
+    StagingRing::Allocation allocation = stagingRing->tryAllocate(size);
+    if (!allocation.isValid()) {
+        // Uploads in flight free ring space, so only ranges larger than the whole
+        // ring need their own staging buffer
+        if (size <= stagingRing->getCapacity()) {
+            return false;
+        }
+        texture->uploadMipRange(entry.data, mip, renderer->getCommandPool(), renderer->getGraphicsQueue());
+        entry.residentMip = texture->getResidentMip();
+        return true;
+    }
+    std::memcpy(allocation.data, entry.data.getPixels() + (entry.data.getSize() - size), static_cast<size_t>(size));
+
+    stagedUploads.push_back({ texture, &entry.data, mip, allocation });
+    entry.residentMip = mip;
+    return true;
+}
+
+void TextureStreamer::submitStagedUploads() {
+    if (stagedUploads.empty()) {
+        return;
+    }
+
+    VkDevice device = renderer->getDevice();
+
+    // One command buffer and one submission for every streamed texture
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = renderer->getCommandPool();
+    allocInfo.commandBufferCount = 1;
+
+    PendingSubmission submission;
+    if (vkAllocateCommandBuffers(device, &allocInfo, &submission.commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate texture streaming command buffer!");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(submission.commandBuffer, &beginInfo);
+
+    for (StagedUpload& upload : stagedUploads) {
+        submission.retiredImages.push_back(upload.texture->recordMipRange(submission.commandBuffer, *upload.data,
+            upload.mip, renderer->getStagingRing()->getBuffer(), upload.allocation.offset));
+        submission.allocations.push_back(upload.allocation);
+    }
+    stagedUploads.clear();
+
+    vkEndCommandBuffer(submission.commandBuffer);
+
+    // No wait: frames submitted before the upload may still sample the replaced
+    // images, and all of them complete before its timeline value. Later frames reach
+    // the new images through fresh bindless slots, never the old ones
+    submission.timelineValue = renderer->getGpuTimeline()->submit(submission.commandBuffer);
+    pendingSubmissions.push_back(std::move(submission));
+}
+
+void TextureStreamer::retireSubmissions(bool wait) {
+    VkDevice device = renderer->getDevice();
+    GpuTimeline* timeline = renderer->getGpuTimeline();
+    for (auto it = pendingSubmissions.begin(); it != pendingSubmissions.end();) {
+        if (wait) {
+            timeline->wait(it->timelineValue);
+        } else if (!timeline->isComplete(it->timelineValue)) {
+            ++it;
+            continue;
+        }
+
+        for (const StagingRing::Allocation& allocation : it->allocations) {
+            renderer->getStagingRing()->release(allocation);
+        }
+        for (Texture::RetiredImage& retired : it->retiredImages) {
+            Texture::destroyRetiredImage(device, renderer->getMipGenerator(), retired);
+        }
+        vkFreeCommandBuffers(device, renderer->getCommandPool(), 1, &it->commandBuffer);
+        it = pendingSubmissions.erase(it);
+    }
+}
@@ -0,0 +1,640 @@
+﻿// Offline texture baker: PNG/JPG (anything stb_image reads) -> mipmapped KTX2.
+//
+// Mips are filtered in linear space (sRGB sources are linearized first) with a
+// 2x2 box filter, then every level is block-compressed across all cores.
+// Runs entirely on the CPU, no Vulkan device or headers needed.
+//
+// Usage:
+//   TextureBaker [options] <input> <output.ktx2>
+//   TextureBaker [options] --out-dir <dir> <input>...
+//
+// Options:
+//   --format bc1|bc3|bc4|bc5|rgba8   output format (default bc1, bc3 if the image has alpha)
+//   --linear                         data texture (normals, masks): no sRGB conversion
+//   --threads N                      worker threads (default: all cores)
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <future>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "../include/Utils/ThreadPool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define MI_BAKER_SSE 1
+#endif
+
+namespace {
+    // VkFormat values, so the tool doesn't need the Vulkan headers
+    const uint32_t VK_FORMAT_R8G8B8A8_UNORM = 37;
+    const uint32_t VK_FORMAT_R8G8B8A8_SRGB = 43;
+    const uint32_t VK_FORMAT_BC1_RGB_UNORM_BLOCK = 131;
+    const uint32_t VK_FORMAT_BC1_RGB_SRGB_BLOCK = 132;
+    const uint32_t VK_FORMAT_BC3_UNORM_BLOCK = 137;
+    const uint32_t VK_FORMAT_BC3_SRGB_BLOCK = 138;
+    const uint32_t VK_FORMAT_BC4_UNORM_BLOCK = 139;
+    const uint32_t VK_FORMAT_BC5_UNORM_BLOCK = 141;
+
+    // Khronos data format descriptor values
+    const uint8_t KHR_DF_MODEL_RGBSDA = 1;
+    const uint8_t KHR_DF_MODEL_BC1A = 128;
+    const uint8_t KHR_DF_MODEL_BC3 = 130;
+    const uint8_t KHR_DF_MODEL_BC4 = 131;
+    const uint8_t KHR_DF_MODEL_BC5 = 132;
+    const uint8_t KHR_DF_PRIMARIES_BT709 = 1;
+    const uint8_t KHR_DF_TRANSFER_LINEAR = 1;
+    const uint8_t KHR_DF_TRANSFER_SRGB = 2;
+    const uint8_t KHR_DF_SAMPLE_DATATYPE_LINEAR = 0x10;
+
+    const uint8_t KTX2_IDENTIFIER[12] = {
+        0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+    };
+
+    enum class OutputFormat { Auto, BC1, BC3, BC4, BC5, RGBA8 };
+
+    struct BakeOptions {
+        OutputFormat format = OutputFormat::Auto;
+        bool linear = false;
+        uint32_t threads = 0;
+    };
+
+    // Linear float RGBA image
+    struct FloatImage {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<float> texels;
+    };
+
+    struct EncodedLevel {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<uint8_t> data;
+    };
+
+    // ---- Color space ----
+
+    float srgbToLinear(float c) {
+        return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    float linearToSrgb(float c) {
+        return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+    }
+
+    struct ColorTables {
+        float toLinear[256];
+        uint8_t toSrgb[4096];
+
+        ColorTables() {
+            for (int i = 0; i < 256; i++) {
+                toLinear[i] = srgbToLinear(i / 255.0f);
+            }
+            for (int i = 0; i < 4096; i++) {
+                toSrgb[i] = static_cast<uint8_t>(linearToSrgb(i / 4095.0f) * 255.0f + 0.5f);
+            }
+        }
+    };
+
+    const ColorTables& colorTables() {
+        static const ColorTables tables;
+        return tables;
+    }
+
+    FloatImage toFloatImage(const uint8_t* pixels, uint32_t width, uint32_t height, bool srgb) {
+        const ColorTables& tables = colorTables();
+        FloatImage image;
+        image.width = width;
+        image.height = height;
+        image.texels.resize(size_t(width) * height * 4);
+
+        for (size_t i = 0; i < size_t(width) * height; i++) {
+            for (int c = 0; c < 3; c++) {
+                uint8_t value = pixels[i * 4 + c];
+                image.texels[i * 4 + c] = srgb ? tables.toLinear[value] : value / 255.0f;
+            }
+            // Alpha is always linear
+            image.texels[i * 4 + 3] = pixels[i * 4 + 3] / 255.0f;
+        }
+        return image;
+    }
+
+    void toBytes(const FloatImage& image, bool srgb, std::vector<uint8_t>& pixels) {
+        const ColorTables& tables = colorTables();
+        pixels.resize(size_t(image.width) * image.height * 4);
+
+        for (size_t i = 0; i < pixels.size(); i++) {
+            float value = std::min(std::max(image.texels[i], 0.0f), 1.0f);
+            bool isAlpha = (i & 3) == 3;
+            if (srgb && !isAlpha) {
+                pixels[i] = tables.toSrgb[static_cast<int>(value * 4095.0f + 0.5f)];
+            } else {
+                pixels[i] = static_cast<uint8_t>(value * 255.0f + 0.5f);
+            }
+        }
+    }
+
+    // ---- Mip generation ----
+
+    // 2x2 box filter; odd edges reuse the last row/column
+    FloatImage downsample(const FloatImage& source) {
+        FloatImage result;
+        result.width = std::max(source.width / 2, 1u);
+        result.height = std::max(source.height / 2, 1u);
+        result.texels.resize(size_t(result.width) * result.height * 4);
+
+        for (uint32_t y = 0; y < result.height; y++) {
+            uint32_t y0 = std::min(y * 2, source.height - 1);
+            uint32_t y1 = std::min(y * 2 + 1, source.height - 1);
+            const float* row0 = &source.texels[size_t(y0) * source.width * 4];
+            const float* row1 = &source.texels[size_t(y1) * source.width * 4];
+            float* out = &result.texels[size_t(y) * result.width * 4];
+
+            for (uint32_t x = 0; x < result.width; x++) {
+                uint32_t x0 = std::min(x * 2, source.width - 1) * 4;
+                uint32_t x1 = std::min(x * 2 + 1, source.width - 1) * 4;
+#ifdef MI_BAKER_SSE
+                // One RGBA texel per register
+                __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1)),
+                                        _mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+                _mm_storeu_ps(out + x * 4, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+                for (int c = 0; c < 4; c++) {
+                    out[x * 4 + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) * 0.25f;
+                }
+#endif
+            }
+        }
+        return result;
+    }
+
+    // ---- Block compression ----
+
+    // Gather a 4x4 block, clamping at the image edge
+    void fetchBlock(const std::vector<uint8_t>& pixels, uint32_t width, uint32_t height,
+                    uint32_t blockX, uint32_t blockY, uint8_t block[16][4]) {
+        for (uint32_t y = 0; y < 4; y++) {
+            uint32_t sy = std::min(blockY * 4 + y, height - 1);
+            for (uint32_t x = 0; x < 4; x++) {
+                uint32_t sx = std::min(blockX * 4 + x, width - 1);
+                std::memcpy(block[y * 4 + x], &pixels[(size_t(sy) * width + sx) * 4], 4);
+            }
+        }
+    }
+
+    uint16_t packRgb565(const int color[3]) {
+        return static_cast<uint16_t>(((color[0] * 31 + 127) / 255) << 11 |
+                                     ((color[1] * 63 + 127) / 255) << 5 |
+                                     ((color[2] * 31 + 127) / 255));
+    }
+
+    void unpackRgb565(uint16_t packed, int color[3]) {
+        int r = (packed >> 11) & 31;
+        int g = (packed >> 5) & 63;
+        int b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 3);
+    }
+
+    // BC1 color block: endpoints on the bounding box diagonal that best follows the
+    // color distribution, inset slightly, and 4-color mode (also valid inside BC3)
+    void encodeColorBlock(const uint8_t block[16][4], uint8_t* output) {
+        int minColor[3] = { 255, 255, 255 };
+        int maxColor[3] = { 0, 0, 0 };
+        int mean[3] = { 0, 0, 0 };
+        for (int i = 0; i < 16; i++) {
+            for (int c = 0; c < 3; c++) {
+                minColor[c] = std::min(minColor[c], int(block[i][c]));
+                maxColor[c] = std::max(maxColor[c], int(block[i][c]));
+                mean[c] += block[i][c];
+            }
+        }
+
+        // Flip green/blue along the diagonal if they anti-correlate with red
+        int covRG = 0;
+        int covRB = 0;
+        for (int i = 0; i < 16; i++) {
+            int r = block[i][0] * 16 - mean[0];
+            covRG += r * (block[i][1] * 16 - mean[1]);
+            covRB += r * (block[i][2] * 16 - mean[2]);
+        }
+        if (covRG < 0) std::swap(minColor[1], maxColor[1]);
+        if (covRB < 0) std::swap(minColor[2], maxColor[2]);
+
+        for (int c = 0; c < 3; c++) {
+            int inset = (maxColor[c] - minColor[c]) / 16;
+            maxColor[c] = std::min(std::max(maxColor[c] - inset, 0), 255);
+            minColor[c] = std::min(std::max(minColor[c] + inset, 0), 255);
+        }
+
+        uint16_t color0 = packRgb565(maxColor);
+        uint16_t color1 = packRgb565(minColor);
+        if (color0 < color1) {
+            std::swap(color0, color1);
+        }
+
+        int palette[4][3];
+        unpackRgb565(color0, palette[0]);
+        unpackRgb565(color1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        uint32_t indices = 0;
+        if (color0 != color1) {
+            for (int i = 0; i < 16; i++) {
+                int bestIndex = 0;
+                int bestError = INT32_MAX;
+                for (int p = 0; p < 4; p++) {
+                    int dr = block[i][0] - palette[p][0];
+                    int dg = block[i][1] - palette[p][1];
+                    int db = block[i][2] - palette[p][2];
+                    int error = dr * dr + dg * dg + db * db;
+                    if (error < bestError) {
+                        bestError = error;
+                        bestIndex = p;
+                    }
+                }
+                indices |= uint32_t(bestIndex) << (i * 2);
+            }
+        }
+
+        output[0] = color0 & 0xFF;
+        output[1] = color0 >> 8;
+        output[2] = color1 & 0xFF;
+        output[3] = color1 >> 8;
+        std::memcpy(output + 4, &indices, 4);
+    }
+
+    // BC4 single channel block in 8-value mode (endpoint 0 > endpoint 1)
+    void encodeChannelBlock(const uint8_t block[16][4], int channel, uint8_t* output) {
+        int minValue = 255;
+        int maxValue = 0;
+        for (int i = 0; i < 16; i++) {
+            minValue = std::min(minValue, int(block[i][channel]));
+            maxValue = std::max(maxValue, int(block[i][channel]));
+        }
+
+        output[0] = static_cast<uint8_t>(maxValue);
+        output[1] = static_cast<uint8_t>(minValue);
+
+        uint64_t indices = 0;
+        if (maxValue > minValue) {
+            int range = maxValue - minValue;
+            for (int i = 0; i < 16; i++) {
+                // Position between min (0) and max (7), then the BC4 index for it
+                int step = ((block[i][channel] - minValue) * 14 + range) / (2 * range);
+                uint64_t index = step == 7 ? 0 : step == 0 ? 1 : uint64_t(8 - step);
+                indices |= index << (i * 3);
+            }
+        }
+        for (int b = 0; b < 6; b++) {
+            output[2 + b] = static_cast<uint8_t>(indices >> (b * 8));
+        }
+    }
+
+    uint32_t getBlockBytes(OutputFormat format) {
+        switch (format) {
+        case OutputFormat::BC1:
+        case OutputFormat::BC4:
+            return 8;
+        case OutputFormat::BC3:
+        case OutputFormat::BC5:
+            return 16;
+        default:
+            return 4;
+        }
+    }
+
+    // Compress one mip level, splitting block rows across the pool
+    EncodedLevel encodeLevel(const std::vector<uint8_t>& pixels, uint32_t width, uint32_t height,
+                             OutputFormat format, ThreadPool& pool) {
+        EncodedLevel level;
+        level.width = width;
+        level.height = height;
+
+        if (format == OutputFormat::RGBA8) {
+            level.data = pixels;
+            return level;
+        }
+
+        uint32_t blocksX = (width + 3) / 4;
+        uint32_t blocksY = (height + 3) / 4;
+        uint32_t blockBytes = getBlockBytes(format);
+        level.data.resize(size_t(blocksX) * blocksY * blockBytes);
+
+        uint32_t rowsPerJob = std::max(1u, blocksY / (pool.getThreadCount() * 4));
+        std::vector<std::future<void>> jobs;
+        for (uint32_t firstRow = 0; firstRow < blocksY; firstRow += rowsPerJob) {
+            uint32_t lastRow = std::min(firstRow + rowsPerJob, blocksY);
+            jobs.push_back(pool.submit([&, firstRow, lastRow]() {
+                uint8_t block[16][4];
+                for (uint32_t by = firstRow; by < lastRow; by++) {
+                    for (uint32_t bx = 0; bx < blocksX; bx++) {
+                        fetchBlock(pixels, width, height, bx, by, block);
+                        uint8_t* output = &level.data[(size_t(by) * blocksX + bx) * blockBytes];
+                        switch (format) {
+                        case OutputFormat::BC1:
+                            encodeColorBlock(block, output);
+                            break;
+                        case OutputFormat::BC3:
+                            encodeChannelBlock(block, 3, output);
+                            encodeColorBlock(block, output + 8);
+                            break;
+                        case OutputFormat::BC4:
+                            encodeChannelBlock(block, 0, output);
+                            break;
+                        case OutputFormat::BC5:
+                            encodeChannelBlock(block, 0, output);
+                            encodeChannelBlock(block, 1, output + 8);
+                            break;
+                        default:
+                            break;
+                        }
+                    }
+                }
+            }));
+        }
+        for (auto& job : jobs) {
+            job.get();
+        }
+        return level;
+    }
+
+    // ---- KTX2 output ----
+
+    uint32_t getVkFormat(OutputFormat format, bool srgb) {
+        switch (format) {
+        case OutputFormat::BC1: return srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+        case OutputFormat::BC3: return srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+        case OutputFormat::BC4: return VK_FORMAT_BC4_UNORM_BLOCK;
+        case OutputFormat::BC5: return VK_FORMAT_BC5_UNORM_BLOCK;
+        default: return srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+        }
+    }
+
+    void appendU32(std::vector<uint8_t>& out, uint32_t value) {
+        for (int i = 0; i < 4; i++) out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+
+    void appendU64(std::vector<uint8_t>& out, uint64_t value) {
+        for (int i = 0; i < 8; i++) out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+
+    void appendSample(std::vector<uint8_t>& out, uint32_t bitOffset, uint32_t bitLength,
+                      uint8_t channel, uint32_t upper) {
+        appendU32(out, bitOffset | ((bitLength - 1) << 16) | (uint32_t(channel) << 24));
+        appendU32(out, 0);  // sample position
+        appendU32(out, 0);  // lower
+        appendU32(out, upper);
+    }
+
+    // Basic data format descriptor (KHR_DF) for the formats this tool writes
+    std::vector<uint8_t> buildDataFormatDescriptor(OutputFormat format, bool srgb) {
+        std::vector<uint8_t> samples;
+        uint8_t model = KHR_DF_MODEL_RGBSDA;
+        bool compressed = format != OutputFormat::RGBA8;
+
+        switch (format) {
+        case OutputFormat::BC1:
+            model = KHR_DF_MODEL_BC1A;
+            appendSample(samples, 0, 64, 0, UINT32_MAX);
+            break;
+        case OutputFormat::BC3:
+            model = KHR_DF_MODEL_BC3;
+            appendSample(samples, 0, 64, 15 | KHR_DF_SAMPLE_DATATYPE_LINEAR, UINT32_MAX);
+            appendSample(samples, 64, 64, 0, UINT32_MAX);
+            break;
+        case OutputFormat::BC4:
+            model = KHR_DF_MODEL_BC4;
+            appendSample(samples, 0, 64, 0, UINT32_MAX);
+            break;
+        case OutputFormat::BC5:
+            model = KHR_DF_MODEL_BC5;
+            appendSample(samples, 0, 64, 0, UINT32_MAX);
+            appendSample(samples, 64, 64, 1, UINT32_MAX);
+            break;
+        default:
+            appendSample(samples, 0, 8, 0, 255);
+            appendSample(samples, 8, 8, 1, 255);
+            appendSample(samples, 16, 8, 2, 255);
+            appendSample(samples, 24, 8, 15 | KHR_DF_SAMPLE_DATATYPE_LINEAR, 255);
+            break;
+        }
+
+        uint32_t blockSize = 24 + static_cast<uint32_t>(samples.size());
+        std::vector<uint8_t> dfd;
+        appendU32(dfd, 4 + blockSize);           // total size
+        appendU32(dfd, 0);                       // vendor Khronos, descriptor type basic
+        appendU32(dfd, 2 | (blockSize << 16));   // version 1.3, block size
+        dfd.push_back(model);
+        dfd.push_back(KHR_DF_PRIMARIES_BT709);
+        dfd.push_back(srgb ? KHR_DF_TRANSFER_SRGB : KHR_DF_TRANSFER_LINEAR);
+        dfd.push_back(0);                        // straight alpha
+        uint8_t blockDimension = compressed ? 3 : 0;
+        dfd.push_back(blockDimension);
+        dfd.push_back(blockDimension);
+        dfd.push_back(0);
+        dfd.push_back(0);
+        dfd.push_back(static_cast<uint8_t>(getBlockBytes(format)));
+        for (int i = 0; i < 7; i++) dfd.push_back(0);
+        dfd.insert(dfd.end(), samples.begin(), samples.end());
+        return dfd;
+    }
+
+    bool writeKTX2(const std::string& filename, OutputFormat format, bool srgb,
+                   const std::vector<EncodedLevel>& levels) {
+        const size_t headerSize = 80;
+        const size_t levelIndexSize = levels.size() * 24;
+        std::vector<uint8_t> dfd = buildDataFormatDescriptor(format, srgb);
+
+        // Level data follows the descriptor, smallest level first, 16-byte aligned
+        auto align = [](uint64_t offset) { return (offset + 15) & ~uint64_t(15); };
+        uint64_t dfdOffset = headerSize + levelIndexSize;
+        uint64_t offset = dfdOffset + dfd.size();
+        std::vector<uint64_t> levelOffsets(levels.size());
+        for (size_t i = levels.size(); i-- > 0;) {
+            offset = align(offset);
+            levelOffsets[i] = offset;
+            offset += levels[i].data.size();
+        }
+
+        std::vector<uint8_t> file;
+        file.reserve(static_cast<size_t>(offset));
+        file.insert(file.end(), KTX2_IDENTIFIER, KTX2_IDENTIFIER + sizeof(KTX2_IDENTIFIER));
+        appendU32(file, getVkFormat(format, srgb));
+        appendU32(file, 1);                                         // typeSize
+        appendU32(file, levels[0].width);
+        appendU32(file, levels[0].height);
+        appendU32(file, 0);                                         // pixelDepth
+        appendU32(file, 0);                                         // layerCount
+        appendU32(file, 1);                                         // faceCount
+        appendU32(file, static_cast<uint32_t>(levels.size()));
+        appendU32(file, 0);                                         // no supercompression
+        appendU32(file, static_cast<uint32_t>(dfdOffset));
+        appendU32(file, static_cast<uint32_t>(dfd.size()));
+        appendU32(file, 0);                                         // no key/value data
+        appendU32(file, 0);
+        appendU64(file, 0);                                         // no supercompression globals
+        appendU64(file, 0);
+
+        for (size_t i = 0; i < levels.size(); i++) {
+            appendU64(file, levelOffsets[i]);
+            appendU64(file, levels[i].data.size());
+            appendU64(file, levels[i].data.size());
+        }
+        file.insert(file.end(), dfd.begin(), dfd.end());
+
+        for (size_t i = levels.size(); i-- > 0;) {
+            file.resize(static_cast<size_t>(levelOffsets[i]), 0);
+            file.insert(file.end(), levels[i].data.begin(), levels[i].data.end());
+        }
+
+        std::ofstream out(filename, std::ios::binary);
+        if (!out.is_open()) {
+            std::cerr << "Failed to open output file: " << filename << std::endl;
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(file.data()), file.size());
+        return static_cast<bool>(out);
+    }
+
+    // ---- Driver ----
+
+    bool bakeTexture(const std::string& input, const std::string& output, const BakeOptions& options,
+                     ThreadPool& pool) {
+        auto startTime = std::chrono::high_resolution_clock::now();
+
+        int width, height, channels;
+        stbi_uc* pixels = stbi_load(input.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+        if (!pixels) {
+            std::cerr << "Failed to load image: " << input << std::endl;
+            return false;
+        }
+
+        OutputFormat format = options.format;
+        if (format == OutputFormat::Auto) {
+            format = (channels == 4 || channels == 2) ? OutputFormat::BC3 : OutputFormat::BC1;
+        }
+        // Single and dual channel formats hold data, never color
+        bool srgb = !options.linear && format != OutputFormat::BC4 && format != OutputFormat::BC5;
+
+        FloatImage image = toFloatImage(pixels, width, height, srgb);
+        stbi_image_free(pixels);
+
+        std::vector<EncodedLevel> levels;
+        std::vector<uint8_t> levelPixels;
+        while (true) {
+            toBytes(image, srgb, levelPixels);
+            levels.push_back(encodeLevel(levelPixels, image.width, image.height, format, pool));
+            if (image.width == 1 && image.height == 1) {
+                break;
+            }
+            image = downsample(image);
+        }
+
+        if (!writeKTX2(output, format, srgb, levels)) {
+            return false;
+        }
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        std::cout << input << " -> " << output << " (" << width << "x" << height << ", "
+                  << levels.size() << " mips, "
+                  << std::chrono::duration<double, std::milli>(endTime - startTime).count() << " ms)" << std::endl;
+        return true;
+    }
+
+    bool parseFormat(const std::string& name, OutputFormat& format) {
+        if (name == "bc1") format = OutputFormat::BC1;
+        else if (name == "bc3") format = OutputFormat::BC3;
+        else if (name == "bc4") format = OutputFormat::BC4;
+        else if (name == "bc5") format = OutputFormat::BC5;
+        else if (name == "rgba8") format = OutputFormat::RGBA8;
+        else return false;
+        return true;
+    }
+
+    std::string outputPathFor(const std::string& input, const std::string& outDir) {
+        size_t slash = input.find_last_of("/\\");
+        std::string name = slash == std::string::npos ? input : input.substr(slash + 1);
+        size_t dot = name.find_last_of('.');
+        if (dot != std::string::npos) {
+            name = name.substr(0, dot);
+        }
+        return outDir + "/" + name + ".ktx2";
+    }
+
+    void printUsage() {
+        std::cerr << "Usage:\n"
+                  << "  TextureBaker [options] <input> <output.ktx2>\n"
+                  << "  TextureBaker [options] --out-dir <dir> <input>...\n"
+                  << "Options:\n"
+                  << "  --format bc1|bc3|bc4|bc5|rgba8\n"
+                  << "  --linear\n"
+                  << "  --threads N\n";
+    }
+}
+
+int main(int argc, char** argv) {
+    BakeOptions options;
+    std::string outDir;
+    std::vector<std::string> positional;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--format" && i + 1 < argc) {
+            if (!parseFormat(argv[++i], options.format)) {
+                std::cerr << "Unknown format: " << argv[i] << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--linear") {
+            options.linear = true;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.threads = static_cast<uint32_t>(std::atoi(argv[++i]));
+        } else if (arg == "--out-dir" && i + 1 < argc) {
+            outDir = argv[++i];
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            printUsage();
+            return EXIT_FAILURE;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+
+    std::vector<std::pair<std::string, std::string>> jobs;
+    if (!outDir.empty()) {
+        for (const auto& input : positional) {
+            jobs.emplace_back(input, outputPathFor(input, outDir));
+        }
+    } else if (positional.size() == 2) {
+        jobs.emplace_back(positional[0], positional[1]);
+    }
+    if (jobs.empty()) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    // Every core compresses; the pool's default leaves one for a render thread we don't have
+    uint32_t threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    ThreadPool pool(threads);
+
+    int failures = 0;
+    for (const auto& job : jobs) {
+        if (!bakeTexture(job.first, job.second, options, pool)) {
+            failures++;
+        }
+    }
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
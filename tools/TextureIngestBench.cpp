@@ -0,0 +1,139 @@
+﻿// Texture ingestion benchmark: texels/second expanded to RGBA8 for 1, 2, 3 and
+// 4-channel sources, SIMD kernels against the scalar loop.
+//
+// With image files as arguments it also times the full decode path per file:
+// stb_image expanding to RGBA plus a copy (the old path) against decoding at the
+// native channel count and expanding with PixelConvert.
+//
+// Usage:
+//   TextureIngestBench [--size N] [--iterations N] [image...]
+//
+// Build together with ../src/texture/PixelConvert.cpp; no Vulkan needed.
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "../include/texture/PixelConvert.h"
+
+namespace {
+    using Clock = std::chrono::high_resolution_clock;
+
+    double secondsSince(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // Best of several runs, the least disturbed one is closest to the real throughput
+    template<typename Func>
+    double bestTime(uint32_t iterations, Func func) {
+        double best = 1e30;
+        for (uint32_t i = 0; i < iterations; i++) {
+            auto start = Clock::now();
+            func();
+            best = std::min(best, secondsSince(start));
+        }
+        return best;
+    }
+
+    bool benchmarkKernels(uint32_t size, uint32_t iterations) {
+        size_t pixelCount = static_cast<size_t>(size) * size;
+        std::vector<unsigned char> source(pixelCount * 4);
+        uint32_t state = 12345;
+        for (unsigned char& value : source) {
+            state = state * 1664525u + 1013904223u;
+            value = static_cast<unsigned char>(state >> 24);
+        }
+        std::vector<unsigned char> simdOut(pixelCount * 4);
+        std::vector<unsigned char> scalarOut(pixelCount * 4);
+
+        std::printf("%ux%u texels, best of %u runs, SIMD %s\n", size, size, iterations,
+                    PixelConvert::hasSIMD() ? "available" : "not available");
+        std::printf("channels   scalar Mtexel/s   simd Mtexel/s   speedup\n");
+
+        bool allMatch = true;
+        for (uint32_t channels = 1; channels <= 4; channels++) {
+            double scalarTime = bestTime(iterations, [&]() {
+                PixelConvert::expandToRGBAScalar(source.data(), channels, scalarOut.data(), pixelCount);
+            });
+            double simdTime = bestTime(iterations, [&]() {
+                PixelConvert::expandToRGBA(source.data(), channels, simdOut.data(), pixelCount);
+            });
+
+            bool match = std::memcmp(simdOut.data(), scalarOut.data(), simdOut.size()) == 0;
+            allMatch = allMatch && match;
+
+            std::printf("%8u   %16.1f   %13.1f   %6.2fx%s\n", channels,
+                        pixelCount / scalarTime / 1e6, pixelCount / simdTime / 1e6,
+                        scalarTime / simdTime, match ? "" : "   MISMATCH");
+        }
+        return allMatch;
+    }
+
+    void benchmarkFile(const std::string& path, uint32_t iterations) {
+        int width, height, channels;
+        if (!stbi_info(path.c_str(), &width, &height, &channels)) {
+            std::fprintf(stderr, "Failed to read %s\n", path.c_str());
+            return;
+        }
+        size_t pixelCount = static_cast<size_t>(width) * height;
+        std::vector<unsigned char> staging(pixelCount * 4);
+
+        // Old path: stb converts to RGBA, then the result is copied into the upload buffer
+        double stbTime = bestTime(iterations, [&]() {
+            int w, h, c;
+            stbi_uc* pixels = stbi_load(path.c_str(), &w, &h, &c, STBI_rgb_alpha);
+            if (pixels) {
+                std::memcpy(staging.data(), pixels, staging.size());
+                stbi_image_free(pixels);
+            }
+        });
+
+        // New path: native channels, expanded straight into the upload buffer
+        double directTime = bestTime(iterations, [&]() {
+            int w, h, c;
+            stbi_uc* pixels = stbi_load(path.c_str(), &w, &h, &c, 0);
+            if (pixels) {
+                PixelConvert::expandToRGBA(pixels, static_cast<uint32_t>(c), staging.data(), pixelCount);
+                stbi_image_free(pixels);
+            }
+        });
+
+        std::printf("%s (%dx%d, %d ch): stb rgba + copy %.1f Mtexel/s, native + expand %.1f Mtexel/s\n",
+                    path.c_str(), width, height, channels,
+                    pixelCount / stbTime / 1e6, pixelCount / directTime / 1e6);
+    }
+}
+
+int main(int argc, char** argv) {
+    uint32_t size = 2048;
+    uint32_t iterations = 10;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--size" && i + 1 < argc) {
+            size = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--iterations" && i + 1 < argc) {
+            iterations = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--help" || arg == "-h") {
+            std::printf("Usage: TextureIngestBench [--size N] [--iterations N] [image...]\n");
+            return 0;
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    bool ok = benchmarkKernels(size, iterations);
+    for (const std::string& file : files) {
+        benchmarkFile(file, iterations);
+    }
+    return ok ? 0 : 1;
+}